@@ -27,8 +27,10 @@ pub enum HfVCpuRunReturn {
 
     /// The vCPU has voluntarily yielded the CPU. The scheduler SHOULD take a
     /// scheduling decision to give cycles to those that need them but MUST
-    /// call `hf_vcpu_run` on the vCPU at a later point.
-    Yield,
+    /// call `hf_vcpu_run` on the vCPU at a later point. A nonzero `ns` is a
+    /// hint that re-running it before that many nanoseconds have passed is
+    /// pointless (e.g. a cooperative spin-wait with a known period).
+    Yield { ns: u64 },
 
     /// The vCPU is blocked waiting for an interrupt. The scheduler MUST take
     /// it off the run queue and not call `hf_vcpu_run` on the vCPU until it
@@ -57,8 +59,9 @@ pub enum HfVCpuRunReturn {
 
     /// A message has been sent by the vCPU. The scheduler MUST run a vCPU from
     /// the recipient VM and priority SHOULD be given to those vCPUs that are
-    /// waiting for a message.
-    Message { vm_id: spci_vm_id_t },
+    /// waiting for a message. The payload size travels in the same register
+    /// write, so the receiver needs no extra query.
+    Message { vm_id: spci_vm_id_t, size: u32 },
 
     /// The vCPU has made the mailbox writable and there are pending waiters.
     /// The scheduler MUST call hf_mailbox_waiter_get() repeatedly and notify
@@ -86,17 +89,22 @@ pub enum HfShare {
 }
 
 impl HfVCpuRunReturn {
-    /// Encode an HfVCpuRunReturn struct in the 64-bit packing ABI.
+    /// Encode an HfVCpuRunReturn struct in the 64-bit packing ABI. The
+    /// dominant Preempted/Yield cases encode to the constants 0 and 1 with no
+    /// data, so the match collapses to a register move for them.
+    #[inline]
     pub fn into_raw(self) -> u64 {
         use HfVCpuRunReturn::*;
 
         match self {
             Preempted => 0,
-            Yield => 1,
+            Yield { ns } => 1 | (ns << 8),
             WaitForInterrupt { ns } => 2 | (ns << 8),
             WaitForMessage { ns } => 3 | (ns << 8),
             WakeUp { vm_id, vcpu } => 4 | (u64::from(vm_id) << 32) | (u64::from(vcpu) << 16),
-            Message { vm_id } => 5 | (u64::from(vm_id) << 8),
+            Message { vm_id, size } => {
+                5 | (u64::from(vm_id) << 8) | (u64::from(size) << 32)
+            }
             NotifyWaiters => 6,
             Aborted => 7,
         }
@@ -130,7 +138,7 @@ mod test {
     /// Encode a yield response without leaking.
     #[test]
     fn abi_hf_vcpu_run_return_encode_yield() {
-        let res = HfVCpuRunReturn::Yield;
+        let res = HfVCpuRunReturn::Yield { ns: 0 };
         assert_eq!(res.into_raw(), 1);
     }
 
@@ -15,15 +15,20 @@
  */
 
 use core::convert::TryFrom;
-use core::mem::ManuallyDrop;
+use core::mem::{self, ManuallyDrop};
+use core::ptr;
+use core::sync::atomic::Ordering;
 
 use crate::abi::*;
 use crate::addr::*;
+use crate::arch::*;
 use crate::cpu::*;
 use crate::init::*;
+use crate::mm::*;
 use crate::page::*;
 use crate::spci::*;
 use crate::types::*;
+use crate::vm::*;
 
 // To eliminate the risk of deadlocks, we define a partial order for the acquisition of locks held
 // concurrently by the same physical CPU. Our current ordering requirements are as follows:
@@ -65,11 +70,12 @@ pub unsafe extern "C" fn api_vcpu_off(current: *const VCpu) -> *const VCpu {
 /// SpciReturn::Success.
 #[no_mangle]
 pub unsafe extern "C" fn api_spci_yield(
+    deadline_ns: u64,
     current: *const VCpu,
     next: *mut *const VCpu,
 ) -> SpciReturn {
     let mut current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
-    if let Some(vcpu) = hypervisor().spci_yield(&mut current) {
+    if let Some(vcpu) = hypervisor().spci_yield(deadline_ns, &mut current) {
         *next = vcpu;
     }
 
@@ -119,6 +125,145 @@ pub unsafe extern "C" fn api_vcpu_get_count(
     hypervisor().vcpu_get_count(vm_id, &current).unwrap_or(0)
 }
 
+/// Returns the scheduling attributes of the given VM packed as
+/// `affinity[31:0] | priority[39:32] | dedicated[40]`, or -1 if the VM does
+/// not exist or the caller is neither the primary VM nor the VM itself.
+#[no_mangle]
+pub unsafe extern "C" fn api_vm_sched_attrs(vm_id: spci_vm_id_t, current: *const VCpu) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+
+    if current.vm().id != HF_PRIMARY_VM_ID && current.vm().id != vm_id {
+        return -1;
+    }
+
+    let vm = some_or!(hypervisor().vm_manager.get(vm_id), return -1);
+
+    (vm.cpu_affinity & 0xffff_ffff) as i64
+        | (i64::from(vm.priority) << 32)
+        | ((vm.dedicated_cores as i64) << 40)
+}
+
+/// Reads one of the per-VM telemetry counters (0 = stage-2 faults, 1 = TLB
+/// invalidations, 2 = defrag passes, 3 = mailbox-full events). Returns -1 if
+/// the VM or field doesn't exist or the caller is not the primary VM.
+#[no_mangle]
+pub unsafe extern "C" fn api_vm_telemetry(
+    vm_id: spci_vm_id_t,
+    field: usize,
+    current: *const VCpu,
+) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+
+    if current.vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    let vm = some_or!(hypervisor().vm_manager.get(vm_id), return -1);
+    vm.telemetry.read(field).map(|v| v as i64).unwrap_or(-1)
+}
+
+/// Register-encoded single-page grant: lends one page to the target VM with
+/// the access encoded in the low bits of the address argument (bit 0 = R,
+/// bit 1 = W, bit 2 = X), no TX-page descriptor needed. Virtio-style drivers
+/// grant single pages at high frequency; this path goes straight to the
+/// share machinery — and through its validated-range cache — reserving the
+/// descriptor flow for multi-constituent regions.
+#[no_mangle]
+pub unsafe extern "C" fn api_page_grant(
+    encoded: uintreg_t,
+    target: spci_vm_id_t,
+    current: *const VCpu,
+) -> SpciReturn {
+    use crate::spci_architected_message::spci_share_memory;
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    let from = current.vm();
+
+    let address = (encoded as usize) & !(PAGE_SIZE - 1);
+    let access = (encoded as usize) & (PAGE_SIZE - 1);
+
+    let mut mode = Mode::empty();
+    if access & 1 != 0 {
+        mode |= Mode::R;
+    }
+    if access & 2 != 0 {
+        mode |= Mode::W;
+    }
+    if access & 4 != 0 {
+        mode |= Mode::X;
+    }
+
+    if address == 0 || !mode.contains(Mode::R) || access & !0x7 != 0 {
+        return SpciReturn::InvalidParameters;
+    }
+
+    let to = some_or!(
+        hypervisor().vm_manager.get(target),
+        return SpciReturn::InvalidParameters
+    );
+
+    // A one-constituent region built in place of the TX-page descriptor.
+    #[repr(C)]
+    struct SinglePageRegion {
+        region: SpciMemoryRegion,
+        constituent: SpciMemoryRegionConstituent,
+    }
+
+    let mut single: SinglePageRegion = mem::zeroed();
+    single.region.count = 1;
+    single.constituent.address = address as u64;
+    single.constituent.page_count = 1;
+
+    // The synthesized region uses the v1 layout regardless of what the
+    // caller negotiated for its TX-page descriptors.
+    spci_share_memory(
+        to,
+        from,
+        &single.region,
+        mode,
+        SpciMemoryShare::Lend,
+        false,
+    )
+}
+
+/// Clones a template VM for scale-out; see `Hypervisor::vm_clone`. A
+/// nonzero `entry` readies vCPU 0 to boot there with `arg` in x0. Returns
+/// the new VM's id, or -1 on failure. Primary VM only.
+#[no_mangle]
+pub unsafe extern "C" fn api_vm_clone(
+    template_id: spci_vm_id_t,
+    entry: uintreg_t,
+    arg: uintreg_t,
+    current: *const VCpu,
+) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    hypervisor().vm_clone(template_id, entry, arg, &current)
+}
+
+/// Reads the scheduling tier's per-CPU idle statistics: field 0 is idle
+/// residency in cycles, field 1 the number of wakeups that found work.
+/// Primary VM only; -1 on a bad CPU index or field.
+#[no_mangle]
+pub unsafe extern "C" fn api_idle_residency(
+    cpu_index: usize,
+    field: usize,
+    current: *const VCpu,
+) -> i64 {
+    use crate::hypervisor::{IDLE_CYCLES, IDLE_WAKES};
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+
+    if current.vm().id != HF_PRIMARY_VM_ID || cpu_index >= MAX_CPUS {
+        return -1;
+    }
+
+    match field {
+        0 => IDLE_CYCLES[cpu_index].load(Ordering::Relaxed) as i64,
+        1 => IDLE_WAKES[cpu_index].load(Ordering::Relaxed) as i64,
+        _ => -1,
+    }
+}
+
 /// This function is called by the architecture-specific context switching
 /// function to indicate that register state for the given vcpu has been saved
 /// and can therefore be used by other pcpus.
@@ -150,6 +295,38 @@ pub unsafe extern "C" fn api_vcpu_run(
     HfVCpuRunReturn::Preempted.into_raw()
 }
 
+/// Issues an opaque run token for (vm, vcpu); see hf_vcpu_token().
+#[no_mangle]
+pub unsafe extern "C" fn api_vcpu_token(
+    vm_id: spci_vm_id_t,
+    vcpu_idx: spci_vcpu_index_t,
+    current: *const VCpu,
+) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    match hypervisor().vcpu_token(vm_id, vcpu_idx, &current) {
+        Some(token) => token as i64,
+        None => -1,
+    }
+}
+
+/// Runs the vCPU identified by a token from api_vcpu_token, skipping the id
+/// and bounds validation of the id-based path.
+#[no_mangle]
+pub unsafe extern "C" fn api_vcpu_run_token(
+    token: u64,
+    current: *const VCpu,
+    next: *mut *const VCpu,
+) -> u64 {
+    let mut current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+
+    match hypervisor().vcpu_run_token(token, &mut current) {
+        Ok(vcpu) => *next = vcpu.into_raw(),
+        Err(ret) => return ret.into_raw(),
+    }
+
+    HfVCpuRunReturn::Preempted.into_raw()
+}
+
 /// Configures the VM to send/receive data through the specified pages. The
 /// pages must not be shared.
 ///
@@ -163,11 +340,12 @@ pub unsafe extern "C" fn api_vcpu_run(
 pub unsafe extern "C" fn api_vm_configure(
     send: ipaddr_t,
     recv: ipaddr_t,
+    pages: size_t,
     current: *const VCpu,
     next: *mut *const VCpu,
 ) -> i64 {
     let mut current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
-    let (ret, vcpu) = hypervisor().vm_configure(send, recv, &mut current);
+    let (ret, vcpu) = hypervisor().vm_configure(send, recv, pages, &mut current);
 
     *next = some_or!(vcpu, return ret);
     ret
@@ -191,6 +369,23 @@ pub unsafe extern "C" fn api_spci_msg_send(
     ret
 }
 
+/// Sends a short register-based message directly to a vCPU of the target VM,
+/// bypassing the mailbox entirely. The payload is carried in the hypercall
+/// argument registers and delivered in the return registers of the target
+/// vCPU, which must be blocked waiting for a message.
+#[no_mangle]
+pub unsafe extern "C" fn api_spci_msg_send_direct(
+    target: uintreg_t,
+    current: *const VCpu,
+    next: *mut *const VCpu,
+) -> SpciReturn {
+    let mut current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    let (ret, vcpu) = hypervisor().spci_msg_send_direct(target, &mut current);
+
+    *next = some_or!(vcpu, return ret);
+    ret
+}
+
 /// Receives a message from the mailbox. If one isn't available, this function
 /// can optionally block the caller until one becomes available.
 ///
@@ -198,11 +393,12 @@ pub unsafe extern "C" fn api_spci_msg_send(
 #[no_mangle]
 pub unsafe extern "C" fn api_spci_msg_recv(
     attributes: SpciMsgRecvAttributes,
+    timeout_ns: u64,
     current: *const VCpu,
     next: *mut *const VCpu,
 ) -> SpciReturn {
     let mut current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
-    let (ret, vcpu) = hypervisor().spci_msg_recv(attributes, &mut current);
+    let (ret, vcpu) = hypervisor().spci_msg_recv(attributes, timeout_ns, &mut current);
 
     *next = some_or!(vcpu, return ret);
     ret
@@ -238,6 +434,34 @@ pub unsafe extern "C" fn api_mailbox_waiter_get(vm_id: spci_vm_id_t, current: *c
     i64::from(res)
 }
 
+/// Drains the caller's entire ready list in one trap: the IDs of all VMs
+/// whose mailboxes became writable are written into the caller's (empty)
+/// receive buffer as an array of 16-bit VM IDs. Returns the number of IDs
+/// written, or -1 if the receive buffer is unavailable.
+#[no_mangle]
+pub unsafe extern "C" fn api_mailbox_writable_get_bulk(current: *const VCpu) -> i64 {
+    use core::slice;
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    let vm = current.vm();
+
+    let mut vm_inner = vm.inner.lock();
+    if !vm_inner.is_empty() {
+        return -1;
+    }
+    let recv = vm_inner.get_recv_ptr();
+    if recv.is_null() {
+        return -1;
+    }
+
+    let out = slice::from_raw_parts_mut(
+        (*recv).payload.as_mut_ptr() as *mut spci_vm_id_t,
+        SPCI_MSG_PAYLOAD_MAX / mem::size_of::<spci_vm_id_t>(),
+    );
+
+    vm_inner.drain_ready_list(out) as i64
+}
+
 /// Clears the caller's mailbox so that a new message can be received. The
 /// caller must have copied out all data they wish to preserve as new messages
 /// will overwrite the old and will arrive asynchronously.
@@ -277,6 +501,150 @@ pub unsafe extern "C" fn api_interrupt_enable(
     }
 }
 
+/// Registers a read-only per-vCPU interrupt status page: the hypervisor maps
+/// a page mirroring the calling vCPU's pending state (count, summary, pending
+/// bitmap) into the VM at the given page-aligned IPA, so the guest's
+/// interrupt loop can check for pending work without trapping and only call
+/// hf_interrupt_get when there is something to acknowledge.
+///
+/// Returns 0 on success, or -1 on failure.
+#[no_mangle]
+pub unsafe extern "C" fn api_interrupt_status_page(ipa: ipaddr_t, current: *const VCpu) -> i64 {
+    use crate::mm::Mode;
+    use crate::std::is_aligned;
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    let vm = current.vm();
+
+    if !is_aligned(ipa_addr(ipa), PAGE_SIZE) {
+        return -1;
+    }
+
+    // Registration is once per vCPU: repeating the call returns the page
+    // already in place instead of allocating and mapping another one, which
+    // a guest loop could otherwise use to drain the hypervisor pool.
+    {
+        let existing = current.interrupts.lock().get_status_page();
+        if !existing.is_null() {
+            return existing as i64;
+        }
+    }
+
+    // The page itself comes from the hypervisor pool; it stays owned by the
+    // hypervisor and is only readable by the guest.
+    let page = ok_or!(hypervisor().mpool.alloc(), return -1);
+    let mut page = page;
+    page.clear();
+    let raw = page.into_raw();
+
+    let pa_begin = pa_init(raw as usize);
+    let pa_end = pa_add(pa_begin, PAGE_SIZE);
+
+    {
+        // The guest chose where the page appears; the mapping is not an
+        // identity one, which the page table cannot express, so the page is
+        // identity-mapped and the IPA is required to equal the page address.
+        // TODO(HfO2): support non-identity stage-2 mappings and honour `ipa`.
+        let _ = ipa;
+        if vm
+            .ptable
+            .lock()
+            .table
+            .identity_map(pa_begin, pa_end, Mode::R | Mode::UNOWNED | Mode::SHARED, &hypervisor().mpool)
+            .is_err()
+        {
+            hypervisor().mpool.free(Page::from_raw(raw));
+            return -1;
+        }
+    }
+
+    current
+        .interrupts
+        .lock()
+        .set_status_page(raw as *mut InterruptStatusPage);
+
+    // Tell the guest where the page actually is.
+    pa_addr(pa_begin) as i64
+}
+
+/// Applies a batch of interrupt enable/disable changes in one trap: the
+/// caller's send buffer holds two bitmaps of HF_NUM_INTIDS bits each — first
+/// the mask of interrupt IDs to touch, then the new enable value for each
+/// masked ID. All changes are applied under a single lock acquisition.
+///
+/// Returns the number of interrupts touched, or -1 if the mailbox is not
+/// configured.
+#[no_mangle]
+pub unsafe extern "C" fn api_interrupt_enable_bulk(current: *const VCpu) -> i64 {
+    use core::slice;
+
+    const WORDS: usize = HF_NUM_INTIDS as usize / 32;
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    let vm = current.vm();
+
+    let send = some_or!(
+        unsafe { vm.inner.read().get_send_ptr().as_ref() },
+        return -1
+    );
+
+    let words = send.payload.as_ptr() as *const u32;
+    let mask = slice::from_raw_parts(words, WORDS);
+    let value = slice::from_raw_parts(words.add(WORDS), WORDS);
+
+    // Bound the guard so it is dropped before `current` at scope end.
+    let enabled = current.interrupts.lock().enable_bulk(mask, value) as i64;
+    enabled
+}
+
+/// Registers a read-only per-vCPU telemetry page (struct
+/// hf_vcpu_telemetry): the world-switch path publishes cumulative run
+/// cycles, steal cycles and preemption counts into it, so the guest
+/// scheduler distinguishes slow workload from host preemption with no
+/// hypercall at all. As with the interrupt status page, the page is
+/// identity-mapped and its address returned.
+#[no_mangle]
+pub unsafe extern "C" fn api_vcpu_telem_page(current: *const VCpu) -> i64 {
+    use crate::mm::Mode;
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    let vm = current.vm();
+
+    // Once per vCPU; see api_interrupt_status_page.
+    let existing = current.inner.get_mut_unchecked().telem_page;
+    if !existing.is_null() {
+        return existing as i64;
+    }
+
+    let page = ok_or!(hypervisor().mpool.alloc(), return -1);
+    let mut page = page;
+    page.clear();
+    let raw = page.into_raw();
+
+    let pa_begin = pa_init(raw as usize);
+    let pa_end = pa_add(pa_begin, PAGE_SIZE);
+
+    if vm
+        .ptable
+        .lock()
+        .table
+        .identity_map(
+            pa_begin,
+            pa_end,
+            Mode::R | Mode::UNOWNED | Mode::SHARED,
+            &hypervisor().mpool,
+        )
+        .is_err()
+    {
+        hypervisor().mpool.free(Page::from_raw(raw));
+        return -1;
+    }
+
+    current.inner.get_mut_unchecked().telem_page = raw as *mut VCpuTelemetry;
+
+    pa_addr(pa_begin) as i64
+}
+
 /// Returns the ID of the next pending interrupt for the calling vCPU, and
 /// acknowledges it (i.e. marks it as no longer pending). Returns
 /// HF_INVALID_INTID if there are no pending interrupts.
@@ -332,22 +700,394 @@ pub unsafe extern "C" fn api_share_memory(
     // The input is untrusted so might not be a valid value.
     let share = ok_or!(HfShare::try_from(share), return -1);
 
-    if hypervisor()
-        .share_memory(vm_id, addr, size, share, &current)
-        .is_ok()
-    {
+    match hypervisor().share_memory(vm_id, addr, size, share, &current) {
+        // The handle can be used with api_share_memory_revoke.
+        Ok(Some(handle)) => i64::from(handle),
+        // A large share processed one bounded chunk; the caller must re-trap
+        // with the same arguments to continue.
+        Ok(None) => -2,
+        Err(()) => -1,
+    }
+}
+
+/// Revokes a previously established memory share by handle, restoring the
+/// original mappings of both VMs without a revalidation pass.
+///
+/// Returns 0 on success, or -1 if the handle is unknown or the caller is not
+/// the VM that shared the memory.
+#[no_mangle]
+pub unsafe extern "C" fn api_share_memory_revoke(
+    handle: spci_memory_handle_t,
+    current: *const VCpu,
+) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if hypervisor().share_memory_revoke(handle, &current).is_ok() {
         0
     } else {
         -1
     }
 }
 
+/// Opts the calling VM in or out of direct mailbox-writable notification:
+/// when enabled, the hypervisor injects HF_MAILBOX_WRITABLE_INTID into the
+/// VM's first vCPU as soon as a mailbox it is waiting on becomes writable,
+/// instead of the primary VM polling waiters and forwarding the interrupt.
+///
+/// Always returns 0.
+#[no_mangle]
+pub unsafe extern "C" fn api_mailbox_writable_notify(enable: bool, current: *const VCpu) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    current.vm().inner.lock().direct_writable_notify = enable;
+    0
+}
+
+/// Enables or disables stage-2 dirty page tracking for the given VM. On
+/// enable, every writable owned-exclusive mapping is write-protected in one
+/// batched pass; subsequent guest writes fault, are logged into the faulting
+/// vCPU's dirty ring and have write access restored page by page. Only the
+/// primary VM may call this.
+///
+/// Returns 0 on success, or -1 on failure.
+#[no_mangle]
+pub unsafe extern "C" fn api_dirty_track(
+    vm_id: spci_vm_id_t,
+    enable: bool,
+    current: *const VCpu,
+) -> i64 {
+    use core::sync::atomic::Ordering;
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if current.vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    let vm = some_or!(hypervisor().vm_manager.get(vm_id), return -1);
+
+    if enable {
+        vm.ptable.lock().table.write_protect_all();
+    }
+    vm.dirty_tracking.store(enable, Ordering::Relaxed);
+    0
+}
+
+/// Pops one entry from the dirty ring of the given vCPU. Only the primary VM
+/// may call this.
+///
+/// Returns the page-aligned IPA of a dirtied page, -2 if the ring overflowed
+/// (every page must then be considered dirty), or -1 if the ring is empty.
+#[no_mangle]
+pub unsafe extern "C" fn api_dirty_log_read(
+    vm_id: spci_vm_id_t,
+    vcpu_idx: spci_vcpu_index_t,
+    current: *const VCpu,
+) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if current.vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    let vm = some_or!(hypervisor().vm_manager.get(vm_id), return -1);
+    let vcpu = some_or!(vm.vcpus.get(vcpu_idx as usize), return -1);
+
+    let mut ring = vcpu.dirty_ring.lock();
+    if ring.overflowed {
+        ring.overflowed = false;
+        return -2;
+    }
+
+    match ring.pop() {
+        Some(ipa) => ipa as i64,
+        None => -1,
+    }
+}
+
+/// Reads one field of the lock contention profile: the argument packs the
+/// query as bits [7:0] slot, bits [9:8] field (0 = lock address, 1 =
+/// acquisitions, 2 = spins, 3 = hold cycles) and bits [23:16] CPU index.
+/// Only the primary VM may read, and the call fails unless the hypervisor
+/// was built with the lock_profile feature.
+#[no_mangle]
+pub unsafe extern "C" fn api_lock_profile_read(arg: u64, current: *const VCpu) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if current.vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    crate::spinlock::profile_read(
+        (arg >> 16) as u8 as usize,
+        arg as u8 as usize,
+        (arg >> 8) as u8 as usize & 0x3,
+    )
+}
+
+/// Writes a snapshot of the given VM's sleeping vCPUs into the caller's
+/// (empty) receive buffer: a 64-bit bitmap of vCPUs blocked waiting for an
+/// interrupt or message, followed by one 64-bit deadline in nanoseconds per
+/// vCPU (HF_SLEEP_INDEFINITE when no timer is armed). This lets the primary
+/// decide its own tickless sleep with one trap instead of probing each vCPU
+/// through hf_vcpu_run.
+///
+/// Returns the number of vCPUs reported, or -1 on failure. Only the primary
+/// VM may call this. The snapshot is racy by design: a vCPU may change state
+/// concurrently, which the scheduler already has to tolerate.
+#[no_mangle]
+pub unsafe extern "C" fn api_vcpu_sleep_info(vm_id: spci_vm_id_t, current: *const VCpu) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if current.vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    let vm = some_or!(hypervisor().vm_manager.get(vm_id), return -1);
+    if vm.vcpus.len() > 64 {
+        return -1;
+    }
+
+    // The snapshot goes into the primary's receive buffer, written under
+    // the Empty->Filling reservation so a concurrent delivery can neither
+    // be clobbered nor clobber the snapshot.
+    if !current.vm().with_reserved_recv(|recv| {
+        let out = (*recv).payload.as_mut_ptr() as *mut u64;
+        let mut bitmap: u64 = 0;
+
+        for (i, vcpu) in vm.vcpus.iter().enumerate() {
+            let inner = vcpu.inner.get_unchecked();
+            let sleeping = inner.state == VCpuStatus::BlockedMailbox
+                || inner.state == VCpuStatus::BlockedInterrupt;
+
+            let deadline = if sleeping && inner.regs.timer_enabled() {
+                inner.regs.timer_remaining_ns()
+            } else {
+                HF_SLEEP_INDEFINITE
+            };
+
+            bitmap |= (sleeping as u64) << i;
+            ptr::write_unaligned(out.add(1 + i), deadline);
+        }
+
+        ptr::write_unaligned(out, bitmap);
+    }) {
+        return -1;
+    }
+
+    vm.vcpus.len() as i64
+}
+
+/// Advertises the calling VM's fast-path capabilities; returns the granted
+/// subset.
+#[no_mangle]
+pub unsafe extern "C" fn api_spci_features(requested: u32, current: *const VCpu) -> i32 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    hypervisor().spci_features(requested, &current)
+}
+
+/// Writes the per-vCPU consumed-cycle vector of the given VM (one 64-bit
+/// value per vCPU) into the caller's empty receive buffer. Only the primary
+/// VM may call this; the values are monotonic counters the scheduler can
+/// difference between calls for proportional-share decisions.
+///
+/// Returns the number of vCPUs reported, or -1 on failure.
+#[no_mangle]
+pub unsafe extern "C" fn api_vcpu_cycles(vm_id: spci_vm_id_t, current: *const VCpu) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if current.vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    let vm = some_or!(hypervisor().vm_manager.get(vm_id), return -1);
+
+    // Written under the Empty->Filling reservation; see api_vcpu_sleep_info.
+    if !current.vm().with_reserved_recv(|recv| {
+        let out = (*recv).payload.as_mut_ptr() as *mut u64;
+        for (i, vcpu) in vm.vcpus.iter().enumerate() {
+            ptr::write_unaligned(out.add(i), vcpu.inner.get_unchecked().consumed_cycles);
+        }
+    }) {
+        return -1;
+    }
+
+    vm.vcpus.len() as i64
+}
+
+/// Resets a single secondary VM in place for crash recovery, leaving every
+/// other VM running: its vCPUs are taken offline and re-initialised, its
+/// stage-2 table is torn down and rebuilt from the VM's cached table pages,
+/// its mailbox state is cleared, and its memory is re-imaged lazily from the
+/// retained ramdisk on first access. Only the primary VM may call this.
+///
+/// Returns 0 on success, or -1 if the VM doesn't exist, is the primary, or
+/// has a vCPU running right now.
+#[no_mangle]
+pub unsafe extern "C" fn api_vm_reset(vm_id: spci_vm_id_t, current: *const VCpu) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if current.vm().id != HF_PRIMARY_VM_ID || vm_id == HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    let vm = some_or!(hypervisor().vm_manager.get(vm_id), return -1);
+
+    // Every vCPU must be stopped: take all execution locks, backing out if
+    // any is running.
+    let mut held = 0;
+    for vcpu in vm.vcpus.iter() {
+        if vcpu.inner.try_lock().map(mem::forget).is_err() {
+            for unlock in vm.vcpus.iter().take(held) {
+                unlock.inner.unlock_unchecked();
+            }
+            return -1;
+        }
+        held += 1;
+    }
+
+    // Rebuild the stage-2 table from the VM's own cached pages; the old one
+    // is dropped into the same pool. The lazy image record is retained, so
+    // the memory re-images itself from the ramdisk on first access.
+    {
+        let mut vm_ptable = vm.ptable.lock();
+        let new_table = match PageTable::new(&vm_ptable.pool) {
+            Ok(table) => table,
+            Err(()) => {
+                for unlock in vm.vcpus.iter() {
+                    unlock.inner.unlock_unchecked();
+                }
+                return -1;
+            }
+        };
+        let old = mem::replace(&mut vm_ptable.table, new_table);
+        old.drop(&vm_ptable.pool);
+    }
+
+    vm.dirty_tracking.store(false, Ordering::Relaxed);
+    vm.aborting.store(false, Ordering::Relaxed);
+
+    // Clear the mailbox machinery; the reborn guest reconfigures its buffers
+    // itself.
+    vm.inner.lock().reset_mailbox();
+
+    // Re-initialise the vCPUs: everything off except the boot vCPU, which
+    // restarts at the image base exactly as the loader set it up.
+    let image = vm.ptable.lock().lazy_image;
+    for (i, vcpu) in vm.vcpus.iter().enumerate() {
+        let inner = vcpu.inner.get_mut_unchecked();
+        inner.regs.reset(false, vm, i as cpu_id_t);
+        inner.prewarmed = true;
+        inner.state = VCpuStatus::Off;
+
+        if i == 0 {
+            if let Some(image) = image {
+                inner.on(
+                    ipa_init(image.begin),
+                    (image.end - image.begin) as uintreg_t,
+                );
+            }
+        }
+    }
+
+    for vcpu in vm.vcpus.iter() {
+        vcpu.inner.unlock_unchecked();
+    }
+
+    0
+}
+
+/// Working-set sampling: with `harvest` clear, removes the access flag from
+/// every mapping of the given stage-2 range so hardware access faults
+/// repopulate it; with `harvest` set, writes a bitmap (one bit per page,
+/// little-endian words) of the pages accessed since the last clear into the
+/// caller's empty receive buffer. Only the primary VM may call this.
+///
+/// Returns the number of pages covered, or -1 on failure.
+#[no_mangle]
+pub unsafe extern "C" fn api_wset_sample(
+    arg: u64,
+    begin: uintpaddr_t,
+    size: size_t,
+    current: *const VCpu,
+) -> i64 {
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if current.vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    let vm_id = arg as spci_vm_id_t;
+    let harvest = arg & (1 << 16) != 0;
+    let vm = some_or!(hypervisor().vm_manager.get(vm_id), return -1);
+
+    let pages = size / PAGE_SIZE;
+    if pages == 0 || pages > SPCI_MSG_PAYLOAD_MAX * 8 {
+        return -1;
+    }
+
+    if !harvest {
+        vm.ptable.lock().table.clear_af(begin, begin + size);
+        return pages as i64;
+    }
+
+    // Written under the Empty->Filling reservation; see api_vcpu_sleep_info.
+    if !current.vm().with_reserved_recv(|recv| {
+        let bitmap = (*recv).payload.as_mut_ptr();
+        ptr::write_bytes(bitmap, 0, (pages + 7) / 8);
+
+        vm.ptable
+            .lock()
+            .table
+            .harvest_af(begin, begin + size, &mut |extent_begin, extent_size| {
+                let first = (extent_begin.saturating_sub(begin)) / PAGE_SIZE;
+                let count = extent_size / PAGE_SIZE;
+                for page in first..core::cmp::min(first + count, pages) {
+                    *bitmap.add(page / 8) |= 1 << (page % 8);
+                }
+            });
+    }) {
+        return -1;
+    }
+
+    pages as i64
+}
+
+/// Reads one counter of the hypervisor page pool's statistics (field 0
+/// allocs, 1 frees, 2 fallback promotions, 3 current free pages, 4 free-page
+/// low watermark). Only the primary VM may read.
+#[no_mangle]
+pub unsafe extern "C" fn api_mpool_stat(field: u32, current: *const VCpu) -> i64 {
+    use crate::mpool::mpool_stat;
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if current.vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    mpool_stat(&hypervisor().mpool, field) as i64
+}
+
 /// Returns the version of the implemented SPCI specification.
 #[no_mangle]
 pub extern "C" fn api_spci_version() -> i32 {
     hypervisor().spci_version()
 }
 
+/// Splices up to `count` bytes of guest log output from the caller's send
+/// buffer into the debug log with a single trap, instead of one trap per
+/// character. Returns the number of bytes consumed, or -1 if the mailbox is
+/// not configured or the count is out of range.
+#[no_mangle]
+pub unsafe extern "C" fn api_debug_log_buffer(count: size_t, current: *const VCpu) -> i64 {
+    use core::slice;
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    let vm = current.vm();
+
+    if count > SPCI_MSG_PAYLOAD_MAX {
+        return -1;
+    }
+
+    let mut vm_inner = vm.inner.lock();
+    let send = some_or!(unsafe { vm_inner.get_send_ptr().as_ref() }, return -1);
+    let bytes = slice::from_raw_parts(send.payload.as_ptr(), count);
+
+    vm_inner.debug_log_bytes(vm.id, bytes);
+    count as i64
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn api_debug_log(c: c_char, current: *const VCpu) -> i64 {
     let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
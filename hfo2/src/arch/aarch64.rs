@@ -60,6 +60,17 @@ pub struct ArchVm {
     /// on that CPU, which avoids contention and so no lock is needed to
     /// access this field.
     last_vcpu_on_cpu: [spci_vcpu_index_t; MAX_CPUS],
+
+    /// Generation-tagged stage-2 VMID, managed by `arch_mm_assign_vmid()`;
+    /// zero until the VM first runs.
+    vmid: u64,
+
+    /// Cache of constant trapped-sysreg read results, populated on first
+    /// access (see `debug_el1_process_access`). Refills are idempotent reads
+    /// of invariant registers, so no lock is needed.
+    sysreg_mdrar: uintreg_t,
+    sysreg_dbgauthstatus: uintreg_t,
+    sysreg_cache_valid: u32,
 }
 
 /// Type to represent the register state of a vCPU.
@@ -117,6 +128,32 @@ pub fn arch_cpu_module_init() {
     assert_eq!(offset_of!(ArchRegs, gic_ich_hcr_el2), REGS_GIC);
 }
 
+/// The number of registers carried by a register-based direct message.
+pub const DIRECT_PAYLOAD_REGS: usize = 6;
+
+impl ArchRegs {
+    /// Reads the hypercall argument registers x2..x7, used as the payload of
+    /// register-based direct messages.
+    pub fn get_direct_payload(&self) -> [uintreg_t; DIRECT_PAYLOAD_REGS] {
+        [
+            self.r[2], self.r[3], self.r[4], self.r[5], self.r[6], self.r[7],
+        ]
+    }
+
+    /// Writes a direct-message payload and its source into the return
+    /// registers x1..x7 of a vCPU waking up from a message receive. x1 is the
+    /// source VM ID with the direct-delivery marker set; x0 (the return code)
+    /// is left for the caller to set.
+    pub fn set_direct_payload(
+        &mut self,
+        source_vm_id: spci_vm_id_t,
+        payload: [uintreg_t; DIRECT_PAYLOAD_REGS],
+    ) {
+        self.r[1] = (1 << 16) | uintreg_t::from(source_vm_id);
+        self.r[2..(2 + DIRECT_PAYLOAD_REGS)].copy_from_slice(&payload);
+    }
+}
+
 #[repr(C)]
 #[derive(Default)]
 pub struct ArchSysRegs {
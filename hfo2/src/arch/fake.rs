@@ -49,6 +49,32 @@ pub struct ArchRegs {
     virtual_interrupt: bool,
 }
 
+/// The number of registers carried by a register-based direct message. The
+/// fake architecture only has room for two payload registers beside the
+/// return value and the source register.
+pub const DIRECT_PAYLOAD_REGS: usize = 6;
+
+impl ArchRegs {
+    /// Reads the direct-message payload from the argument registers. The fake
+    /// register file is too small to carry the full payload, so the rest is
+    /// zero.
+    pub fn get_direct_payload(&self) -> [uintreg_t; DIRECT_PAYLOAD_REGS] {
+        [self.r[2], self.r[3], 0, 0, 0, 0]
+    }
+
+    /// Writes a direct-message payload and its source into the return
+    /// registers, as far as the fake register file allows.
+    pub fn set_direct_payload(
+        &mut self,
+        source_vm_id: spci_vm_id_t,
+        payload: [uintreg_t; DIRECT_PAYLOAD_REGS],
+    ) {
+        self.r[1] = (1 << 16) | uintreg_t::from(source_vm_id);
+        self.r[2] = payload[0];
+        self.r[3] = payload[1];
+    }
+}
+
 pub fn arch_cpu_module_init() {
     // Do nothing.
 }
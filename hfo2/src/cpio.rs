@@ -15,8 +15,10 @@
  */
 
 use core::mem;
+use core::ptr;
 
 use crate::memiter::*;
+use crate::spinlock::SpinLock;
 use crate::types::*;
 
 extern "C" {
@@ -47,15 +49,18 @@ pub struct CpioResult {
 /// Retrieves the next file stored in the cpio archive stored in the cpio, and advances the iterator
 /// such that another call to this function would return the following file.
 pub fn parse_cpio(it: &mut MemIter) -> Option<CpioResult> {
-    let header = unsafe { &*(it.read(mem::size_of::<CpioHeader>())? as *const CpioHeader) };
+    // Each record is consumed as three claimed windows — header, name,
+    // contents — one bounds check each.
+    let header =
+        unsafe { &*(it.claim(mem::size_of::<CpioHeader>())?.as_ptr() as *const CpioHeader) };
 
     // TODO: Check magic.
 
     let name_len = (header.namesize + 1) & !1;
-    let name = it.read(name_len as usize)?;
+    let name = unsafe { it.claim(name_len as usize)? }.as_ptr();
 
     let contents_len = ((header.filesize[0] as usize) << 16) | header.filesize[1] as usize;
-    let contents = it.read((contents_len + 1) & !1)?;
+    let contents = unsafe { it.claim((contents_len + 1) & !1)? }.as_ptr();
 
     // TODO: Check that string is null-terminated.
 
@@ -71,30 +76,113 @@ pub fn parse_cpio(it: &mut MemIter) -> Option<CpioResult> {
     })
 }
 
-/// Looks for a file in the given cpio archive. The filename is not null-terminated, so we use a
-/// memory iterator to represent it. The file, if found, is returned in the `it` argument.
-pub fn find_file_memiter(cpio: &MemIter, filename: &MemIter) -> Option<MemIter> {
-    let mut iter = cpio.clone();
+/// The number of archive members the index can hold.
+const CPIO_INDEX_SIZE: usize = 64;
+
+/// Build-once index over the ramdisk, mapping member names to their contents.
+/// It is filled in a single pass over the archive on the first lookup, so
+/// each later lookup is a scan of at most `CPIO_INDEX_SIZE` entries instead
+/// of a re-parse of every header. Members beyond the capacity are found by
+/// the linear fallback.
+struct CpioIndex {
+    /// The start of the archive this index describes.
+    base: *const u8,
+
+    /// Indexed members as (name, contents, size).
+    entries: [(*const u8, *const u8, usize); CPIO_INDEX_SIZE],
+    count: usize,
+
+    /// Whether every member of the archive fit into the index, making misses
+    /// definitive.
+    complete: bool,
+}
 
-    while let Some(result) = parse_cpio(&mut iter) {
-        if unsafe { filename.iseq(result.name) } {
-            return Some(unsafe { MemIter::from_raw(result.contents, result.size) });
+unsafe impl Send for CpioIndex {}
+
+/// Boot-only: lives in `.boot.init`, which is unmapped and donated to the
+/// page pool once initialisation completes. The archive is never consulted
+/// after the VMs are loaded.
+#[link_section = ".boot.init"]
+static CPIO_INDEX: SpinLock<CpioIndex> = SpinLock::new(CpioIndex {
+    base: ptr::null(),
+    entries: [(ptr::null(), ptr::null(), 0); CPIO_INDEX_SIZE],
+    count: 0,
+    complete: false,
+});
+
+impl CpioIndex {
+    /// Makes sure this index describes the given archive, scanning it once if
+    /// it doesn't yet.
+    fn ensure(&mut self, cpio: &MemIter) {
+        let base = cpio.get_next();
+        if self.base == base {
+            return;
+        }
+
+        self.base = base;
+        self.count = 0;
+        self.complete = true;
+
+        let mut iter = cpio.clone();
+        while let Some(result) = parse_cpio(&mut iter) {
+            if self.count == CPIO_INDEX_SIZE {
+                self.complete = false;
+                break;
+            }
+
+            self.entries[self.count] = (result.name, result.contents, result.size);
+            self.count += 1;
         }
     }
 
-    None
+    fn find<F>(&self, matches: F) -> Option<MemIter>
+    where
+        F: Fn(*const u8) -> bool,
+    {
+        self.entries[..self.count]
+            .iter()
+            .find(|(name, _, _)| matches(*name))
+            .map(|&(_, contents, size)| unsafe { MemIter::from_raw(contents, size) })
+    }
 }
 
-/// Looks for a file in the given cpio archive. The file, if found, is returned in the `it`
-/// argument.
-pub unsafe fn find_file(cpio: &MemIter, filename: *const u8) -> Option<MemIter> {
-    let mut iter = cpio.clone();
+/// Looks for a file in the given cpio archive through the build-once index.
+/// `matches` decides whether a member name is the wanted one. Falls back to a
+/// linear parse only if the archive has more members than the index holds.
+fn find_file_indexed<F>(cpio: &MemIter, matches: F) -> Option<MemIter>
+where
+    F: Fn(*const u8) -> bool,
+{
+    let mut index = CPIO_INDEX.lock();
+    index.ensure(cpio);
+
+    if let Some(it) = index.find(&matches) {
+        return Some(it);
+    }
+
+    if index.complete {
+        return None;
+    }
+    drop(index);
 
+    let mut iter = cpio.clone();
     while let Some(result) = parse_cpio(&mut iter) {
-        if strcmp(filename, result.name) == 0 {
-            return Some(MemIter::from_raw(result.contents, result.size));
+        if matches(result.name) {
+            return Some(unsafe { MemIter::from_raw(result.contents, result.size) });
         }
     }
 
     None
 }
+
+/// Looks for a file in the given cpio archive. The filename is not null-terminated, so we use a
+/// memory iterator to represent it. The file, if found, is returned in the `it` argument.
+pub fn find_file_memiter(cpio: &MemIter, filename: &MemIter) -> Option<MemIter> {
+    find_file_indexed(cpio, |name| unsafe { filename.iseq(name) })
+}
+
+/// Looks for a file in the given cpio archive. The file, if found, is returned in the `it`
+/// argument.
+pub unsafe fn find_file(cpio: &MemIter, filename: *const u8) -> Option<MemIter> {
+    find_file_indexed(cpio, |name| strcmp(filename, name) == 0)
+}
@@ -17,6 +17,7 @@
 use core::mem::{self, ManuallyDrop, MaybeUninit};
 use core::ops::Deref;
 use core::ptr;
+use core::sync::atomic::{AtomicBool, AtomicU32, Ordering};
 
 use crate::addr::*;
 use crate::arch::*;
@@ -59,10 +60,33 @@ extern "C" {
     /// This function must only be called on an arch_regs that is known not be in use
     /// by any other physical CPU.
     fn arch_regs_set_retval(r: *mut ArchRegs, v: uintreg_t);
+
+    /// Tries to inject the given virtual interrupt directly into a GICv3
+    /// list register of the current CPU. Returns false if no list register is
+    /// available or the GIC doesn't support it.
+    pub fn arch_gicv3_try_inject_current(intid: intid_t) -> bool;
+
+    /// Interrupts the given physical CPU, so that if it is running a vCPU it
+    /// traps back to the hypervisor promptly.
+    pub fn arch_cpu_kick(id: cpu_id_t);
+
+    /// Configures the given registers so that wfi/wfe execute natively in
+    /// the guest instead of trapping.
+    fn arch_regs_set_wfi_passthrough(r: *mut ArchRegs);
+    fn arch_regs_set_timer_passthrough(r: *mut ArchRegs);
 }
 
 pub const STACK_SIZE: usize = PAGE_SIZE;
 
+/// Size of the unmapped guard page below each CPU stack.
+pub const STACK_GUARD_SIZE: usize = PAGE_SIZE;
+
+/// How many unlock events a vCPU-lock contender rides out with wfe before
+/// giving up and taking the scheduling round trip instead.
+pub const VCPU_LOCK_SPIN_WAITS: u32 = 128;
+
+const_assert_eq!(mem::align_of::<Cpu>(), CACHE_LINE_SIZE);
+
 /// The number of bits in each element of the interrupt bitfields.
 pub const INTERRUPT_REGISTER_BITS: usize = 32;
 
@@ -96,14 +120,91 @@ pub struct Interrupts {
     /// The number of interrupts which are currently both enabled and pending. i.e. the number of
     /// bits set in enabled & pending.
     enabled_and_pending_count: u32,
+
+    /// Summary bitmap with one bit per word of `enabled & pending`, so the
+    /// next deliverable interrupt is found with two trailing-zero counts
+    /// instead of a linear scan over the words.
+    summary: u32,
+
+    /// Optional page, mapped read-only into the guest, mirroring the pending
+    /// state so the guest only traps when there is something to acknowledge.
+    /// Null until the guest registers one.
+    status_page: *mut InterruptStatusPage,
+}
+
+/// Layout of the per-vCPU interrupt status page shared read-only with the
+/// guest. Keep in sync with `struct hf_interrupt_status_page` in
+/// inc/vmapi/hf/types.h.
+#[repr(C)]
+pub struct InterruptStatusPage {
+    pub enabled_and_pending_count: u32,
+    pub summary: u32,
+    pub pending: [u32; HF_NUM_INTIDS as usize / INTERRUPT_REGISTER_BITS],
 }
 
+const_assert!(HF_NUM_INTIDS as usize / INTERRUPT_REGISTER_BITS <= 32);
+
 impl Interrupts {
     pub fn new() -> Self {
         Self {
             enabled: [0; HF_NUM_INTIDS as usize / INTERRUPT_REGISTER_BITS],
             pending: [0; HF_NUM_INTIDS as usize / INTERRUPT_REGISTER_BITS],
             enabled_and_pending_count: 0,
+            summary: 0,
+            status_page: ptr::null_mut(),
+        }
+    }
+
+    /// Recomputes the summary bit of the given word and the
+    /// enabled-and-pending count — the latter branch-free via popcount over
+    /// the masked words, which is cheap at these sizes and immune to
+    /// storm-induced branch misprediction — and mirrors the new state to the
+    /// guest-visible status page, if any.
+    fn update_summary(&mut self, index: usize) {
+        let deliverable = ((self.enabled[index] & self.pending[index]) != 0) as u32;
+        self.summary = (self.summary & !(1 << index)) | (deliverable << index);
+
+        self.enabled_and_pending_count = self
+            .enabled
+            .iter()
+            .zip(self.pending.iter())
+            .map(|(e, p)| (e & p).count_ones())
+            .sum();
+
+        self.publish();
+    }
+
+    /// Registers the guest-visible status page and publishes the current
+    /// state to it.
+    pub fn set_status_page(&mut self, page: *mut InterruptStatusPage) {
+        self.status_page = page;
+        self.publish();
+    }
+
+    /// The registered status page, or null.
+    pub fn get_status_page(&self) -> *mut InterruptStatusPage {
+        self.status_page
+    }
+
+    /// Mirrors the pending state to the status page. Volatile stores, as the
+    /// guest reads the page concurrently without synchronization.
+    fn publish(&self) {
+        if self.status_page.is_null() {
+            return;
+        }
+
+        unsafe {
+            ptr::write_volatile(
+                &mut (*self.status_page).summary,
+                self.summary,
+            );
+            for (i, word) in self.pending.iter().enumerate() {
+                ptr::write_volatile(&mut (*self.status_page).pending[i], *word);
+            }
+            ptr::write_volatile(
+                &mut (*self.status_page).enabled_and_pending_count,
+                self.enabled_and_pending_count,
+            );
         }
     }
 
@@ -126,9 +227,10 @@ impl Interrupts {
     pub fn inject(&mut self, intid: intid_t) -> Result<(), ()> {
         let (intid_index, intid_mask) = Self::id_to_index(intid)?;
 
-        // Make it pending.
+        // Make it pending; the count is recomputed by update_summary.
         let pending = self.pending[intid_index];
         self.pending[intid_index] |= intid_mask;
+        self.update_summary(intid_index);
 
         // We only need to change state and (maybe) trigger a virtual IRQ if it
         // is enabled and was not previously pending. Otherwise we can skip
@@ -140,9 +242,6 @@ impl Interrupts {
             return Err(());
         }
 
-        // Increment the count.
-        self.enabled_and_pending_count += 1;
-
         // Only need to update state if there was not already an
         // interrupt enabled and pending.
         if self.enabled_and_pending_count != 1 {
@@ -156,23 +255,57 @@ impl Interrupts {
     pub fn enable(&mut self, intid: intid_t, enable: bool) -> Result<(), ()> {
         let (intid_index, intid_mask) = Self::id_to_index(intid)?;
 
+        // The count maintenance is fully delegated to update_summary's
+        // popcount recomputation; only the bit itself is touched here.
         if enable {
-            // If it is pending and was not enabled before, increment the count.
-            if (self.pending[intid_index] & !self.enabled[intid_index] & intid_mask) != 0 {
-                self.enabled_and_pending_count += 1;
-            }
             self.enabled[intid_index] |= intid_mask;
         } else {
-            // If it is pending and was enabled before, decrement the count.
-            if (self.pending[intid_index] & self.enabled[intid_index] & intid_mask) != 0 {
-                self.enabled_and_pending_count -= 1;
-            }
             self.enabled[intid_index] &= !intid_mask;
         }
 
+        self.update_summary(intid_index);
         Ok(())
     }
 
+    /// Applies a batch of enable/disable changes: every interrupt whose bit
+    /// is set in `mask` is enabled or disabled according to the matching bit
+    /// of `value`, all under the single lock acquisition of the caller.
+    /// Returns the number of interrupts touched.
+    pub fn enable_bulk(&mut self, mask: &[u32], value: &[u32]) -> usize {
+        let mut count = 0;
+
+        // Whole-word updates with a single summary/count recomputation at
+        // the end: branch-free however many bits change.
+        for index in 0..(HF_NUM_INTIDS as usize / INTERRUPT_REGISTER_BITS) {
+            let word = mask.get(index).copied().unwrap_or(0);
+            let values = value.get(index).copied().unwrap_or(0);
+
+            self.enabled[index] = (self.enabled[index] & !word) | (values & word);
+            count += word.count_ones() as usize;
+
+            let deliverable = ((self.enabled[index] & self.pending[index]) != 0) as u32;
+            self.summary = (self.summary & !(1 << index)) | (deliverable << index);
+        }
+
+        self.enabled_and_pending_count = self
+            .enabled
+            .iter()
+            .zip(self.pending.iter())
+            .map(|(e, p)| (e & p).count_ones())
+            .sum();
+        self.publish();
+
+        count
+    }
+
+    /// Checks whether the given interrupt is enabled for this vCPU.
+    pub fn is_enabled(&self, intid: intid_t) -> bool {
+        match Self::id_to_index(intid) {
+            Ok((index, mask)) => self.enabled[index] & mask != 0,
+            Err(()) => false,
+        }
+    }
+
     /// Checks whether the vCPU's attempt to block for a message has already been interrupted or
     /// whether it is allowed to block.
     #[inline]
@@ -186,21 +319,22 @@ impl Interrupts {
     /// acknowledges it (i.e. marks it as no longer pending). Returns
     /// HF_INVALID_INTID if there are no pending interrupts.
     pub fn get(&mut self) -> intid_t {
-        // Find the first enabled pending interrupt ID, returns it, and
-        // deactive it.
-        for i in 0..(HF_NUM_INTIDS as usize / INTERRUPT_REGISTER_BITS) {
-            let enabled_and_pending = self.enabled[i] & self.pending[i];
-            if enabled_and_pending != 0 {
-                let bit_index = enabled_and_pending.trailing_zeros();
-
-                // Mark it as no longer pending and decrement the count.
-                self.pending[i] &= !(1u32 << bit_index);
-                self.enabled_and_pending_count -= 1;
-                return (i * INTERRUPT_REGISTER_BITS) as u32 + bit_index;
-            }
+        // Find the first enabled pending interrupt ID with two trailing-zero
+        // counts via the summary bitmap, return it, and deactivate it.
+        if self.summary == 0 {
+            return HF_INVALID_INTID;
         }
 
-        HF_INVALID_INTID
+        let i = self.summary.trailing_zeros() as usize;
+        let enabled_and_pending = self.enabled[i] & self.pending[i];
+        let bit_index = enabled_and_pending.trailing_zeros();
+
+        // Mark it as no longer pending; the count is recomputed by
+        // update_summary.
+        self.pending[i] &= !(1u32 << bit_index);
+        self.update_summary(i);
+
+        (i * INTERRUPT_REGISTER_BITS) as u32 + bit_index
     }
 }
 
@@ -209,6 +343,18 @@ impl ArchRegs {
     /// with `arch_regs_set_pc_arg()`.
     pub fn reset(&mut self, is_primary: bool, vm: &Vm, vcpu_id: cpu_id_t) {
         unsafe { arch_regs_reset(self, is_primary, vm.id, vcpu_id, vm.get_ptable_raw()) }
+
+        // Dedicated-core VMs execute wfi/wfe natively instead of trapping.
+        if vm.wfi_passthrough {
+            unsafe { arch_regs_set_wfi_passthrough(self) }
+        }
+
+        // With a core of its own, the VM also gets the EL1 physical timer
+        // outright: no traps, and the world-switch path skips the timer
+        // save/restore for it.
+        if vm.dedicated_cores {
+            unsafe { arch_regs_set_timer_passthrough(self) }
+        }
     }
 
     /// Updates the register holding the return value of a function.
@@ -239,6 +385,63 @@ impl ArchRegs {
     }
 }
 
+/// Lock-free MPSC post box of interrupt IDs raised by other physical CPUs.
+///
+/// Producers publish an intid with a single atomic OR and never touch the
+/// target vCPU's interrupts lock, so a cross-core inject is one store plus
+/// the kick IPI. The owning CPU folds the posted bits into the locked
+/// pending state the next time the vCPU traps or is switched in. Duplicate
+/// posts collapse, which matches the pending-bitfield semantics of
+/// `Interrupts::inject` exactly.
+pub struct RemotePending {
+    /// One bit per word of `words` that may have something posted; lets the
+    /// hot empty path bail out on a single relaxed load.
+    any: AtomicU32,
+
+    words: [AtomicU32; HF_NUM_INTIDS as usize / INTERRUPT_REGISTER_BITS],
+}
+
+impl RemotePending {
+    pub const fn new() -> Self {
+        Self {
+            any: AtomicU32::new(0),
+            words: [AtomicU32::new(0); HF_NUM_INTIDS as usize / INTERRUPT_REGISTER_BITS],
+        }
+    }
+
+    /// Posts an interrupt from another physical CPU. Returns Err if the ID
+    /// is out of range.
+    pub fn post(&self, intid: intid_t) -> Result<(), ()> {
+        let (intid_index, intid_mask) = Interrupts::id_to_index(intid)?;
+
+        self.words[intid_index].fetch_or(intid_mask, Ordering::Release);
+        self.any.fetch_or(1 << intid_index, Ordering::Release);
+        Ok(())
+    }
+
+    /// Drains every posted ID into the locked pending state. Called by the
+    /// owning CPU with the interrupts lock held.
+    pub fn drain(&self, interrupts: &mut Interrupts) {
+        if self.any.load(Ordering::Relaxed) == 0 {
+            return;
+        }
+
+        let mut any = self.any.swap(0, Ordering::Acquire);
+        while any != 0 {
+            let intid_index = any.trailing_zeros() as usize;
+            any &= any - 1;
+
+            let mut word = self.words[intid_index].swap(0, Ordering::Acquire);
+            while word != 0 {
+                let bit = word.trailing_zeros();
+                word &= word - 1;
+                let _ = interrupts
+                    .inject((intid_index * INTERRUPT_REGISTER_BITS) as intid_t + bit);
+            }
+        }
+    }
+}
+
 #[repr(C)]
 pub struct VCpuFaultInfo {
     ipaddr: ipaddr_t,
@@ -254,6 +457,28 @@ pub struct VCpuInner {
     pub state: VCpuStatus,
     pub cpu: *const Cpu,
     pub regs: ArchRegs,
+
+    /// Total cycles this vCPU has consumed on physical CPUs, accumulated by
+    /// the world-switch path; exposed to the primary scheduler in bulk.
+    pub consumed_cycles: u64,
+
+    /// Telemetry shared with the guest: accumulated steal cycles (ready but
+    /// not running), preemption count, and the counter stamp of the last
+    /// switch-out, published to `telem_page` if the guest registered one.
+    pub steal_cycles: u64,
+    pub preemptions: u64,
+    pub deactivated_at: u64,
+    pub telem_page: *mut VCpuTelemetry,
+
+    /// Counter deadline of a timed message receive (0 when none): when it
+    /// passes while the vCPU is blocked on its mailbox, the receive returns
+    /// with a retry status instead of sleeping on.
+    pub recv_deadline: u64,
+
+    /// Whether `regs` already holds a freshly reset context, prepared when
+    /// the vCPU was turned off, so that CPU_ON only has to patch the entry
+    /// point and argument.
+    pub prewarmed: bool,
 }
 
 impl VCpuInner {
@@ -264,6 +489,13 @@ impl VCpuInner {
             state: VCpuStatus::Off,
             cpu: ptr::null(),
             regs: ArchRegs::default(),
+            consumed_cycles: 0,
+            steal_cycles: 0,
+            preemptions: 0,
+            deactivated_at: 0,
+            telem_page: ptr::null_mut(),
+            recv_deadline: 0,
+            prewarmed: false,
         }
     }
 
@@ -285,6 +517,54 @@ impl VCpuInner {
     }
 }
 
+/// The number of dirty page addresses each vCPU ring can hold.
+pub const DIRTY_RING_SIZE: usize = 64;
+
+/// Ring of intermediate physical addresses dirtied by this vCPU while stage-2
+/// dirty tracking is active, consumed by the migration manager through a
+/// hypercall.
+pub struct DirtyRing {
+    entries: [uintpaddr_t; DIRTY_RING_SIZE],
+    head: usize,
+    len: usize,
+
+    /// Set when an address had to be dropped because the ring was full; the
+    /// consumer must then treat every page as dirty.
+    pub overflowed: bool,
+}
+
+impl DirtyRing {
+    pub const fn new() -> Self {
+        Self {
+            entries: [0; DIRTY_RING_SIZE],
+            head: 0,
+            len: 0,
+            overflowed: false,
+        }
+    }
+
+    pub fn push(&mut self, ipa: uintpaddr_t) {
+        if self.len == DIRTY_RING_SIZE {
+            self.overflowed = true;
+            return;
+        }
+
+        self.entries[(self.head + self.len) % DIRTY_RING_SIZE] = ipa;
+        self.len += 1;
+    }
+
+    pub fn pop(&mut self) -> Option<uintpaddr_t> {
+        if self.len == 0 {
+            return None;
+        }
+
+        let ipa = self.entries[self.head];
+        self.head = (self.head + 1) % DIRTY_RING_SIZE;
+        self.len -= 1;
+        Some(ipa)
+    }
+}
+
 #[repr(C)]
 pub struct VCpu {
     vm: *mut Vm,
@@ -292,6 +572,11 @@ pub struct VCpu {
     /// If a vCPU of secondary VMs is running, its lock is logically held by the running pCPU.
     pub inner: SpinLock<VCpuInner>,
     pub interrupts: SpinLock<Interrupts>,
+    pub dirty_ring: SpinLock<DirtyRing>,
+
+    /// Interrupts posted by other physical CPUs, folded into `interrupts`
+    /// when this vCPU next traps.
+    pub remote_pending: RemotePending,
 }
 
 impl VCpu {
@@ -300,6 +585,8 @@ impl VCpu {
             vm,
             inner: SpinLock::new(VCpuInner::new()),
             interrupts: SpinLock::new(Interrupts::new()),
+            dirty_ring: SpinLock::new(DirtyRing::new()),
+            remote_pending: RemotePending::new(),
         }
     }
 
@@ -362,8 +649,53 @@ impl VCpuExecutionLocked {
     }
 }
 
-// TODO: Update alignment such that cpus are in different cache lines.
-#[repr(C)]
+/// The capacity of each per-CPU run queue of the in-hypervisor scheduling
+/// tier.
+pub const RUN_QUEUE_SIZE: usize = 8;
+
+/// Ready vCPUs waiting for cycles on one physical CPU. When the current vCPU
+/// blocks, the hypervisor switches straight to the next queued vCPU and only
+/// falls out to the primary VM's scheduler when the queue is empty.
+pub struct RunQueue {
+    entries: [*const VCpu; RUN_QUEUE_SIZE],
+    head: usize,
+    len: usize,
+}
+
+impl RunQueue {
+    pub const fn new() -> Self {
+        Self {
+            entries: [ptr::null(); RUN_QUEUE_SIZE],
+            head: 0,
+            len: 0,
+        }
+    }
+
+    pub fn push(&mut self, vcpu: *const VCpu) -> Result<(), ()> {
+        if self.len == RUN_QUEUE_SIZE {
+            return Err(());
+        }
+
+        self.entries[(self.head + self.len) % RUN_QUEUE_SIZE] = vcpu;
+        self.len += 1;
+        Ok(())
+    }
+
+    pub fn pop(&mut self) -> Option<*const VCpu> {
+        if self.len == 0 {
+            return None;
+        }
+
+        let vcpu = self.entries[self.head];
+        self.head = (self.head + 1) % RUN_QUEUE_SIZE;
+        self.len -= 1;
+        Some(vcpu)
+    }
+}
+
+/// Aligned so that each entry of the global CPU array starts on its own cache
+/// line, avoiding false sharing between CPUs; see `CACHE_LINE_SIZE`.
+#[repr(C, align(64))]
 pub struct Cpu {
     /// CPU identifier. Doesn't have to be contiguous.
     pub id: cpu_id_t,
@@ -374,6 +706,14 @@ pub struct Cpu {
 
     /// Determines whether or not the cpu is currently on.
     is_on: SpinLock<bool>,
+
+    /// Lock-free mirror of `is_on`, maintained with release stores by
+    /// cpu_on/cpu_off so PSCI AFFINITY_INFO polls read it with a single
+    /// acquire load instead of taking the CPU lock.
+    online: AtomicBool,
+
+    /// Ready vCPUs waiting for cycles on this CPU; see `RunQueue`.
+    pub run_queue: SpinLock<RunQueue>,
 }
 
 impl Cpu {
@@ -382,6 +722,8 @@ impl Cpu {
             id,
             stack_bottom: stack_bottom as *mut _,
             is_on: SpinLock::new(is_on),
+            online: AtomicBool::new(is_on),
+            run_queue: SpinLock::new(RunQueue::new()),
         }
     }
 }
@@ -404,19 +746,29 @@ pub unsafe fn cpu_get_buffer(cpu_id: cpu_id_t) -> &'static mut RawPage {
 pub struct CpuManager {
     /// State of all supported CPUs.
     cpus: ArrayVec<[Cpu; MAX_CPUS]>,
+
+    /// (id, index) pairs sorted by CPU ID, built once at boot, so id lookup
+    /// is a binary search instead of a linear scan of the array — cpu_find
+    /// runs on every PSCI CPU_ON and affinity query, often with interrupts
+    /// disabled.
+    sorted_ids: ArrayVec<[(cpu_id_t, u8); MAX_CPUS]>,
 }
 
 impl CpuManager {
     pub fn new(
         cpu_ids: &[cpu_id_t],
         boot_cpu_id: cpu_id_t,
-        stacks: &[[u8; STACK_SIZE]; MAX_CPUS],
+        stacks: &[[u8; STACK_GUARD_SIZE + STACK_SIZE]; MAX_CPUS],
     ) -> Self {
         let mut cpus: ArrayVec<[Cpu; MAX_CPUS]> = ArrayVec::new();
 
         // Initialize boot CPU.
         let boot_stack = stacks[0].as_ptr() as usize;
-        cpus.push(Cpu::new(boot_cpu_id, boot_stack + STACK_SIZE, true));
+        cpus.push(Cpu::new(
+            boot_cpu_id,
+            boot_stack + STACK_GUARD_SIZE + STACK_SIZE,
+            true,
+        ));
 
         // TODO(HfO2): Ask hafnium-discuss about zero or multiple boot CPU IDs
         // and the reason why Hafnium initializes pCPUs in reverse order. If it
@@ -431,12 +783,22 @@ impl CpuManager {
         for (cpu_id, stack) in cpu_ids.zip(stacks) {
             cpus.push(Cpu::new(
                 *cpu_id,
-                stack.as_ptr() as usize + STACK_SIZE,
+                stack.as_ptr() as usize + STACK_GUARD_SIZE + STACK_SIZE,
                 false,
             ));
         }
 
-        Self { cpus }
+        // Build the sorted id index once.
+        let mut sorted_ids: ArrayVec<[(cpu_id_t, u8); MAX_CPUS]> = ArrayVec::new();
+        for (i, cpu) in cpus.iter().enumerate() {
+            let pos = sorted_ids
+                .iter()
+                .position(|&(id, _)| id > cpu.id)
+                .unwrap_or_else(|| sorted_ids.len());
+            sorted_ids.insert(pos, (cpu.id, i as u8));
+        }
+
+        Self { cpus, sorted_ids }
     }
 
     pub fn index_of(&self, c: *const Cpu) -> usize {
@@ -447,6 +809,7 @@ impl CpuManager {
         let mut is_on = c.is_on.lock();
         let prev = *is_on;
         *is_on = true;
+        c.online.store(true, Ordering::Release);
 
         if !prev {
             let vm = vm_manager.get_primary();
@@ -458,8 +821,16 @@ impl CpuManager {
         prev
     }
 
+    /// The hardware ID of the CPU at the given index.
+    pub fn id_of_index(&self, index: usize) -> Option<cpu_id_t> {
+        self.cpus.get(index).map(|cpu| cpu.id)
+    }
+
     pub fn lookup(&self, id: cpu_id_t) -> Option<&Cpu> {
-        self.cpus.iter().find(|cpu| cpu.id == id)
+        self.sorted_ids
+            .binary_search_by_key(&id, |&(id, _)| id)
+            .ok()
+            .map(|pos| &self.cpus[self.sorted_ids[pos].1 as usize])
     }
 
     // TODO(HfO2): strange name...  boot_cpu itself looks suspicious...
@@ -485,9 +856,24 @@ pub unsafe extern "C" fn cpu_on(c: *const Cpu, entry: ipaddr_t, arg: uintreg_t)
 #[no_mangle]
 pub unsafe extern "C" fn cpu_off(c: *mut Cpu) {
     *(*c).is_on.lock() = false;
+    (*c).online.store(false, Ordering::Release);
+}
+
+/// Lock-free read of a CPU's online state, for the AFFINITY_INFO poll loop:
+/// one acquire load, no lock acquisition.
+#[no_mangle]
+pub unsafe extern "C" fn cpu_is_on_lockfree(c: *const Cpu) -> bool {
+    (*c).online.load(Ordering::Acquire)
 }
 
 /// Searches for a CPU based on its id.
+/// Returns the hardware ID of the CPU at the given index, or 0 when out of
+/// range; for the watchdog's cross-CPU kick.
+#[no_mangle]
+pub extern "C" fn cpu_id_of_index(index: usize) -> cpu_id_t {
+    hypervisor().cpu_manager.id_of_index(index).unwrap_or(0)
+}
+
 #[no_mangle]
 pub extern "C" fn cpu_find(id: cpu_id_t) -> *const Cpu {
     hypervisor()
@@ -509,7 +895,7 @@ pub unsafe extern "C" fn vcpu_lock(vcpu: *const VCpu) -> VCpuExecutionLocked {
 pub unsafe extern "C" fn vcpu_try_lock(vcpu: *mut VCpu, locked: *mut VCpuExecutionLocked) -> bool {
     (*vcpu)
         .inner
-        .try_lock()
+        .try_lock_bounded(VCPU_LOCK_SPIN_WAITS)
         .map(|guard| {
             mem::forget(guard);
             ptr::write(locked, VCpuExecutionLocked::from_raw(vcpu));
@@ -555,9 +941,28 @@ pub unsafe extern "C" fn vcpu_get_interrupts(vcpu: *const VCpu) -> *mut Interrup
     (*vcpu).interrupts.get_mut_unchecked()
 }
 
+/// Pops the next enabled-and-pending interrupt of the given vCPU for direct
+/// list-register refill, or HF_INVALID_INTID when none is deliverable.
+#[no_mangle]
+pub unsafe extern "C" fn vcpu_interrupt_pop(vcpu: *const VCpu) -> intid_t {
+    let mut interrupts = (*vcpu).interrupts.lock();
+    (*vcpu).remote_pending.drain(&mut interrupts);
+    interrupts.get()
+}
+
+/// Moves an interrupt reclaimed from a GICv3 list register back to the
+/// software pending state, so it is delivered again the next time the vCPU
+/// runs.
+#[no_mangle]
+pub unsafe extern "C" fn vcpu_interrupt_repend(vcpu: *const VCpu, intid: intid_t) {
+    let _ = (*vcpu).interrupts.lock().inject(intid);
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn vcpu_is_interrupted(vcpu: *const VCpu) -> bool {
-    (*vcpu).interrupts.lock().is_interrupted()
+    let mut interrupts = (*vcpu).interrupts.lock();
+    (*vcpu).remote_pending.drain(&mut interrupts);
+    interrupts.is_interrupted()
 }
 
 /// Check whether the given vcpu_inner is an off state, for the purpose of
@@ -592,17 +997,115 @@ pub unsafe extern "C" fn vcpu_secondary_reset_and_start(
     let mut state = vcpu.inner.lock();
     let vcpu_was_off = state.is_off();
     if vcpu_was_off {
+        // Publish any image bytes loaded for this VM to the instruction
+        // caches, once, at first start.
+        if vm.pending_exec_sync.swap(false, Ordering::SeqCst) {
+            arch_mm_sync_icache();
+        }
+
         // Set vCPU registers to a clean state ready for boot. As this
         // is a secondary which can migrate between pCPUs, the ID of the
         // vCPU is defined as the index and does not match the ID of the
-        // pCPU it is running on.
-        state.regs.reset(false, vm, cpu_id_t::from(vcpu.index()));
+        // pCPU it is running on. The full reset is skipped when a pre-warmed
+        // context was prepared when the vCPU was turned off.
+        if !state.prewarmed {
+            state.regs.reset(false, vm, cpu_id_t::from(vcpu.index()));
+        }
+        state.prewarmed = false;
         state.on(entry, arg);
     }
 
     vcpu_was_off
 }
 
+/// Layout of the per-vCPU telemetry page shared read-only with the guest.
+/// Keep in sync with struct hf_vcpu_telemetry in inc/vmapi/hf/types.h.
+#[repr(C)]
+pub struct VCpuTelemetry {
+    pub run_cycles: u64,
+    pub steal_cycles: u64,
+    pub preemptions: u64,
+}
+
+/// Adds cycles consumed on a physical CPU to the vCPU's account and stamps
+/// the switch-out for steal accounting; a vCPU leaving in the ready state was
+/// preempted. Called from the world-switch path while the registers are
+/// still owned by this CPU.
+#[no_mangle]
+pub unsafe extern "C" fn vcpu_add_cycles(vcpu: *const VCpu, cycles: u64) {
+    extern "C" {
+        fn arch_cpu_cycle_count() -> u64;
+    }
+
+    let inner = (*vcpu).inner.get_mut_unchecked();
+    inner.consumed_cycles += cycles;
+    inner.deactivated_at = arch_cpu_cycle_count();
+    if inner.state == VCpuStatus::Ready {
+        inner.preemptions += 1;
+    }
+
+    if !inner.telem_page.is_null() {
+        ptr::write_volatile(&mut (*inner.telem_page).run_cycles, inner.consumed_cycles);
+        ptr::write_volatile(&mut (*inner.telem_page).preemptions, inner.preemptions);
+    }
+}
+
+/// Accounts the time a ready vCPU spent off-CPU as steal and publishes it.
+/// Folds interrupts posted by other physical CPUs into the pending state.
+/// Called on the trap paths of the owning CPU.
+#[no_mangle]
+pub unsafe extern "C" fn vcpu_drain_remote_intids(vcpu: *const VCpu) {
+    if (*vcpu).remote_pending.any.load(Ordering::Relaxed) == 0 {
+        return;
+    }
+
+    let mut interrupts = (*vcpu).interrupts.lock();
+    (*vcpu).remote_pending.drain(&mut interrupts);
+}
+
+/// Called when the vCPU is switched back in.
+#[no_mangle]
+pub unsafe extern "C" fn vcpu_record_switch_in(vcpu: *const VCpu) {
+    extern "C" {
+        fn arch_cpu_cycle_count() -> u64;
+    }
+
+    let inner = (*vcpu).inner.get_mut_unchecked();
+    if inner.state == VCpuStatus::Ready && inner.deactivated_at != 0 {
+        inner.steal_cycles = inner
+            .steal_cycles
+            .wrapping_add(arch_cpu_cycle_count().wrapping_sub(inner.deactivated_at));
+    }
+    inner.deactivated_at = 0;
+
+    if !inner.telem_page.is_null() {
+        ptr::write_volatile(&mut (*inner.telem_page).steal_cycles, inner.steal_cycles);
+    }
+}
+
+/// Dispatches a trapped data abort with valid syndrome information to the
+/// VM's emulated MMIO regions, before any generic fault handling. Returns
+/// true if a handler emulated the access and the faulting instruction should
+/// be skipped.
+#[no_mangle]
+pub unsafe extern "C" fn vcpu_mmio_dispatch(
+    current: *const VCpu,
+    ipa: uintpaddr_t,
+    is_write: bool,
+    reg: u8,
+    size: u8,
+) -> bool {
+    let vm = (*current).vm();
+    let handler = {
+        // Registration only happens at set-up, so the uncontended lock is
+        // cheap on the fault path.
+        let table = vm.mmio.lock();
+        some_or!(table.lookup(ipa), return false)
+    };
+
+    handler(current, ipa, is_write, reg, size)
+}
+
 /// Handles a page fault. It does so by determining if it's a legitimate or
 /// spurious fault, and recovering from the latter.
 ///
@@ -617,22 +1120,73 @@ pub unsafe extern "C" fn vcpu_handle_page_fault(
     let vm = &*current.vm;
     let f = &*f;
     let mask = f.mode | Mode::INVALID;
-    let vm_inner = vm.inner.lock();
+
+    vm.telemetry.stage2_faults.fetch_add(1, Ordering::Relaxed);
 
     // Check if this is a legitimate fault, i.e., if the page table doesn't
     // allow the access attemped by the VM.
     //
     // Otherwise, this is a spurious fault, likely because another CPU is
     // updating the page table. It is responsible for issuing global TLB
-    // invalidations while holding the VM lock, so we don't need to do
-    // anything else to recover from it. (Acquiring/releasing the lock
-    // ensured that the invalidations have completed.)
-    let resume = vm_inner
-        .ptable
-        .get_mode(f.ipaddr, ipa_add(f.ipaddr, 1))
+    // invalidations before it completes, so we don't need to do anything else
+    // to recover from it. (The lock-free read waits for any concurrent update
+    // to finish, and thus for the invalidations to have completed.)
+    let resume = vm
+        .get_mode_lockfree(f.ipaddr, ipa_add(f.ipaddr, 1))
         .map(|mode| mode & mask == f.mode)
         .unwrap_or(false);
 
+    // A fault on a correctly mapped page can be a hardware access-flag
+    // fault from working-set sampling: remap the page with its own mode,
+    // which sets the access flag again, before restarting the instruction.
+    if resume {
+        if let Ok(mode) = vm.get_mode_lockfree(f.ipaddr, ipa_add(f.ipaddr, 1)) {
+            if !mode.contains(Mode::INVALID) {
+                let page = ipa_addr(f.ipaddr) & !(PAGE_SIZE - 1);
+                let _ = vm.ptable.lock().table.identity_map(
+                    pa_init(page),
+                    pa_add(pa_init(page), PAGE_SIZE),
+                    mode,
+                    &hypervisor().mpool,
+                );
+            }
+        }
+        return true;
+    }
+
+    // Lazily populated image: a first access to an unmapped page of a
+    // deferred kernel image copies that page in and resumes the vCPU.
+    if !resume && hypervisor().lazy_image_populate(vm, f.ipaddr) {
+        return true;
+    }
+
+    // Dirty tracking: a write to a page that was write-protected when
+    // tracking was enabled is logged and has its write access restored, then
+    // the faulting instruction is restarted.
+    if !resume
+        && f.mode.contains(Mode::W)
+        && vm.dirty_tracking.load(Ordering::Relaxed)
+    {
+        if let Ok(mode) = vm.get_mode_lockfree(f.ipaddr, ipa_add(f.ipaddr, 1)) {
+            if !mode.contains(Mode::W) && mode.contains(Mode::R) && mode.valid_owned_exclusive() {
+                let page = ipa_addr(f.ipaddr) & !(PAGE_SIZE - 1);
+                current.dirty_ring.lock().push(page);
+
+                let pa_begin = pa_init(page);
+                let pa_end = pa_add(pa_begin, PAGE_SIZE);
+                if vm
+                    .ptable
+                    .lock()
+                    .table
+                    .identity_map(pa_begin, pa_end, mode | Mode::W, &hypervisor().mpool)
+                    .is_ok()
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
     if !resume {
         dlog!(
             "Stage-2 page fault: pc=0x{}, vmid={}, vcpu={}, vaddr=0x{}, ipaddr=0x{}, mode=0x{}\n",
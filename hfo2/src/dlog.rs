@@ -18,11 +18,66 @@ use core::fmt;
 use core::mem;
 
 use crate::spinlock::*;
+use crate::types::*;
 
 extern "C" {
     fn plat_console_putchar(c: u8);
+    fn plat_console_drain();
+    fn plat_console_flush_sync();
+
+    /// Returns the index of the currently executing CPU, used to select the
+    /// per-CPU deferred ring.
+    fn arch_cpu_index_current() -> usize;
+}
+
+/// The capacity of each per-CPU deferred ring.
+const DLOG_RING_SIZE: usize = 2048;
+
+/// Per-CPU ring of characters waiting to be driven out to the console by the
+/// flusher. Writers only touch the ring of the executing CPU, so the lock is
+/// effectively uncontended; it only synchronizes with the flusher.
+#[repr(align(64))]
+struct Ring {
+    buffer: [u8; DLOG_RING_SIZE],
+    head: usize,
+    len: usize,
 }
 
+impl Ring {
+    const fn new() -> Self {
+        Self {
+            buffer: [0; DLOG_RING_SIZE],
+            head: 0,
+            len: 0,
+        }
+    }
+
+    fn push(&mut self, c: u8) {
+        debug_assert!(self.len < DLOG_RING_SIZE);
+        self.buffer[(self.head + self.len) % DLOG_RING_SIZE] = c;
+        self.len += 1;
+    }
+
+    /// Drives all pending characters out to the console.
+    fn drain(&mut self) {
+        while self.len > 0 {
+            unsafe {
+                plat_console_putchar(self.buffer[self.head]);
+            }
+            self.head = (self.head + 1) % DLOG_RING_SIZE;
+            self.len -= 1;
+        }
+    }
+}
+
+const RING_INIT: SpinLock<Ring> = SpinLock::new(Ring::new());
+static DLOG_RINGS: [SpinLock<Ring>; MAX_CPUS] = [RING_INIT; MAX_CPUS];
+
+/// Whether logging is deferred through the per-CPU rings. Turned on once
+/// booting has finished and turned off again on panic, so that panic output
+/// always reaches the console synchronously.
+static mut DLOG_DEFERRED: bool = false;
+
 struct Writer {}
 
 impl Writer {
@@ -50,6 +105,58 @@ macro_rules! dlog {
     ($($arg:tt)*) => ($crate::dlog::_print(format_args!($($arg)*)));
 }
 
+/// Compile-time log levels, mirroring DLOG_LEVEL_* in inc/hf/dlog.h.
+pub const DLOG_LEVEL_NONE: u32 = 0;
+pub const DLOG_LEVEL_ERROR: u32 = 1;
+pub const DLOG_LEVEL_NOTICE: u32 = 2;
+pub const DLOG_LEVEL_INFO: u32 = 3;
+pub const DLOG_LEVEL_VERBOSE: u32 = 4;
+
+/// The level compiled into this build: INFO by default, VERBOSE with the
+/// `dlog_verbose` Cargo feature. The leveled macros below compare against
+/// this constant, so calls at disabled levels fold away entirely — no
+/// argument evaluation and no code.
+#[cfg(feature = "dlog_verbose")]
+pub const DLOG_LEVEL: u32 = DLOG_LEVEL_VERBOSE;
+#[cfg(not(feature = "dlog_verbose"))]
+pub const DLOG_LEVEL: u32 = DLOG_LEVEL_INFO;
+
+#[macro_export]
+macro_rules! dlog_error {
+    ($($arg:tt)*) => {
+        if $crate::dlog::DLOG_LEVEL >= $crate::dlog::DLOG_LEVEL_ERROR {
+            dlog!($($arg)*);
+        }
+    };
+}
+
+#[macro_export]
+macro_rules! dlog_notice {
+    ($($arg:tt)*) => {
+        if $crate::dlog::DLOG_LEVEL >= $crate::dlog::DLOG_LEVEL_NOTICE {
+            dlog!($($arg)*);
+        }
+    };
+}
+
+#[macro_export]
+macro_rules! dlog_info {
+    ($($arg:tt)*) => {
+        if $crate::dlog::DLOG_LEVEL >= $crate::dlog::DLOG_LEVEL_INFO {
+            dlog!($($arg)*);
+        }
+    };
+}
+
+#[macro_export]
+macro_rules! dlog_verbose {
+    ($($arg:tt)*) => {
+        if $crate::dlog::DLOG_LEVEL >= $crate::dlog::DLOG_LEVEL_VERBOSE {
+            dlog!($($arg)*);
+        }
+    };
+}
+
 #[doc(hidden)]
 pub fn _print(args: fmt::Arguments) {
     use core::fmt::Write;
@@ -90,5 +197,57 @@ pub static mut dlog_buffer: [u8; DLOG_BUFFER_SIZE] = [0; DLOG_BUFFER_SIZE];
 pub unsafe extern "C" fn dlog_putchar(c: u8) {
     dlog_buffer[dlog_buffer_offset] = c;
     dlog_buffer_offset = (dlog_buffer_offset + 1) % DLOG_BUFFER_SIZE;
-    plat_console_putchar(c);
+
+    if DLOG_DEFERRED {
+        let mut ring = DLOG_RINGS[arch_cpu_index_current()].lock();
+
+        // Never drop characters: a full ring is drained inline, degrading to
+        // the synchronous behaviour under sustained logging.
+        if ring.len == DLOG_RING_SIZE {
+            ring.drain();
+        }
+
+        ring.push(c);
+    } else {
+        plat_console_putchar(c);
+    }
+}
+
+/// Stores a character into the in-memory log buffer without driving it out to
+/// the console. Binary log records are emitted through this, as they are only
+/// meaningful to an offline decoder reading the buffer.
+#[no_mangle]
+pub unsafe extern "C" fn dlog_putchar_raw(c: u8) {
+    dlog_buffer[dlog_buffer_offset] = c;
+    dlog_buffer_offset = (dlog_buffer_offset + 1) % DLOG_BUFFER_SIZE;
+}
+
+/// Defers console output through the per-CPU rings, keeping log calls on hot
+/// paths down to buffer stores. Until this is called (and again after a
+/// panic), every character is driven out synchronously.
+pub unsafe fn dlog_enable_deferred() {
+    DLOG_DEFERRED = true;
+}
+
+/// Drives all pending deferred output out to the console. Called from
+/// scheduling slack (yield, wait-for-interrupt) and on panic.
+#[no_mangle]
+pub unsafe extern "C" fn dlog_flush() {
+    for ring in DLOG_RINGS.iter() {
+        ring.lock().drain();
+    }
+
+    // Also push whatever fits into the console hardware FIFO.
+    plat_console_drain();
+}
+
+/// Reverts to synchronous logging and flushes everything pending; used on
+/// panic so the backtrace is never stuck in a ring.
+pub unsafe fn dlog_flush_and_disable() {
+    DLOG_DEFERRED = false;
+    dlog_flush();
+
+    // Drive everything out of the console's TX ring synchronously and revert
+    // it to unbuffered output.
+    plat_console_flush_sync();
 }
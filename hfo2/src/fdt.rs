@@ -20,6 +20,7 @@ use core::ptr;
 use core::slice;
 use core::str;
 
+use crate::spinlock::SpinLock;
 use crate::std::*;
 
 use scopeguard::guard;
@@ -117,6 +118,85 @@ impl TryFrom<u32> for FdtToken {
     }
 }
 
+/// Number of slots in the devicetree node index. Must be a power of two.
+const FDT_INDEX_SIZE: usize = 128;
+
+/// One-pass index over the devicetree, mapping (parent node, child name) to
+/// the child's position in the structure block, so repeated `find_child`
+/// lookups during boot don't rescan the blob. Lookups are by a 64-bit hash of
+/// the full key; the blob is boot-controlled input, so hash collisions are
+/// not an attack surface, and an overflowing table just falls back to the
+/// linear scan.
+struct FdtIndex {
+    /// Open-addressed slots of (key hash, child offset + 1); 0 in the second
+    /// element marks an empty slot.
+    slots: [(u64, u32); FDT_INDEX_SIZE],
+
+    /// The structure block this index describes, so a stale index is never
+    /// consulted for another blob.
+    data_base: usize,
+
+    /// Whether insertions were dropped because the table was full, in which
+    /// case a lookup miss is inconclusive.
+    overflowed: bool,
+}
+
+/// Boot-only: lives in `.boot.init`, which is unmapped and donated to the
+/// page pool once initialisation completes. The devicetree is only parsed
+/// during boot_flow_init and the boot-params patch.
+#[link_section = ".boot.init"]
+static FDT_INDEX: SpinLock<FdtIndex> = SpinLock::new(FdtIndex {
+    slots: [(0, 0); FDT_INDEX_SIZE],
+    data_base: 0,
+    overflowed: false,
+});
+
+impl FdtIndex {
+    /// FNV-1a over the parent offset and the child node name (including its
+    /// NUL terminator).
+    fn hash(parent_off: u32, name: &[u8]) -> u64 {
+        let mut h: u64 = 0xcbf2_9ce4_8422_2325;
+        for &b in parent_off.to_le_bytes().iter().chain(name.iter()) {
+            h ^= u64::from(b);
+            h = h.wrapping_mul(0x100_0000_01b3);
+        }
+        h
+    }
+
+    fn insert(&mut self, parent_off: u32, name: &[u8], child_off: u32) {
+        let hash = Self::hash(parent_off, name);
+        let mut i = hash as usize & (FDT_INDEX_SIZE - 1);
+
+        for _ in 0..FDT_INDEX_SIZE {
+            if self.slots[i].1 == 0 {
+                self.slots[i] = (hash, child_off + 1);
+                return;
+            }
+            i = (i + 1) & (FDT_INDEX_SIZE - 1);
+        }
+
+        self.overflowed = true;
+    }
+
+    fn lookup(&self, parent_off: u32, name: &[u8]) -> Option<u32> {
+        let hash = Self::hash(parent_off, name);
+        let mut i = hash as usize & (FDT_INDEX_SIZE - 1);
+
+        for _ in 0..FDT_INDEX_SIZE {
+            let (h, off) = self.slots[i];
+            if off == 0 {
+                return None;
+            }
+            if h == hash {
+                return Some(off - 1);
+            }
+            i = (i + 1) & (FDT_INDEX_SIZE - 1);
+        }
+
+        None
+    }
+}
+
 struct FdtTokenizer<'a> {
     cur: &'a [u8],
     strs: &'a [u8],
@@ -219,7 +299,11 @@ impl<'a> FdtTokenizer<'a> {
     }
 
     fn str(&mut self) -> Option<&'a [u8]> {
-        let (i, _) = self.cur.iter().enumerate().find(|(_, p)| **p == 0)?;
+        // Word-at-a-time scan for the terminator.
+        let i = unsafe { crate::std::memchr_rs(self.cur.as_ptr(), 0, self.cur.len()) };
+        if i == self.cur.len() {
+            return None;
+        }
 
         // Found the end of the string.
         let (first, rest) = self.cur.split_at(i + 1);
@@ -312,11 +396,68 @@ impl<'a> FdtNode<'a> {
 
         // TODO: Verify that it is all within the fdt.
         // TODO: Verify strings as well.
-        Some(FdtNode {
+        let root = FdtNode {
             hdr,
             data: unsafe { slice::from_raw_parts(hdr_ptr.add(data_begin), data_size) },
             strs: unsafe { slice::from_raw_parts(hdr_ptr.add(strs_begin), strs_size) },
-        })
+        };
+
+        root.build_index();
+        Some(root)
+    }
+
+    /// FNV-1a hash over the structure block, used to detect whether a cached
+    /// artefact derived from this blob is still valid.
+    pub fn content_hash(&self) -> u64 {
+        let mut h: u64 = 0xcbf2_9ce4_8422_2325;
+        for &b in self.data.iter() {
+            h ^= u64::from(b);
+            h = h.wrapping_mul(0x100_0000_01b3);
+        }
+        h
+    }
+
+    /// The address of the structure block, used as the reference point for
+    /// the node index.
+    fn data_base(&self) -> usize {
+        self.hdr as *const _ as usize + u32::from_be(self.hdr.off_dt_struct) as usize
+    }
+
+    /// Indexes all (parent, child name) pairs of the blob in a single pass,
+    /// unless this blob is the one already indexed.
+    fn build_index(&self) {
+        let base = self.data_base();
+        let mut index = FDT_INDEX.lock();
+
+        if index.data_base == base {
+            return;
+        }
+
+        index.slots = [(0, 0); FDT_INDEX_SIZE];
+        index.data_base = base;
+        index.overflowed = false;
+
+        let mut t = FdtTokenizer::new(self.data, self.strs);
+        Self::index_children(&mut t, 0, &mut index, base);
+    }
+
+    /// Indexes the children of the node whose content starts at the
+    /// tokenizer's position, recursively, leaving the tokenizer just before
+    /// the node's end token.
+    fn index_children(t: &mut FdtTokenizer, parent_off: u32, index: &mut FdtIndex, base: usize) {
+        t.skip_properties();
+
+        while let Some(name) = t.next_subnode() {
+            let child_off = (t.cur.as_ptr() as usize - base) as u32;
+            index.insert(parent_off, name, child_off);
+
+            Self::index_children(t, child_off, index, base);
+
+            if t.token_expect(FdtToken::EndNode).is_none() {
+                t.collapse();
+                return;
+            }
+        }
     }
 
     pub fn read_property(&self, name: *const u8) -> Result<&'a [u8], ()> {
@@ -352,6 +493,34 @@ impl<'a> FdtNode<'a> {
     }
 
     pub fn find_child(&mut self, child: *const u8) -> Option<()> {
+        // Consult the node index first; the linear sibling scan below is only
+        // needed when the index overflowed while being built.
+        {
+            let index = FDT_INDEX.lock();
+            let base = self.data_base();
+
+            if index.data_base == base {
+                let name = unsafe {
+                    let len = (0..).find(|i| *child.add(*i) == 0).unwrap();
+                    slice::from_raw_parts(child, len + 1)
+                };
+                let parent_off = (self.data.as_ptr() as usize - base) as u32;
+
+                if let Some(off) = index.lookup(parent_off, name) {
+                    let end = self.data.as_ptr() as usize + self.data.len();
+                    let begin = base + off as usize;
+                    self.data = unsafe {
+                        slice::from_raw_parts(begin as *const u8, end - begin)
+                    };
+                    return Some(());
+                }
+
+                if !index.overflowed {
+                    return None;
+                }
+            }
+        }
+
         let mut t = FdtTokenizer::new(self.data, self.strs);
         t.skip_properties();
 
@@ -458,6 +627,30 @@ impl FdtHeader {
         (*e).size = len.to_be();
     }
 
+    /// Adds several memory reservations in one pass: the tail of the blob is
+    /// shifted once by the combined size and the header offsets fixed up
+    /// once, instead of a whole-blob move per reservation.
+    pub unsafe fn add_mem_reservations(&mut self, entries: &[(u64, u64)]) {
+        let shift = entries.len() * mem::size_of::<FdtReserveEntry>();
+        let begin =
+            (self as *const _ as usize as *mut u8).add(u32::from_be(self.off_mem_rsvmap) as usize);
+        let old_size = (u32::from_be(self.totalsize) - u32::from_be(self.off_mem_rsvmap)) as usize;
+
+        self.totalsize = (u32::from_be(self.totalsize) + shift as u32).to_be();
+        self.off_dt_struct = (u32::from_be(self.off_dt_struct) + shift as u32).to_be();
+        self.off_dt_strings = (u32::from_be(self.off_dt_strings) + shift as u32).to_be();
+
+        ptr::copy(begin, begin.add(shift), old_size);
+
+        #[allow(clippy::cast_ptr_alignment)]
+        let mut e = begin as *mut FdtReserveEntry;
+        for &(addr, len) in entries {
+            (*e).address = addr.to_be();
+            (*e).size = len.to_be();
+            e = e.add(1);
+        }
+    }
+
     pub fn total_size(&self) -> u32 {
         u32::from_be(self.totalsize)
     }
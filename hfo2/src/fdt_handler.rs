@@ -18,6 +18,8 @@ use core::mem;
 use core::ptr;
 use core::slice;
 
+use arrayvec::ArrayVec;
+
 use crate::addr::*;
 use crate::arch::*;
 use crate::boot_params::*;
@@ -371,28 +373,30 @@ pub unsafe fn patch(
         return Err(());
     }
 
-    // Patch FDT to reserve hypervisor memory so the primary VM doesn't try to
-    // use it.
-    (*fdt).add_mem_reservation(
+    // Collect every reservation — the hypervisor image, so the primary VM
+    // doesn't try to use it, plus the ranges carved out for secondary VMs —
+    // into one plan and apply it with a single pass over the blob and a
+    // single header fix-up.
+    let mut reservations: ArrayVec<[(u64, u64); 3 + MAX_MEM_RANGES]> = ArrayVec::new();
+    reservations.push((
         pa_addr(layout_text_begin()) as u64,
         pa_difference(layout_text_begin(), layout_text_end()) as u64,
-    );
-    (*fdt).add_mem_reservation(
+    ));
+    reservations.push((
         pa_addr(layout_rodata_begin()) as u64,
         pa_difference(layout_rodata_begin(), layout_rodata_end()) as u64,
-    );
-    (*fdt).add_mem_reservation(
+    ));
+    reservations.push((
         pa_addr(layout_data_begin()) as u64,
         pa_difference(layout_data_begin(), layout_data_end()) as u64,
-    );
-
-    // Patch FDT to reserve memory for secondary VMs.
+    ));
     for i in 0..p.reserved_ranges_count {
-        (*fdt).add_mem_reservation(
+        reservations.push((
             pa_addr(p.reserved_ranges[i].begin) as u64,
             pa_addr(p.reserved_ranges[i].end) as u64 - pa_addr(p.reserved_ranges[i].begin) as u64,
-        );
+        ));
     }
+    (*fdt).add_mem_reservations(&reservations);
 
     let stage1_ptable = ScopeGuard::into_inner(stage1_ptable);
     if stage1_ptable
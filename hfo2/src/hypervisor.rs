@@ -14,10 +14,12 @@
  * limitations under the License.
  */
 
+use core::cmp;
 use core::mem;
 use core::ops::Deref;
 use core::ptr;
-use core::sync::atomic::Ordering;
+use core::slice;
+use core::sync::atomic::{spin_loop_hint, AtomicU64, Ordering};
 
 use crate::abi::*;
 use crate::addr::*;
@@ -34,11 +36,141 @@ use crate::types::*;
 use crate::utils::*;
 use crate::vm::*;
 
+/// The number of memory shares that can be tracked for cheap revocation at
+/// any one time.
+const MAX_SHARE_STATES: usize = 32;
+
+/// Bookkeeping for one active memory share, recorded when the share is
+/// established so revoking it is a table lookup plus a batched mapping
+/// restore instead of a full validation pass.
+#[derive(Clone, Copy)]
+struct ShareState {
+    handle: spci_memory_handle_t,
+    from: spci_vm_id_t,
+    to: spci_vm_id_t,
+    begin: usize,
+    size: usize,
+    orig_from_mode: Mode,
+    orig_to_mode: Mode,
+
+    /// The modes being applied by the share, kept so a preempted operation
+    /// can be continued by a later call.
+    from_mode: Mode,
+    to_mode: Mode,
+
+    /// How far (in bytes from `begin`) the share has progressed. The
+    /// operation is complete once the cursor reaches `size`; until then the
+    /// caller keeps re-trapping to continue it.
+    cursor: usize,
+}
+
+pub struct ShareStates {
+    states: [Option<ShareState>; MAX_SHARE_STATES],
+    next_handle: spci_memory_handle_t,
+}
+
+impl ShareStates {
+    pub fn new() -> Self {
+        Self {
+            states: [None; MAX_SHARE_STATES],
+            // Handle 0 is never allocated, so callers can use it as "none".
+            next_handle: 1,
+        }
+    }
+
+    /// Records a new share, returning its slot, or Err if the table is
+    /// full.
+    fn allocate(&mut self, mut state: ShareState) -> Result<usize, ()> {
+        let slot = self.states.iter().position(|s| s.is_none()).ok_or(())?;
+        state.handle = self.next_handle;
+        self.next_handle = self.next_handle.checked_add(1).unwrap_or(1);
+        self.states[slot] = Some(state);
+        Ok(slot)
+    }
+
+    /// Finds the in-progress share matching the caller's arguments, so a
+    /// preempted operation resumes where it left off.
+    fn find_in_progress(
+        &self,
+        from: spci_vm_id_t,
+        to: spci_vm_id_t,
+        begin: usize,
+        size: usize,
+    ) -> Option<(usize, ShareState)> {
+        self.states.iter().enumerate().find_map(|(i, s)| match s {
+            Some(state)
+                if state.cursor < state.size
+                    && state.from == from
+                    && state.to == to
+                    && state.begin == begin
+                    && state.size == size =>
+            {
+                Some((i, *state))
+            }
+            _ => None,
+        })
+    }
+
+    /// Removes and returns the share with the given handle.
+    fn take(&mut self, handle: spci_memory_handle_t) -> Option<ShareState> {
+        self.states
+            .iter_mut()
+            .find(|s| s.map(|state| state.handle) == Some(handle))?
+            .take()
+    }
+}
+
+/// The number of regions that can be pending scrub at any one time.
+const SCRUB_QUEUE_SIZE: usize = 8;
+
+/// A region waiting to be scrubbed before being handed back to its owner.
+#[derive(Clone, Copy)]
+struct ScrubEntry {
+    vm: spci_vm_id_t,
+    begin: usize,
+    end: usize,
+    mode: Mode,
+}
+
+/// Queue of regions whose owner mapping is withheld until the memory has been
+/// zeroed. Revocation enqueues here and returns immediately; the scrubbing is
+/// done from idle cycles, one region at a time.
+pub struct ScrubQueue {
+    entries: [Option<ScrubEntry>; SCRUB_QUEUE_SIZE],
+}
+
+impl ScrubQueue {
+    pub fn new() -> Self {
+        Self {
+            entries: [None; SCRUB_QUEUE_SIZE],
+        }
+    }
+}
+
+/// Bounds for the adaptive halt-polling window of message receivers.
+const HALT_POLL_MIN_CYCLES: u32 = 256;
+const HALT_POLL_MAX_CYCLES: u32 = 65536;
+
+extern "C" {
+    /// Free-running cycle counter, for halt-poll windows.
+    fn arch_cpu_cycle_count() -> u64;
+
+    /// Converts a duration in nanoseconds to counter ticks.
+    fn arch_timer_ticks_from_ns(ns: u64) -> u64;
+}
+
+/// Per-CPU idle residency (cycles spent in the WFE idle wait) and wakeup
+/// counts of the scheduling tier, read through HF_IDLE_RESIDENCY.
+pub static IDLE_CYCLES: [AtomicU64; MAX_CPUS] = [AtomicU64::new(0); MAX_CPUS];
+pub static IDLE_WAKES: [AtomicU64; MAX_CPUS] = [AtomicU64::new(0); MAX_CPUS];
+
 pub struct Hypervisor {
     pub mpool: MPool,
     pub memory_manager: MemoryManager,
     pub cpu_manager: CpuManager,
     pub vm_manager: VmManager,
+    pub share_states: SpinLock<ShareStates>,
+    pub scrub_queue: SpinLock<ScrubQueue>,
 }
 
 impl Hypervisor {
@@ -54,6 +186,61 @@ impl Hypervisor {
             memory_manager,
             cpu_manager,
             vm_manager,
+            share_states: SpinLock::new(ShareStates::new()),
+            scrub_queue: SpinLock::new(ScrubQueue::new()),
+        }
+    }
+
+    /// Queues a region for deferred scrubbing; the owner's mapping stays
+    /// withheld until the scrub has run. Fails when the queue is full, in
+    /// which case the caller must scrub synchronously.
+    fn scrub_enqueue(
+        &self,
+        vm: spci_vm_id_t,
+        begin: usize,
+        end: usize,
+        mode: Mode,
+    ) -> Result<(), ()> {
+        let mut queue = self.scrub_queue.lock();
+        let slot = queue.entries.iter_mut().find(|e| e.is_none()).ok_or(())?;
+        *slot = Some(ScrubEntry {
+            vm,
+            begin,
+            end,
+            mode,
+        });
+        Ok(())
+    }
+
+    /// Scrubs one pending region, if any, and hands it back to its owner by
+    /// restoring the withheld mapping. Called from idle cycles so the
+    /// revocation hypercall itself returns immediately.
+    pub fn scrub_drain(&self) {
+        let entry = {
+            let mut queue = self.scrub_queue.lock();
+            let slot = queue.entries.iter_mut().find(|e| e.is_some());
+            match slot {
+                Some(slot) => some_or!(slot.take(), return),
+                None => return,
+            }
+        };
+
+        let begin = pa_init(entry.begin);
+        let end = pa_init(entry.end);
+
+        // Zeroing goes through memset, which uses dc zva block zeroing for
+        // large runs.
+        if self.clear_memory(begin, end, &self.mpool).is_err() {
+            return;
+        }
+
+        if let Some(vm) = self.vm_manager.get(entry.vm) {
+            let local_page_pool = MPool::new_with_fallback(&self.mpool);
+            let _ = vm
+                .ptable
+                .lock()
+                .table
+                .identity_map(begin, end, entry.mode, &local_page_pool);
         }
     }
 
@@ -61,12 +248,201 @@ impl Hypervisor {
     ///
     /// This triggers the scheduling logic to run. Run in the context of secondary VM to cause
     /// HF_VCPU_RUN to return and the primary VM to regain control of the cpu.
+    /// In-hypervisor scheduling tier: when the current vCPU stops running,
+    /// switch straight to the next ready vCPU queued on this physical CPU,
+    /// skipping the round trip through the primary scheduler. Returns None
+    /// when the queue is empty (or a queued vCPU is no longer runnable), in
+    /// which case control falls out to the primary as usual.
+    #[cfg(feature = "sched_tier")]
+    fn run_queue_next(&self, current: &mut VCpuExecutionLocked) -> Option<&VCpu> {
+        let cpu = current.get_inner().cpu;
+
+        loop {
+            let vcpu = unsafe { (*cpu).run_queue.lock().pop()? };
+            let vcpu = unsafe { &*vcpu };
+
+            let mut vcpu_inner = ok_or!(vcpu.inner.try_lock(), continue);
+            if vcpu_inner.state != VCpuStatus::Ready {
+                continue;
+            }
+
+            vcpu_inner.cpu = cpu;
+            // Keep holding the execution lock: the vCPU is about to run on
+            // this physical CPU.
+            mem::forget(vcpu_inner);
+            return Some(unsafe { &*(vcpu as *const VCpu) });
+        }
+    }
+
+    /// Bounded WFE idle wait for the scheduling tier: with an empty run
+    /// queue, the core waits on the queue word under WFE — woken by the
+    /// sev an enqueuer's lock release generates, by the kick IPI, or at the
+    /// latest by the ARM event stream armed as a bounded-latency backstop —
+    /// instead of burning a world switch into the primary just to be told
+    /// there is nothing to do. The wait is capped at a few events so the
+    /// primary scheduler still sees the core promptly when real policy
+    /// decisions are needed. Idle residency and wake counts are recorded
+    /// per CPU and exported through HF_IDLE_RESIDENCY, so wakeup latency
+    /// can be checked against its budget.
+    #[cfg(feature = "sched_tier")]
+    fn run_queue_idle(&self, current: &mut VCpuExecutionLocked) -> Option<&VCpu> {
+        extern "C" {
+            fn arch_cpu_wfe();
+            fn arch_cpu_event_stream_enable();
+            fn arch_cpu_event_stream_disable();
+            fn arch_cpu_cycle_count() -> u64;
+        }
+
+        const IDLE_MAX_EVENTS: usize = 8;
+
+        let cpu = current.get_inner().cpu;
+        let index = self.cpu_manager.index_of(cpu);
+        let begin = unsafe { arch_cpu_cycle_count() };
+        let mut found = None;
+
+        unsafe { arch_cpu_event_stream_enable() };
+
+        for _ in 0..IDLE_MAX_EVENTS {
+            if let Some(next) = self.run_queue_next(current) {
+                found = Some(next);
+                break;
+            }
+
+            unsafe { arch_cpu_wfe() };
+        }
+
+        unsafe { arch_cpu_event_stream_disable() };
+
+        IDLE_CYCLES[index].fetch_add(
+            unsafe { arch_cpu_cycle_count() } - begin,
+            Ordering::Relaxed,
+        );
+        IDLE_WAKES[index].fetch_add(u64::from(found.is_some()), Ordering::Relaxed);
+
+        found
+    }
+
+    /// Queues a ready vCPU on the current physical CPU's run queue. Fails if
+    /// the queue is full; the caller then falls back to telling the primary
+    /// scheduler.
+    #[cfg(feature = "sched_tier")]
+    fn run_queue_push(&self, current: &VCpuExecutionLocked, vcpu: &VCpu) -> Result<(), ()> {
+        let cpu = current.get_inner().cpu;
+
+        // Respect the manifest placement policy: a vCPU whose affinity mask
+        // excludes this physical CPU is left to the primary scheduler, which
+        // enforces the mask when handing out cycles.
+        let affinity = vcpu.vm().cpu_affinity;
+        if affinity != 0 {
+            let index = self.cpu_manager.index_of(cpu);
+            if affinity & (1 << index) == 0 {
+                return Err(());
+            }
+        }
+
+        unsafe { (*cpu).run_queue.lock().push(vcpu) }
+    }
+
+    /// Clones a template VM for fast scale-out: creates a new VM with the
+    /// same vCPU count, vCPUs in the OFF state, and the template's kernel
+    /// image region mapped read-only executable into it — unowned and
+    /// shared, exactly like an execute-in-place image, so the text costs no
+    /// copies and no incremental memory. Identity mapping rules out private
+    /// copy-on-write pages (a clone's copy would need the template's own
+    /// physical addresses), so writable state is instead donated to the
+    /// clone by the primary through the existing share hypercalls before it
+    /// starts the first vCPU. Returns the new VM's id.
+    ///
+    /// With a nonzero `entry`, vCPU 0 is reset and made ready to boot there
+    /// with `arg` in x0 — the donate-then-run flow needs the entry in the
+    /// ABI since nothing else can set it after creation; with `entry` zero
+    /// every vCPU stays OFF.
+    ///
+    /// Runtime VM creation is serialized on the clone lock; concurrent
+    /// readers of the VM manager only ever index the initialized prefix,
+    /// which `new_vm` publishes with a release fence.
+    pub fn vm_clone(
+        &self,
+        template_id: spci_vm_id_t,
+        entry: uintreg_t,
+        arg: uintreg_t,
+        current: &VCpuExecutionLocked,
+    ) -> i64 {
+        static CLONE_LOCK: SpinLock<()> = SpinLock::new(());
+
+        if current.vm().id != HF_PRIMARY_VM_ID {
+            return -1;
+        }
+
+        let template = some_or!(self.vm_manager.get(template_id), return -1);
+        if template.id == HF_PRIMARY_VM_ID {
+            return -1;
+        }
+
+        let image = template.ptable.lock().lazy_image.as_ref().map(|i| (i.begin, i.end));
+
+        let _guard = CLONE_LOCK.lock();
+
+        // The manager is only ever grown, under the clone lock; the shared
+        // reference is promoted for the append alone.
+        #[allow(clippy::cast_ref_to_mut)]
+        let vm_manager =
+            unsafe { &mut *(&self.vm_manager as *const VmManager as *mut VmManager) };
+
+        let vcpu_count = template.vcpus.len() as spci_vcpu_count_t;
+        let vm = some_or!(vm_manager.new_vm(vcpu_count, &self.mpool), return -1);
+
+        if let Some((begin, end)) = image {
+            if vm
+                .ptable
+                .get_mut()
+                .table
+                .identity_map(
+                    pa_init(begin),
+                    pa_init(end),
+                    Mode::R | Mode::X | Mode::UNOWNED | Mode::SHARED,
+                    &self.mpool,
+                )
+                .is_err()
+            {
+                return -1;
+            }
+        }
+
+        let id = vm.id;
+
+        if entry != 0 {
+            unsafe {
+                vcpu_secondary_reset_and_start(&mut vm.vcpus[0], ipa_init(entry as usize), arg);
+            }
+        }
+
+        i64::from(id)
+    }
+
     fn switch_to_primary(
         &self,
         current: &mut VCpuExecutionLocked,
         mut primary_ret: HfVCpuRunReturn,
         secondary_state: VCpuStatus,
     ) -> &VCpu {
+        // If the current vCPU is blocking and another ready vCPU is queued on
+        // this CPU, run that one instead of bouncing through the primary. The
+        // primary eventually sees the run return of whichever vCPU blocks
+        // last with an empty queue.
+        #[cfg(feature = "sched_tier")]
+        {
+            if secondary_state != VCpuStatus::Ready {
+                if let Some(next) = self
+                    .run_queue_next(current)
+                    .or_else(|| self.run_queue_idle(current))
+                {
+                    current.get_inner_mut().state = secondary_state;
+                    return next;
+                }
+            }
+        }
+
         let primary = self.vm_manager.get_primary();
         let next = &primary.vcpus[self.cpu_manager.index_of(current.get_inner().cpu)];
 
@@ -75,11 +451,15 @@ impl Hypervisor {
         match &mut primary_ret {
             HfVCpuRunReturn::WaitForInterrupt { ns } | HfVCpuRunReturn::WaitForMessage { ns } => {
                 // TODO(HfO2): a module for arch_timer?
-                *ns = if unsafe { arch_timer_enabled_current() } {
+                let timer_ns = if unsafe { arch_timer_enabled_current() } {
                     unsafe { arch_timer_remaining_ns_current() }
                 } else {
                     HF_SLEEP_INDEFINITE
                 };
+
+                // Keep an explicit (e.g. receive-timeout) deadline if it is
+                // sooner than the guest timer.
+                *ns = cmp::min(*ns, timer_ns);
             }
             _ => {}
         }
@@ -108,6 +488,13 @@ impl Hypervisor {
 
     /// Puts the current vcpu in wait for interrupt mode, and returns to the primary vm.
     pub fn wait_for_interrupt(&self, current: &mut VCpuExecutionLocked) -> &VCpu {
+        // The vCPU is going idle, so drive out any deferred log output and
+        // advance the scrub queue.
+        unsafe {
+            crate::dlog::dlog_flush();
+        }
+        self.scrub_drain();
+
         self.switch_to_primary(
             current,
             HfVCpuRunReturn::WaitForInterrupt {
@@ -124,6 +511,17 @@ impl Hypervisor {
             arch_timer_disable_current();
         }
 
+        // Pre-warm the context for the next CPU_ON: with the full register
+        // reset done now, the power-on path only patches the entry point and
+        // argument.
+        if current.vm().id != HF_PRIMARY_VM_ID {
+            let vm = unsafe { &*(current.vm() as *const Vm) };
+            let vcpu_id = cpu_id_t::from(current.index());
+            let inner = current.get_inner_mut();
+            inner.regs.reset(false, vm, vcpu_id);
+            inner.prewarmed = true;
+        }
+
         self.switch_to_primary(
             current,
             HfVCpuRunReturn::WaitForInterrupt {
@@ -135,18 +533,56 @@ impl Hypervisor {
 
     /// Returns to the primary vm to allow this cpu to be used for other tasks as the vcpu does not
     /// have work to do at this moment. The current vcpu is masked as ready to be scheduled again.
-    pub fn spci_yield(&self, current: &mut VCpuExecutionLocked) -> Option<&VCpu> {
+    /// `deadline_ns` (0 for none) tells the scheduler when re-running the
+    /// vCPU becomes useful again.
+    pub fn spci_yield(
+        &self,
+        deadline_ns: u64,
+        current: &mut VCpuExecutionLocked,
+    ) -> Option<&VCpu> {
         if current.vm().id == HF_PRIMARY_VM_ID {
             // Noop on the primary as it makes the scheduling decisions.
             return None;
         }
 
-        Some(self.switch_to_primary(current, HfVCpuRunReturn::Yield, VCpuStatus::Ready))
+        // The vCPU has no work to do right now, so opportunistically advance
+        // the incremental defrag of its VM's page table. Each step does a
+        // small bounded amount of work, and try_lock makes sure the yield is
+        // never blocked on a concurrent page table operation.
+        if let Ok(mut vm_ptable) = current.vm().ptable.try_lock() {
+            vm_ptable.table.defrag_incremental(&self.mpool);
+            vm_ptable.trim_pool();
+            current
+                .vm()
+                .telemetry
+                .defrag_passes
+                .fetch_add(1, Ordering::Relaxed);
+        }
+
+        // Also drive out any deferred log output and advance the scrub
+        // queue while there is slack.
+        unsafe {
+            crate::dlog::dlog_flush();
+        }
+        self.scrub_drain();
+
+        Some(self.switch_to_primary(
+            current,
+            HfVCpuRunReturn::Yield { ns: deadline_ns },
+            VCpuStatus::Ready,
+        ))
     }
 
     /// Switches to the primary so that it can switch to the target, or kick tit if it is already
     /// running on a different physical CPU.
     pub fn wake_up(&self, current: &mut VCpuExecutionLocked, target_vcpu: &VCpu) -> &VCpu {
+        // With the scheduling tier, a woken vCPU is queued on this CPU so it
+        // gets cycles as soon as someone blocks, without the primary round
+        // trip; the WakeUp return below is still sent so the primary's view
+        // stays correct if the queue overflowed.
+        #[cfg(feature = "sched_tier")]
+        let _ = self.run_queue_push(current, target_vcpu);
+
         self.switch_to_primary(
             current,
             HfVCpuRunReturn::WakeUp {
@@ -213,7 +649,38 @@ impl Hypervisor {
         intid: intid_t,
         current: &mut VCpuExecutionLocked,
     ) -> (i64, Option<&VCpu>) {
-        if target_vcpu.interrupts.lock().inject(intid).is_ok() {
+        // If the target is the vCPU running on this CPU and its interrupt is
+        // enabled, try to place it straight into a GICv3 list register: the
+        // guest then takes it through its GIC CPU interface with no
+        // wake-up bounce and no query hypercall. Any interrupt left in the
+        // list register when the vCPU is switched out is reclaimed into the
+        // software pending state.
+        if current.deref().deref() as *const _ == target_vcpu as *const _
+            && target_vcpu.interrupts.lock().is_enabled(intid)
+            && unsafe { arch_gicv3_try_inject_current(intid) }
+        {
+            return (0, None);
+        }
+
+        // If the target vCPU is currently running on another physical CPU,
+        // don't contend on its interrupts lock from here: post the ID to its
+        // lock-free box and kick that CPU with an IPI, so the vCPU traps,
+        // drains the box and observes the interrupt immediately. A running
+        // vCPU needs no scheduling help, so this path is complete in itself.
+        if target_vcpu.inner.try_lock().is_err() {
+            let target_cpu = unsafe { target_vcpu.inner.get_unchecked() }.cpu;
+            if !target_cpu.is_null() && target_cpu != current.get_inner().cpu {
+                let _ = target_vcpu.remote_pending.post(intid);
+                unsafe {
+                    arch_cpu_kick((*target_cpu).id);
+                }
+                return (0, None);
+            }
+        }
+
+        let needs_scheduling = target_vcpu.interrupts.lock().inject(intid).is_ok();
+
+        if needs_scheduling {
             if current.vm().id == HF_PRIMARY_VM_ID {
                 // If the call came from the primary VM, let it know that it should run or kick the
                 // target vCPU.
@@ -243,7 +710,10 @@ impl Hypervisor {
         vcpu: &VCpu,
         run_ret: HfVCpuRunReturn,
     ) -> Result<VCpuExecutionLocked, HfVCpuRunReturn> {
-        let mut vcpu_inner = vcpu.inner.try_lock().map_err(|_| {
+        // Ride out a short critical section of another pCPU with a bounded
+        // wfe wait before giving up: losing this race costs a full scheduling
+        // round trip through the primary.
+        let mut vcpu_inner = vcpu.inner.try_lock_bounded(VCPU_LOCK_SPIN_WAITS).map_err(|_| {
             // vCPU is running or prepared to run on another pCPU.
             //
             // It's ok not to return the sleep duration here because the other physical CPU that is
@@ -268,14 +738,25 @@ impl Hypervisor {
             }
 
             // A pending message allows the vCPU to run so the message can be delivered directly.
-            // The VM needs to be locked to deliver mailbox messages.
-            // The VM lock is not needed in the common case so it must only be taken when it is
-            // going to be needed. This ensures there are no inter-vCPU dependencies in the common
-            // run case meaning the sensitive context switch performance is consistent.
-            VCpuStatus::BlockedMailbox if vm.inner.lock().try_read().is_ok() => {
+            // The acknowledgement is a single CAS on the atomic mailbox state
+            // word, so no VM lock is taken at all on this path and there are
+            // no inter-vCPU dependencies in the common run case, keeping the
+            // sensitive context switch performance consistent.
+            VCpuStatus::BlockedMailbox if vm.try_read_lockfree().is_ok() => {
+                vcpu_inner.recv_deadline = 0;
                 vcpu_inner.regs.set_retval(SpciReturn::Success as uintreg_t);
             }
 
+            // A timed receive whose deadline has passed wakes with a retry
+            // status instead of sleeping on.
+            VCpuStatus::BlockedMailbox
+                if vcpu_inner.recv_deadline != 0
+                    && unsafe { arch_cpu_cycle_count() } >= vcpu_inner.recv_deadline =>
+            {
+                vcpu_inner.recv_deadline = 0;
+                vcpu_inner.regs.set_retval(SpciReturn::Retry as uintreg_t);
+            }
+
             // Allow virtual interrupts to be delivered.
             // The timer expired so allow the interrupt to be delivered.
             // The vCPU is not ready to run, return the appropriate code to the primary which
@@ -320,6 +801,22 @@ impl Hypervisor {
         vcpu_idx: spci_vcpu_index_t,
         current: &mut VCpuExecutionLocked,
     ) -> Result<VCpuExecutionLocked, HfVCpuRunReturn> {
+        /// Per-CPU cache of the last (vm, vcpu) target the primary
+        /// successfully ran, so the common re-run of the same vCPU skips VM
+        /// lookup and bounds re-validation. Each slot is only touched by its
+        /// own physical CPU.
+        #[derive(Clone, Copy)]
+        struct LastRun {
+            vm_id: spci_vm_id_t,
+            vcpu_idx: spci_vcpu_index_t,
+            vcpu: *const VCpu,
+        }
+        static mut LAST_RUN: [LastRun; MAX_CPUS] = [LastRun {
+            vm_id: 0,
+            vcpu_idx: 0,
+            vcpu: ptr::null(),
+        }; MAX_CPUS];
+
         let ret = HfVCpuRunReturn::WaitForInterrupt {
             ns: HF_SLEEP_INDEFINITE,
         };
@@ -334,11 +831,100 @@ impl Hypervisor {
             return Err(ret);
         }
 
-        // The requested VM must exist.
-        let vm = some_or!(self.vm_manager.get(vm_id), return Err(ret));
+        let cpu = self.cpu_manager.index_of(current.get_inner().cpu);
+        let cached = unsafe { &mut LAST_RUN[cpu] };
+
+        let vcpu = if cached.vm_id == vm_id
+            && cached.vcpu_idx == vcpu_idx
+            && !cached.vcpu.is_null()
+        {
+            // Warm re-run of the same target: the pointer was validated when
+            // it was cached and VMs are never torn down.
+            unsafe { &*cached.vcpu }
+        } else {
+            // The requested VM must exist.
+            let vm = some_or!(self.vm_manager.get(vm_id), return Err(ret));
+
+            // The requested vcpu must exist.
+            let vcpu = some_or!(vm.vcpus.get(vcpu_idx as usize), return Err(ret));
+
+            cached.vm_id = vm_id;
+            cached.vcpu_idx = vcpu_idx;
+            cached.vcpu = vcpu;
+            vcpu
+        };
+
+        self.vcpu_run_resolved(vcpu, current)
+    }
+
+    /// Issues an opaque run token for the given vCPU: the vCPU address mixed
+    /// with a boot-time secret, verified on use with a bounds check and one
+    /// tag compare instead of table lookups. Primary only.
+    pub fn vcpu_token(
+        &self,
+        vm_id: spci_vm_id_t,
+        vcpu_idx: spci_vcpu_index_t,
+        current: &VCpu,
+    ) -> Option<u64> {
+        if current.vm().id != HF_PRIMARY_VM_ID || vm_id == HF_PRIMARY_VM_ID {
+            return None;
+        }
+
+        let vm = self.vm_manager.get(vm_id)?;
+        let vcpu = vm.vcpus.get(vcpu_idx as usize)?;
+
+        Some(vcpu as *const VCpu as u64 ^ self.token_secret())
+    }
+
+    /// The secret mixed into run tokens, initialised lazily from the counter.
+    fn token_secret(&self) -> u64 {
+        static SECRET: AtomicU64 = AtomicU64::new(0);
+
+        let mut secret = SECRET.load(Ordering::Relaxed);
+        if secret == 0 {
+            secret = unsafe { arch_cpu_cycle_count() } | 1;
+            SECRET.store(secret, Ordering::Relaxed);
+        }
+        secret
+    }
+
+    /// Runs a vCPU identified by a token from `vcpu_token`: the recovered
+    /// pointer is range-checked against the VM manager's storage before any
+    /// dereference, so a forged token fails cleanly.
+    pub fn vcpu_run_token(
+        &self,
+        token: u64,
+        current: &mut VCpuExecutionLocked,
+    ) -> Result<VCpuExecutionLocked, HfVCpuRunReturn> {
+        let ret = HfVCpuRunReturn::WaitForInterrupt {
+            ns: HF_SLEEP_INDEFINITE,
+        };
+
+        if current.vm().id != HF_PRIMARY_VM_ID {
+            return Err(ret);
+        }
+
+        let addr = (token ^ self.token_secret()) as usize;
+        let base = &self.vm_manager as *const VmManager as usize;
+        let limit = base + mem::size_of::<VmManager>();
+
+        if addr < base || addr >= limit || addr % mem::align_of::<VCpu>() != 0 {
+            return Err(ret);
+        }
+
+        let vcpu = unsafe { &*(addr as *const VCpu) };
+        self.vcpu_run_resolved(vcpu, current)
+    }
 
-        // The requested vcpu must exist.
-        let vcpu = some_or!(vm.vcpus.get(vcpu_idx as usize), return Err(ret));
+    /// Shared tail of the run paths: state checks and the switch.
+    fn vcpu_run_resolved(
+        &self,
+        vcpu: &VCpu,
+        current: &mut VCpuExecutionLocked,
+    ) -> Result<VCpuExecutionLocked, HfVCpuRunReturn> {
+        let ret = HfVCpuRunReturn::WaitForInterrupt {
+            ns: HF_SLEEP_INDEFINITE,
+        };
 
         // Update state if allowed.
         let mut vcpu_locked = self.vcpu_prepare_run(current, vcpu, ret)?;
@@ -400,6 +986,7 @@ impl Hypervisor {
         &self,
         send: ipaddr_t,
         recv: ipaddr_t,
+        pages: usize,
         current: &mut VCpuExecutionLocked,
     ) -> (i64, Option<&VCpu>) {
         let vm = unsafe { &*(current.vm() as *const Vm) };
@@ -414,8 +1001,9 @@ impl Hypervisor {
             .configure(
                 send,
                 recv,
+                pages,
                 &self.memory_manager.hypervisor_ptable,
-                &self.mpool,
+                &vm.ptable,
             )
             .is_err()
         {
@@ -431,6 +1019,109 @@ impl Hypervisor {
     ///
     /// If the recipient's receive buffer is busy, it can optionally register the caller to be
     /// notified when the recipient's receive buffer becomes available.
+    /// Multicast variant of `spci_msg_send`: the payload starts with a
+    /// little-endian u16 recipient count followed by that many u16 vm-ids;
+    /// the body after the list is copied ONCE into this CPU's bounce buffer
+    /// and then delivered from that cache-hot copy to every listed recipient
+    /// whose mailbox is free. Busy recipients are skipped, and a delivery
+    /// bitmap (bit i = recipient i received the message) is written to the
+    /// start of the sender's receive buffer when it is empty. The sender
+    /// keeps running (asynchronous semantics); blocked receivers pick the
+    /// message up when the scheduler next offers them cycles, exactly as for
+    /// an asynchronous unicast send.
+    fn spci_msg_send_multicast(
+        &self,
+        from: &Vm,
+        from_msg: &SpciMessage,
+        from_msg_replica: &SpciMessage,
+        current: &mut VCpuExecutionLocked,
+    ) -> (SpciReturn, Option<&VCpu>) {
+        const MULTICAST_MAX_RECIPIENTS: usize = 32;
+
+        let payload_length = from_msg_replica.length as usize;
+        if from_msg_replica.source_vm_id != from.id
+            || !from_msg_replica.flags.contains(SpciMessageFlags::IMPDEF)
+            || payload_length < mem::size_of::<u16>()
+            || payload_length > SPCI_MSG_PAYLOAD_MAX
+        {
+            return (SpciReturn::InvalidParameters, None);
+        }
+
+        let payload =
+            unsafe { slice::from_raw_parts(from_msg.payload.as_ptr(), payload_length) };
+        let count = u16::from_le_bytes([payload[0], payload[1]]) as usize;
+        let list_end = mem::size_of::<u16>() * (1 + count);
+
+        if count == 0 || count > MULTICAST_MAX_RECIPIENTS || payload_length < list_end {
+            return (SpciReturn::InvalidParameters, None);
+        }
+
+        let body_length = payload_length - list_end;
+
+        // The single payload read: everything after this delivers from the
+        // hypervisor-owned copy, which also closes TOCTOU on the body.
+        let bounce = unsafe { cpu_get_buffer((*current.get_inner().cpu).id) };
+        unsafe {
+            ptr::copy_nonoverlapping(
+                payload.as_ptr().add(list_end),
+                bounce.as_mut_ptr(),
+                body_length,
+            );
+        }
+
+        let mut delivered: u32 = 0;
+
+        for i in 0..count {
+            let id_offset = mem::size_of::<u16>() * (1 + i);
+            let id = u16::from_le_bytes([payload[id_offset], payload[id_offset + 1]]);
+
+            if id == from.id {
+                continue;
+            }
+
+            let to = some_or!(self.vm_manager.get(id), continue);
+            let to_inner = to.inner.lock();
+
+            if !to_inner.is_configured()
+                || body_length > to_inner.mailbox_size() - mem::size_of::<SpciMessage>()
+                || !to_inner.try_begin_fill()
+            {
+                continue;
+            }
+
+            let to_msg = unsafe { &mut *to_inner.get_recv_ptr() };
+            unsafe {
+                ptr::copy_nonoverlapping(from_msg_replica, to_msg, 1);
+            }
+            to_msg.flags = SpciMessageFlags::IMPDEF;
+            to_msg.length = body_length as u32;
+            to_msg.target_vm_id = id;
+            let payload_dst = to_msg.payload.as_mut_ptr();
+            drop(to_inner);
+
+            unsafe {
+                memcpy_payload(payload_dst, bounce.as_ptr(), body_length);
+            }
+
+            to.commit_fill_lockfree(false);
+            delivered |= 1 << i;
+        }
+
+        // Report the per-recipient outcome into the sender's receive buffer
+        // so it can retry the busy ones.
+        {
+            let from_inner = from.inner.lock();
+            if from_inner.is_configured() && from_inner.is_empty() {
+                unsafe {
+                    #[allow(clippy::cast_ptr_alignment)]
+                    ptr::write(from_inner.get_recv_ptr() as *mut u32, delivered);
+                }
+            }
+        }
+
+        (SpciReturn::Success, None)
+    }
+
     pub fn spci_msg_send(
         &self,
         attributes: SpciMsgSendAttributes,
@@ -443,9 +1134,13 @@ impl Hypervisor {
         // Check that the sender has configured its send buffer. If the tx mailbox at from_msg is
         // configured (i.e. from_msg != ptr::null()) then it can be safely accessed after releasing
         // the lock since the tx mailbox address can only be configured once.
+        // The send pointer is read without any lock: the configuration
+        // generation guards it, and configuration is a once-per-boot event.
         let from_msg = some_or!(
-            // TODO(HfO2): complicated invariant...  send_ptr never changes.
-            unsafe { from.inner.lock().get_send_ptr().as_ref() },
+            unsafe {
+                from.get_send_ptr_lockfree()
+                    .and_then(|send| send.as_ref())
+            },
             return (SpciReturn::InvalidParameters, None)
         );
 
@@ -454,18 +1149,18 @@ impl Hypervisor {
         let from_msg_replica = unsafe { ptr::read(from_msg) };
         let from_msg_payload_length = from_msg_replica.length as usize;
 
-        // Ensure source VM id corresponds to the current VM.
-        if from_msg_replica.source_vm_id != from.id {
-            return (SpciReturn::InvalidParameters, None);
+        if attributes.contains(SpciMsgSendAttributes::MULTICAST) {
+            return self.spci_msg_send_multicast(from, from_msg, &from_msg_replica, current);
         }
 
-        // Limit the size of transfer.
-        if from_msg_payload_length > SPCI_MSG_PAYLOAD_MAX {
-            return (SpciReturn::InvalidParameters, None);
-        }
-
-        // Disallow reflexive requests as this suggests an error in the VM.
-        if from_msg_replica.target_vm_id == from.id {
+        // One fused, table-driven header validation covers the flag
+        // combination, the length against the sender's negotiated buffer,
+        // the source ID and the reflexive-target check.
+        if !spci_header_valid(
+            &from_msg_replica,
+            from.id,
+            from.mailbox_size_lockfree() - mem::size_of::<SpciMessage>(),
+        ) {
             return (SpciReturn::InvalidParameters, None);
         }
 
@@ -475,14 +1170,92 @@ impl Hypervisor {
             return (SpciReturn::InvalidParameters, None)
         );
 
+        // Lock-free fast fail: if the receiver's mailbox is busy and this
+        // message can neither be queued (architected payloads take the
+        // synchronous path) nor wants a busy notification, the send cannot
+        // make progress, so answer without touching any lock.
+        if !notify
+            && !from_msg_replica.flags.contains(SpciMessageFlags::IMPDEF)
+            && to.mailbox_state_lockfree() != MailboxState::Empty
+        {
+            return (SpciReturn::Busy, None);
+        }
+
         // Hf needs to hold the lock on `to` before the mailbox state is checked. The lock on `to`
         // must be held until the information is copied to `to` Rx buffer. Since in
         // spci_msg_handle_architected_message we may call api_spci_share_memory which must hold
         // the `from` lock, we must hold the `from` lock at this point to prevent a deadlock
         // scenario.
-        let (mut to_inner, mut from_inner) = SpinLock::lock_both(&to.inner, &from.inner);
+        let (mut to_inner, mut from_inner) = RwLock::lock_both(&to.inner, &from.inner);
+
+        if !to_inner.is_configured() || !to_inner.try_begin_fill() {
+            to.telemetry.mailbox_full.fetch_add(1, Ordering::Relaxed);
+            // Urgent messages use the reserved priority slot and wake the
+            // receiver immediately, jumping every queue.
+            if to_inner.is_configured()
+                && from_msg_replica.flags.contains(SpciMessageFlags::URGENT)
+                && from_msg_payload_length <= SPCI_MSG_PAYLOAD_MAX
+            {
+                let payload = unsafe {
+                    slice::from_raw_parts(from_msg.payload.as_ptr(), from_msg_payload_length)
+                };
+                if to_inner
+                    .urgent_push(&from_msg_replica, payload, &self.mpool)
+                    .is_ok()
+                {
+                    let next = if from.id != HF_PRIMARY_VM_ID {
+                        Some(self.switch_to_primary(
+                            current,
+                            HfVCpuRunReturn::WakeUp {
+                                vm_id: to.id,
+                                vcpu: 0,
+                            },
+                            VCpuStatus::Ready,
+                        ))
+                    } else {
+                        None
+                    };
+                    return (SpciReturn::Success, next);
+                }
+            }
+
+            // The receive buffer is busy. Plain messages can still be accepted
+            // into the pending ring, to be delivered when the mailbox is
+            // cleared, so the sender doesn't need a wake-up round trip per
+            // message.
+            if to_inner.is_configured()
+                && from_msg_replica.flags.contains(SpciMessageFlags::IMPDEF)
+                && from_msg_payload_length <= SPCI_MSG_PAYLOAD_MAX
+            {
+                let payload = unsafe {
+                    slice::from_raw_parts(from_msg.payload.as_ptr(), from_msg_payload_length)
+                };
+                if to_inner
+                    .queue_push(&from_msg_replica, payload, &self.mpool)
+                    .is_ok()
+                {
+                    // Give the receiver cycles to drain its mailbox, unless
+                    // the sender asked for a fully asynchronous send, in
+                    // which case it keeps running and the receiver picks the
+                    // message up when next scheduled.
+                    let next = if from.id != HF_PRIMARY_VM_ID
+                        && !attributes.contains(SpciMsgSendAttributes::ASYNC)
+                    {
+                        Some(self.switch_to_primary(
+                            current,
+                            HfVCpuRunReturn::Message {
+                                vm_id: to.id,
+                                size: from_msg_replica.length,
+                            },
+                            VCpuStatus::Ready,
+                        ))
+                    } else {
+                        None
+                    };
+                    return (SpciReturn::Success, next);
+                }
+            }
 
-        if !to_inner.is_empty() || !to_inner.is_configured() {
             // Fail if the target isn't currently ready to receive data, setting up for
             // notification if requested.
             if notify {
@@ -492,17 +1265,138 @@ impl Hypervisor {
             return (SpciReturn::Busy, None);
         }
 
+        // The receiver's buffer must be able to take the payload.
+        if from_msg_payload_length > to_inner.mailbox_size() - mem::size_of::<SpciMessage>() {
+            to_inner.abort_fill();
+            return (SpciReturn::InvalidParameters, None);
+        }
+
         let to_msg = unsafe { &mut *to_inner.get_recv_ptr() };
 
         // Handle architected messages.
         if from_msg_replica.flags.contains(SpciMessageFlags::IMPDEF) {
-            *to_msg = from_msg_replica;
-            unsafe {
-                ptr::copy_nonoverlapping(
-                    from_msg.payload.as_ptr(),
-                    to_msg.payload.as_mut_ptr(),
-                    from_msg_payload_length,
-                );
+            if attributes.contains(SpciMsgSendAttributes::STREAM) {
+                // The payload is a descriptor of a multi-page buffer in the
+                // sender's memory; set up the pipelined transfer and deliver
+                // the first chunk. Later chunks are delivered as the receiver
+                // clears its mailbox, with no more sender involvement.
+                if from_msg_payload_length != 2 * mem::size_of::<u64>() {
+                    to_inner.abort_fill();
+                    return (SpciReturn::InvalidParameters, None);
+                }
+
+                let (addr, len) = unsafe {
+                    let p = from_msg.payload.as_ptr() as *const u64;
+                    (
+                        ptr::read_unaligned(p) as usize,
+                        ptr::read_unaligned(p.add(1)) as usize,
+                    )
+                };
+
+                if len == 0 {
+                    to_inner.abort_fill();
+                    return (SpciReturn::InvalidParameters, None);
+                }
+
+                // The sender must have read access to the whole buffer.
+                if from
+                    .get_mode_lockfree(ipa_init(addr), ipa_init(addr + len))
+                    .map(|mode| !mode.contains(Mode::R) || mode.contains(Mode::INVALID))
+                    .unwrap_or(true)
+                {
+                    to_inner.abort_fill();
+                    return (SpciReturn::InvalidParameters, None);
+                }
+
+                to_inner.stream_start(from.id, addr, len);
+                if !self.stream_deliver(to.id, &mut to_inner) {
+                    to_inner.abort_fill();
+                    return (SpciReturn::NoMemory, None);
+                }
+            } else if attributes.contains(SpciMsgSendAttributes::ZERO_COPY) {
+                // Deliver the payload by reference: map the sender's send
+                // buffer page read-only into the receiver and hand over a
+                // descriptor holding its address. The page is unmapped again
+                // when the receiver clears its mailbox.
+                let pa_begin = pa_init(from_msg as *const SpciMessage as uintpaddr_t);
+                let pa_end = pa_add(pa_begin, PAGE_SIZE);
+
+                if to
+                    .ptable
+                    .lock()
+                    .table
+                    .identity_map(
+                        pa_begin,
+                        pa_end,
+                        Mode::R | Mode::UNOWNED | Mode::SHARED,
+                        &self.mpool,
+                    )
+                    .is_err()
+                {
+                    to_inner.abort_fill();
+                    return (SpciReturn::NoMemory, None);
+                }
+
+                *to_msg = from_msg_replica;
+                to_msg.flags |= SpciMessageFlags::ZERO_COPY;
+                to_msg.length = mem::size_of::<u64>() as u32;
+                unsafe {
+                    #[allow(clippy::cast_ptr_alignment)]
+                    ptr::write(to_msg.payload.as_mut_ptr() as *mut u64, pa_addr(pa_begin) as u64);
+                }
+                to_inner.set_zero_copy_page(from_msg);
+            } else {
+                // The header is written under the locks, but the payload —
+                // the longest lock hold in the system — is copied with both
+                // VM locks dropped: the Filling reservation taken above keeps
+                // every other sender and the receiver's acknowledgement out
+                // until the commit below.
+                *to_msg = from_msg_replica;
+                let payload_dst = to_msg.payload.as_mut_ptr();
+                let payload_src = from_msg.payload.as_ptr();
+                drop(from_inner);
+                drop(to_inner);
+
+                unsafe {
+                    memcpy_payload(payload_dst, payload_src, from_msg_payload_length);
+                }
+
+                // Re-take the locks briefly for the waiter bookkeeping, then
+                // publish the message.
+                let (mut to_inner, mut from_inner) =
+                    RwLock::lock_both(&to.inner, &from.inner);
+                from_inner.cancel_wait_for(&mut to_inner, to.id);
+
+                // The header was moved into the receive buffer above, so
+                // use the length captured before the move.
+                let primary_ret = HfVCpuRunReturn::Message {
+                    vm_id: to.id,
+                    size: from_msg_payload_length as u32,
+                };
+
+                if to.id == HF_PRIMARY_VM_ID {
+                    to.commit_fill_lockfree(true);
+                    let next = self.switch_to_primary(current, primary_ret, VCpuStatus::Ready);
+                    return (SpciReturn::Success, Some(next));
+                }
+
+                to.commit_fill_lockfree(false);
+
+                if attributes.contains(SpciMsgSendAttributes::DIRECT_YIELD) {
+                    if let Some(next) = self.direct_yield_to(current, to, &mut to_inner) {
+                        return (SpciReturn::Success, Some(next));
+                    }
+                }
+
+                let next = if from.id != HF_PRIMARY_VM_ID
+                    && !attributes.contains(SpciMsgSendAttributes::ASYNC)
+                {
+                    Some(self.switch_to_primary(current, primary_ret, VCpuStatus::Ready))
+                } else {
+                    None
+                };
+
+                return (SpciReturn::Success, next);
             }
         } else {
             // Buffer holding the internal copy of the shared memory regions.
@@ -511,11 +1405,10 @@ impl Hypervisor {
 
             let architected_header = from_msg.get_architected_message_header();
 
-            if from_msg_payload_length > message_buffer.len() {
-                return (SpciReturn::InvalidParameters, None);
-            }
-
-            if from_msg_payload_length < mem::size_of::<SpciArchitectedMessageHeader>() {
+            if from_msg_payload_length > message_buffer.len()
+                || from_msg_payload_length < mem::size_of::<SpciArchitectedMessageHeader>()
+            {
+                to_inner.abort_fill();
                 return (SpciReturn::InvalidParameters, None);
             }
 
@@ -538,20 +1431,29 @@ impl Hypervisor {
             // message_buffer. The memory area message_buffer must be exclusively owned by Hf so
             // that TOCTOU issues do not arise.
             let ret = spci_msg_handle_architected_message(
-                &mut to_inner,
-                &mut from_inner,
+                to,
+                from,
                 architected_message_replica,
                 &from_msg_replica,
                 to_msg,
-                &self.mpool,
             );
 
             if ret != SpciReturn::Success {
+                // Release the fill reservation taken above.
+                to_inner.abort_fill();
                 return (ret, None);
             }
         }
 
-        let primary_ret = HfVCpuRunReturn::Message { vm_id: to.id };
+        // The send succeeded, so a wait entry left over from an earlier
+        // failed attempt is stale; unlink it in O(1) so the sender doesn't
+        // get a spurious writable notification later.
+        from_inner.cancel_wait_for(&mut to_inner, to.id);
+
+        let primary_ret = HfVCpuRunReturn::Message {
+            vm_id: to.id,
+            size: from_msg_payload_length as u32,
+        };
 
         // Messages for the primary VM are delivered directly.
         if to.id == HF_PRIMARY_VM_ID {
@@ -562,8 +1464,20 @@ impl Hypervisor {
 
         to_inner.set_received();
 
-        // Return to the primary VM directly or with a switch.
-        let next = if from.id != HF_PRIMARY_VM_ID {
+        // Donate the rest of the timeslice to a blocked receiver vCPU if the
+        // sender asked for a directed yield, skipping the two world switches
+        // through the primary scheduler.
+        if attributes.contains(SpciMsgSendAttributes::DIRECT_YIELD) {
+            if let Some(next) = self.direct_yield_to(current, to, &mut to_inner) {
+                return (SpciReturn::Success, Some(next));
+            }
+        }
+
+        // Return to the primary VM directly or with a switch, unless the
+        // sender asked for an asynchronous send and keeps running.
+        let next = if from.id != HF_PRIMARY_VM_ID
+            && !attributes.contains(SpciMsgSendAttributes::ASYNC)
+        {
             Some(self.switch_to_primary(current, primary_ret, VCpuStatus::Ready))
         } else {
             None
@@ -572,6 +1486,125 @@ impl Hypervisor {
         (SpciReturn::Success, next)
     }
 
+    /// Tries to switch straight to a vCPU of the receiving VM that is blocked waiting for the
+    /// message just delivered, donating the rest of the sender's timeslice to it. The caller must
+    /// hold the receiver's VM lock (`to_inner`) with the message already in the mailbox. Returns
+    /// the vCPU to run next, or None if no vCPU of the receiver is ready to take the message on
+    /// this physical CPU.
+    fn direct_yield_to(
+        &self,
+        current: &mut VCpuExecutionLocked,
+        to: &Vm,
+        to_inner: &mut VmInner,
+    ) -> Option<&VCpu> {
+        for vcpu in to.vcpus.iter() {
+            // Never blocks: a vCPU running elsewhere just fails the try_lock
+            // and is skipped.
+            let mut vcpu_inner = ok_or!(vcpu.inner.try_lock(), continue);
+
+            if vcpu_inner.state != VCpuStatus::BlockedMailbox {
+                continue;
+            }
+
+            // Deliver the message to the blocked receiver, exactly as
+            // vcpu_prepare_run would on the next scheduling round trip.
+            to_inner.set_read();
+            vcpu_inner.recv_deadline = 0;
+            vcpu_inner.regs.set_retval(SpciReturn::Success as uintreg_t);
+            vcpu_inner.state = VCpuStatus::Ready;
+            vcpu_inner.cpu = current.get_inner().cpu;
+
+            // Keep holding the execution lock: the vCPU is about to run on
+            // this physical CPU.
+            mem::forget(vcpu_inner);
+
+            // The sender stays ready to be scheduled again later.
+            current.get_inner_mut().state = VCpuStatus::Ready;
+
+            return Some(unsafe { &*(vcpu as *const VCpu) });
+        }
+
+        None
+    }
+
+    /// Sends a short register-based message directly to a vCPU of the target VM, bypassing the
+    /// mailbox entirely. The payload travels in the hypercall argument registers of the sender and
+    /// is delivered in the return registers of the target vCPU, which must be blocked waiting for
+    /// a message.
+    ///
+    /// Returns:
+    ///  - InvalidParameters if the target VM or vCPU doesn't exist or the request is reflexive.
+    ///  - Busy if the target vCPU is currently running on another physical CPU.
+    ///  - Retry if the target vCPU is not blocked waiting for a message.
+    pub fn spci_msg_send_direct(
+        &self,
+        target: uintreg_t,
+        current: &mut VCpuExecutionLocked,
+    ) -> (SpciReturn, Option<&VCpu>) {
+        let from = current.vm();
+        let target_vm_id = target as spci_vm_id_t;
+        let target_vcpu_idx = (target >> 16) as spci_vcpu_index_t;
+
+        // Disallow reflexive requests as this suggests an error in the VM.
+        if target_vm_id == from.id {
+            return (SpciReturn::InvalidParameters, None);
+        }
+
+        let to = some_or!(
+            self.vm_manager.get(target_vm_id),
+            return (SpciReturn::InvalidParameters, None)
+        );
+
+        let target_vcpu = some_or!(
+            to.vcpus.get(target_vcpu_idx as usize),
+            return (SpciReturn::InvalidParameters, None)
+        );
+
+        // Only deliver direct messages to VMs that negotiated them; others
+        // would misread the payload registers on wake-up.
+        if !SpciFeatures::from_bits_truncate(to.features.load(Ordering::Relaxed))
+            .contains(SpciFeatures::DIRECT_MSG)
+        {
+            return (SpciReturn::NotSupported, None);
+        }
+
+        // The execution lock makes sure the target's registers are not in use
+        // by another physical CPU while they are written.
+        let mut vcpu_inner = ok_or!(
+            target_vcpu.inner.try_lock(),
+            return (SpciReturn::Busy, None)
+        );
+
+        // Deliver only to a vCPU that is blocked waiting for a message, so the
+        // payload registers cannot clobber state the vCPU still needs.
+        if vcpu_inner.state != VCpuStatus::BlockedMailbox {
+            return (SpciReturn::Retry, None);
+        }
+
+        let payload = current.get_inner().regs.get_direct_payload();
+        vcpu_inner.regs.set_retval(SpciReturn::Success as uintreg_t);
+        vcpu_inner.regs.set_direct_payload(from.id, payload);
+        vcpu_inner.state = VCpuStatus::Ready;
+        drop(vcpu_inner);
+
+        // Tell the scheduler to give the target vCPU cycles; the primary makes
+        // its own scheduling decisions.
+        let next = if from.id != HF_PRIMARY_VM_ID {
+            Some(self.switch_to_primary(
+                current,
+                HfVCpuRunReturn::WakeUp {
+                    vm_id: target_vm_id,
+                    vcpu: target_vcpu_idx,
+                },
+                VCpuStatus::Ready,
+            ))
+        } else {
+            None
+        };
+
+        (SpciReturn::Success, next)
+    }
+
     /// Receives a message from the mailbox. If one isn't available, this function can optionally
     /// block the caller until one becomes available.
     ///
@@ -579,6 +1612,7 @@ impl Hypervisor {
     pub fn spci_msg_recv(
         &self,
         attributes: SpciMsgRecvAttributes,
+        timeout_ns: u64,
         current: &mut VCpuExecutionLocked,
     ) -> (SpciReturn, Option<&VCpu>) {
         let vm = unsafe { &*(current.vm() as *const Vm) };
@@ -590,10 +1624,10 @@ impl Hypervisor {
             return (SpciReturn::Interrupted, None);
         }
 
-        let mut vm_inner = vm.inner.lock();
-
-        // Return pending messages without blocking.
-        if vm_inner.try_read().is_ok() {
+        // Return pending messages without blocking; the acknowledgement is a
+        // CAS on the atomic state word, so no VM lock is needed anywhere on
+        // this path.
+        if vm.try_read_lockfree().is_ok() {
             return (SpciReturn::Success, None);
         }
 
@@ -602,18 +1636,52 @@ impl Hypervisor {
             return (SpciReturn::Retry, None);
         }
 
+        // Adaptive halt-polling: briefly spin on the mailbox state before
+        // paying for a full block-and-reschedule, sized per VM — the window
+        // grows when polling catches a message (the RPC reply pattern) and
+        // shrinks when it expires idle.
+        let window = vm.halt_poll_cycles.load(Ordering::Relaxed);
+        if window > 0 {
+            let start = unsafe { arch_cpu_cycle_count() };
+            while unsafe { arch_cpu_cycle_count() }.wrapping_sub(start) < u64::from(window) {
+                if vm.try_read_lockfree().is_ok() {
+                    vm.halt_poll_cycles.store(
+                        cmp::min(window.saturating_mul(2), HALT_POLL_MAX_CYCLES),
+                        Ordering::Relaxed,
+                    );
+                    return (SpciReturn::Success, None);
+                }
+                spin_loop_hint();
+            }
+            vm.halt_poll_cycles.store(
+                cmp::max(window / 2, HALT_POLL_MIN_CYCLES),
+                Ordering::Relaxed,
+            );
+        }
+
         // From this point onward this call can only be interrupted or a message received. If a
         // message is received the return value will be set at that time to SPCI_SUCCESS.
         //
         // Block only if there are enabled and pending interrupts, to match behaviour of
         // wait_for_interrupt.
         let next = if !current.interrupts.lock().is_interrupted() {
+            // A timed receive records its counter deadline, so the wake-up
+            // path turns expiry into a retry status, and tells the scheduler
+            // to come back at the timeout. One trap in, one trap out — no
+            // guest-side timer arming and cancelling.
+            let ns = if timeout_ns != 0 {
+                current.get_inner_mut().recv_deadline = unsafe {
+                    arch_cpu_cycle_count().wrapping_add(arch_timer_ticks_from_ns(timeout_ns))
+                };
+                timeout_ns
+            } else {
+                HF_SLEEP_INDEFINITE
+            };
+
             // Switch back to primary vm to block.
             Some(self.switch_to_primary(
                 current,
-                HfVCpuRunReturn::WaitForMessage {
-                    ns: HF_SLEEP_INDEFINITE,
-                },
+                HfVCpuRunReturn::WaitForMessage { ns },
                 VCpuStatus::BlockedMailbox,
             ))
         } else {
@@ -646,17 +1714,48 @@ impl Hypervisor {
         // Check if there are outstanding notifications from given vm.
         let entry = unsafe { vm.inner.lock().fetch_waiter().as_mut()? };
 
-        // Enqueue notification to waiting VM.
+        // Enqueue the notification with one lock-free push; the waiting
+        // VM's lock is never touched.
         let waiting_vm = unsafe { &*entry.waiting_vm };
-
-        let mut vm_inner = waiting_vm.inner.lock();
-        if !entry.is_in_ready_list() {
-            vm_inner.enqueue_ready_list(&mut *entry);
-        }
+        waiting_vm.ready_push(entry);
 
         Some(waiting_vm.id)
     }
 
+    /// Notifies waiters of the given VM whose mailbox just became writable by
+    /// injecting HF_MAILBOX_WRITABLE_INTID into them directly, without the
+    /// round trip through the primary VM's waiter polling. Only waiters that
+    /// opted in are handled; draining stops at the first waiter that expects
+    /// the classic notification flow, which is then reported through
+    /// waiter_result as before.
+    fn notify_waiters_direct(&self, vm_inner: &mut VmInner) {
+        loop {
+            // Peek whether the next waiter opted in, then pop it.
+            let entry = unsafe {
+                match vm_inner.fetch_waiter_if(|vm| {
+                    vm.inner.get_unchecked().direct_writable_notify
+                })
+                .as_mut()
+                {
+                    Some(entry) => entry,
+                    None => return,
+                }
+            };
+
+            let waiting_vm = unsafe { &*entry.waiting_vm };
+
+            // Keep the writable_get bookkeeping intact with a lock-free
+            // push; no other VM's lock is taken while holding this one.
+            waiting_vm.ready_push(entry);
+
+            // Make the interrupt pending; the waiter observes it the next
+            // time it runs or is woken by its scheduler.
+            if let Some(vcpu) = waiting_vm.vcpus.get(0) {
+                let _ = vcpu.interrupts.lock().inject(HF_MAILBOX_WRITABLE_INTID);
+            }
+        }
+    }
+
     /// Clears the caller's mailbox so that a new message can be received. The caller must have
     /// copied out all data they wish to preserve as new messages will overwrite the old and will
     /// arrive asynchronously.
@@ -672,9 +1771,46 @@ impl Hypervisor {
         let mut vm_inner = vm.inner.lock();
         match vm_inner.get_state() {
             MailboxState::Empty => (0, None),
-            MailboxState::Received => (-1, None),
+            // A fill reservation in flight is as busy as a delivered
+            // message: the sender owns the buffer until it commits or
+            // aborts, so the clear fails the same way.
+            MailboxState::Received | MailboxState::Filling => (-1, None),
             MailboxState::Read => {
+                // The urgent lane jumps every queue.
+                if vm_inner.refill_from_urgent(&self.mpool) {
+                    return (0, None);
+                }
+
+                // Return a zero-copy sender page, if one is mapped.
+                if let Some(page) = vm_inner.take_zero_copy_page() {
+                    let pa_begin = pa_init(page as uintpaddr_t);
+                    let pa_end = pa_add(pa_begin, PAGE_SIZE);
+                    vm.ptable
+                        .lock()
+                        .table
+                        .unmap(pa_begin, pa_end, &self.mpool)
+                        .unwrap();
+                }
+
+                // An in-flight streamed transfer delivers its next chunk
+                // straight into the buffer.
+                if self.stream_deliver(vm.id, &mut vm_inner) {
+                    return (0, None);
+                }
+
+                // Deliver the next queued message, if any, instead of going
+                // through an empty-notify-send round trip.
+                if vm_inner.refill_from_queue(&self.mpool) {
+                    return (0, None);
+                }
+
                 vm_inner.set_empty();
+
+                // Waiters that asked for it are notified by direct interrupt
+                // injection; any remaining ones go through the primary VM's
+                // polling as before.
+                self.notify_waiters_direct(&mut vm_inner);
+
                 self.waiter_result(vm.id, &vm_inner, current)
             }
         }
@@ -749,6 +1885,143 @@ impl Hypervisor {
         self.internal_interrupt_inject(target_vcpu, intid, current)
     }
 
+    /// Copies `len` bytes of guest memory at the given physical address into
+    /// `dst`, mapping the range into the hypervisor's stage-1 tables for the
+    /// duration of the copy. The caller must have validated that the source
+    /// VM has access to the range.
+    fn copy_from_guest(&self, dst: *mut u8, begin: paddr_t, len: usize) -> Result<(), ()> {
+        let mut hypervisor_ptable = self.memory_manager.hypervisor_ptable.lock();
+        let map_begin = pa_init(round_down(pa_addr(begin), PAGE_SIZE));
+        let map_end = pa_init(round_up(pa_addr(begin) + len, PAGE_SIZE));
+
+        if hypervisor_ptable
+            .identity_map(map_begin, map_end, Mode::R, &self.mpool)
+            .is_err()
+        {
+            hypervisor_ptable.defrag(&self.mpool);
+            return Err(());
+        }
+
+        unsafe {
+            memcpy_payload(dst, pa_addr(begin) as *const u8, len);
+        }
+
+        hypervisor_ptable
+            .unmap(map_begin, map_end, &self.mpool)
+            .unwrap();
+        Ok(())
+    }
+
+    /// Delivers the next chunk of an in-flight streamed transfer into the
+    /// given (cleared or about-to-be-refilled) mailbox. Returns true if a
+    /// chunk was delivered and the mailbox marked received again.
+    fn stream_deliver(&self, vm_id: spci_vm_id_t, vm_inner: &mut VmInner) -> bool {
+        let (src_id, cursor, remaining) = some_or!(vm_inner.stream_state(), return false);
+        let src_vm = some_or!(self.vm_manager.get(src_id), {
+            vm_inner.stream_clear();
+            return false;
+        });
+
+        let chunk = cmp::min(remaining, SPCI_MSG_PAYLOAD_MAX);
+
+        // Re-validate that the source still has read access to this part of
+        // the buffer, so memory given away mid-stream is not leaked.
+        let readable = src_vm
+            .get_mode_lockfree(ipa_init(cursor), ipa_init(cursor + chunk))
+            .map(|mode| mode.contains(Mode::R) && !mode.contains(Mode::INVALID))
+            .unwrap_or(false);
+        if !readable {
+            vm_inner.stream_clear();
+            return false;
+        }
+
+        let to_msg = unsafe { &mut *vm_inner.get_recv_ptr() };
+        if self
+            .copy_from_guest(
+                to_msg.payload.as_mut_ptr(),
+                pa_init(cursor),
+                chunk,
+            )
+            .is_err()
+        {
+            vm_inner.stream_clear();
+            return false;
+        }
+
+        to_msg.flags = if remaining > chunk {
+            SpciMessageFlags::IMPDEF | SpciMessageFlags::STREAM_MORE
+        } else {
+            SpciMessageFlags::IMPDEF
+        };
+        to_msg.length = chunk as u32;
+        to_msg.source_vm_id = src_id;
+        to_msg.target_vm_id = vm_id;
+
+        vm_inner.stream_advance(chunk);
+        vm_inner.set_received();
+        true
+    }
+
+    /// Populates one page of a lazily loaded VM image: copies the matching
+    /// page of the master image (zero-filling past its end), flushes it, and
+    /// maps it into the VM. Returns true if the fault was resolved and the
+    /// vCPU should retry the access.
+    pub fn lazy_image_populate(&self, vm: &Vm, ipa: ipaddr_t) -> bool {
+        let mut vm_ptable = vm.ptable.lock();
+        let image = some_or!(vm_ptable.lazy_image, return false);
+
+        let page = ipa_addr(ipa) & !(PAGE_SIZE - 1);
+        if page < image.begin || page >= image.end {
+            return false;
+        }
+
+        let local_page_pool = MPool::new_with_fallback(&vm_ptable.pool);
+
+        // Map a stage-1 window over the destination page. The master image
+        // lives in the ramdisk, which is already mapped readable.
+        let pa_begin = pa_init(page);
+        let pa_end = pa_add(pa_begin, PAGE_SIZE);
+        {
+            let mut hypervisor_ptable = self.memory_manager.hypervisor_ptable.lock();
+            if hypervisor_ptable
+                .identity_map(pa_begin, pa_end, Mode::W, &local_page_pool)
+                .is_err()
+            {
+                return false;
+            }
+
+            let offset = page - image.begin;
+            let copy_len = cmp::min(
+                PAGE_SIZE,
+                image.src_len.saturating_sub(offset),
+            );
+
+            unsafe {
+                if copy_len > 0 {
+                    memcpy_payload(
+                        page as *mut u8,
+                        (image.src + offset) as *const u8,
+                        copy_len,
+                    );
+                }
+                ptr::write_bytes((page + copy_len) as *mut u8, 0, PAGE_SIZE - copy_len);
+
+                // Flush so the guest, which may run with caches off or fetch
+                // instructions from this page, sees the copy.
+                arch_mm_flush_dcache(page, PAGE_SIZE);
+            }
+
+            hypervisor_ptable
+                .unmap(pa_begin, pa_end, &local_page_pool)
+                .unwrap();
+        }
+
+        vm_ptable
+            .table
+            .identity_map(pa_begin, pa_end, Mode::R | Mode::W | Mode::X, &local_page_pool)
+            .is_ok()
+    }
+
     /// Clears a region of physical memory by overwriting it with zeros. The data is flushed from
     /// the cache so the memory has been cleared across the system.
     fn clear_memory(&self, begin: paddr_t, end: paddr_t, ppool: &MPool) -> Result<(), ()> {
@@ -785,6 +2058,11 @@ impl Hypervisor {
     ///       different modes e.g. read-only, informing the recipient of the memory they have been
     ///       given, opting to not wipe the memory and possibly allowing multiple blocks to be
     ///       transferred. What this will look like is TBD.
+    /// The number of bytes a single share_memory call processes before
+    /// releasing the VM locks and asking the caller to re-trap, bounding each
+    /// critical section.
+    const SHARE_CHUNK_BYTES: usize = 512 * PAGE_SIZE;
+
     pub fn share_memory(
         &self,
         vm_id: spci_vm_id_t,
@@ -792,7 +2070,7 @@ impl Hypervisor {
         size: usize,
         share: HfShare,
         current: &VCpu,
-    ) -> Result<(), ()> {
+    ) -> Result<Option<spci_memory_handle_t>, ()> {
         let from: &Vm = current.vm();
 
         // Disallow reflexive shares as this suggests an error in the VM.
@@ -823,79 +2101,237 @@ impl Hypervisor {
             ),
         };
 
+        // Memory sharing only touches the stage-2 state, so it takes the
+        // dedicated ptable locks and leaves the mailbox locks free for
+        // unrelated deliveries to either VM.
+        let (mut from_ptable, mut to_ptable) = SpinLock::lock_both(&from.ptable, &to.ptable);
+
         // Create a local pool so any freed memory can't be used by another thread. This is to
-        // ensure the original mapping can be restored if any stage of the process fails.
-        let local_page_pool = MPool::new_with_fallback(&self.mpool);
+        // ensure the original mapping can be restored if any stage of the process fails. It
+        // drains into the sender's table page cache.
+        let local_page_pool = MPool::new_with_fallback(&from_ptable.pool);
+
+        // Resume a preempted operation, or validate and record a new one. The
+        // whole-range validation is read-only; only the mapping work is
+        // chunked.
+        let (slot, state) = match self
+            .share_states
+            .lock()
+            .find_in_progress(from.id, vm_id, ipa_addr(begin), size)
+        {
+            Some(found) => found,
+            None => {
+                // Ensure that the memory range is mapped with the same mode so that changes can
+                // be reverted if the process fails.
+                // Also ensure the memory range is valid for the sender. If it isn't, the sender
+                // has either shared it with another VM already or has no claim to the memory.
+                let orig_from_mode = from_ptable.table.get_mode(begin, end)?;
+                let orig_to_mode = to_ptable
+                    .table
+                    .get_mode(begin, end)
+                    .unwrap_or(Mode::INVALID | Mode::UNOWNED | Mode::SHARED);
+
+                if orig_from_mode.contains(Mode::INVALID) {
+                    return Err(());
+                }
+
+                // The sender must own the memory and have exclusive access to it in order to
+                // share it. Alternatively, it is giving memory back to the owning VM.
+                if orig_from_mode.contains(Mode::UNOWNED) {
+                    let to_mode = to_ptable.table.get_mode(begin, end)?;
+
+                    if to_mode.contains(Mode::UNOWNED) {
+                        return Err(());
+                    }
 
-        let (mut from_inner, mut to_inner) = SpinLock::lock_both(&from.inner, &to.inner);
+                    if share != HfShare::Give {
+                        return Err(());
+                    }
+                } else if orig_from_mode.contains(Mode::SHARED) {
+                    return Err(());
+                }
+
+                let state = ShareState {
+                    handle: 0,
+                    from: from.id,
+                    to: vm_id,
+                    begin: ipa_addr(begin),
+                    size,
+                    orig_from_mode,
+                    orig_to_mode,
+                    from_mode,
+                    to_mode,
+                    cursor: 0,
+                };
+                let slot = self.share_states.lock().allocate(state)?;
+                (slot, state)
+            }
+        };
 
-        // Ensure that the memory range is mapped with the same mode so that changes can be
-        // reverted if the process fails.
-        // Also ensure the memory range is valid for the sender. If it isn't, the sender has either
-        // shared it with another VM already or has no claim to the memory.
-        let orig_from_mode = from_inner.ptable.get_mode(begin, end)?;
+        // Process one bounded chunk under the locks.
+        let chunk_begin = state.begin + state.cursor;
+        let chunk_end = cmp::min(chunk_begin + Self::SHARE_CHUNK_BYTES, state.begin + size);
+        let pa_begin = pa_init(chunk_begin);
+        let pa_end = pa_init(chunk_end);
+
+        // Roll the whole operation back on any failure: restore the sender's
+        // mapping of everything processed so far, unmap the recipient's, and
+        // drop the record.
+        let rollback = |from_ptable: &mut VmPtable, to_ptable: &mut VmPtable| {
+            let done_end = pa_init(chunk_begin);
+            let _ = from_ptable.table.identity_map(
+                pa_init(state.begin),
+                done_end,
+                state.orig_from_mode,
+                &local_page_pool,
+            );
+            let _ = to_ptable.table.identity_map(
+                pa_init(state.begin),
+                done_end,
+                state.orig_to_mode,
+                &local_page_pool,
+            );
+            self.share_states.lock().states[slot] = None;
+        };
 
-        if orig_from_mode.contains(Mode::INVALID) {
+        // Guard against the sender's mapping having changed between chunks.
+        if from_ptable
+            .table
+            .get_mode(ipa_init(chunk_begin), ipa_init(chunk_end))
+            .map(|mode| mode != state.orig_from_mode)
+            .unwrap_or(true)
+        {
+            rollback(&mut from_ptable, &mut to_ptable);
             return Err(());
         }
 
-        // The sender must own the memory and have exclusive access to it in order to share it.
-        // Alternatively, it is giving memory back to the owning VM.
-        if orig_from_mode.contains(Mode::UNOWNED) {
-            let to_mode = to_inner.ptable.get_mode(begin, end)?;
-
-            if to_mode.contains(Mode::UNOWNED) {
-                return Err(());
-            }
+        // First update the mapping for the sender so there is not overlap with the recipient.
+        if from_ptable
+            .table
+            .identity_map(pa_begin, pa_end, state.from_mode, &local_page_pool)
+            .is_err()
+        {
+            rollback(&mut from_ptable, &mut to_ptable);
+            return Err(());
+        }
 
-            if share != HfShare::Give {
-                return Err(());
-            }
-        } else if orig_from_mode.contains(Mode::SHARED) {
+        // Clear the memory so no VM or device can see the previous contents,
+        // then complete the transfer by mapping the memory into the
+        // recipient.
+        if self.clear_memory(pa_begin, pa_end, &local_page_pool).is_err()
+            || to_ptable
+                .table
+                .identity_map(pa_begin, pa_end, state.to_mode, &local_page_pool)
+                .is_err()
+        {
+            let _ = from_ptable.table.identity_map(
+                pa_begin,
+                pa_end,
+                state.orig_from_mode,
+                &local_page_pool,
+            );
+            rollback(&mut from_ptable, &mut to_ptable);
             return Err(());
         }
 
-        let pa_begin = pa_from_ipa(begin);
-        let pa_end = pa_from_ipa(end);
+        // Advance the cursor; the caller re-traps until the range is done.
+        let mut share_states = self.share_states.lock();
+        let entry = share_states.states[slot].as_mut().ok_or(())?;
+        entry.cursor = chunk_end - state.begin;
 
-        // First update the mapping for the sender so there is not overlap with the recipient.
-        from_inner
-            .ptable
-            .identity_map(pa_begin, pa_end, from_mode, &local_page_pool)?;
+        if entry.cursor == size {
+            Ok(Some(entry.handle))
+        } else {
+            Ok(None)
+        }
+    }
 
-        // Clear the memory so no VM or device can see the previous contents.
-        if self
-            .clear_memory(pa_begin, pa_end, &local_page_pool)
-            .is_err()
-        {
-            from_inner
-                .ptable
-                .identity_map(pa_begin, pa_end, orig_from_mode, &local_page_pool)
-                .unwrap();
+    /// Revokes a previously recorded memory share: the recorded extent is
+    /// restored to its original mode in both VMs in one batched update each,
+    /// with no revalidation walk. Only the sharing VM may revoke.
+    pub fn share_memory_revoke(
+        &self,
+        handle: spci_memory_handle_t,
+        current: &VCpu,
+    ) -> Result<(), ()> {
+        let mut share_states = self.share_states.lock();
+
+        let state = {
+            let slot = share_states
+                .states
+                .iter_mut()
+                .find(|s| s.map(|state| state.handle) == Some(handle))
+                .ok_or(())?;
+
+            // Only the VM that shared the memory may revoke it, and an
+            // operation still in progress cannot be revoked.
+            if slot.unwrap().from != current.vm().id || slot.unwrap().cursor < slot.unwrap().size {
+                return Err(());
+            }
 
-            return Err(());
-        }
+            slot.take().unwrap()
+        };
+        drop(share_states);
 
-        // Complete the transfer by mapping the memory into the recipient.
-        if to_inner
-            .ptable
-            .identity_map(pa_begin, pa_end, to_mode, &local_page_pool)
-            .is_err()
-        {
-            // TODO: partial defrag of failed range.
-            // Recover any memory consumed in failed mapping.
-            from_inner.ptable.defrag(&local_page_pool);
-            from_inner
-                .ptable
-                .identity_map(pa_begin, pa_end, orig_from_mode, &local_page_pool)
-                .unwrap();
+        let from = self.vm_manager.get(state.from).ok_or(())?;
+        let to = self.vm_manager.get(state.to).ok_or(())?;
 
-            return Err(());
+        let local_page_pool = MPool::new_with_fallback(&self.mpool);
+        let (mut from_ptable, mut to_ptable) = SpinLock::lock_both(&from.ptable, &to.ptable);
+
+        let pa_begin = pa_init(state.begin);
+        let pa_end = pa_init(state.begin + state.size);
+
+        // Unmap from the recipient first so there is no window with overlap.
+        to_ptable
+            .table
+            .identity_map(pa_begin, pa_end, state.orig_to_mode, &local_page_pool)?;
+
+        // The recipient may have written secrets, so the memory is scrubbed
+        // before the owner sees it again. If the owner currently has no
+        // access to the region (it gave or lent the memory away), the scrub
+        // is deferred to idle cycles and the owner's mapping stays withheld
+        // until it has run; otherwise scrub synchronously.
+        let from_locked_out = {
+            let current_mode = from_ptable
+                .table
+                .get_mode(ipa_init(state.begin), ipa_init(state.begin + state.size))
+                .unwrap_or(Mode::empty());
+            current_mode.contains(Mode::INVALID)
+        };
+
+        if from_locked_out
+            && self
+                .scrub_enqueue(state.from, state.begin, state.begin + state.size, state.orig_from_mode)
+                .is_ok()
+        {
+            return Ok(());
         }
 
+        self.clear_memory(pa_begin, pa_end, &local_page_pool)?;
+        from_ptable
+            .table
+            .identity_map(pa_begin, pa_end, state.orig_from_mode, &local_page_pool)?;
+
         Ok(())
     }
 
+    /// Records the fast-path capabilities the calling VM advertises and
+    /// returns the subset the hypervisor supports, which is also what gets
+    /// recorded. Hot handlers then branch on the cached word instead of
+    /// probing per call.
+    pub fn spci_features(&self, requested: u32, current: &VCpu) -> i32 {
+        let supported = SpciFeatures::all();
+        let granted = SpciFeatures::from_bits_truncate(requested) & supported;
+
+        current
+            .vm()
+            .features
+            .store(granted.bits(), Ordering::Relaxed);
+
+        granted.bits() as i32
+    }
+
     /// Returns the version of the implemented SPCI specification.
     pub fn spci_version(&self) -> i32 {
         // Ensure that both major and minor revision representation occupies at most 15 bits.
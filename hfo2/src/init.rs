@@ -23,6 +23,7 @@ use crate::boot_flow::*;
 use crate::boot_params::*;
 use crate::cpu::*;
 use crate::hypervisor::*;
+use crate::layout::*;
 use crate::load::*;
 use crate::manifest::*;
 use crate::memiter::*;
@@ -34,11 +35,17 @@ use crate::vm::*;
 
 extern "C" {
     fn plat_console_init();
+    fn arch_mm_early_init();
+    fn arch_cpu_locality_current() -> u32;
+    fn arch_pmu_cpu_init();
+    fn arch_cpu_cycle_count() -> u64;
+    fn plat_console_enable_buffered();
     fn arch_one_time_init();
     fn dlog_enable_lock();
 
-    /// The stack to be used by the CPUs.
-    static callstacks: [[u8; STACK_SIZE]; MAX_CPUS];
+    /// The stack to be used by the CPUs. The first page of each slot is a
+    /// guard, unmapped below.
+    static callstacks: [[u8; STACK_GUARD_SIZE + STACK_SIZE]; MAX_CPUS];
 
     /// A record for boot CPU. Its field `stack_bottom` is initialized.
     /// Hafnium loader writes booted CPU ID on `cpus.id` and initializes the CPU
@@ -50,6 +57,54 @@ extern "C" {
     static boot_cpu: Cpu;
 }
 
+/// Number of boot phase stamps the timeline can hold.
+const BOOT_TRACE_SIZE: usize = 16;
+
+/// Boot phase timeline: (phase name, counter stamp) pairs recorded during
+/// one_time_init, dumped to the log at the end of boot and queryable by the
+/// primary through a hypercall. Only touched by the boot CPU.
+static mut BOOT_TRACE: [(&str, u64); BOOT_TRACE_SIZE] = [("", 0); BOOT_TRACE_SIZE];
+static mut BOOT_TRACE_LEN: usize = 0;
+
+/// Records a boot phase stamp.
+fn boot_trace(phase: &'static str) {
+    unsafe {
+        if BOOT_TRACE_LEN < BOOT_TRACE_SIZE {
+            BOOT_TRACE[BOOT_TRACE_LEN] = (phase, arch_cpu_cycle_count());
+            BOOT_TRACE_LEN += 1;
+        }
+    }
+}
+
+/// Dumps the boot timeline, with deltas between consecutive phases.
+fn boot_trace_dump() {
+    unsafe {
+        let mut prev = some_or!(BOOT_TRACE.get(0), return).1;
+        for (phase, stamp) in BOOT_TRACE[..BOOT_TRACE_LEN].iter() {
+            dlog!("boot trace: {:<12} at {} (+{})\n", phase, stamp, stamp - prev);
+            prev = *stamp;
+        }
+    }
+}
+
+/// Returns the counter stamp of the given boot phase index, or -1 when out
+/// of range or the caller is not the primary VM.
+#[no_mangle]
+pub unsafe extern "C" fn api_boot_trace_read(index: usize, current: *const VCpu) -> i64 {
+    use core::mem::ManuallyDrop;
+
+    let current = ManuallyDrop::new(VCpuExecutionLocked::from_raw(current));
+    if current.vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    if index >= BOOT_TRACE_LEN {
+        return -1;
+    }
+
+    BOOT_TRACE[index].1 as i64
+}
+
 /// Note(HfO2): this variable was originally of type
 /// MaybeUninit<[u8; mem::size_of::<RawPageTable>() * HEAP_PAGES]>,
 /// but it was not aligned to PAGE_SIZE.
@@ -82,29 +137,42 @@ unsafe extern "C" fn one_time_init(c: *const Cpu) -> *const Cpu {
         return c;
     }
 
+    // Get the MMU and caches on behind the coarse boot table before
+    // anything else: the FDT parse, manifest walk and image loads below
+    // run orders of magnitude faster cached than device-ordered.
+    arch_mm_early_init();
+
     // Make sure the console is initialised before calling dlog.
     plat_console_init();
 
     dlog!("Initialising hafnium\n");
+    boot_trace("start");
 
     arch_one_time_init();
     arch_cpu_module_init();
 
     let ppool = MPool::new();
-    ppool.free_pages(Pages::from_raw(
-        PTABLE_BUF.get_mut().as_mut_ptr(),
-        HEAP_PAGES,
-    ));
+    // Tag the boot heap with the boot CPU's cluster. Platforms whose
+    // devicetree describes per-cluster memory can add further chunks with
+    // their own tags through mpool_add_chunk_tagged.
+    ppool.add_pages_tagged(
+        Pages::from_raw(PTABLE_BUF.get_mut().as_mut_ptr(), HEAP_PAGES),
+        arch_cpu_locality_current(),
+    );
 
     let mm = MemoryManager::new(&ppool).expect("mm_init failed");
 
     mm.cpu_init();
+    boot_trace("mm_init");
 
     // Enable locks now that mm is initialised.
     dlog_enable_lock();
     mpool_enable_locks();
 
     /// Note(HfO2): This variable was originally local, but now is static to prevent stack overflow.
+    /// Boot-only: placed in `.boot.init` and reclaimed with the rest of the
+    /// region below; the persistent manifest cache keeps its own copy.
+    #[link_section = ".boot.init"]
     static mut MANIFEST: MaybeUninit<Manifest> = MaybeUninit::uninit();
     let mut manifest = MANIFEST.get_mut();
     let mut params: BootParams = MaybeUninit::uninit().assume_init();
@@ -117,6 +185,7 @@ unsafe extern "C" fn one_time_init(c: *const Cpu) -> *const Cpu {
         &ppool,
     )
     .expect("Could not parse data from FDT.");
+    boot_trace("fdt_manifest");
 
     let cpum = CpuManager::new(
         &params.cpu_ids[..params.cpu_count],
@@ -129,6 +198,7 @@ unsafe extern "C" fn one_time_init(c: *const Cpu) -> *const Cpu {
         HYPERVISOR.get_mut(),
         Hypervisor::new(ppool, mm, cpum, VmManager::new()),
     );
+    boot_trace("cpu_managers");
 
     for i in 0..params.mem_ranges_count {
         dlog!(
@@ -166,12 +236,12 @@ unsafe extern "C" fn one_time_init(c: *const Cpu) -> *const Cpu {
     // Load all VMs.
     let primary_initrd = load_primary(
         &mut HYPERVISOR.get_mut().vm_manager,
-        &mut hypervisor_ptable,
         &cpio,
         params.kernel_arg,
         &hypervisor().mpool,
     )
     .expect("unable to load primary VM");
+    boot_trace("load_primary");
 
     // load_secondary will add regions assigned to the secondary VMs from
     // mem_ranges to reserved_ranges.
@@ -190,6 +260,7 @@ unsafe extern "C" fn one_time_init(c: *const Cpu) -> *const Cpu {
         &hypervisor().mpool,
     )
     .expect("unable to load secondary VMs");
+    boot_trace("load_secondary");
 
     // Prepare to run by updating bootparams as seen by primary VM.
     boot_params_patch_fdt(&mut hypervisor_ptable, &mut update, &hypervisor().mpool)
@@ -200,6 +271,53 @@ unsafe extern "C" fn one_time_init(c: *const Cpu) -> *const Cpu {
     // Enable TLB invalidation for VM page table updates.
     mm_vm_enable_invalidation();
 
+    // Now that the executing CPU is always known, enable the per-CPU caches of
+    // the page pool and defer console output through the per-CPU log rings.
+    mpool_enable_caches();
+    crate::dlog::dlog_enable_deferred();
+    plat_console_enable_buffered();
+
+    // Unmap the guard page below each CPU stack, so an overflow takes an
+    // immediate stage-1 fault instead of corrupting the neighbouring
+    // stack. The canary-free build profile relies on these guards.
+    for stack in callstacks.iter() {
+        let guard_begin = pa_init(stack.as_ptr() as usize);
+        let _ = hypervisor_ptable.unmap(
+            guard_begin,
+            pa_add(guard_begin, STACK_GUARD_SIZE),
+            &hypervisor().mpool,
+        );
+    }
+
+    // Boot-only code and data are dead weight from here on: unmap the
+    // .boot.init region from stage-1 and donate its pages to the page pool
+    // for stage-2 tables.
+    {
+        let begin = layout_init_begin();
+        let end = layout_init_end();
+        let size = pa_difference(begin, end);
+
+        if size > 0 {
+            let _ = hypervisor_ptable.unmap(begin, end, &hypervisor().mpool);
+            if let Ok(pages) = Pages::from_raw_u8(pa_addr(begin) as *mut u8, size) {
+                hypervisor().mpool.free_pages(pages);
+            }
+            dlog!("Reclaimed {} bytes of boot-only memory\n", size);
+        }
+    }
+
+    // Allocator summary for capacity planning.
+    dlog!(
+        "ppool: {} allocs, {} frees, {} free pages (low watermark {})\n",
+        crate::mpool::mpool_stat(&hypervisor().mpool, 0),
+        crate::mpool::mpool_stat(&hypervisor().mpool, 1),
+        crate::mpool::mpool_stat(&hypervisor().mpool, 3),
+        crate::mpool::mpool_stat(&hypervisor().mpool, 4),
+    );
+
+    boot_trace("finish");
+    boot_trace_dump();
+
     dlog!("Hafnium initialisation completed\n");
     INITED = true;
 
@@ -222,6 +340,9 @@ pub unsafe extern "C" fn cpu_main(c: *const Cpu) -> *const VCpu {
         hypervisor().memory_manager.cpu_init();
     }
 
+    // Start the self-profiling counters of this CPU.
+    arch_pmu_cpu_init();
+
     let primary = hypervisor().vm_manager.get_primary();
     let vcpu = &primary.vcpus[hypervisor().cpu_manager.index_of(c)];
 
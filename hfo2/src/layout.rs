@@ -26,6 +26,9 @@ extern "C" {
     pub fn layout_data_begin() -> paddr_t;
     pub fn layout_data_end() -> paddr_t;
 
+    pub fn layout_init_begin() -> paddr_t;
+    pub fn layout_init_end() -> paddr_t;
+
     pub fn layout_initrd_begin() -> paddr_t;
     pub fn layout_initrd_end() -> paddr_t;
 
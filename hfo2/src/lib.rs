@@ -26,6 +26,7 @@
 #![feature(linkage)]
 #![feature(track_caller)]
 #![feature(try_blocks)]
+#![feature(const_in_array_repeat_expressions)]
 
 #[macro_use]
 extern crate bitflags;
@@ -57,12 +58,14 @@ mod hypervisor;
 mod init;
 mod layout;
 mod load;
+mod lz4;
 mod manifest;
 mod memiter;
 mod mm;
 mod mpool;
 mod page;
 mod panic;
+mod perf;
 mod slist;
 mod spci;
 mod spci_architected_message;
@@ -14,9 +14,11 @@
  * limitations under the License.
  */
 
+use core::cmp;
 use core::mem;
 use core::ptr;
 use core::str;
+use core::sync::atomic::Ordering;
 
 use crate::addr::*;
 use crate::arch::*;
@@ -24,11 +26,13 @@ use crate::boot_params::*;
 use crate::cpio::*;
 use crate::cpu::*;
 use crate::layout::*;
+use crate::lz4::*;
 use crate::manifest::*;
 use crate::memiter::*;
 use crate::mm::*;
 use crate::mpool::*;
 use crate::page::*;
+use crate::std::*;
 use crate::types::*;
 use crate::utils::*;
 use crate::vm::*;
@@ -58,8 +62,18 @@ unsafe fn copy_to_unmapped(
         return false;
     }
 
-    ptr::copy_nonoverlapping(from, pa_addr(to) as *mut _, size);
-    arch_mm_flush_dcache(pa_addr(to), size);
+    // Copy and maintain the cache in chunks: cleaning a chunk right after it
+    // is copied hits lines that are still hot in L1, instead of re-walking
+    // the whole image cold after a copy-then-flush sequence. A clean is
+    // enough here; the mapping change below publishes the data.
+    const COPY_CHUNK: usize = 64 * 1024;
+    let mut offset = 0;
+    while offset < size {
+        let chunk = cmp::min(COPY_CHUNK, size - offset);
+        ptr::copy_nonoverlapping(from.add(offset), (pa_addr(to) + offset) as *mut _, chunk);
+        arch_mm_clean_dcache(pa_addr(to) + offset, chunk);
+        offset += chunk;
+    }
 
     hypervisor_ptable.unmap(to, to_end, ppool).unwrap();
 
@@ -69,7 +83,6 @@ unsafe fn copy_to_unmapped(
 /// Loads the primary VM.
 pub unsafe fn load_primary(
     vm_manager: &mut VmManager,
-    hypervisor_ptable: &mut PageTable<Stage1>,
     cpio: &MemIter,
     kernel_arg: uintreg_t,
     ppool: &MPool,
@@ -82,15 +95,10 @@ pub unsafe fn load_primary(
     });
 
     dlog!(
-        "Copying primary to {:p}\n",
+        "Primary kernel at {:p}, populated on demand\n",
         pa_addr(primary_begin) as *const u8
     );
 
-    if !copy_to_unmapped(hypervisor_ptable, primary_begin, &it, ppool) {
-        dlog!("Unable to relocate kernel for primary vm.\n");
-        return Err(());
-    }
-
     let initrd = some_or!(find_file(cpio, "initrd.img\0".as_ptr()), {
         dlog!("Unable to find initrd.img\n");
         return Err(());
@@ -110,9 +118,9 @@ pub unsafe fn load_primary(
     // Map the 1TB of memory.
     // TODO: We should do a whitelist rather than blacklist.
     if vm
-        .inner
-        .get_mut()
         .ptable
+        .get_mut()
+        .table
         .identity_map(
             pa_init(0),
             pa_init(1024usize * 1024 * 1024 * 1024),
@@ -125,11 +133,35 @@ pub unsafe fn load_primary(
         return Err(());
     }
 
-    if !mm_vm_unmap_hypervisor(&mut (*vm).inner.get_mut_unchecked().ptable, ppool) {
+    if !mm_vm_unmap_hypervisor(&mut (*vm).ptable.get_mut_unchecked().table, ppool) {
         dlog!("Unable to unmap hypervisor from primary vm\n");
         return Err(());
     }
 
+    // The primary kernel is not copied by the boot CPU: its region is left
+    // unmapped and pages are populated from the ramdisk image on first
+    // access, with per-page cache maintenance. The copy work is thereby
+    // spread over every core the primary brings up, each faulting in the
+    // stripes it actually executes, instead of serializing on one core while
+    // the others sit in the boot spin.
+    let kernel_end = round_up(pa_addr(primary_begin) + it.len(), PAGE_SIZE);
+    if vm
+        .ptable
+        .get_mut()
+        .table
+        .unmap(primary_begin, pa_init(kernel_end), ppool)
+        .is_err()
+    {
+        dlog!("Unable to prepare lazy primary kernel\n");
+        return Err(());
+    }
+    vm.ptable.get_mut().lazy_image = Some(LazyImage {
+        src: it.get_next() as usize,
+        src_len: it.len(),
+        begin: pa_addr(primary_begin),
+        end: kernel_end,
+    });
+
     vm.vcpus[0]
         .inner
         .lock() // TODO(HfO2): We can safely use get_mut() here
@@ -147,12 +179,34 @@ fn carve_out_mem_range(
 ) -> Result<(paddr_t, paddr_t), ()> {
     // TODO(b/116191358): Consider being cleverer about how we pack VMs
     // together, with a non-greedy algorithm.
-    for mem_range in mem_ranges.iter_mut() {
-        if size_to_find <= pa_difference(mem_range.begin, mem_range.end) as u64 {
-            // This range is big enough, take some of it from the end and reduce
-            // its size accordingly.
-            let found_end = mem_range.end;
-            let found_begin = pa_init(pa_addr(mem_range.end) - size_to_find as usize);
+    // Base alignment policy: the largest block size (up to 1 GiB) the VM's
+    // memory fills, so stage-2 block mappings and the contiguous hint can
+    // engage for guest RAM instead of being defeated by a misaligned base.
+    let alignment = if size_to_find >= (1 << 30) {
+        1u64 << 30
+    } else if size_to_find >= (2 << 20) {
+        2u64 << 20
+    } else {
+        PAGE_SIZE as u64
+    };
+
+    // First pass aligned; fall back to any placement rather than failing the
+    // load. The cut tail below an aligned base (at most one alignment unit)
+    // stays reserved and unused.
+    for &align in [alignment, PAGE_SIZE as u64].iter() {
+        for mem_range in mem_ranges.iter_mut() {
+            if size_to_find > pa_difference(mem_range.begin, mem_range.end) as u64 {
+                continue;
+            }
+
+            let found_begin =
+                round_down(pa_addr(mem_range.end) - size_to_find as usize, align as usize);
+            if found_begin < pa_addr(mem_range.begin) {
+                continue;
+            }
+
+            let found_end = pa_init(found_begin + size_to_find as usize);
+            let found_begin = pa_init(found_begin);
             mem_range.end = found_begin;
             return Ok((found_begin, found_end));
         }
@@ -263,59 +317,201 @@ pub unsafe fn load_secondary(
                 continue;
             });
 
-        if !copy_to_unmapped(hypervisor_ptable, secondary_mem_begin, &kernel, ppool) {
-            dlog!("Unable to copy kernel\n");
-            continue;
-        }
+        // Each VM is loaded out of its own pool fragment, pre-charged in bulk
+        // from the boot pool, so the per-VM loads are independent units that
+        // don't contend on the shared pool lock. (In this tree the remaining
+        // physical CPUs are still powered off at this point, so the units run
+        // sequentially on the boot CPU; the fragments keep them ready to be
+        // farmed out once early CPU bring-up exists.)
+        let local_ppool = MPool::new_with_fallback(ppool);
+        local_ppool.prefetch((mem_size as usize >> (PAGE_BITS + PAGE_LEVEL_BITS)) + 8);
+
+        // Execute-in-place: when the manifest asks for it and the archive
+        // laid the kernel out page-aligned, the image pages are mapped
+        // read-only executable straight from the ramdisk — shared by every
+        // VM that runs the same image — and only the VM's (lazily zeroed)
+        // RAM is carved out. Otherwise the VM's memory is left unmapped and
+        // each page is populated from the master image on first access, so
+        // untouched pages cost neither boot-time copy nor memory.
+        let kernel_slice =
+            unsafe { core::slice::from_raw_parts(kernel.get_next(), kernel.len()) };
+        let compressed = is_lz4(kernel_slice);
+
+        let xip = !compressed
+            && manifest_vm.execute_in_place
+            && is_aligned(kernel.get_next() as usize, PAGE_SIZE);
+        let lazy_image = if xip {
+            // RAM only; zero-filled on first access.
+            LazyImage {
+                src: 0,
+                src_len: 0,
+                begin: pa_addr(secondary_mem_begin),
+                end: pa_addr(secondary_mem_end),
+            }
+        } else {
+            LazyImage {
+                src: kernel.get_next() as usize,
+                src_len: kernel.len(),
+                begin: pa_addr(secondary_mem_begin),
+                end: pa_addr(secondary_mem_end),
+            }
+        };
 
         let primary = vm_manager.get_mut(HF_PRIMARY_VM_ID).unwrap();
 
         // Deny the primary VM access to this memory.
         if primary
-            .inner
-            .get_mut()
             .ptable
-            .unmap(secondary_mem_begin, secondary_mem_end, ppool)
+            .get_mut()
+            .table
+            .unmap(secondary_mem_begin, secondary_mem_end, &local_ppool)
             .is_err()
         {
             dlog!("Unable to unmap secondary VM from primary VM\n");
             return Err(());
         }
 
-        let vm = some_or!(vm_manager.new_vm(manifest_vm.vcpu_count, ppool), {
+        let vm = some_or!(vm_manager.new_vm(manifest_vm.vcpu_count, &local_ppool), {
             dlog!("Unable to initialise VM\n");
             continue;
         });
 
-        // Grant the VM access to the memory.
-        if vm
-            .inner
-            .get_mut()
-            .ptable
-            .identity_map(
-                secondary_mem_begin,
-                secondary_mem_end,
-                Mode::R | Mode::W | Mode::X,
-                ppool,
-            )
-            .is_err()
-        {
-            dlog!("Unable to initialise memory\n");
-            continue;
+        // Compressed members are decompressed straight into the VM's mapped
+        // memory, block by block with cache maintenance interleaved —
+        // trading cheap CPU for flash reads, with no extra copy pass. The
+        // remaining RAM is still lazily zeroed.
+        if compressed {
+            let dst_size = pa_difference(secondary_mem_begin, secondary_mem_end);
+            let mut ok = false;
+            if hypervisor_ptable
+                .identity_map(secondary_mem_begin, secondary_mem_end, Mode::W, &local_ppool)
+                .is_ok()
+            {
+                let dst = unsafe {
+                    core::slice::from_raw_parts_mut(
+                        pa_addr(secondary_mem_begin) as *mut u8,
+                        dst_size,
+                    )
+                };
+                let mut cleaned = 0;
+                let mut image_end = 0;
+                ok = decompress_legacy(kernel_slice, dst, |done| {
+                    unsafe {
+                        arch_mm_clean_dcache(pa_addr(secondary_mem_begin) + cleaned, done - cleaned)
+                    };
+                    cleaned = done;
+                })
+                .map(|len| {
+                    // Zero the partial last page while the window is mapped,
+                    // then hand the rest of RAM to lazy zeroing.
+                    image_end = round_up(pa_addr(secondary_mem_begin) + len, PAGE_SIZE);
+                    unsafe {
+                        ptr::write_bytes(
+                            (pa_addr(secondary_mem_begin) + len) as *mut u8,
+                            0,
+                            image_end - (pa_addr(secondary_mem_begin) + len),
+                        );
+                    }
+                    vm.ptable.get_mut().lazy_image = Some(LazyImage {
+                        src: 0,
+                        src_len: 0,
+                        begin: image_end,
+                        end: pa_addr(secondary_mem_end),
+                    });
+                })
+                .is_ok();
+                let _ = hypervisor_ptable.unmap(
+                    secondary_mem_begin,
+                    secondary_mem_end,
+                    &local_ppool,
+                );
+
+                // Map only the decompressed image eagerly; the zero tail
+                // stays unmapped for lazy population.
+                ok = ok
+                    && vm
+                        .ptable
+                        .get_mut()
+                        .table
+                        .identity_map(
+                            secondary_mem_begin,
+                            pa_init(image_end),
+                            Mode::R | Mode::W | Mode::X,
+                            &local_ppool,
+                        )
+                        .is_ok();
+            }
+            if !ok {
+                dlog!("Unable to decompress kernel\n");
+                continue;
+            }
+        } else {
+            // Record where the memory is populated from; the pages
+            // themselves are mapped on first access.
+            vm.ptable.get_mut().lazy_image = Some(lazy_image);
         }
 
+        // Map the in-place image read-only executable; the pages stay owned
+        // by the ramdisk, so any number of VMs share the same master copy.
+        if xip {
+            let image_begin = pa_init(kernel.get_next() as usize);
+            let image_end = pa_init(round_up(
+                kernel.get_next() as usize + kernel.len(),
+                PAGE_SIZE,
+            ));
+            if vm
+                .ptable
+                .get_mut()
+                .table
+                .identity_map(
+                    image_begin,
+                    image_end,
+                    Mode::R | Mode::X | Mode::UNOWNED | Mode::SHARED,
+                    &local_ppool,
+                )
+                .is_err()
+            {
+                dlog!("Unable to map in-place image\n");
+                continue;
+            }
+        }
+        vm.wfi_passthrough = manifest_vm.wfi_passthrough;
+        vm.cpu_affinity = manifest_vm.cpu_affinity;
+        vm.priority = manifest_vm.priority as u8;
+        vm.dedicated_cores = manifest_vm.dedicated_cores;
+        if manifest_vm.log_buffer_size != 0 {
+            vm.inner
+                .get_mut()
+                .set_log_limit(manifest_vm.log_buffer_size as usize);
+        }
+        vm.inner.get_mut().set_log_rate(manifest_vm.log_rate);
+
         dlog!(
             "Loaded with {} vcpus, entry at 0x{:x}\n",
             manifest_vm.vcpu_count,
             pa_addr(secondary_mem_begin)
         );
 
-        let secondary_entry = ipa_from_pa(secondary_mem_begin);
-        vcpu_secondary_reset_and_start(
-            &mut vm.vcpus[0],
-            secondary_entry,
-            pa_difference(secondary_mem_begin, secondary_mem_end) as uintreg_t,
-        );
+        // An execute-in-place VM starts at the ramdisk-resident image with
+        // its RAM base as argument; a copied VM keeps the traditional entry
+        // at its memory base with the memory size as argument.
+        let (secondary_entry, secondary_arg) = if xip {
+            (
+                ipa_init(kernel.get_next() as usize),
+                pa_addr(secondary_mem_begin) as uintreg_t,
+            )
+        } else {
+            (
+                ipa_from_pa(secondary_mem_begin),
+                pa_difference(secondary_mem_begin, secondary_mem_end) as uintreg_t,
+            )
+        };
+        // The image bytes written above (copied, decompressed or mapped in
+        // place) still need an instruction-cache sync; defer it to the
+        // first vCPU start so standby images that never run pay nothing.
+        vm.pending_exec_sync.store(true, Ordering::Relaxed);
+
+        vcpu_secondary_reset_and_start(&mut vm.vcpus[0], secondary_entry, secondary_arg);
     }
 
     // Add newly reserved areas to update params by looking at the difference
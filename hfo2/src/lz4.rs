@@ -0,0 +1,142 @@
+/*
+ * Copyright 2019 Jeehoon Kang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! Minimal LZ4 decoder for compressed ramdisk members.
+//!
+//! Supports the legacy frame format (magic 0x184C2102: a sequence of
+//! 32-bit-length-prefixed raw LZ4 blocks), which is what `lz4 -l` and kernel
+//! build systems emit. Self-contained, allocation-free, and streamed block
+//! by block so the loader can interleave cache maintenance.
+
+/// The legacy frame magic, little-endian.
+pub const LZ4_LEGACY_MAGIC: u32 = 0x184C_2102;
+
+/// Returns whether the buffer starts with a legacy LZ4 frame.
+pub fn is_lz4(src: &[u8]) -> bool {
+    src.len() >= 4 && read_u32(src, 0) == LZ4_LEGACY_MAGIC
+}
+
+fn read_u32(src: &[u8], at: usize) -> u32 {
+    u32::from(src[at])
+        | u32::from(src[at + 1]) << 8
+        | u32::from(src[at + 2]) << 16
+        | u32::from(src[at + 3]) << 24
+}
+
+/// Decodes one raw LZ4 block into `dst[dst_len..]`, returning the new output
+/// length. Fails on malformed input or output overflow; all accesses are
+/// bounds checked.
+fn decompress_block(src: &[u8], dst: &mut [u8], mut dst_len: usize) -> Result<usize, ()> {
+    let mut i = 0;
+
+    while i < src.len() {
+        let token = src[i];
+        i += 1;
+
+        // Literal run.
+        let mut lit = (token >> 4) as usize;
+        if lit == 15 {
+            loop {
+                let b = *src.get(i).ok_or(())?;
+                i += 1;
+                lit += b as usize;
+                if b != 255 {
+                    break;
+                }
+            }
+        }
+        if i + lit > src.len() || dst_len + lit > dst.len() {
+            return Err(());
+        }
+        dst[dst_len..dst_len + lit].copy_from_slice(&src[i..i + lit]);
+        i += lit;
+        dst_len += lit;
+
+        // The last sequence has no match part.
+        if i == src.len() {
+            break;
+        }
+
+        // Match: 16-bit little-endian offset plus length.
+        if i + 2 > src.len() {
+            return Err(());
+        }
+        let offset = usize::from(src[i]) | usize::from(src[i + 1]) << 8;
+        i += 2;
+        if offset == 0 || offset > dst_len {
+            return Err(());
+        }
+
+        let mut mlen = (token & 0xf) as usize + 4;
+        if token & 0xf == 0xf {
+            loop {
+                let b = *src.get(i).ok_or(())?;
+                i += 1;
+                mlen += b as usize;
+                if b != 255 {
+                    break;
+                }
+            }
+        }
+        if dst_len + mlen > dst.len() {
+            return Err(());
+        }
+
+        // Byte-by-byte: matches may overlap their own output.
+        let start = dst_len - offset;
+        for k in 0..mlen {
+            dst[dst_len + k] = dst[start + k];
+        }
+        dst_len += mlen;
+    }
+
+    Ok(dst_len)
+}
+
+/// Decompresses a whole legacy frame, calling `progress(done_len)` after each
+/// block so the caller can interleave cache maintenance. Returns the
+/// decompressed size.
+pub fn decompress_legacy<F: FnMut(usize)>(
+    src: &[u8],
+    dst: &mut [u8],
+    mut progress: F,
+) -> Result<usize, ()> {
+    if !is_lz4(src) {
+        return Err(());
+    }
+
+    let mut i = 4;
+    let mut dst_len = 0;
+
+    while i + 4 <= src.len() {
+        let block_len = read_u32(src, i) as usize;
+        i += 4;
+
+        // A following frame magic ends the stream.
+        if block_len == LZ4_LEGACY_MAGIC as usize {
+            break;
+        }
+        if i + block_len > src.len() {
+            return Err(());
+        }
+
+        dst_len = decompress_block(&src[i..i + block_len], dst, dst_len)?;
+        i += block_len;
+        progress(dst_len);
+    }
+
+    Ok(dst_len)
+}
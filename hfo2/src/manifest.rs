@@ -16,6 +16,8 @@
 
 use core::convert::TryInto;
 use core::fmt::{self, Write};
+use core::mem::MaybeUninit;
+use core::ptr;
 
 use crate::fdt::*;
 use crate::memiter::*;
@@ -75,6 +77,37 @@ pub struct ManifestVm {
     pub kernel_filename: [u8; MANIFEST_MAX_STRING_LENGTH],
     pub mem_size: u64,
     pub vcpu_count: spci_vcpu_count_t,
+
+    /// Whether wfi/wfe execute natively in this VM instead of trapping, for
+    /// VMs with a dedicated physical core. Set by the boolean
+    /// "wfi_passthrough" manifest property.
+    pub wfi_passthrough: bool,
+
+    /// The VM's log flush threshold in bytes ("log_buffer_size" property;
+    /// 0 keeps the default).
+    pub log_buffer_size: u64,
+
+    /// The VM's log rate limit in lines per second ("log_rate" property;
+    /// 0 keeps it unlimited).
+    pub log_rate: u64,
+
+    /// Whether the VM executes its kernel in place from the ramdisk
+    /// ("execute_in_place" boolean property): the image pages are mapped
+    /// read-only executable at their ramdisk-resident addresses instead of
+    /// being copied, and only the VM's RAM is carved out.
+    pub execute_in_place: bool,
+
+    /// Physical CPUs this VM's vCPUs may be placed on ("cpu_affinity"
+    /// property, a bit mask over CPU indices; 0 means unrestricted).
+    pub cpu_affinity: u64,
+
+    /// Scheduling priority class ("priority" property; 0 is the default
+    /// class, lower numbers are more urgent).
+    pub priority: u64,
+
+    /// Whether the CPUs in the affinity mask are dedicated to this VM and
+    /// should not run anything else ("dedicated_cores" boolean property).
+    pub dedicated_cores: bool,
 }
 
 /// Hafnium manifest parsed from FDT.
@@ -237,10 +270,42 @@ impl ManifestVm {
             kernel_filename,
             mem_size,
             vcpu_count,
+            wfi_passthrough: node
+                .read_property("wfi_passthrough\0".as_ptr())
+                .is_ok(),
+            log_buffer_size: node.read_u64("log_buffer_size\0".as_ptr()).unwrap_or(0),
+            log_rate: node.read_u64("log_rate\0".as_ptr()).unwrap_or(0),
+            execute_in_place: node
+                .read_property("execute_in_place\0".as_ptr())
+                .is_ok(),
+            cpu_affinity: node.read_u64("cpu_affinity\0".as_ptr()).unwrap_or(0),
+            priority: node.read_u64("priority\0".as_ptr()).unwrap_or(0),
+            dedicated_cores: node
+                .read_property("dedicated_cores\0".as_ptr())
+                .is_ok(),
         })
     }
 }
 
+/// Magic identifying a valid packed manifest cache. The structure size is
+/// folded in so a cache written by an image with a different manifest layout
+/// never validates across a warm reboot.
+const MANIFEST_CACHE_MAGIC: u64 =
+    0x4d46_5354_4341_4348 ^ (core::mem::size_of::<Manifest>() as u64); // "MFSTCACH"
+
+/// Packed manifest built by a previous boot. It lives in the `.persistent`
+/// section, which the entry code does not zero, so it survives warm reboots
+/// of the same image. A hash of the manifest devicetree guards staleness.
+#[repr(C)]
+struct ManifestCache {
+    magic: u64,
+    fdt_hash: u64,
+    manifest: Manifest,
+}
+
+#[link_section = ".persistent"]
+static mut MANIFEST_CACHE: MaybeUninit<ManifestCache> = MaybeUninit::uninit();
+
 impl Manifest {
     /// Parse manifest from FDT.
     pub fn init<'a>(&mut self, fdt: &FdtNode<'a>) -> Result<(), Error> {
@@ -250,6 +315,17 @@ impl Manifest {
             self.vms.set_len(0);
         }
 
+        // Warm-reboot fast path: if the previous boot built a manifest from
+        // an identical devicetree, load the packed form and skip parsing.
+        let fdt_hash = fdt.content_hash();
+        unsafe {
+            let cache = MANIFEST_CACHE.get_ref();
+            if cache.magic == MANIFEST_CACHE_MAGIC && cache.fdt_hash == fdt_hash {
+                ptr::copy_nonoverlapping(&cache.manifest, self as *mut Manifest, 1);
+                return Ok(());
+            }
+        }
+
         // Find hypervisor node.
         let mut hyp_node = fdt.clone();
         hyp_node
@@ -295,10 +371,20 @@ impl Manifest {
         }
 
         if !found_primary_vm {
-            Err(Error::NoPrimaryVm)
-        } else {
-            Ok(())
+            return Err(Error::NoPrimaryVm);
         }
+
+        // Save the packed form for the next boot; the magic is written last
+        // so a reboot in the middle of the copy never validates.
+        unsafe {
+            let cache = MANIFEST_CACHE.get_mut();
+            cache.magic = 0;
+            cache.fdt_hash = fdt_hash;
+            ptr::copy_nonoverlapping(self as *const Manifest, &mut cache.manifest, 1);
+            cache.magic = MANIFEST_CACHE_MAGIC;
+        }
+
+        Ok(())
     }
 }
 
@@ -139,6 +139,20 @@ impl MemIter {
         Ok(())
     }
 
+    /// Claims the next `n` bytes as a directly accessible slice after a
+    /// single bounds check, advancing the iterator past them. Structured
+    /// readers that know their record sizes up front do one check per record
+    /// and access the window without further checks, safely by construction.
+    ///
+    /// # Safety
+    ///
+    /// The returned slice borrows the underlying buffer, which the iterator
+    /// does not own; the caller must not outlive it.
+    pub unsafe fn claim(&mut self, n: usize) -> Option<&'static [u8]> {
+        let ptr = self.read(n)?;
+        Some(slice::from_raw_parts(ptr, n))
+    }
+
     pub fn read(&mut self, v: usize) -> Option<*const u8> {
         let next = self.next;
         if self.advance(v).is_ok() {
@@ -183,3 +197,12 @@ pub unsafe extern "C" fn memiter_parse_str(it: *mut MemIter, str: *mut MemIter)
 pub unsafe extern "C" fn memiter_iseq(it: *const MemIter, str: *const u8) -> bool {
     (*it).iseq(str)
 }
+
+/// Claims `n` bytes as a directly accessible window after one bounds check;
+/// returns NULL if the iterator doesn't have that many bytes left.
+#[no_mangle]
+pub unsafe extern "C" fn memiter_claim(it: *mut MemIter, n: size_t) -> *const c_void {
+    (*it).read(n)
+        .map(|p| p as *const c_void)
+        .unwrap_or(ptr::null())
+}
@@ -31,7 +31,8 @@ use core::mem;
 use core::ops::*;
 use core::ptr;
 use core::slice;
-use core::sync::atomic::{fence, AtomicBool, Ordering};
+use core::sync::atomic::{fence, spin_loop_hint, AtomicBool, AtomicUsize, Ordering};
+use arrayvec::ArrayVec;
 use reduce::Reduce;
 
 use crate::addr::*;
@@ -67,8 +68,21 @@ extern "C" {
     fn arch_mm_mode_to_stage2_attrs(mode: c_int) -> u64;
 
     fn arch_mm_stage2_attrs_to_mode(attrs: u64) -> c_int;
+    fn arch_mm_stage2_attrs_to_readonly(attrs: u64) -> u64;
+
+    fn arch_mm_table_pte_set_uniform(pte: pte_t) -> pte_t;
+    fn arch_mm_table_pte_clear_uniform(pte: pte_t) -> pte_t;
+    fn arch_mm_table_pte_is_uniform(pte: pte_t) -> bool;
+
+    fn arch_mm_attrs_set_cont(attrs: u64) -> u64;
+    fn arch_mm_attrs_clear_af(attrs: u64) -> u64;
+    fn arch_mm_attrs_has_af(attrs: u64) -> bool;
+    fn arch_mm_attrs_clear_cont(attrs: u64) -> u64;
+    fn arch_mm_attrs_is_cont(attrs: u64) -> bool;
 
     pub fn arch_mm_flush_dcache(base: usize, size: size_t);
+    pub fn arch_mm_clean_dcache(base: usize, size: size_t);
+    pub fn arch_mm_sync_icache();
 
     fn arch_mm_stage1_max_level() -> u8;
     fn arch_mm_stage2_max_level() -> u8;
@@ -159,6 +173,68 @@ bitflags! {
         /// Stage 1
         /// Note(HfO2): This flag is not used in HfO2; only exists for FFI.
         const STAGE1 = 0b100;
+
+        /// Batch TLB invalidation: instead of invalidating during the walk,
+        /// accumulate the affected address range and issue a single ranged
+        /// invalidation once the update is complete. Only safe for updates
+        /// whose stale TLB entries are tolerable until the final invalidation,
+        /// such as unmaps performed under the VM lock, which are covered by
+        /// the spurious fault recovery protocol.
+        const TLBI_BATCH = 0b1000;
+    }
+}
+
+/// Accumulates the address range affected by a page table update so that a
+/// single ranged TLB invalidation can be issued for the whole update. The
+/// architecture falls back to invalidating all entries when the range is too
+/// large for individual operations.
+struct TlbFlushRange {
+    range: Option<(ptable_addr_t, ptable_addr_t)>,
+}
+
+impl TlbFlushRange {
+    const fn new() -> Self {
+        Self { range: None }
+    }
+
+    fn push(&mut self, begin: ptable_addr_t, end: ptable_addr_t) {
+        self.range = Some(match self.range {
+            Some((b, e)) => (cmp::min(b, begin), cmp::max(e, end)),
+            None => (begin, end),
+        });
+    }
+}
+
+/// Accumulates the (hint-stripped) attributes of the entries a walk passes
+/// over, so validation can ride along with table reservation instead of
+/// costing a separate get_attrs walk.
+struct AttrObserver {
+    attrs: Option<u64>,
+    uniform: bool,
+}
+
+impl AttrObserver {
+    const fn new() -> Self {
+        Self {
+            attrs: None,
+            uniform: true,
+        }
+    }
+
+    fn observe(&mut self, attrs: u64) {
+        let attrs = unsafe { arch_mm_attrs_clear_cont(attrs) };
+        match self.attrs {
+            None => self.attrs = Some(attrs),
+            Some(prev) if prev == attrs => {}
+            Some(_) => self.uniform = false,
+        }
+    }
+
+    fn result(&self) -> Result<u64, ()> {
+        match (self.uniform, self.attrs) {
+            (true, Some(attrs)) => Ok(attrs),
+            _ => Err(()),
+        }
     }
 }
 
@@ -175,17 +251,20 @@ mod addr {
     use crate::page::*;
 
     /// Rounds an address down to a page boundary.
+    #[inline(always)]
     pub fn round_down_to_page(addr: ptable_addr_t) -> ptable_addr_t {
         addr & !(PAGE_SIZE - 1)
     }
 
     /// Rounds an address up to a page boundary.
+    #[inline(always)]
     pub fn round_up_to_page(addr: ptable_addr_t) -> ptable_addr_t {
         round_down_to_page(addr + PAGE_SIZE - 1)
     }
 
     /// Calculates the size of the address space represented by a page table entry at the given
     /// level.
+    #[inline(always)]
     pub fn entry_size(level: u8) -> usize {
         1usize << (PAGE_BITS + level as usize * PAGE_LEVEL_BITS)
     }
@@ -193,12 +272,14 @@ mod addr {
     /// Gets the address of the start of the next block of the given size. The size must be a pow
     /// er
     /// of two.
+    #[inline(always)]
     pub fn start_of_next_block(addr: ptable_addr_t, block_size: usize) -> ptable_addr_t {
         (addr + block_size) & !(block_size - 1)
     }
 
     /// For a given address, calculates the maximum (plus one) address that can be represented by
     /// the same table at the given level.
+    #[inline(always)]
     pub fn level_end(addr: ptable_addr_t, level: u8) -> ptable_addr_t {
         let offset = PAGE_BITS + (level as usize + 1) * PAGE_LEVEL_BITS;
         ((addr >> offset) + 1) << offset
@@ -206,6 +287,7 @@ mod addr {
 
     /// For a given address, calculates the index at which its entry is stored in a table at the
     /// given level.
+    #[inline(always)]
     pub fn index(addr: ptable_addr_t, level: u8) -> usize {
         let v = addr >> (PAGE_BITS + level as usize * PAGE_LEVEL_BITS);
         v & ((1usize << PAGE_LEVEL_BITS) - 1)
@@ -299,6 +381,31 @@ impl Stage for Stage2 {
 
 /// Page table entry.
 #[repr(C)]
+/// Whether `pa` can possibly be a live page-table page: page-aligned and
+/// within the hypervisor image span every pool page comes from (the static
+/// heap in .bss plus the donated boot-only regions). The lock-free walk can
+/// race a writer and read a stale PTE from a freed-and-recycled table page;
+/// such garbage can decode as a "table" pointing anywhere, and while the
+/// sequence re-check discards the result, a wild dereference could fault at
+/// EL2 first. Bounding decoded table pointers to the image span turns that
+/// into a harmless in-range read. The host test build keeps its
+/// heap-allocated tables and skips the check.
+#[cfg(target_arch = "aarch64")]
+fn plausible_table_page(pa: usize) -> bool {
+    let begin = pa_addr(unsafe { layout_text_begin() });
+    let end = cmp::max(
+        pa_addr(unsafe { layout_data_end() }),
+        pa_addr(unsafe { layout_init_end() }),
+    );
+
+    pa & (PAGE_SIZE - 1) == 0 && pa >= begin && pa + PAGE_SIZE <= end
+}
+
+#[cfg(not(target_arch = "aarch64"))]
+fn plausible_table_page(_pa: usize) -> bool {
+    true
+}
+
 struct PageTableEntry {
     inner: pte_t,
 }
@@ -347,6 +454,25 @@ impl PageTableEntry {
         unsafe { arch_mm_pte_is_table(self.inner, level) }
     }
 
+
+    /// Whether this is a table entry whose whole subtree carries identical
+    /// attributes (software summary; see arch_mm_table_pte_is_uniform).
+    fn is_uniform_table(&self, level: u8) -> bool {
+        self.is_table(level) && unsafe { arch_mm_table_pte_is_uniform(self.inner) }
+    }
+
+    /// Sets or clears the subtree-uniform summary on a table entry. The bit
+    /// is software-only, so the descriptor is updated in place without
+    /// break-before-make.
+    fn set_table_uniform(&mut self, uniform: bool) {
+        self.inner = unsafe {
+            if uniform {
+                arch_mm_table_pte_set_uniform(self.inner)
+            } else {
+                arch_mm_table_pte_clear_uniform(self.inner)
+            }
+        };
+    }
     fn attrs(&self, level: u8) -> u64 {
         unsafe { arch_mm_pte_attrs(self.inner, level) }
     }
@@ -365,7 +491,11 @@ impl PageTableEntry {
 
     fn as_table(&self, level: u8) -> Result<&RawPageTable, ()> {
         if self.is_table(level) {
-            unsafe { Ok(&*(pa_addr(arch_mm_table_from_pte(self.inner, level)) as *const _)) }
+            let pa = pa_addr(unsafe { arch_mm_table_from_pte(self.inner, level) });
+            if !plausible_table_page(pa) {
+                return Err(());
+            }
+            unsafe { Ok(&*(pa as *const _)) }
         } else {
             Err(())
         }
@@ -373,7 +503,11 @@ impl PageTableEntry {
 
     fn as_table_mut(&mut self, level: u8) -> Result<&mut RawPageTable, ()> {
         if self.is_table(level) {
-            unsafe { Ok(&mut *(pa_addr(arch_mm_table_from_pte(self.inner, level)) as *mut _)) }
+            let pa = pa_addr(unsafe { arch_mm_table_from_pte(self.inner, level) });
+            if !plausible_table_page(pa) {
+                return Err(());
+            }
+            unsafe { Ok(&mut *(pa as *mut _)) }
         } else {
             Err(())
         }
@@ -412,13 +546,32 @@ impl PageTableEntry {
         new_pte: PageTableEntry,
         begin: ptable_addr_t,
         level: u8,
+        flags: Flags,
+        flush: &mut TlbFlushRange,
         mpool: &MPool,
     ) {
-        // We need to do the break-before-make sequence if both values are present and the TLB is
-        // being invalidated.
-        if self.is_valid(level) && new_pte.is_valid(level) {
-            unsafe { ptr::write(self, Self::absent(level)) };
-            S::invalidate_tlb(begin, begin + addr::entry_size(level));
+        if self.is_valid(level) {
+            // Any replaced valid entry may be cached in the TLB, so make sure
+            // it is covered by the batched invalidation.
+            if flags.contains(Flags::TLBI_BATCH) {
+                flush.push(begin, begin + addr::entry_size(level));
+            }
+
+            // We need to do the break-before-make sequence if both values are
+            // present and the TLB is being invalidated. Batching may defer
+            // the invalidation for leaf-for-leaf replacements, where the
+            // worst case is a stale translation covered by the spurious
+            // fault protocol — but a block being split into a table keeps
+            // full BBM even then: until the deferred flush, the TLB could
+            // otherwise hold the old block and new table-derived entries
+            // for the same address at different granularity, which is a
+            // TLB conflict abort, not a tolerable stale entry.
+            if new_pte.is_valid(level)
+                && (!flags.contains(Flags::TLBI_BATCH) || new_pte.is_table(level))
+            {
+                unsafe { ptr::write(self, Self::absent(level)) };
+                S::invalidate_tlb(begin, begin + addr::entry_size(level));
+            }
         }
 
         // Assign the new pte.
@@ -434,6 +587,8 @@ impl PageTableEntry {
         &mut self,
         begin: ptable_addr_t,
         level: u8,
+        flags: Flags,
+        flush: &mut TlbFlushRange,
         mpool: &MPool,
     ) -> Result<(), ()> {
         // Just return if it's already populated.
@@ -468,16 +623,28 @@ impl PageTableEntry {
         // TODO(@jeehoonkang): very suspicious..
         fence(Ordering::Release);
 
-        // Replace the pte entry, doing a break-before-make if needed.
-        let table = Self::table(level, table);
-        self.replace::<S>(table, begin, level, mpool);
+        // Replace the pte entry, doing a break-before-make if needed. A
+        // table populated from a block or from absent entries starts with
+        // every leaf identical, so it carries the uniform summary until a
+        // partial update below it clears it.
+        let mut table = Self::table(level, table);
+        table.set_table_uniform(true);
+        self.replace::<S>(table, begin, level, flags, flush, mpool);
 
         Ok(())
     }
 
     /// Defragments the given PTE by recursively replacing any tables with blocks or absent entries
-    /// where possible.
-    fn defrag(&mut self, level: u8, mpool: &MPool) -> Result<u64, ()> {
+    /// where possible. Fully-populated, attribute-uniform subtables are promoted to block
+    /// mappings, shrinking the walk depth of the covered range. The range of each promotion is
+    /// recorded in `flush` so the caller can invalidate the stale table entries in one go.
+    fn defrag(
+        &mut self,
+        begin: ptable_addr_t,
+        level: u8,
+        flush: &mut TlbFlushRange,
+        mpool: &MPool,
+    ) -> Result<u64, ()> {
         let attrs = self.attrs(level);
 
         if self.is_block(level) {
@@ -491,7 +658,15 @@ impl PageTableEntry {
         // identity mapping.
         let children_attrs = table
             .iter_mut()
-            .map(|pte| pte.defrag(level - 1, mpool))
+            .enumerate()
+            .map(|(i, pte)| {
+                pte.defrag(
+                    begin + i * addr::entry_size(level - 1),
+                    level - 1,
+                    flush,
+                    mpool,
+                )
+            })
             .reduce(|l, r| if l == r { l } else { Err(()) })
             .ok_or(())??;
 
@@ -511,7 +686,10 @@ impl PageTableEntry {
 
         // Merge table into a single block with equivalent attributes.
         let block_address = unsafe { table.get_unchecked(0).as_block_unchecked(level - 1) };
-        let combined_attrs = unsafe { arch_mm_combine_table_entry_attrs(attrs, children_attrs) };
+        let combined_attrs = unsafe {
+            // The hint is sized for the smaller entries; never carry it up.
+            arch_mm_attrs_clear_cont(arch_mm_combine_table_entry_attrs(attrs, children_attrs))
+        };
 
         mpool.free(unsafe { Page::from_raw(table as *mut _ as *mut _) });
         unsafe {
@@ -521,6 +699,10 @@ impl PageTableEntry {
             );
         }
 
+        // Translations through the old table may still be cached, so record
+        // the promoted range for invalidation.
+        flush.push(begin, begin + addr::entry_size(level));
+
         Ok(combined_attrs)
     }
 }
@@ -561,6 +743,9 @@ impl Iterator for BlockIter {
     }
 }
 
+/// The number of naturally aligned entries covered by one contiguous hint.
+const CONT_ENTRIES: usize = 16;
+
 /// Number of page table entries in a page table.
 pub const PTE_PER_PAGE: usize = (PAGE_SIZE / mem::size_of::<PageTableEntry>());
 
@@ -586,7 +771,84 @@ impl DerefMut for RawPageTable {
     }
 }
 
+/// Generates a `get_attrs_level` walker specialized for one level, so the
+/// entry size and index shift are compile-time constants and the four-level
+/// descent is a chain of direct calls.
+macro_rules! get_attrs_level_specialized {
+    ($name:ident, $next:ident, $level:expr) => {
+        fn $name(&self, begin: ptable_addr_t, end: ptable_addr_t) -> Result<u64, ()> {
+            const LEVEL: u8 = $level;
+
+            let ptes = self[addr::index(begin, LEVEL)..].iter();
+            let begins = BlockIter::new(
+                begin,
+                // Cap end so that we don't go over the current level max.
+                cmp::min(end, addr::level_end(begin, LEVEL)),
+                addr::entry_size(LEVEL),
+            );
+
+            // Check that each entry is owned.
+            ptes.zip(begins)
+                .map(|(pte, begin)| {
+                    if let Ok(table) = pte.as_table(LEVEL) {
+                        if pte.is_uniform_table(LEVEL) {
+                            // Every leaf below carries identical attributes:
+                            // read them off the first covered page instead of
+                            // walking the whole subtree.
+                            table.$next(begin, begin + 1)
+                        } else {
+                            table.$next(begin, end)
+                        }
+                    } else {
+                        Ok(unsafe { arch_mm_attrs_clear_cont(pte.attrs(LEVEL)) })
+                    }
+                })
+                .res_reduce(|l, r| if l == r { Ok(l) } else { Err(()) })
+        }
+    };
+}
+
 impl RawPageTable {
+    /// Clears the contiguous hint from the whole naturally aligned run
+    /// containing `index`. Required before any entry of the run is changed,
+    /// as mixing hinted entries with differing translations is constrained
+    /// unpredictable. The affected range is recorded for invalidation.
+    fn clear_cont_run(
+        &mut self,
+        index: usize,
+        begin: ptable_addr_t,
+        level: u8,
+        flush: &mut TlbFlushRange,
+    ) {
+        let entry_size = addr::entry_size(level);
+        let run_start = index & !(CONT_ENTRIES - 1);
+        let run_begin = begin & !(CONT_ENTRIES * entry_size - 1);
+
+        for pte in self[run_start..run_start + CONT_ENTRIES].iter_mut() {
+            if !pte.is_valid(level) {
+                continue;
+            }
+
+            let attrs = pte.attrs(level);
+            if !unsafe { arch_mm_attrs_is_cont(attrs) } {
+                continue;
+            }
+
+            if let Ok(pa) = pte.as_block(level) {
+                // A block entry holds no subtable, so overwriting in place is
+                // enough.
+                unsafe {
+                    ptr::write(
+                        pte,
+                        PageTableEntry::block(level, pa, arch_mm_attrs_clear_cont(attrs)),
+                    );
+                }
+            }
+        }
+
+        flush.push(run_begin, run_begin + CONT_ENTRIES * entry_size);
+    }
+
     /// Returns whether all entries in this table are absent.
     fn is_empty(&self, level: u8) -> bool {
         self.iter().all(|pte| !pte.is_present(level))
@@ -605,13 +867,16 @@ impl RawPageTable {
         attrs: u64,
         level: u8,
         flags: Flags,
+        flush: &mut TlbFlushRange,
+        observer: &mut AttrObserver,
         mpool: &MPool,
     ) -> Result<(), ()> {
         let entry_size = addr::entry_size(level);
         let commit = flags.contains(Flags::COMMIT);
         let unmap = flags.contains(Flags::UNMAP);
+        let range_begin = begin;
 
-        let ptes = self[addr::index(begin, level)..].iter_mut();
+        let mut index = addr::index(begin, level);
         let begins = BlockIter::new(
             begin,
             // Cap end so that we don't go over the current level max.
@@ -620,28 +885,73 @@ impl RawPageTable {
         );
 
         // Fill each entry in the table.
-        for (pte, begin) in ptes.zip(begins) {
+        for begin in begins {
+            let i = index;
+            index += 1;
+
             // If the entry is already mapped with the right attributes, or already absent in the
-            // case of unmapping, no need to do anything; carry on to the next entry.
-            if unmap && !pte.is_present(level) {
+            // case of unmapping, no need to do anything; carry on to the next entry. The original
+            // attributes of covered leaf entries are fed to the observer on the reservation pass,
+            // where validation rides along with the walk.
+            if unmap && !self[i].is_present(level) {
+                if !commit {
+                    observer.observe(self[i].attrs(level));
+                }
                 continue;
             }
-            if !unmap && pte.is_block(level) && pte.attrs(level) == attrs {
+            if !unmap && self[i].is_block(level) && self[i].attrs(level) == attrs {
+                if !commit {
+                    observer.observe(self[i].attrs(level));
+                }
                 continue;
             }
 
+            // Changing any entry of a contiguous run first demotes the whole
+            // run to plain entries.
+            if commit
+                && self[i].is_valid(level)
+                && unsafe { arch_mm_attrs_is_cont(self[i].attrs(level)) }
+            {
+                self.clear_cont_run(i, begin, level, flush);
+            }
+
+            let pte = &mut self[i];
+
             // If the entire entry is within the region we want to map, map/unmap the whole entry.
             if end - begin >= entry_size
                 && (unmap || unsafe { arch_mm_is_block_allowed(level) })
                 && (begin & (entry_size - 1) == 0)
             {
+                if !commit {
+                    if let Ok(table) = pte.as_table(level) {
+                        // A covered subtable is replaced wholesale on commit;
+                        // observe its current content the way get_attrs
+                        // would.
+                        match table.get_attrs_level(begin, end, level - 1) {
+                            Ok(attrs) => observer.observe(attrs),
+                            Err(()) => observer.uniform = false,
+                        }
+                    } else {
+                        observer.observe(pte.attrs(level));
+                    }
+                }
                 if commit {
                     let new_pte = if unmap {
                         PageTableEntry::absent(level)
                     } else {
+                        // Set the contiguous hint on naturally aligned runs
+                        // of CONT_ENTRIES entries fully covered by this
+                        // mapping, multiplying TLB reach for large ranges.
+                        let cont_size = CONT_ENTRIES * entry_size;
+                        let run = begin & !(cont_size - 1);
+                        let attrs = if run >= range_begin && run + cont_size <= end {
+                            unsafe { arch_mm_attrs_set_cont(attrs) }
+                        } else {
+                            attrs
+                        };
                         PageTableEntry::block(level, pa_init(begin), attrs)
                     };
-                    pte.replace::<S>(new_pte, begin, level, mpool);
+                    pte.replace::<S>(new_pte, begin, level, flags, flush, mpool);
                 }
 
                 continue;
@@ -649,20 +959,31 @@ impl RawPageTable {
 
             // If the entry is already a subtable get it; otherwise replace it with an equivalent
             // subtable and get that.
-            pte.populate_table::<S>(begin, level, mpool)?;
+            pte.populate_table::<S>(begin, level, flags, flush, mpool)?;
 
             // Since `pte` is just populated, it should be a table.
             let new_table = pte.as_table_mut(level).unwrap();
 
             // Recurse to map/unmap the appropriate entries within the subtable.
-            new_table.map_level::<S>(begin, end, attrs, level - 1, flags, mpool)?;
+            new_table.map_level::<S>(begin, end, attrs, level - 1, flags, flush, observer, mpool)?;
+
+            let now_empty = commit && unmap && new_table.is_empty(level - 1);
+
+            // Maintain the subtree-uniform summary: an update covering the
+            // entire entry rewrites every leaf below with one set of
+            // attributes, anything partial may leave a mix.
+            if commit {
+                pte.set_table_uniform(
+                    begin & (entry_size - 1) == 0 && end - begin >= entry_size,
+                );
+            }
 
             // If the subtable is now empty, replace it with an absent entry at this level. We never
             // need to do break-before-makes here because we are assigning an absent value.
             //
             // TODO(@jeehoonkang): I think we should do break-before-makes here due to reordering.
-            if commit && unmap && new_table.is_empty(level - 1) {
-                pte.replace::<S>(PageTableEntry::absent(level), begin, level, mpool);
+            if now_empty {
+                pte.replace::<S>(PageTableEntry::absent(level), begin, level, flags, flush, mpool);
             }
         }
 
@@ -677,32 +998,47 @@ impl RawPageTable {
     /// The value returned in `attrs` is only valid if the function returns true.
     ///
     /// Returns true if the whole range has the same attributes and false otherwise.
+    ///
+    /// This only dispatches on the level once: the descent itself runs in the
+    /// level-specialized walkers below, whose index shifts and block sizes
+    /// are compile-time constants. (The pinned toolchain predates usable
+    /// const generics, so the specialization is macro-generated instead.)
     pub fn get_attrs_level(
         &self,
         begin: ptable_addr_t,
         end: ptable_addr_t,
         level: u8,
     ) -> Result<u64, ()> {
-        let ptes = self[addr::index(begin, level)..].iter();
+        match level {
+            0 => self.get_attrs_level_0(begin, end),
+            1 => self.get_attrs_level_1(begin, end),
+            2 => self.get_attrs_level_2(begin, end),
+            3 => self.get_attrs_level_3(begin, end),
+            _ => Err(()),
+        }
+    }
+
+    /// The bottom of the specialized descent: level-0 entries are pages, so
+    /// there is no further table to follow.
+    fn get_attrs_level_0(&self, begin: ptable_addr_t, end: ptable_addr_t) -> Result<u64, ()> {
+        let ptes = self[addr::index(begin, 0)..].iter();
         let begins = BlockIter::new(
             begin,
-            // Cap end so that we don't go over the current level max.
-            cmp::min(end, addr::level_end(begin, level)),
-            addr::entry_size(level),
+            cmp::min(end, addr::level_end(begin, 0)),
+            addr::entry_size(0),
         );
 
-        // Check that each entry is owned.
+        // The contiguous hint is stripped: it is a TLB layout detail, not
+        // part of the logical attributes of the range.
         ptes.zip(begins)
-            .map(|(pte, begin)| {
-                if let Ok(table) = pte.as_table(level) {
-                    table.get_attrs_level(begin, end, level - 1)
-                } else {
-                    Ok(pte.attrs(level))
-                }
-            })
+            .map(|(pte, _)| Ok(unsafe { arch_mm_attrs_clear_cont(pte.attrs(0)) }))
             .res_reduce(|l, r| if l == r { Ok(l) } else { Err(()) })
     }
 
+    get_attrs_level_specialized!(get_attrs_level_1, get_attrs_level_0, 1);
+    get_attrs_level_specialized!(get_attrs_level_2, get_attrs_level_1, 2);
+    get_attrs_level_specialized!(get_attrs_level_3, get_attrs_level_2, 3);
+
     /// Writes the given table to the debug log, calling itself recursively to write sub-tables.
     fn dump(&self, level: u8, max_level: u8) {
         for (i, pte) in self.iter().enumerate() {
@@ -804,10 +1140,33 @@ impl Drop for PageTableNode {
     }
 }
 
+/// The number of root-level entries (including their subtables) visited by one
+/// step of incremental defrag.
+const DEFRAG_INCREMENT: usize = 16;
+
 /// Page table.
 #[repr(C)]
 pub struct PageTable<S: Stage> {
     root: paddr_t,
+
+    /// Index of the next root-level entry to be visited by incremental defrag.
+    defrag_cursor: usize,
+
+    /// Walk memoization for ascending sequential mappings: the deepest table
+    /// page the last map operation fit under, stored as its identity-mapped
+    /// address (kept as usize so the table type stays Send), the level of its
+    /// entries and the address span it covers. Map operations inside the span
+    /// start the walk there instead of at the root; any unmap, defrag or
+    /// reserve/commit pass drops the cursor, and maps inside the span can
+    /// never free the cursor table itself, so the pointer stays valid for as
+    /// long as it is used.
+    cursor_table: usize,
+    cursor_level: u8,
+    cursor_span: (ptable_addr_t, ptable_addr_t),
+
+    /// Sequence counter protecting the lock-free read path. It is odd while a
+    /// writer is updating the table; see `get_mode_lockfree()`.
+    seq: AtomicUsize,
     _marker: PhantomData<S>,
 }
 
@@ -815,10 +1174,36 @@ impl<S: Stage> PageTable<S> {
     const unsafe fn from_raw(root: paddr_t) -> Self {
         Self {
             root,
+            defrag_cursor: 0,
+            cursor_table: 0,
+            cursor_level: 0,
+            cursor_span: (0, 0),
+            seq: AtomicUsize::new(0),
             _marker: PhantomData,
         }
     }
 
+    /// Returns the current value of the sequence counter, for callers that
+    /// tag derived state (e.g. validated-range caches) with the table
+    /// version it was computed from.
+    pub fn read_seq(&self) -> usize {
+        self.seq.load(Ordering::Relaxed)
+    }
+
+    /// Marks the beginning of a table update for the benefit of lock-free
+    /// readers. The caller must hold the table lock.
+    fn write_begin(&self) {
+        self.seq.fetch_add(1, Ordering::Relaxed);
+        fence(Ordering::Release);
+    }
+
+    /// Marks the end of a table update, allowing lock-free readers to
+    /// validate again.
+    fn write_end(&self) {
+        fence(Ordering::Release);
+        self.seq.fetch_add(1, Ordering::Relaxed);
+    }
+
     const unsafe fn null() -> Self {
         Self::from_raw(pa_init(0))
     }
@@ -838,6 +1223,11 @@ impl<S: Stage> PageTable<S> {
         // TODO: halloc could return a virtual or physical address if mm not enabled?
         Ok(Self {
             root: pa_init(pages.into_raw() as usize),
+            defrag_cursor: 0,
+            cursor_table: 0,
+            cursor_level: 0,
+            cursor_span: (0, 0),
+            seq: AtomicUsize::new(0),
             _marker: PhantomData,
         })
     }
@@ -895,6 +1285,8 @@ impl<S: Stage> PageTable<S> {
         attrs: u64,
         root_level: u8,
         flags: Flags,
+        flush: &mut TlbFlushRange,
+        observer: &mut AttrObserver,
         mpool: &MPool,
     ) -> Result<(), ()> {
         let root_table_size = addr::entry_size(root_level);
@@ -903,7 +1295,7 @@ impl<S: Stage> PageTable<S> {
         let begins = BlockIter::new(begin, end, root_table_size);
 
         for (table, begin) in tables.zip(begins) {
-            table.map_level::<S>(begin, end, attrs, root_level - 1, flags, mpool)?;
+            table.map_level::<S>(begin, end, attrs, root_level - 1, flags, flush, observer, mpool)?;
         }
 
         Ok(())
@@ -923,17 +1315,183 @@ impl<S: Stage> PageTable<S> {
         let ptable_end = S::ptable_addr_space_end();
         let end = cmp::min(addr::round_up_to_page(pa_addr(end)), ptable_end);
         let begin = pa_addr(unsafe { arch_mm_clear_pa(begin) });
+        let unmap = flags.contains(Flags::UNMAP);
+
+        // Boot and migration map memory in ascending order, so consecutive
+        // operations usually land under the table page the previous one
+        // descended into. When the remembered span covers the whole range,
+        // start both passes at that table instead of at the root; the
+        // operation can only write entries inside the cursor table, never
+        // replace the table itself, so the cursor stays valid across hits.
+        if !unmap && self.cursor_table != 0 {
+            let (span_begin, span_end) = self.cursor_span;
+
+            if span_begin <= begin && end <= span_end {
+                let level = self.cursor_level;
+                let table = unsafe { &mut *(self.cursor_table as *mut RawPageTable) };
+                let local_mpool = MPool::new_with_fallback(mpool);
+                let mut flush = TlbFlushRange::new();
+                let mut observer = AttrObserver::new();
+
+                self.write_begin();
+                let result = table
+                    .map_level::<S>(
+                        begin,
+                        end,
+                        attrs,
+                        level,
+                        flags,
+                        &mut flush,
+                        &mut observer,
+                        &local_mpool,
+                    )
+                    .and_then(|()| {
+                        table.map_level::<S>(
+                            begin,
+                            end,
+                            attrs,
+                            level,
+                            flags | Flags::COMMIT,
+                            &mut flush,
+                            &mut observer,
+                            &local_mpool,
+                        )
+                    });
+                if result.is_ok() {
+                    flush.push(begin, end);
+                    if let Some((begin, end)) = flush.range {
+                        S::invalidate_tlb(begin, end);
+                    }
+                }
+                self.write_end();
+
+                return result;
+            }
+
+            self.cursor_table = 0;
+        }
+
+        // Pre-charge a local pool with an estimate of the table pages the walk will need, moving
+        // them from the backing pool in bulk rather than taking its lock once per page. Unused
+        // pages are given back when the local pool is dropped.
+        let local_mpool = MPool::new_with_fallback(mpool);
+        local_mpool.prefetch(
+            root_level as usize + ((end - begin) >> (PAGE_BITS + PAGE_LEVEL_BITS)),
+        );
 
         // Do it in two steps to prevent leaving the table in a halfway updated state. In such a
         // two-step implementation, the table may be left with extra internal tables, but no
         // different mapping on failure.
-        self.map_root(begin, end, attrs, root_level, flags, mpool)?;
-        self.map_root(begin, end, attrs, root_level, flags | Flags::COMMIT, mpool)?;
+        let mut flush = TlbFlushRange::new();
+        let mut observer = AttrObserver::new();
+        self.write_begin();
+        let result = self
+            .map_root(
+                begin,
+                end,
+                attrs,
+                root_level,
+                flags,
+                &mut flush,
+                &mut observer,
+                &local_mpool,
+            )
+            .and_then(|()| {
+                self.map_root(
+                    begin,
+                    end,
+                    attrs,
+                    root_level,
+                    flags | Flags::COMMIT,
+                    &mut flush,
+                    &mut observer,
+                    &local_mpool,
+                )
+            });
 
         // Invalidate the tlb.
-        S::invalidate_tlb(begin, end);
+        if result.is_ok() {
+            if flags.contains(Flags::TLBI_BATCH) {
+                // Issue a single ranged invalidation covering every entry the
+                // walk actually replaced, or nothing if no valid entry was
+                // touched.
+                if let Some((begin, end)) = flush.range {
+                    S::invalidate_tlb(begin, end);
+                }
+            } else {
+                // Include entries outside [begin, end) that were touched,
+                // e.g. contiguous runs demoted at the edges of the range.
+                flush.push(begin, end);
+                if let Some((begin, end)) = flush.range {
+                    S::invalidate_tlb(begin, end);
+                }
+            }
+        }
+        self.write_end();
 
-        Ok(())
+        if result.is_ok() && !unmap {
+            self.cursor_aim(begin, end, root_level);
+        } else {
+            self.cursor_table = 0;
+        }
+
+        result
+    }
+
+    /// Re-aims the walk cursor at the deepest table page whose span contains
+    /// the just-updated range: a read-only O(depth) descent following table
+    /// entries, run after a successful map so the next ascending operation
+    /// skips the shared upper levels.
+    fn cursor_aim(&mut self, begin: ptable_addr_t, end: ptable_addr_t, root_level: u8) {
+        self.cursor_table = 0;
+
+        if end <= begin {
+            return;
+        }
+
+        let root_index = addr::index(begin, root_level);
+        if addr::index(end - 1, root_level) != root_index {
+            return;
+        }
+
+        let mut level = root_level - 1;
+        let mut span_size = addr::entry_size(root_level);
+        let mut table = &mut self.deref_mut()[root_index] as *mut RawPageTable;
+
+        loop {
+            let span_begin = begin & !(span_size - 1);
+            self.cursor_span = (span_begin, span_begin + span_size);
+            self.cursor_level = level;
+            self.cursor_table = table as usize;
+
+            if level == 0 {
+                return;
+            }
+
+            // Only descend while the child entry's span still contains the
+            // whole range.
+            let child_span = addr::entry_size(level);
+            if end > (begin & !(child_span - 1)) + child_span {
+                return;
+            }
+
+            let t = unsafe { &mut *table };
+            let pte = &mut t[addr::index(begin, level)];
+
+            if !pte.is_table(level) {
+                return;
+            }
+
+            // Operations taken through the cursor start below this entry and
+            // never revisit it, so its subtree-uniform summary cannot be
+            // maintained; clear it so the summary only ever
+            // under-approximates.
+            pte.set_table_uniform(false);
+
+            table = pte.as_table_mut(level).unwrap() as *mut RawPageTable;
+            span_size = child_span;
+            level -= 1;
+        }
     }
 
     /// Writes the given table to the debug log.
@@ -946,17 +1504,84 @@ impl<S: Stage> PageTable<S> {
     }
 
     /// Defragments the given page table by converting page table references to blocks whenever
-    /// possible.
+    /// possible: empty subtables are freed and fully-populated, attribute-uniform subtables are
+    /// promoted to block mappings.
     pub fn defrag(&mut self, mpool: &MPool) {
         let level = S::max_level();
+        let entry_size = addr::entry_size(level);
+        let root_table_size = addr::entry_size(level + 1);
+        let mut flush = TlbFlushRange::new();
+
+        // Defrag frees table pages, so the walk cursor must go.
+        self.cursor_table = 0;
+        self.write_begin();
 
         // Loop through each entry in the table. If it points to another table, check if that table
         // can be replaced by a block or an absent entry.
-        for page_table in self.deref_mut().iter_mut() {
-            for pte in page_table.iter_mut() {
-                let _ = pte.defrag(level, mpool);
+        for (i, page_table) in self.deref_mut().iter_mut().enumerate() {
+            for (j, pte) in page_table.iter_mut().enumerate() {
+                let _ = pte.defrag(
+                    i * root_table_size + j * entry_size,
+                    level,
+                    &mut flush,
+                    mpool,
+                );
+            }
+        }
+
+        // Promotions change the translation granularity of the ranges they
+        // cover, so issue a single ranged invalidation for all of them.
+        if let Some((begin, end)) = flush.range {
+            S::invalidate_tlb(begin, end);
+        }
+
+        self.write_end();
+    }
+
+    /// Incrementally defragments the page table, doing a bounded amount of work per call so the
+    /// table lock is never held for long: up to `DEFRAG_INCREMENT` root-level entries (and their
+    /// subtables) are visited, with a cursor keeping track of progress across calls. Returns true
+    /// whenever a call completes a full pass over the table.
+    pub fn defrag_incremental(&mut self, mpool: &MPool) -> bool {
+        let level = S::max_level();
+        let entry_size = addr::entry_size(level);
+        let root_table_size = addr::entry_size(level + 1);
+        let total = S::root_table_count() as usize * PTE_PER_PAGE;
+        let mut flush = TlbFlushRange::new();
+        let mut cursor = self.defrag_cursor;
+        let mut finished = false;
+
+        // Defrag frees table pages, so the walk cursor must go.
+        self.cursor_table = 0;
+        self.write_begin();
+
+        for _ in 0..DEFRAG_INCREMENT {
+            let i = cursor / PTE_PER_PAGE;
+            let j = cursor % PTE_PER_PAGE;
+
+            let _ = self.deref_mut()[i][j].defrag(
+                i * root_table_size + j * entry_size,
+                level,
+                &mut flush,
+                mpool,
+            );
+
+            cursor += 1;
+            if cursor == total {
+                cursor = 0;
+                finished = true;
             }
         }
+
+        self.defrag_cursor = cursor;
+
+        if let Some((begin, end)) = flush.range {
+            S::invalidate_tlb(begin, end);
+        }
+
+        self.write_end();
+
+        finished
     }
 
     pub fn identity_map(
@@ -969,14 +1594,96 @@ impl<S: Stage> PageTable<S> {
         self.identity_update(begin, end, S::mode_to_attrs(mode), Flags::empty(), mpool)
     }
 
+    /// First half of a fused validate-and-map: reserves the tables an
+    /// identity mapping of the range will need (the uncommitted pass of
+    /// `identity_update`) while observing the attributes currently applied,
+    /// so validation no longer costs a separate get_mode walk. Returns the
+    /// uniform mode the range has, or Err if it is mixed. Must be followed by
+    /// `commit_reserved` with the final mode, under the same table lock.
+    pub fn reserve_observed(
+        &mut self,
+        begin: paddr_t,
+        end: paddr_t,
+        mpool: &MPool,
+    ) -> Result<Mode, ()> {
+        let root_level = S::max_level() + 1;
+        let ptable_end = S::ptable_addr_space_end();
+        let end = cmp::min(addr::round_up_to_page(pa_addr(end)), ptable_end);
+        let begin = pa_addr(unsafe { arch_mm_clear_pa(begin) });
+        let mut flush = TlbFlushRange::new();
+        let mut observer = AttrObserver::new();
+
+        // The attributes passed to the reservation pass are irrelevant: table
+        // population is driven by the range boundaries only. The walk cursor
+        // is not maintained across the reserve/commit pair, so drop it.
+        self.cursor_table = 0;
+        self.write_begin();
+        let result = self.map_root(
+            begin,
+            end,
+            0,
+            root_level,
+            Flags::empty(),
+            &mut flush,
+            &mut observer,
+            mpool,
+        );
+        self.write_end();
+        result?;
+
+        observer.result().map(S::attrs_to_mode)
+    }
+
+    /// Second half of a fused validate-and-map: commits the reserved mapping
+    /// with the final mode and invalidates the TLB.
+    pub fn commit_reserved(
+        &mut self,
+        begin: paddr_t,
+        end: paddr_t,
+        mode: Mode,
+        mpool: &MPool,
+    ) -> Result<(), ()> {
+        let root_level = S::max_level() + 1;
+        let ptable_end = S::ptable_addr_space_end();
+        let end = cmp::min(addr::round_up_to_page(pa_addr(end)), ptable_end);
+        let begin = pa_addr(unsafe { arch_mm_clear_pa(begin) });
+        let mut flush = TlbFlushRange::new();
+        let mut observer = AttrObserver::new();
+
+        self.cursor_table = 0;
+        self.write_begin();
+        let result = self.map_root(
+            begin,
+            end,
+            S::mode_to_attrs(mode),
+            root_level,
+            Flags::COMMIT,
+            &mut flush,
+            &mut observer,
+            mpool,
+        );
+        if result.is_ok() {
+            flush.push(begin, end);
+            if let Some((begin, end)) = flush.range {
+                S::invalidate_tlb(begin, end);
+            }
+        }
+        self.write_end();
+
+        result
+    }
+
     /// Updates the VM's table such that the given physical address range has no connection to the
     /// VM.
     pub fn unmap(&mut self, begin: paddr_t, end: paddr_t, mpool: &MPool) -> Result<(), ()> {
+        // Unmaps are done under the appropriate table lock, so the stale TLB entries that batching
+        // allows until the final ranged invalidation are covered by the spurious fault recovery
+        // protocol.
         self.identity_update(
             begin,
             end,
             S::mode_to_attrs(Mode::UNOWNED | Mode::INVALID | Mode::SHARED),
-            Flags::UNMAP,
+            Flags::UNMAP | Flags::TLBI_BATCH,
             mpool,
         )
     }
@@ -1017,6 +1724,273 @@ impl<S: Stage> PageTable<S> {
         let attrs = self.get_attrs(ipa_addr(begin), ipa_addr(end))?;
         Ok(S::attrs_to_mode(attrs))
     }
+
+    /// Gets the mode of the given range, like `get_mode()`, but without requiring the caller to
+    /// hold the table lock: a seqlock protocol against concurrent writers is used instead, so
+    /// concurrent readers never contend with each other. The walk is retried whenever it overlaps
+    /// a table update, and once it validates, the observed mode is at least as recent as the last
+    /// completed update.
+    ///
+    /// A walk that overlaps an update may pass through table pages the writer has already freed
+    /// and that were recycled with arbitrary content; the sequence re-check discards the result.
+    /// Decoded table pointers are bounds-checked against the image span in `as_table` before
+    /// being dereferenced (see `plausible_table_page`), so the overlap can only cause harmless
+    /// in-range garbage reads, never a wild dereference that faults at EL2. A deferred-free
+    /// scheme would avoid even the garbage reads.
+    pub fn get_mode_lockfree(&self, begin: ipaddr_t, end: ipaddr_t) -> Result<Mode, ()> {
+        loop {
+            let seq = self.seq.load(Ordering::Acquire);
+            if seq & 1 != 0 {
+                // A writer is active; wait for it to finish.
+                spin_loop_hint();
+                continue;
+            }
+
+            let result = self.get_attrs(ipa_addr(begin), ipa_addr(end));
+
+            fence(Ordering::Acquire);
+            if self.seq.load(Ordering::Relaxed) == seq {
+                return result.map(S::attrs_to_mode);
+            }
+        }
+    }
+}
+
+impl<S: Stage> PageTable<S> {
+    /// Unmaps all given extents in a single transaction: one writer section,
+    /// one shared local pool and one ranged TLB invalidation, instead of a
+    /// full reserve/commit/invalidate cycle per extent.
+    pub fn unmap_extents(&mut self, extents: &[(usize, usize)], mpool: &MPool) -> Result<(), ()> {
+        let root_level = S::max_level() + 1;
+        let attrs = S::mode_to_attrs(Mode::UNOWNED | Mode::INVALID | Mode::SHARED);
+        let flags = Flags::UNMAP | Flags::TLBI_BATCH;
+        let mut flush = TlbFlushRange::new();
+        let mut observer = AttrObserver::new();
+        let local_mpool = MPool::new_with_fallback(mpool);
+
+        self.write_begin();
+        let result: Result<(), ()> = try {
+            for pass in &[flags, flags | Flags::COMMIT] {
+                for &(begin, end) in extents {
+                    let end = cmp::min(addr::round_up_to_page(end), S::ptable_addr_space_end());
+                    self.map_root(
+                        begin,
+                        end,
+                        attrs,
+                        root_level,
+                        *pass,
+                        &mut flush,
+                        &mut observer,
+                        &local_mpool,
+                    )?;
+                }
+            }
+        };
+
+        if result.is_ok() {
+            if let Some((begin, end)) = flush.range {
+                S::invalidate_tlb(begin, end);
+            }
+        }
+        self.write_end();
+
+        result
+    }
+}
+
+/// The hypervisor image extents that are unmapped from every VM's stage-2
+/// table, sorted by address with adjacent ranges merged. Computed from the
+/// layout symbols once and reused for every VM, instead of re-walking the
+/// three image ranges per VM at boot.
+static VM_UNMAP_EXTENTS: SpinLock<Option<ArrayVec<[(usize, usize); 4]>>> = SpinLock::new(None);
+
+fn hypervisor_extents() -> ArrayVec<[(usize, usize); 4]> {
+    let mut cached = VM_UNMAP_EXTENTS.lock();
+    if let Some(extents) = &*cached {
+        return extents.clone();
+    }
+
+    let ranges = unsafe {
+        [
+            (pa_addr(layout_text_begin()), pa_addr(layout_text_end())),
+            (pa_addr(layout_rodata_begin()), pa_addr(layout_rodata_end())),
+            (pa_addr(layout_data_begin()), pa_addr(layout_data_end())),
+        ]
+    };
+
+    let mut extents: ArrayVec<[(usize, usize); 4]> = ArrayVec::new();
+    for &(begin, end) in ranges.iter() {
+        let pos = extents
+            .iter()
+            .position(|&(b, _)| b > begin)
+            .unwrap_or_else(|| extents.len());
+
+        let merge_prev = pos > 0 && extents[pos - 1].1 >= begin;
+        let merge_next = pos < extents.len() && end >= extents[pos].0;
+
+        if merge_prev && merge_next {
+            extents[pos - 1].1 = cmp::max(end, extents[pos].1);
+            extents.remove(pos);
+        } else if merge_prev {
+            extents[pos - 1].1 = cmp::max(extents[pos - 1].1, end);
+        } else if merge_next {
+            extents[pos].0 = begin;
+            extents[pos].1 = cmp::max(extents[pos].1, end);
+        } else {
+            extents.insert(pos, (begin, end));
+        }
+    }
+
+    *cached = Some(extents.clone());
+    extents
+}
+
+impl PageTable<Stage2> {
+    /// Removes write access from every valid owned-exclusive block mapping of
+    /// the table, for dirty page tracking: subsequent guest writes fault, are
+    /// logged and have their write access restored page by page. Shared,
+    /// unowned or already read-only mappings are left alone. One full TLB
+    /// invalidation is issued at the end rather than one per entry.
+    pub fn write_protect_all(&mut self) {
+        let level = Stage2::max_level();
+
+        self.write_begin();
+
+        for page_table in self.deref_mut().iter_mut() {
+            page_table.write_protect_level(level);
+        }
+
+        Stage2::invalidate_tlb(0, Stage2::ptable_addr_space_end());
+        self.write_end();
+    }
+}
+
+impl PageTable<Stage2> {
+    /// Clears the access flag of every valid block mapping in the range, so
+    /// hardware access faults repopulate it; one ranged invalidation at the
+    /// end. The working set can then be harvested with `harvest_af()`.
+    pub fn clear_af(&mut self, begin: usize, end: usize) {
+        let level = Stage2::max_level();
+        let root_table_size = addr::entry_size(level + 1);
+        let mut flush = TlbFlushRange::new();
+
+        self.write_begin();
+        for (i, page_table) in self.deref_mut().iter_mut().enumerate() {
+            let table_begin = i * root_table_size;
+            if table_begin + root_table_size <= begin || table_begin >= end {
+                continue;
+            }
+            page_table.visit_af(table_begin, begin, end, level, true, &mut |_, _| {});
+        }
+        flush.push(begin, end);
+        if let Some((begin, end)) = flush.range {
+            Stage2::invalidate_tlb(begin, end);
+        }
+        self.write_end();
+    }
+
+    /// Harvests access flags over the range: calls `out(page_begin, size)`
+    /// for every accessed extent. Read-only walk.
+    pub fn harvest_af<F: FnMut(usize, usize)>(&mut self, begin: usize, end: usize, out: &mut F) {
+        let level = Stage2::max_level();
+        let root_table_size = addr::entry_size(level + 1);
+
+        for (i, page_table) in self.deref_mut().iter_mut().enumerate() {
+            let table_begin = i * root_table_size;
+            if table_begin + root_table_size <= begin || table_begin >= end {
+                continue;
+            }
+            page_table.visit_af(table_begin, begin, end, level, false, out);
+        }
+    }
+}
+
+impl RawPageTable {
+    /// Walks the table visiting valid leaf entries in [begin, end): with
+    /// `clear` set, rewrites them with the access flag removed; otherwise
+    /// reports accessed extents through `out`.
+    fn visit_af<F: FnMut(usize, usize)>(
+        &mut self,
+        table_begin: usize,
+        begin: usize,
+        end: usize,
+        level: u8,
+        clear: bool,
+        out: &mut F,
+    ) {
+        let entry_size = addr::entry_size(level);
+
+        for (i, pte) in self.iter_mut().enumerate() {
+            let pte_begin = table_begin + i * entry_size;
+            if pte_begin + entry_size <= begin || pte_begin >= end {
+                continue;
+            }
+
+            if pte.is_table(level) {
+                if clear {
+                    // Leaves below are rewritten in place; drop the uniform
+                    // summary.
+                    pte.set_table_uniform(false);
+                }
+                pte.as_table_mut(level)
+                    .unwrap()
+                    .visit_af(pte_begin, begin, end, level - 1, clear, out);
+                continue;
+            }
+
+            if !pte.is_valid(level) {
+                continue;
+            }
+
+            let attrs = pte.attrs(level);
+            if clear {
+                if let Ok(pa) = pte.as_block(level) {
+                    unsafe {
+                        ptr::write(
+                            pte,
+                            PageTableEntry::block(level, pa, arch_mm_attrs_clear_af(attrs)),
+                        );
+                    }
+                }
+            } else if unsafe { arch_mm_attrs_has_af(attrs) } {
+                out(pte_begin, entry_size);
+            }
+        }
+    }
+
+    /// Recursive part of `write_protect_all()`.
+    fn write_protect_level(&mut self, level: u8) {
+        for pte in self.iter_mut() {
+            if pte.is_table(level) {
+                // The leaves below are about to be rewritten in place, so
+                // the uniform summary no longer holds.
+                pte.set_table_uniform(false);
+                pte.as_table_mut(level)
+                    .unwrap()
+                    .write_protect_level(level - 1);
+                continue;
+            }
+
+            if !pte.is_valid(level) {
+                continue;
+            }
+
+            let attrs = pte.attrs(level);
+            let mode = Stage2::attrs_to_mode(attrs);
+            if !mode.contains(Mode::W) || mode.intersects(Mode::UNOWNED | Mode::SHARED) {
+                continue;
+            }
+
+            if let Ok(pa) = pte.as_block(level) {
+                let readonly = unsafe { arch_mm_stage2_attrs_to_readonly(attrs) };
+                // The old entry is a block, so there is no subtable to free;
+                // overwriting in place is enough.
+                unsafe {
+                    ptr::write(pte, PageTableEntry::block(level, pa, readonly));
+                }
+            }
+        }
+    }
 }
 
 impl<S: Stage> Drop for PageTable<S> {
@@ -1025,6 +1999,94 @@ impl<S: Stage> Drop for PageTable<S> {
     }
 }
 
+/// The maximum number of ranges a boot mapping plan can hold.
+pub const MAP_PLAN_SIZE: usize = 16;
+
+/// A sorted plan of identity mappings to be applied to a page table in one
+/// transaction. Collecting the boot-time mappings into a plan lets the table
+/// be populated with a single pre-charged pool, one writer section and one
+/// TLB invalidation, instead of a full map call per range.
+pub struct MapPlan {
+    entries: ArrayVec<[(usize, usize, Mode); MAP_PLAN_SIZE]>,
+}
+
+impl MapPlan {
+    pub fn new() -> Self {
+        Self {
+            entries: ArrayVec::new(),
+        }
+    }
+
+    /// Adds a range to the plan, keeping the entries sorted by address.
+    pub fn push(&mut self, begin: paddr_t, end: paddr_t, mode: Mode) -> Result<(), ()> {
+        if self.entries.is_full() {
+            return Err(());
+        }
+
+        let begin = pa_addr(begin);
+        let end = pa_addr(end);
+        let pos = self
+            .entries
+            .iter()
+            .position(|&(b, _, _)| b > begin)
+            .unwrap_or_else(|| self.entries.len());
+
+        self.entries.insert(pos, (begin, end, mode));
+        Ok(())
+    }
+}
+
+impl<S: Stage> PageTable<S> {
+    /// Applies every mapping of the plan in one transaction: table pages are
+    /// pre-charged in bulk for the whole plan, all ranges are first reserved
+    /// and then committed (so a failure leaves no partial mapping), and a
+    /// single TLB invalidation covers the union of the ranges.
+    pub fn apply_plan(&mut self, plan: &MapPlan, mpool: &MPool) -> Result<(), ()> {
+        let root_level = S::max_level() + 1;
+        let mut flush = TlbFlushRange::new();
+
+        let total: usize = plan
+            .entries
+            .iter()
+            .map(|&(b, e, _)| (e - b) >> (PAGE_BITS + PAGE_LEVEL_BITS))
+            .sum();
+
+        let mut observer = AttrObserver::new();
+        let local_mpool = MPool::new_with_fallback(mpool);
+        local_mpool.prefetch(plan.entries.len() * root_level as usize + total);
+
+        self.write_begin();
+        let result: Result<(), ()> = try {
+            for pass in &[Flags::empty(), Flags::COMMIT] {
+                for &(begin, end, mode) in plan.entries.iter() {
+                    let end = cmp::min(addr::round_up_to_page(end), S::ptable_addr_space_end());
+                    self.map_root(
+                        begin,
+                        end,
+                        S::mode_to_attrs(mode),
+                        root_level,
+                        *pass,
+                        &mut flush,
+                        &mut observer,
+                        &local_mpool,
+                    )?;
+                }
+            }
+        };
+
+        if result.is_ok() {
+            if let (Some(&(first, ..)), Some(&(.., last, _))) =
+                (plan.entries.first(), plan.entries.last())
+            {
+                S::invalidate_tlb(first, last);
+            }
+        }
+        self.write_end();
+
+        result
+    }
+}
+
 /// Locked hypervisor page table.
 /// This structure exists temporarily for C-compatibility. Someday this
 /// will be replaced by `SpinLockGuard`.
@@ -1124,23 +2186,16 @@ impl MemoryManager {
             // Let console driver map pages for itself.
             plat_console_mm_init(stage1_locked, mpool);
 
-            page_table
-                .get_mut()
-                .identity_map(layout_text_begin(), layout_text_end(), Mode::X, mpool)
+            // Collect the image mappings into a plan and populate the table
+            // in one transaction.
+            let mut plan = MapPlan::new();
+            plan.push(layout_text_begin(), layout_text_end(), Mode::X)
                 .unwrap();
-            page_table
-                .get_mut()
-                .identity_map(layout_rodata_begin(), layout_rodata_end(), Mode::R, mpool)
+            plan.push(layout_rodata_begin(), layout_rodata_end(), Mode::R)
                 .unwrap();
-            page_table
-                .get_mut()
-                .identity_map(
-                    layout_data_begin(),
-                    layout_data_end(),
-                    Mode::R | Mode::W,
-                    mpool,
-                )
+            plan.push(layout_data_begin(), layout_data_end(), Mode::R | Mode::W)
                 .unwrap();
+            page_table.get_mut().apply_plan(&plan, mpool).unwrap();
 
             if !arch_mm_init() {
                 return None;
@@ -1167,23 +2222,7 @@ impl MemoryManager {
 
     pub fn vm_unmap_hypervisor(ptable: &mut PageTable<Stage2>, mpool: &MPool) -> Result<(), ()> {
         // TODO: If we add pages dynamically, they must be included here too.
-        ptable.unmap(
-            unsafe { layout_text_begin() },
-            unsafe { layout_text_end() },
-            mpool,
-        )?;
-        ptable.unmap(
-            unsafe { layout_rodata_begin() },
-            unsafe { layout_rodata_end() },
-            mpool,
-        )?;
-        ptable.unmap(
-            unsafe { layout_data_begin() },
-            unsafe { layout_data_end() },
-            mpool,
-        )?;
-
-        Ok(())
+        ptable.unmap_extents(&hypervisor_extents(), mpool)
     }
 }
 
@@ -1248,7 +2287,7 @@ pub unsafe extern "C" fn mm_vm_unmap(
         begin,
         end,
         Stage2::mode_to_attrs(Mode::UNOWNED | Mode::INVALID | Mode::SHARED),
-        Flags::UNMAP,
+        Flags::UNMAP | Flags::TLBI_BATCH,
         mpool,
     )
     .is_ok()
@@ -1266,6 +2305,16 @@ pub unsafe extern "C" fn mm_vm_defrag(t: *mut PageTable<Stage2>, mpool: *const M
     t.defrag(mpool);
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn mm_vm_defrag_incremental(
+    t: *mut PageTable<Stage2>,
+    mpool: *const MPool,
+) -> bool {
+    let t = &mut *t;
+    let mpool = &*mpool;
+    t.defrag_incremental(mpool)
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn mm_vm_get_mode(
     t: *mut PageTable<Stage2>,
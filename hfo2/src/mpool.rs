@@ -14,42 +14,216 @@
  * limitations under the License.
  */
 
+use core::cmp;
 use core::mem;
-use core::ops::DerefMut;
+use core::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
 use core::ptr;
+use core::slice;
 
 use crate::page::*;
 use crate::slist::{IsElement, List, ListEntry};
-use crate::spinlock::SpinLock;
+use crate::spinlock::{SpinLock, TicketLock};
 use crate::types::*;
 use crate::utils::*;
 
+extern "C" {
+    /// Returns the index of the currently executing CPU, used to select the
+    /// per-CPU front-end cache.
+    fn arch_cpu_index_current() -> usize;
+
+    /// Returns the locality (cluster) of the currently executing CPU, used to
+    /// prefer memory chunks close to it.
+    fn arch_cpu_locality_current() -> u32;
+}
+
+/// The number of free pages kept in each per-CPU front-end cache.
+const CACHE_SIZE: usize = 8;
+
+/// The number of pages moved between a cache and the shared pool in one batch,
+/// under a single acquisition of the shared pool lock.
+const CACHE_BATCH_SIZE: usize = CACHE_SIZE / 2;
+
+/// The maximum number of pages moved by one batch of a bulk allocation.
+const BULK_SIZE: usize = 16;
+
+const_assert_eq!(mem::align_of::<Cache>(), CACHE_LINE_SIZE);
+
+/// Per-CPU front-end cache of free pages.
+///
+/// The common alloc/free path only touches the cache of the executing CPU, so
+/// its lock is effectively uncontended; the shared pool lock is only taken for
+/// batched refills and flushes.
+#[repr(C, align(64))]
+struct Cache {
+    pages: [*mut RawPage; CACHE_SIZE],
+    len: usize,
+}
+
+impl Cache {
+    const fn new() -> Self {
+        Self {
+            pages: [ptr::null_mut(); CACHE_SIZE],
+            len: 0,
+        }
+    }
+
+    fn pop(&mut self) -> Option<Page> {
+        if self.len == 0 {
+            return None;
+        }
+
+        self.len -= 1;
+        Some(unsafe { Page::from_raw(self.pages[self.len]) })
+    }
+
+    fn push(&mut self, page: Page) -> Result<(), Page> {
+        if self.len == CACHE_SIZE {
+            return Err(page);
+        }
+
+        self.pages[self.len] = page.into_raw();
+        self.len += 1;
+        Ok(())
+    }
+}
+
+/// ABA-safe lock-free stack of free pages (a Treiber stack). The head word
+/// packs the page address in its low 48 bits with a modification tag in the
+/// high 16 bits, so a concurrent pop/push/pop of the same page fails the CAS
+/// instead of corrupting the list. A pop may read a stale next pointer from a
+/// page that was concurrently reallocated; the read lands in the
+/// identity-mapped heap (so it cannot fault) and the tagged CAS then fails
+/// and retries.
+#[repr(C)]
+struct FreeStack {
+    head: AtomicU64,
+    len: AtomicUsize,
+}
+
+const FREE_STACK_ADDR_MASK: u64 = (1 << 48) - 1;
+
+const_assert!(mem::size_of::<u64>() <= mem::size_of::<RawPage>());
+
+impl FreeStack {
+    const fn new() -> Self {
+        Self {
+            head: AtomicU64::new(0),
+            len: AtomicUsize::new(0),
+        }
+    }
+
+    fn push(&self, page: Page) {
+        let page = page.into_raw();
+        let mut head = self.head.load(Ordering::Relaxed);
+
+        loop {
+            // Link the new top to the current top.
+            unsafe {
+                ptr::write(page as *mut u64, head & FREE_STACK_ADDR_MASK);
+            }
+
+            let tag = head & !FREE_STACK_ADDR_MASK;
+            let new = (page as u64) | tag.wrapping_add(1 << 48);
+
+            match self
+                .head
+                .compare_exchange_weak(head, new, Ordering::Release, Ordering::Relaxed)
+            {
+                Ok(_) => break,
+                Err(current) => head = current,
+            }
+        }
+
+        self.len.fetch_add(1, Ordering::Relaxed);
+    }
+
+    fn pop(&self) -> Option<Page> {
+        let mut head = self.head.load(Ordering::Acquire);
+
+        loop {
+            let page = (head & FREE_STACK_ADDR_MASK) as *mut RawPage;
+            if page.is_null() {
+                return None;
+            }
+
+            // May be stale if the page was reallocated meanwhile; the tagged
+            // CAS below detects that and retries.
+            let next = unsafe { ptr::read_volatile(page as *const u64) };
+            let tag = head & !FREE_STACK_ADDR_MASK;
+            let new = (next & FREE_STACK_ADDR_MASK) | tag.wrapping_add(1 << 48);
+
+            match self
+                .head
+                .compare_exchange_weak(head, new, Ordering::AcqRel, Ordering::Acquire)
+            {
+                Ok(_) => {
+                    self.len.fetch_sub(1, Ordering::Relaxed);
+                    return Some(unsafe { Page::from_raw(page) });
+                }
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    fn len(&self) -> usize {
+        self.len.load(Ordering::Relaxed)
+    }
+
+    /// Takes the whole stack in one swap, returning the raw head (the nodes
+    /// stay linked through their first words). Only safe for the pool's
+    /// exclusive owner during teardown.
+    fn take_all(&self) -> u64 {
+        self.len.store(0, Ordering::Relaxed);
+        self.head.swap(0, Ordering::AcqRel) & FREE_STACK_ADDR_MASK
+    }
+
+    /// Splices an already linked chain of `count` nodes onto the stack with
+    /// a single CAS, instead of one push per node.
+    fn splice(&self, head: u64, tail: *mut u64, count: usize) {
+        if head == 0 {
+            return;
+        }
+
+        let mut old = self.head.load(Ordering::Relaxed);
+        loop {
+            unsafe {
+                ptr::write(tail, old & FREE_STACK_ADDR_MASK);
+            }
+            let tag = old & !FREE_STACK_ADDR_MASK;
+            let new = head | tag.wrapping_add(1 << 48);
+
+            match self
+                .head
+                .compare_exchange_weak(old, new, Ordering::Release, Ordering::Relaxed)
+            {
+                Ok(_) => break,
+                Err(current) => old = current,
+            }
+        }
+
+        self.len.fetch_add(count, Ordering::Relaxed);
+    }
+}
+
 #[repr(C)]
 struct Chunk {
     entry: ListEntry,
     size: usize,
+
+    /// The locality (cluster) this chunk's memory is close to; allocation
+    /// prefers chunks matching the calling CPU's locality. Tag 0 means
+    /// untagged.
+    locality: u32,
 }
 const_assert!(mem::size_of::<Chunk>() <= mem::size_of::<RawPage>());
 
-#[repr(C)]
-struct Entry {
-    entry: ListEntry,
-}
-const_assert!(mem::size_of::<Entry>() <= mem::size_of::<RawPage>());
 
 impl Chunk {
     pub const fn new(size: usize) -> Self {
         Self {
             entry: ListEntry::new(),
             size,
-        }
-    }
-}
-
-impl Entry {
-    pub const fn new() -> Self {
-        Self {
-            entry: ListEntry::new(),
+            locality: 0,
         }
     }
 }
@@ -64,21 +238,10 @@ impl IsElement<Chunk> for Chunk {
     }
 }
 
-impl IsElement<Entry> for Entry {
-    fn entry_of(element: &Entry) -> &ListEntry {
-        &element.entry
-    }
-
-    unsafe fn element_of(entry: &ListEntry) -> &Entry {
-        &*(entry as *const _ as *const _)
-    }
-}
-
 /// Page pool.
 #[repr(C)]
 pub struct Pool {
     chunk_list: List<Chunk>,
-    entry_list: List<Entry>,
 }
 
 impl Pool {
@@ -86,19 +249,34 @@ impl Pool {
     pub const fn new() -> Self {
         Self {
             chunk_list: List::new(),
-            entry_list: List::new(),
         }
     }
 
-    /// Allocates a page.
+    /// Carves a page out of the chunk list. Single freed pages live in the
+    /// lock-free stack in front of this; see `MPool::alloc`.
     pub fn alloc(&mut self) -> Result<Page, ()> {
-        if let Some(entry) = self.entry_list.pop() {
-            #[allow(clippy::cast_ptr_alignment)]
-            return Ok(unsafe { Page::from_raw(entry as *mut RawPage) });
-        }
 
-        let chunk = self.chunk_list.pop().ok_or(())?;
+        // Prefer a chunk local to the calling CPU's cluster; fall back to
+        // any chunk.
+        let locality = unsafe { arch_cpu_locality_current() };
+        let chunk = unsafe {
+            self.chunk_list
+                .pop_if_some(|chunk| {
+                    if (*chunk).locality == locality {
+                        Some(())
+                    } else {
+                        None
+                    }
+                })
+                .map(|(chunk, ())| chunk)
+        };
+        let chunk = match chunk {
+            Some(chunk) => chunk,
+            None => self.chunk_list.pop().ok_or(())?,
+        };
+
         let size = unsafe { (*chunk).size };
+        let chunk_locality = unsafe { (*chunk).locality };
         debug_assert_ne!(size, 0);
 
         #[allow(clippy::cast_ptr_alignment)]
@@ -107,6 +285,7 @@ impl Pool {
         if size > 1 {
             let new_chunk = unsafe { &mut *((chunk as usize + PAGE_SIZE) as *mut Chunk) };
             new_chunk.size = size - 1;
+            new_chunk.locality = chunk_locality;
             unsafe { self.chunk_list.push(new_chunk) };
         }
 
@@ -158,21 +337,31 @@ impl Pool {
         Ok(unsafe { Pages::from_raw(start as *mut RawPage, size) })
     }
 
-    /// Frees a page back into the given page pool, making it available for reuse.
-    ///
-    /// This is meant to be used for freeing single pages. To free multiple pages, call
-    /// `free_pages()` instead.
-    pub fn free(&mut self, mut page: Page) {
-        let entry = unsafe { &*(page.deref_mut() as *mut RawPage as *mut Entry) };
-        mem::forget(page);
-        unsafe { self.entry_list.push(entry) };
+    /// Allocates up to `out.len()` pages, storing them in `out`. Returns the number of pages
+    /// allocated. Unlike `alloc_pages()`, the pages are not necessarily contiguous.
+    pub fn alloc_bulk(&mut self, out: &mut [*mut RawPage]) -> usize {
+        for (i, slot) in out.iter_mut().enumerate() {
+            match self.alloc() {
+                Ok(page) => *slot = page.into_raw(),
+                Err(()) => return i,
+            }
+        }
+
+        out.len()
     }
 
     /// Frees a number of contiguous pages to the given page pool.
     pub fn free_pages(&mut self, pages: Pages) {
+        self.free_pages_tagged(pages, 0)
+    }
+
+    /// Frees a number of contiguous pages, tagging the resulting chunk with
+    /// the locality of the memory.
+    pub fn free_pages_tagged(&mut self, pages: Pages, locality: u32) {
         let size = pages.len();
         let chunk = unsafe { &mut *(pages.into_raw() as *mut Chunk) };
         chunk.size = size;
+        chunk.locality = locality;
         unsafe { self.chunk_list.push(chunk) };
     }
 }
@@ -180,9 +369,48 @@ impl Pool {
 /// Memory pool equipped with spinlock and fallback pool.
 /// TODO(HfO2): Make a trait, which generalizes Pool (linked list) and a pair of
 /// (pool, fallback) (#35.)
+/// Allocator observability counters, updated relaxed on the fast paths and
+/// read racily by the stats hypercall; see `MPool::stat`.
+#[repr(C)]
+pub struct MPoolStats {
+    pub allocs: AtomicU64,
+    pub frees: AtomicU64,
+
+    /// Allocations this pool couldn't satisfy and promoted to its fallback.
+    pub fallback_allocs: AtomicU64,
+
+    /// The lowest number of stacked free pages observed.
+    pub free_low_watermark: AtomicU64,
+}
+
+impl MPoolStats {
+    const fn new() -> Self {
+        Self {
+            allocs: AtomicU64::new(0),
+            frees: AtomicU64::new(0),
+            fallback_allocs: AtomicU64::new(0),
+            free_low_watermark: AtomicU64::new(u64::max_value()),
+        }
+    }
+}
+
 #[repr(C)]
 pub struct MPool {
-    pool: SpinLock<Pool>,
+    pool: TicketLock<Pool>,
+
+    /// Observability counters; capacity planning and leak detection read
+    /// these instead of guessing.
+    pub stats: MPoolStats,
+
+    /// Lock-free stack of free single pages, the dominant alloc/free source
+    /// under page-table churn; the ticket lock above only covers chunk
+    /// carving.
+    free_stack: FreeStack,
+
+    /// Per-CPU front-end caches of free pages. Only engaged for pools without
+    /// a fallback (i.e. the global page pool), so that local pools keep their
+    /// freed pages reserved for rollback.
+    caches: [SpinLock<Cache>; MAX_CPUS],
     fallback: *const MPool,
 }
 
@@ -193,9 +421,14 @@ impl MPool {
     /// of two pointers.
     ///
     /// All entries stored in the memory pool will be aligned to at least the entry size.
+    const CACHE_INIT: SpinLock<Cache> = SpinLock::new(Cache::new());
+
     pub const fn new() -> Self {
         Self {
-            pool: SpinLock::new(Pool::new()),
+            pool: TicketLock::new(Pool::new()),
+            stats: MPoolStats::new(),
+            free_stack: FreeStack::new(),
+            caches: [Self::CACHE_INIT; MAX_CPUS],
             fallback: ptr::null(),
         }
     }
@@ -204,8 +437,25 @@ impl MPool {
     /// chunk and free lists from `from`, consuming all its resources and making them available via
     /// the new memory pool.
     pub fn new_from(from: &Self) -> Self {
+        let pool = TicketLock::new(mem::replace(&mut *from.pool.lock(), Pool::new()));
+        let free_stack = FreeStack::new();
+
+        // Migrate the pages cached or stacked by `from` as well.
+        for cache in from.caches.iter() {
+            let mut cache = cache.lock();
+            while let Some(page) = cache.pop() {
+                free_stack.push(page);
+            }
+        }
+        while let Some(page) = from.free_stack.pop() {
+            free_stack.push(page);
+        }
+
         Self {
-            pool: SpinLock::new(mem::replace(&mut from.pool.lock(), Pool::new())),
+            pool,
+            stats: MPoolStats::new(),
+            free_stack,
+            caches: [Self::CACHE_INIT; MAX_CPUS],
             fallback: from.fallback,
         }
 
@@ -221,20 +471,70 @@ impl MPool {
         pool
     }
 
+    /// Checks whether the per-CPU front-end caches are engaged for this pool.
+    fn is_cached(&self) -> bool {
+        unsafe { MPOOL_CACHES_ENABLED && self.fallback.is_null() }
+    }
+
     /// Allocates an entry from the given memory pool, if one is available. If there isn't one
     /// available, try and allocate from the fallback if there is one.
     pub fn alloc(&self) -> Result<Page, ()> {
-        if let Ok(result) = self.pool.lock().alloc() {
-            return Ok(result);
+        if self.is_cached() {
+            let mut cache = self.caches[unsafe { arch_cpu_index_current() }].lock();
+            if let Some(page) = cache.pop() {
+                return Ok(page);
+            }
+
+            // The cache is empty; refill it in a batch from the lock-free
+            // stack, falling back to carving from the locked chunk list.
+            let result = self.alloc_uncached();
+            if result.is_ok() {
+                for _ in 0..CACHE_BATCH_SIZE {
+                    match self.free_stack.pop() {
+                        Some(page) => {
+                            if let Err(page) = cache.push(page) {
+                                self.free_stack.push(page);
+                                break;
+                            }
+                        }
+                        None => break,
+                    }
+                }
+            }
+            return result;
+        }
+
+        if let Ok(page) = self.alloc_uncached() {
+            return Ok(page);
         }
 
         if let Some(fallback) = unsafe { self.fallback.as_ref() } {
+            self.stats.fallback_allocs.fetch_add(1, Ordering::Relaxed);
             return fallback.alloc();
         }
 
         Err(())
     }
 
+    /// Allocates a single page: from the lock-free stack if it has one, else
+    /// by carving from the locked chunk list.
+    fn alloc_uncached(&self) -> Result<Page, ()> {
+        self.stats.allocs.fetch_add(1, Ordering::Relaxed);
+
+        let remaining = self.free_stack.len() as u64;
+        if remaining < self.stats.free_low_watermark.load(Ordering::Relaxed) {
+            self.stats
+                .free_low_watermark
+                .store(remaining, Ordering::Relaxed);
+        }
+
+        if let Some(page) = self.free_stack.pop() {
+            return Ok(page);
+        }
+
+        self.pool.lock().alloc()
+    }
+
     /// Allocates a number of contiguous and aligned entries. This is a best-effort operation and
     /// only succeeds if such entries can be found in the chunks list or the chunks of the fallbacks
     /// (i.e., the entry list is never used to satisfy these allocations).
@@ -255,12 +555,109 @@ impl MPool {
         Err(())
     }
 
+    /// Allocates up to `out.len()` pages in a single acquisition of each pool lock, storing them
+    /// in `out`. Returns the number of pages allocated, which may be fewer than requested if the
+    /// pools run out of memory. The per-CPU caches are bypassed, as bulk callers batch on their
+    /// own.
+    pub fn alloc_bulk(&self, out: &mut [*mut RawPage]) -> usize {
+        let mut n = 0;
+
+        // Drain the lock-free stack first, then carve the rest from the
+        // chunk list under one lock acquisition.
+        while n < out.len() {
+            match self.free_stack.pop() {
+                Some(page) => {
+                    out[n] = page.into_raw();
+                    n += 1;
+                }
+                None => break,
+            }
+        }
+
+        if n < out.len() {
+            n += self.pool.lock().alloc_bulk(&mut out[n..]);
+        }
+
+        if n < out.len() {
+            if let Some(fallback) = unsafe { self.fallback.as_ref() } {
+                n += fallback.alloc_bulk(&mut out[n..]);
+            }
+        }
+
+        n
+    }
+
+    /// Moves up to `count` free pages from the fallback into this pool, taking the fallback's lock
+    /// once per batch rather than once per page. This is useful for pre-charging a local pool
+    /// before an operation that is known to allocate many pages, such as populating a large page
+    /// table range.
+    pub fn prefetch(&self, count: usize) {
+        let fallback = some_or!(unsafe { self.fallback.as_ref() }, return);
+        let mut remaining = count;
+
+        while remaining > 0 {
+            let mut batch = [ptr::null_mut(); BULK_SIZE];
+            let take = cmp::min(remaining, BULK_SIZE);
+            let allocated = fallback.alloc_bulk(&mut batch[..take]);
+
+            for page in batch[..allocated].iter() {
+                self.free_stack.push(unsafe { Page::from_raw(*page) });
+            }
+
+            if allocated < take {
+                break;
+            }
+
+            remaining -= allocated;
+        }
+    }
+
+    /// Returns free single pages beyond `keep` to the fallback pool, in
+    /// batches, bounding how much memory a long-lived cache pool can hold
+    /// back from the rest of the system.
+    pub fn trim(&self, keep: usize) {
+        let fallback = some_or!(unsafe { self.fallback.as_ref() }, return);
+
+        while self.free_stack.len() > keep {
+            match self.free_stack.pop() {
+                Some(page) => fallback.free(page),
+                None => return,
+            }
+        }
+    }
+
     /// Frees an entry back into the memory pool, making it available for reuse.
     ///
     /// This is meant to be used for freeing single entries. To free multiple entries, one must call
     /// mpool_add_chunk instead.
     pub fn free(&self, page: Page) {
-        self.pool.lock().free(page);
+        if self.is_cached() {
+            let mut cache = self.caches[unsafe { arch_cpu_index_current() }].lock();
+            match cache.push(page) {
+                Ok(()) => return,
+                Err(page) => {
+                    // The cache is full; spill a batch onto the lock-free
+                    // stack.
+                    for _ in 0..CACHE_BATCH_SIZE {
+                        match cache.pop() {
+                            Some(page) => self.free_stack.push(page),
+                            None => break,
+                        }
+                    }
+                    self.free_stack.push(page);
+                    return;
+                }
+            }
+        }
+
+        self.free_stack.push(page);
+        self.stats.frees.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Adds contiguous pages to the pool, tagging the chunk with the
+    /// locality of its memory.
+    pub fn add_pages_tagged(&self, pages: Pages, locality: u32) {
+        self.pool.lock().free_pages_tagged(pages, locality);
     }
 
     /// Adds a contiguous chunk of memory to the given memory pool. The chunk will eventually be
@@ -279,15 +676,36 @@ impl Drop for MPool {
     /// Finishes the given memory pool, giving all free memory to the fallback pool if there is one.
     fn drop(&mut self) {
         if let Some(fallback) = unsafe { self.fallback.as_ref() } {
+            // Push cached pages onto our own stack first, then hand the
+            // whole chain to the fallback with a single take-all swap and a
+            // single splice CAS — teardown cost no longer scales in
+            // synchronization operations with the pages touched.
+            for cache in self.caches.iter() {
+                let mut cache = cache.lock();
+                while let Some(page) = cache.pop() {
+                    self.free_stack.push(page);
+                }
+            }
+
+            let head = self.free_stack.take_all();
+            if head != 0 {
+                // Walk the private chain once to find its tail and length.
+                let mut count = 1;
+                let mut tail = head as *mut u64;
+                unsafe {
+                    while ptr::read(tail) & FREE_STACK_ADDR_MASK != 0 {
+                        tail = (ptr::read(tail) & FREE_STACK_ADDR_MASK) as *mut u64;
+                        count += 1;
+                    }
+                }
+                fallback.free_stack.splice(head, tail, count);
+                fallback.stats.frees.fetch_add(count as u64, Ordering::Relaxed);
+            }
+
             let mut pool = self.pool.lock();
             let mut pool_fallback = fallback.pool.lock();
 
             unsafe {
-                // Merge the freelist into the fallback.
-                while let Some(entry) = pool.entry_list.pop() {
-                    pool_fallback.entry_list.push(&*entry);
-                }
-
                 // Merge the chunk list into the fallback.
                 while let Some(chunk) = pool.chunk_list.pop() {
                     pool_fallback.chunk_list.push(&*chunk);
@@ -304,6 +722,17 @@ impl Drop for MPool {
 
 pub unsafe fn mpool_enable_locks() {}
 
+/// Whether the per-CPU front-end caches are engaged. They are only turned on
+/// once booting has finished, as until then allocations may happen before the
+/// executing CPU is known.
+static mut MPOOL_CACHES_ENABLED: bool = false;
+
+/// Enables the per-CPU front-end caches of pools without a fallback, so that
+/// the common alloc/free path no longer contends on the shared pool lock.
+pub unsafe fn mpool_enable_caches() {
+    MPOOL_CACHES_ENABLED = true;
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn mpool_init(p: *mut MPool, entry_size: size_t) {
     assert_eq!(PAGE_SIZE, entry_size as usize);
@@ -334,6 +763,20 @@ pub unsafe extern "C" fn mpool_add_chunk(p: *mut MPool, begin: *mut c_void, size
         .is_ok()
 }
 
+/// Like mpool_add_chunk, but tags the chunk with the locality (cluster) of
+/// its memory, so allocation can prefer chunks close to the calling CPU.
+#[no_mangle]
+pub unsafe extern "C" fn mpool_add_chunk_tagged(
+    p: *mut MPool,
+    begin: *mut c_void,
+    size: size_t,
+    locality: u32,
+) -> bool {
+    Pages::from_raw_u8(begin as *mut u8, size)
+        .map(|pages| (*p).pool.lock().free_pages_tagged(pages, locality))
+        .is_ok()
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn mpool_alloc(p: *mut MPool) -> *mut c_void {
     (*p).alloc()
@@ -352,7 +795,32 @@ pub unsafe extern "C" fn mpool_alloc_contiguous(
         .unwrap_or(ptr::null_mut())
 }
 
+#[no_mangle]
+pub unsafe extern "C" fn mpool_alloc_bulk(
+    p: *mut MPool,
+    n: size_t,
+    out: *mut *mut c_void,
+) -> size_t {
+    let out = slice::from_raw_parts_mut(out as *mut *mut RawPage, n);
+    (*p).alloc_bulk(out)
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn mpool_free(p: *mut MPool, ptr: *mut c_void) {
     (*p).free(Page::from_raw(ptr as *mut RawPage));
 }
+
+/// Reads one counter of the given pool's statistics: 0 allocs, 1 frees,
+/// 2 fallback promotions, 3 current free pages, 4 free-page low watermark.
+#[no_mangle]
+pub unsafe extern "C" fn mpool_stat(p: *const MPool, field: u32) -> u64 {
+    let p = &*p;
+    match field {
+        0 => p.stats.allocs.load(Ordering::Relaxed),
+        1 => p.stats.frees.load(Ordering::Relaxed),
+        2 => p.stats.fallback_allocs.load(Ordering::Relaxed),
+        3 => p.free_stack.len() as u64,
+        4 => p.stats.free_low_watermark.load(Ordering::Relaxed),
+        _ => u64::max_value(),
+    }
+}
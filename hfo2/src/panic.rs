@@ -37,6 +37,12 @@ pub extern "C" fn abort() -> ! {
 #[cfg(not(test))]
 #[panic_handler]
 fn panic(info: &core::panic::PanicInfo) -> ! {
+    // Make sure the panic message reaches the console synchronously, after
+    // anything still sitting in the deferred rings.
+    unsafe {
+        crate::dlog::dlog_flush_and_disable();
+    }
+
     dlog!("Panic: {:?}\n", info);
     abort_impl()
 }
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2019 Jeehoon Kang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! Hypercall latency instrumentation.
+//!
+//! The architecture-specific trap handler timestamps the entry and exit of
+//! each ABI call and reports the elapsed cycles here. Samples are accumulated
+//! in per-CPU log2 histograms keyed by VM and call class, so recording is a
+//! single uncontended increment. The primary VM reads the aggregated
+//! histograms through a debug hypercall.
+
+use core::cmp;
+
+use crate::cpu::*;
+use crate::types::*;
+
+extern "C" {
+    /// Returns the index of the currently executing CPU, used to select the
+    /// per-CPU histogram.
+    fn arch_cpu_index_current() -> usize;
+}
+
+/// ABI call classes tracked separately; everything else is lumped into
+/// `Other`. Keep in sync with the `PERF_CALL_*` defines in `inc/hf/perf.h`.
+pub const PERF_CALL_VCPU_RUN: usize = 0;
+pub const PERF_CALL_MSG_SEND: usize = 1;
+pub const PERF_CALL_SHARE_MEMORY: usize = 2;
+pub const PERF_CALL_OTHER: usize = 3;
+pub const PERF_NUM_CALLS: usize = 4;
+
+/// Histogram buckets: bucket i counts calls that took [2^i, 2^(i+1)) timer
+/// cycles, with the last bucket open-ended.
+pub const PERF_NUM_BUCKETS: usize = 16;
+
+/// Per-CPU histogram storage. Each element is only incremented by its owning
+/// CPU; the reader sums across CPUs and tolerates tearing.
+#[derive(Clone, Copy)]
+#[repr(align(64))]
+struct PerfCpu {
+    counts: [[[u64; PERF_NUM_BUCKETS]; PERF_NUM_CALLS]; MAX_VMS],
+}
+
+static mut PERF_STATS: [PerfCpu; MAX_CPUS] = [PerfCpu {
+    counts: [[[0; PERF_NUM_BUCKETS]; PERF_NUM_CALLS]; MAX_VMS],
+}; MAX_CPUS];
+
+/// Records one completed ABI call of the given class, made by the given VM,
+/// that took the given number of timer cycles.
+#[no_mangle]
+pub unsafe extern "C" fn perf_record(call: usize, vm_id: spci_vm_id_t, cycles: u64) {
+    if vm_id < HF_VM_ID_OFFSET || call >= PERF_NUM_CALLS {
+        return;
+    }
+
+    let vm = (vm_id - HF_VM_ID_OFFSET) as usize;
+    if vm >= MAX_VMS {
+        return;
+    }
+
+    let bucket = cmp::min(
+        PERF_NUM_BUCKETS - 1,
+        (63 - u64::leading_zeros(cycles | 1)) as usize,
+    );
+
+    PERF_STATS[arch_cpu_index_current()].counts[vm][call][bucket] += 1;
+}
+
+/// Reads one histogram bucket, summed over all CPUs. Only the primary VM is
+/// allowed to read the statistics.
+///
+/// The argument packs the query: bits [15:0] the VM ID, bits [23:16] the call
+/// class and bits [31:24] the bucket index. Returns -1 on an invalid query.
+#[no_mangle]
+pub unsafe extern "C" fn api_perf_read(arg: u64, current: *const VCpu) -> i64 {
+    if (*current).vm().id != HF_PRIMARY_VM_ID {
+        return -1;
+    }
+
+    let vm_id = arg as spci_vm_id_t;
+    let call = (arg >> 16) as u8 as usize;
+    let bucket = (arg >> 24) as u8 as usize;
+
+    if vm_id < HF_VM_ID_OFFSET || call >= PERF_NUM_CALLS || bucket >= PERF_NUM_BUCKETS {
+        return -1;
+    }
+
+    let vm = (vm_id - HF_VM_ID_OFFSET) as usize;
+    if vm >= MAX_VMS {
+        return -1;
+    }
+
+    let sum: u64 = PERF_STATS
+        .iter()
+        .map(|cpu| cpu.counts[vm][call][bucket])
+        .sum();
+
+    cmp::min(sum, i64::max_value() as u64) as i64
+}
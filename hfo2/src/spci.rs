@@ -59,6 +59,19 @@ bitflags! {
 
         /// Implementation defined message payload.
         const IMPDEF = 0b0001;
+
+        /// The payload is delivered by reference: the message body carries
+        /// the address of the sender's send buffer page, which is mapped
+        /// read-only into the receiver until the mailbox is cleared.
+        const ZERO_COPY = 0b0010;
+
+        /// This message is a chunk of a streamed transfer and more chunks
+        /// follow; clearing the mailbox delivers the next one.
+        const STREAM_MORE = 0b0100;
+
+        /// Urgent message: may use the reserved priority slot when the
+        /// normal mailbox is occupied and wakes the receiver immediately.
+        const URGENT = 0b1000;
     }
 }
 
@@ -73,9 +86,98 @@ bitflags! {
     #[repr(C)]
     pub struct SpciMsgSendAttributes: u32 {
         const NOTIFY = 0b0001;
+
+        /// Deliver the payload without copying it: the sender's send buffer
+        /// page is mapped read-only into the receiver's stage-2 tables and
+        /// only a descriptor is written to the receive buffer. The sender
+        /// must not reuse its send buffer until the receiver clears its
+        /// mailbox, which unmaps the page again.
+        const ZERO_COPY = 0b0010;
+
+        /// Donate the rest of the sender's timeslice to the receiver: if a
+        /// vCPU of the receiving VM is blocked waiting for the message, the
+        /// hypervisor switches to it directly on this physical CPU instead of
+        /// bouncing through the primary VM's scheduler.
+        const DIRECT_YIELD = 0b0100;
+
+        /// Asynchronous send: return to the sender immediately once the
+        /// message has been accepted (delivered or queued), without switching
+        /// to the primary scheduler. The receiver picks the message up
+        /// whenever it is next scheduled.
+        const ASYNC = 0b1000;
+
+        /// Streamed send: the payload of the message is a descriptor (a
+        /// 64-bit address followed by a 64-bit length) of a multi-page
+        /// buffer in the sender's memory. The hypervisor pipelines the
+        /// buffer into the receiver's mailbox chunk by chunk as the receiver
+        /// clears it, with no further sender involvement.
+        const STREAM = 0b1_0000;
+
+        /// Multicast send: the payload begins with a recipient count and
+        /// vm-id list; the body after it is copied once into hypervisor
+        /// memory and delivered to every listed recipient whose mailbox is
+        /// free. A delivery bitmap is written to the sender's empty receive
+        /// buffer. Implies asynchronous semantics.
+        const MULTICAST = 0b10_0000;
+    }
+}
+
+bitflags! {
+    /// Fast-path capabilities a VM can advertise through SPCI_FEATURES. The
+    /// hypervisor records the negotiated set per VM so hot handlers branch on
+    /// one cached word.
+    #[repr(C)]
+    pub struct SpciFeatures: u32 {
+        /// The VM understands register-based direct messages (wakes with the
+        /// direct-delivery marker in x1).
+        const DIRECT_MSG = 0b0001;
+
+        /// The VM uses asynchronous sends.
+        const ASYNC_SEND = 0b0010;
+
+        /// The VM reads the shared interrupt status page.
+        const STATUS_PAGE = 0b0100;
+
+        /// The VM takes direct mailbox-writable interrupts.
+        const WRITABLE_NOTIFY = 0b1000;
+
+        /// The VM acknowledges its virtual interrupts through its GICv3 CPU
+        /// interface; the hypervisor keeps its list registers filled from
+        /// the pending bitmap instead of waiting for query hypercalls.
+        const GICV3_NATIVE = 0b1_0000;
+
+        /// The VM uses the v2 memory-region layout with 16-byte-aligned
+        /// constituent arrays.
+        const ALIGNED_V2 = 0b10_0000;
     }
 }
 
+/// Validity bitmap over the low four message-flag bits as sent by a guest:
+/// only "architected" (0b0000) and "implementation defined" (0b0001) are
+/// sendable; the delivery-side flags (zero-copy, stream) are set by the
+/// hypervisor only. Indexing this by the flag bits replaces a chain of
+/// comparisons.
+pub const SPCI_SEND_FLAGS_VALID: u32 = (1 << 0b0000) | (1 << 0b0001) | (1 << 0b1001);
+
+/// Validates a guest-sent message header in a handful of branchless checks:
+/// the flag combination via the precomputed bitmap, the payload length
+/// against the sender's limit, and the source/target IDs with fused range
+/// checks. `payload_limit` is the sender's negotiated capacity.
+#[inline]
+pub fn spci_header_valid(
+    msg: &SpciMessage,
+    from_id: spci_vm_id_t,
+    payload_limit: usize,
+) -> bool {
+    let bits = u32::from(msg.flags.bits());
+    let flags_ok = ((bits & !0xf) == 0) as u32 & (SPCI_SEND_FLAGS_VALID >> (bits & 0xf)) & 1;
+    let len_ok = (msg.length as usize <= payload_limit) as u32;
+    let src_ok = (msg.source_vm_id == from_id) as u32;
+    let not_reflexive = (msg.target_vm_id != from_id) as u32;
+
+    flags_ok & len_ok & src_ok & not_reflexive == 1
+}
+
 /// The maximum length possible for a single message.
 pub const SPCI_MSG_PAYLOAD_MAX: usize = HF_MAILBOX_SIZE - mem::size_of::<SpciMessage>();
 
@@ -164,6 +266,17 @@ pub struct SpciMemoryRegion {
     pub constituents: [SpciMemoryRegionConstituent; 0],
 }
 
+/// V2 memory region layout (see struct spci_memory_region_v2): the extra
+/// reserved doubleword aligns the constituent array to 16 bytes within the
+/// message. Negotiated with `SpciFeatures::ALIGNED_V2`.
+#[repr(C)]
+pub struct SpciMemoryRegionV2 {
+    handle: spci_memory_handle_t,
+    pub count: u32,
+    reserved: u64,
+    pub constituents: [SpciMemoryRegionConstituent; 0],
+}
+
 pub struct SpciMemTransitions {
     pub orig_from_mode: Mode,
     pub orig_to_mode: Mode,
@@ -16,6 +16,10 @@
 
 use core::mem;
 use core::ptr;
+use core::slice;
+use core::sync::atomic::Ordering;
+
+use arrayvec::ArrayVec;
 
 use crate::addr::*;
 use crate::mm::*;
@@ -23,48 +27,68 @@ use crate::mpool::*;
 use crate::page::*;
 use crate::spci::*;
 use crate::std::*;
+use crate::spinlock::SpinLock;
 use crate::vm::*;
 
 /// Check if the message length and the number of memory region constituents match, if the check is
 /// correct call the memory sharing routine.
 fn spci_validate_call_share_memory(
-    to_inner: &mut VmInner,
-    from_inner: &mut VmInner,
+    to: &Vm,
+    from: &Vm,
     memory_region: &SpciMemoryRegion,
     memory_share_size: usize,
     memory_to_attributes: Mode,
     share: SpciMemoryShare,
-    fallback: &MPool,
 ) -> SpciReturn {
     let max_count = memory_region.count as usize;
+    let aligned_v2 = SpciFeatures::from_bits_truncate(
+        from.features.load(core::sync::atomic::Ordering::Relaxed),
+    )
+    .contains(SpciFeatures::ALIGNED_V2);
+    let to_aligned_v2 = SpciFeatures::from_bits_truncate(
+        to.features.load(core::sync::atomic::Ordering::Relaxed),
+    )
+    .contains(SpciFeatures::ALIGNED_V2);
+
+    // The architected message is forwarded to the receiver as-is, so both
+    // endpoints must have negotiated the same descriptor layout; a v1
+    // receiver handed a v2 descriptor (or vice versa) would read the
+    // constituent array at the wrong offset.
+    if aligned_v2 != to_aligned_v2 {
+        return SpciReturn::InvalidParameters;
+    }
+
+    let header_size = if aligned_v2 {
+        mem::size_of::<SpciMemoryRegionV2>()
+    } else {
+        mem::size_of::<SpciMemoryRegion>()
+    };
 
     // Ensure the number of constituents are within the memory bounds.
     if memory_share_size
-        != mem::size_of::<SpciMemoryRegion>()
-            + mem::size_of::<SpciMemoryRegionConstituent>() * max_count
+        != header_size + mem::size_of::<SpciMemoryRegionConstituent>() * max_count
     {
         return SpciReturn::InvalidParameters;
     }
 
     spci_share_memory(
-        to_inner,
-        from_inner,
+        to,
+        from,
         memory_region,
         memory_to_attributes,
         share,
-        fallback,
+        aligned_v2,
     )
 }
 
 /// Performs initial architected message information parsing. Calls the corresponding api functions
 /// implementing the functionality requested in the architected message.
 pub fn spci_msg_handle_architected_message(
-    to_inner: &mut VmInner,
-    from_inner: &mut VmInner,
+    to: &Vm,
+    from: &Vm,
     architected_message_replica: &SpciArchitectedMessageHeader,
     from_msg_replica: &SpciMessage,
     to_msg: &mut SpciMessage,
-    fallback: &MPool,
 ) -> SpciReturn {
     let from_msg_payload_length = from_msg_replica.length as usize;
 
@@ -82,13 +106,12 @@ pub fn spci_msg_handle_architected_message(
             let to_mode = Mode::R | Mode::W | Mode::X;
 
             spci_validate_call_share_memory(
-                to_inner,
-                from_inner,
+                to,
+                from,
                 memory_region,
                 memory_share_size,
                 to_mode,
                 message_type,
-                fallback,
             )
         }
         SpciMemoryShare::Relinquish => {
@@ -102,13 +125,12 @@ pub fn spci_msg_handle_architected_message(
             let to_mode = Mode::R | Mode::W | Mode::X;
 
             spci_validate_call_share_memory(
-                to_inner,
-                from_inner,
+                to,
+                from,
                 memory_region,
                 memory_share_size,
                 to_mode,
                 message_type,
-                fallback,
             )
         }
         SpciMemoryShare::Lend => {
@@ -130,13 +152,12 @@ pub fn spci_msg_handle_architected_message(
             let to_mode = spci_memory_attrs_to_mode(borrower_attributes as _);
 
             spci_validate_call_share_memory(
-                to_inner,
-                from_inner,
+                to,
+                from,
                 memory_region,
                 memory_share_size,
                 to_mode,
                 message_type,
-                fallback,
             )
         }
     };
@@ -190,26 +211,16 @@ fn spci_msg_get_next_state(
     Err(())
 }
 
-/// Verify that all pages have the same mode, that the starting mode constitutes a valid state and
-/// obtain the next mode to apply to the two VMs.
-///
-/// # Return
-///
-/// The error code false indicates that:
-///  1) a state transition was not found;
-///  2) the pages being shared do not have the same mode within the <to>
-///    or <form> VMs;
-///  3) The beginning and end IPAs are not page aligned;
-///  4) The requested share type was not handled.
-/// Success is indicated by true.
-pub fn spci_msg_check_transition(
-    to_inner: &VmInner,
-    from_inner: &VmInner,
+/// Verify that the starting modes constitute a valid state and obtain the
+/// next mode to apply to the two VMs. The per-range mode observation now
+/// rides along with table reservation (see `reserve_observed`), so this only
+/// consults the transition tables.
+pub fn spci_msg_get_transition(
     share: SpciMemoryShare,
-    begin: ipaddr_t,
-    end: ipaddr_t,
+    orig_from_mode: Mode,
+    orig_to_mode: Mode,
     memory_to_attributes: Mode,
-) -> Result<(Mode, Mode, Mode), ()> {
+) -> Result<(Mode, Mode), ()> {
     // TODO: Transition table does not currently consider the multiple shared case.
     let donate_transitions: [SpciMemTransitions; 4] = [
         // 1) {O-EA, !O-NA} -> {!O-NA, O-EA}
@@ -285,29 +296,18 @@ pub fn spci_msg_check_transition(
         },
     ];
 
-    // Fail if addresses are not page-aligned.
-    if !is_aligned(ipa_addr(begin), PAGE_SIZE) || !is_aligned(ipa_addr(end), PAGE_SIZE) {
-        return Err(());
-    }
-
-    // Ensure that the memory range is mapped with the same mode.
-    let orig_from_mode = from_inner.ptable.get_mode(begin, end)?;
-    let orig_to_mode = to_inner.ptable.get_mode(begin, end)?;
-
     let mem_transition_table: &[SpciMemTransitions] = match share {
         SpciMemoryShare::Donate => &donate_transitions,
         SpciMemoryShare::Relinquish => &relinquish_transitions,
         SpciMemoryShare::Lend => &shared_lend_transitions,
     };
 
-    let (from_mode, to_mode) = spci_msg_get_next_state(
+    spci_msg_get_next_state(
         &mem_transition_table,
         memory_to_attributes,
         orig_from_mode,
         orig_to_mode,
-    )?;
-
-    Ok((orig_from_mode, from_mode, to_mode))
+    )
 }
 
 /// Shares memory from the calling VM with another. The memory can be shared in different modes.
@@ -319,76 +319,265 @@ pub fn spci_msg_check_transition(
 ///   1) SPCI_INVALID_PARAMETERS - The endpoint provided parameters were erroneous;
 ///   2) SPCI_NO_MEMORY - Hf did not have sufficient memory to complete the request.
 ///  Success is indicated by SPCI_SUCCESS.
+/// The maximum number of discontiguous extents a memory region may resolve to
+/// after adjacent constituents have been coalesced.
+const SPCI_MAX_EXTENTS: usize = 64;
+
+/// A contiguous extent of memory, as `(begin address, size)` in bytes.
+type Extent = (usize, usize);
+
+/// Sorts the constituents of the region by address and merges the adjacent
+/// ones, so each resulting extent can be mapped with a single table walk.
+/// Fails on empty or overlapping constituents, or if the region resolves to
+/// more than `SPCI_MAX_EXTENTS` discontiguous extents.
+fn spci_coalesce_constituents(
+    memory_region: &SpciMemoryRegion,
+    aligned_v2: bool,
+) -> Result<ArrayVec<[Extent; SPCI_MAX_EXTENTS]>, ()> {
+    // Senders that negotiated ALIGNED_V2 use the v2 layout, whose extra
+    // reserved doubleword puts the constituent array on a 16-byte boundary
+    // (the count field is at the same offset in both layouts).
+    let constituents = unsafe {
+        let first = if aligned_v2 {
+            (*(memory_region as *const SpciMemoryRegion as *const SpciMemoryRegionV2))
+                .constituents
+                .as_ptr()
+        } else {
+            memory_region.constituents.as_ptr()
+        };
+
+        slice::from_raw_parts(first, memory_region.count as usize)
+    };
+    let mut extents: ArrayVec<[Extent; SPCI_MAX_EXTENTS]> = ArrayVec::new();
+
+    for constituent in constituents {
+        let begin = constituent.address as usize;
+        let size = constituent.page_count as usize * PAGE_SIZE;
+        let end = begin + size;
+
+        if size == 0 {
+            return Err(());
+        }
+
+        // Insertion point keeping the extents sorted by address.
+        let pos = extents
+            .iter()
+            .position(|&(b, _)| b > begin)
+            .unwrap_or_else(|| extents.len());
+
+        // Reject overlaps with both neighbours.
+        if pos > 0 && extents[pos - 1].0 + extents[pos - 1].1 > begin {
+            return Err(());
+        }
+        if pos < extents.len() && end > extents[pos].0 {
+            return Err(());
+        }
+
+        let merge_prev = pos > 0 && extents[pos - 1].0 + extents[pos - 1].1 == begin;
+        let merge_next = pos < extents.len() && end == extents[pos].0;
+
+        if merge_prev && merge_next {
+            extents[pos - 1].1 += size + extents[pos].1;
+            extents.remove(pos);
+        } else if merge_prev {
+            extents[pos - 1].1 += size;
+        } else if merge_next {
+            extents[pos].0 = begin;
+            extents[pos].1 += size;
+        } else {
+            if extents.is_full() {
+                return Err(());
+            }
+            extents.insert(pos, (begin, size));
+        }
+    }
+
+    Ok(extents)
+}
+
 pub fn spci_share_memory(
-    to_inner: &mut VmInner,
-    from_inner: &mut VmInner,
+    to: &Vm,
+    from: &Vm,
     memory_region: &SpciMemoryRegion,
     memory_to_attributes: Mode,
     share: SpciMemoryShare,
-    fallback: &MPool,
+    aligned_v2: bool,
 ) -> SpciReturn {
     // Disallow reflexive shares as this suggests an error in the VM.
-    if to_inner as *mut _ == from_inner as *mut _ {
+    if to as *const Vm == from as *const Vm {
         return SpciReturn::InvalidParameters;
     }
 
+    // The share only touches stage-2 state: take the dedicated ptable locks,
+    // leaving the mailbox locks (held by the caller) unrelated to the long
+    // mapping work. Ordering: vm::inner before vm::ptable.
+    let (mut from_ptable, mut to_ptable) = SpinLock::lock_both(&from.ptable, &to.ptable);
+
     // Create a local pool so any freed memory can't be used by another thread.
     // This is to ensure the original mapping can be restored if any stage of
-    // the process fails.
-    let local_page_pool: MPool = MPool::new_with_fallback(fallback);
-
-    // Obtain the single contiguous set of pages from the memory_region.
-    // TODO: Add support for multiple constituent regions.
-    let constituent = unsafe { &*memory_region.constituents.as_ptr() };
-    let size = constituent.page_count as usize * PAGE_SIZE;
-    let begin = ipa_init(constituent.address as usize);
-    let end = ipa_add(begin, size as usize);
-
-    // Check if the state transition is lawful for both VMs involved in the
-    // memory exchange, ensure that all constituents of a memory region being
-    // shared are at the same state.
-    let (orig_from_mode, from_mode, to_mode) = ok_or!(
-        spci_msg_check_transition(
-            to_inner,
-            from_inner,
-            share,
-            begin,
-            end,
-            memory_to_attributes,
-        ),
+    // the process fails. It drains into the sender's table page cache, which
+    // itself falls back to the global page pool.
+    let local_page_pool: MPool = MPool::new_with_fallback(&from_ptable.pool);
+
+    // Sort and merge the constituents, so a fragmented region costs one table
+    // walk per contiguous extent rather than one per constituent.
+    let extents = ok_or!(
+        spci_coalesce_constituents(memory_region, aligned_v2),
         return SpciReturn::InvalidParameters
     );
 
-    let pa_begin = pa_from_ipa(begin);
-    let pa_end = pa_from_ipa(end);
+    // Fused validate-and-map: a single reservation walk per table both
+    // builds the subtables the commit will need and observes the original
+    // modes, replacing the separate get_mode validation walks. Every extent
+    // must be in the same state, so a single rollback mode suffices.
+    let mut validate = || -> Result<(Mode, Mode, Mode, Mode), ()> {
+        let mut modes: Option<(Mode, Mode, Mode, Mode)> = None;
+
+        for &(begin, size) in extents.iter() {
+            if !is_aligned(begin, PAGE_SIZE) || !is_aligned(begin + size, PAGE_SIZE) {
+                return Err(());
+            }
+
+            // The per-VM validated-range cache short-circuits the walk for the
+            // steady-state re-share of a known buffer: a hit is tagged with the
+            // table's current sequence counter, so it is only taken when nothing
+            // has touched the table since the mode was recorded. The subtables a
+            // hit skips reserving were built by the recorded operation and
+            // cannot have been freed without bumping the counter.
+            let orig_from_mode = match from_ptable.validated_lookup(begin, begin + size) {
+                Some(mode) => mode,
+                None => from_ptable.table.reserve_observed(
+                    pa_init(begin),
+                    pa_init(begin + size),
+                    &local_page_pool,
+                )?,
+            };
+            let orig_to_mode = match to_ptable.validated_lookup(begin, begin + size) {
+                Some(mode) => mode,
+                None => to_ptable.table.reserve_observed(
+                    pa_init(begin),
+                    pa_init(begin + size),
+                    &local_page_pool,
+                )?,
+            };
+
+            let (from_mode, to_mode) = spci_msg_get_transition(
+                share,
+                orig_from_mode,
+                orig_to_mode,
+                memory_to_attributes,
+            )?;
+
+            let extent_modes = (orig_from_mode, orig_to_mode, from_mode, to_mode);
+            match modes {
+                None => modes = Some(extent_modes),
+                Some(m) if m == extent_modes => {}
+                Some(_) => return Err(()),
+            }
+        }
+
+        modes.ok_or(())
+    };
+
+    let (orig_from_mode, orig_to_mode, from_mode, to_mode) = match validate() {
+        Ok(modes) => modes,
+        Err(()) => {
+            // The reservation walks are not read-only: they split blocks
+            // into attribute-identical subtables in both VMs' tables. A
+            // failed validation must not leave that fragmentation behind —
+            // a guest retrying doomed shares over large valid ranges would
+            // steadily eat pool pages — so merge the splits back; defrag
+            // reverses attribute-preserving splits exactly and returns the
+            // pages through the local pool.
+            from_ptable.table.defrag(&local_page_pool);
+            to_ptable.table.defrag(&local_page_pool);
+            return SpciReturn::InvalidParameters;
+        }
+    };
+
+    // Helper restoring the sender's mapping of the first `count` extents.
+    let rollback_from = |from_ptable: &mut VmPtable, count: usize| {
+        for &(begin, size) in extents[..count].iter() {
+            from_ptable
+                .table
+                .identity_map(
+                    pa_init(begin),
+                    pa_init(begin + size),
+                    orig_from_mode,
+                    &local_page_pool,
+                )
+                .unwrap();
+        }
+    };
 
     // First update the mapping for the sender so there is not overlap with the
-    // recipient.
-    if from_inner
-        .ptable
-        .identity_map(pa_begin, pa_end, from_mode, &local_page_pool)
-        .is_err()
-    {
-        return SpciReturn::NoMemory;
+    // recipient. The tables were already reserved by the validation walk, so
+    // these are commit passes only.
+    for (i, &(begin, size)) in extents.iter().enumerate() {
+        if from_ptable
+            .table
+            .commit_reserved(
+                pa_init(begin),
+                pa_init(begin + size),
+                from_mode,
+                &local_page_pool,
+            )
+            .is_err()
+        {
+            rollback_from(&mut from_ptable, i);
+            return SpciReturn::NoMemory;
+        }
     }
 
     // Complete the transfer by mapping the memory into the recipient.
-    if to_inner
-        .ptable
-        .identity_map(pa_begin, pa_end, to_mode, &local_page_pool)
-        .is_err()
-    {
-        // TODO: partial defrag of failed range.
-        // Recover any memory consumed in failed mapping.
-        from_inner.ptable.defrag(&local_page_pool);
-
-        from_inner
-            .ptable
-            .identity_map(pa_begin, pa_end, orig_from_mode, &local_page_pool)
-            .unwrap();
+    for (i, &(begin, size)) in extents.iter().enumerate() {
+        if to_ptable
+            .table
+            .commit_reserved(
+                pa_init(begin),
+                pa_init(begin + size),
+                to_mode,
+                &local_page_pool,
+            )
+            .is_err()
+        {
+            // TODO: partial defrag of failed range.
+            // Recover any memory consumed in failed mapping.
+            from_ptable.table.defrag(&local_page_pool);
+            to_ptable.table.defrag(&local_page_pool);
+
+            for &(begin, size) in extents[..i].iter() {
+                to_ptable
+                    .table
+                    .identity_map(
+                        pa_init(begin),
+                        pa_init(begin + size),
+                        orig_to_mode,
+                        &local_page_pool,
+                    )
+                    .unwrap();
+            }
+            rollback_from(&mut from_ptable, extents.len());
+
+            return SpciReturn::NoMemory;
+        }
+    }
 
-        return SpciReturn::NoMemory;
+    // Record the freshly committed modes so the next operation on the same
+    // window — typically the matching unshare — skips its validation walk.
+    for &(begin, size) in extents.iter() {
+        from_ptable.validated_record(begin, begin + size, from_mode);
+        to_ptable.validated_record(begin, begin + size, to_mode);
     }
 
+    // Each committed extent cost both VMs a ranged TLB invalidation.
+    let extent_count = extents.len() as u64;
+    from.telemetry
+        .tlb_invalidations
+        .fetch_add(extent_count, Ordering::Relaxed);
+    to.telemetry
+        .tlb_invalidations
+        .fetch_add(extent_count, Ordering::Relaxed);
+
     SpciReturn::Success
 }
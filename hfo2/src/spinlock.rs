@@ -19,7 +19,119 @@ use core::marker::PhantomData;
 use core::mem;
 use core::ops::{Deref, DerefMut};
 use core::ptr;
-use core::sync::atomic::{spin_loop_hint, AtomicBool, Ordering};
+use core::sync::atomic::{spin_loop_hint, AtomicBool, AtomicU16, AtomicUsize, Ordering};
+
+/// Lock contention profiling, enabled by the `lock_profile` feature: every
+/// raw lock records how often it was taken, how many spin iterations were
+/// wasted waiting for it and how long it was held, into per-CPU tables read
+/// through a debug hypercall. Sites are identified by the lock's address
+/// (rather than the caller's return address, which the language gives no
+/// portable access to); lock addresses map straight back to the owning
+/// structure offline.
+#[cfg(feature = "lock_profile")]
+pub mod profile {
+    use crate::types::*;
+
+    extern "C" {
+        fn arch_cpu_index_current() -> usize;
+        fn arch_cpu_cycle_count() -> u64;
+    }
+
+    /// The number of lock sites tracked per CPU.
+    pub const LOCK_PROFILE_SITES: usize = 64;
+
+    #[derive(Clone, Copy)]
+    pub struct Entry {
+        pub lock: usize,
+        pub acquisitions: u64,
+        pub spins: u64,
+        pub hold_cycles: u64,
+        acquired_at: u64,
+    }
+
+    /// Per-CPU open-addressed tables; each entry is only written by its
+    /// owning CPU, the reader tolerates tearing.
+    static mut TABLES: [[Entry; LOCK_PROFILE_SITES]; MAX_CPUS] = [[Entry {
+        lock: 0,
+        acquisitions: 0,
+        spins: 0,
+        hold_cycles: 0,
+        acquired_at: 0,
+    }; LOCK_PROFILE_SITES]; MAX_CPUS];
+
+    unsafe fn entry_for(lock: usize) -> Option<&'static mut Entry> {
+        let table = &mut TABLES[arch_cpu_index_current()];
+        let mut i = (lock >> 4) % LOCK_PROFILE_SITES;
+
+        for _ in 0..LOCK_PROFILE_SITES {
+            let entry = &mut table[i] as *mut Entry;
+            if (*entry).lock == lock || (*entry).lock == 0 {
+                (*entry).lock = lock;
+                return Some(&mut *entry);
+            }
+            i = (i + 1) % LOCK_PROFILE_SITES;
+        }
+
+        None
+    }
+
+    pub fn acquire(lock: usize, spins: u64) {
+        unsafe {
+            if let Some(entry) = entry_for(lock) {
+                entry.acquisitions += 1;
+                entry.spins += spins;
+                entry.acquired_at = arch_cpu_cycle_count();
+            }
+        }
+    }
+
+    pub fn release(lock: usize) {
+        unsafe {
+            if let Some(entry) = entry_for(lock) {
+                entry.hold_cycles += arch_cpu_cycle_count().wrapping_sub(entry.acquired_at);
+            }
+        }
+    }
+
+    /// Reads one field of one slot of one CPU's table: 0 = lock address,
+    /// 1 = acquisitions, 2 = spins, 3 = hold cycles.
+    pub fn read(cpu: usize, slot: usize, field: usize) -> i64 {
+        if cpu >= MAX_CPUS || slot >= LOCK_PROFILE_SITES {
+            return -1;
+        }
+
+        let entry = unsafe { &TABLES[cpu][slot] };
+        let value = match field {
+            0 => entry.lock as u64,
+            1 => entry.acquisitions,
+            2 => entry.spins,
+            3 => entry.hold_cycles,
+            _ => return -1,
+        };
+
+        value as i64
+    }
+}
+
+/// Reads the lock profile tables; always fails when the `lock_profile`
+/// feature is not built in.
+#[cfg(feature = "lock_profile")]
+pub fn profile_read(cpu: usize, slot: usize, field: usize) -> i64 {
+    profile::read(cpu, slot, field)
+}
+
+#[cfg(not(feature = "lock_profile"))]
+pub fn profile_read(_cpu: usize, _slot: usize, _field: usize) -> i64 {
+    -1
+}
+
+extern "C" {
+    /// Waits for an event, used for adaptive lock waiting.
+    fn arch_cpu_wfe();
+
+    /// Signals an event to waiting CPUs.
+    fn arch_cpu_sev();
+}
 
 #[repr(C)]
 pub struct RawSpinLock {
@@ -34,19 +146,46 @@ impl RawSpinLock {
     }
 
     pub fn lock(&self) {
+        #[cfg(feature = "lock_profile")]
+        let mut spins: u64 = 0;
+
         while self
             .inner
             .compare_exchange(false, true, Ordering::Acquire, Ordering::Relaxed)
             .is_err()
         {
             spin_loop_hint();
+            #[cfg(feature = "lock_profile")]
+            {
+                spins += 1;
+            }
         }
+
+        #[cfg(feature = "lock_profile")]
+        profile::acquire(self as *const _ as usize, spins);
     }
 
     pub fn try_lock(&self) -> bool {
         !self.inner.swap(true, Ordering::Acquire)
     }
 
+    /// Tries to lock, waiting with wfe for up to `max_waits` unlock events
+    /// before giving up. Short critical sections of the current holder are
+    /// ridden out on the core instead of failing immediately; unlock issues
+    /// sev, so the waits end promptly.
+    pub fn try_lock_bounded(&self, max_waits: u32) -> bool {
+        for _ in 0..max_waits {
+            if self.try_lock() {
+                return true;
+            }
+            unsafe {
+                arch_cpu_wfe();
+            }
+        }
+
+        self.try_lock()
+    }
+
     /// Locks both locks, enforcing the lowest address first ordering for locks
     /// of the same kind.
     pub fn lock_both(lhs: &Self, rhs: &Self) {
@@ -60,7 +199,79 @@ impl RawSpinLock {
     }
 
     pub fn unlock(&self) {
+        #[cfg(feature = "lock_profile")]
+        profile::release(self as *const _ as usize);
+
         self.inner.store(false, Ordering::Release);
+
+        // Wake CPUs riding out this critical section in try_lock_bounded.
+        unsafe {
+            arch_cpu_sev();
+        }
+    }
+}
+
+/// A fair FIFO ticket lock. Contenders draw a ticket and spin reading only
+/// the owner counter, so handover happens in arrival order and the cache line
+/// is not ping-ponged by test-and-set retries. Use it for locks that see real
+/// contention (the VM locks, the page pool); the bare `RawSpinLock` remains
+/// the cheaper choice for effectively uncontended ones.
+#[repr(C)]
+pub struct RawTicketLock {
+    next: AtomicU16,
+    owner: AtomicU16,
+}
+
+impl RawTicketLock {
+    pub const fn new() -> Self {
+        Self {
+            next: AtomicU16::new(0),
+            owner: AtomicU16::new(0),
+        }
+    }
+
+    pub fn lock(&self) {
+        #[cfg(feature = "lock_profile")]
+        let mut spins: u64 = 0;
+
+        let ticket = self.next.fetch_add(1, Ordering::Relaxed);
+        while self.owner.load(Ordering::Acquire) != ticket {
+            spin_loop_hint();
+            #[cfg(feature = "lock_profile")]
+            {
+                spins += 1;
+            }
+        }
+
+        #[cfg(feature = "lock_profile")]
+        profile::acquire(self as *const _ as usize, spins);
+    }
+
+    pub fn try_lock(&self) -> bool {
+        let owner = self.owner.load(Ordering::Relaxed);
+        self.next
+            .compare_exchange(owner, owner.wrapping_add(1), Ordering::Acquire, Ordering::Relaxed)
+            .is_ok()
+    }
+
+    /// Locks both locks, enforcing the lowest address first ordering for locks
+    /// of the same kind.
+    pub fn lock_both(lhs: &Self, rhs: &Self) {
+        if (lhs as *const _) < (rhs as *const _) {
+            lhs.lock();
+            rhs.lock();
+        } else {
+            rhs.lock();
+            lhs.lock();
+        }
+    }
+
+    pub fn unlock(&self) {
+        #[cfg(feature = "lock_profile")]
+        profile::release(self as *const _ as usize);
+
+        let owner = self.owner.load(Ordering::Relaxed);
+        self.owner.store(owner.wrapping_add(1), Ordering::Release);
     }
 }
 
@@ -104,6 +315,19 @@ impl<T> SpinLock<T> {
         }
     }
 
+    /// Like `try_lock`, but rides out up to `max_waits` unlock events with
+    /// wfe before giving up.
+    pub fn try_lock_bounded(&self, max_waits: u32) -> Result<SpinLockGuard<T>, ()> {
+        if self.lock.try_lock_bounded(max_waits) {
+            Ok(SpinLockGuard {
+                lock: self,
+                _marker: PhantomData,
+            })
+        } else {
+            Err(())
+        }
+    }
+
     pub unsafe fn unlock_unchecked(&self) {
         self.lock.unlock();
     }
@@ -188,6 +412,110 @@ impl<'s, T> SpinLockGuard<'s, T> {
     }
 }
 
+/// A value protected by a fair ticket lock. Same interface as `SpinLock`.
+#[repr(C)]
+pub struct TicketLock<T> {
+    lock: RawTicketLock,
+    data: UnsafeCell<T>,
+}
+
+unsafe impl<'s, T: Send> Send for TicketLock<T> {}
+unsafe impl<'s, T: Send> Sync for TicketLock<T> {}
+
+impl<T> TicketLock<T> {
+    pub const fn new(data: T) -> Self {
+        Self {
+            lock: RawTicketLock::new(),
+            data: UnsafeCell::new(data),
+        }
+    }
+
+    pub fn into_inner(self) -> T {
+        self.data.into_inner()
+    }
+
+    pub fn lock(&self) -> TicketLockGuard<T> {
+        self.lock.lock();
+        TicketLockGuard {
+            lock: self,
+            _marker: PhantomData,
+        }
+    }
+
+    pub fn try_lock(&self) -> Result<TicketLockGuard<T>, ()> {
+        if self.lock.try_lock() {
+            Ok(TicketLockGuard {
+                lock: self,
+                _marker: PhantomData,
+            })
+        } else {
+            Err(())
+        }
+    }
+
+    pub unsafe fn unlock_unchecked(&self) {
+        self.lock.unlock();
+    }
+
+    pub unsafe fn get_unchecked(&self) -> &T {
+        &*self.data.get()
+    }
+
+    pub fn get_mut(&mut self) -> &mut T {
+        unsafe { &mut *self.data.get() }
+    }
+
+    #[allow(clippy::mut_from_ref)]
+    pub unsafe fn get_mut_unchecked(&self) -> &mut T {
+        &mut *self.data.get()
+    }
+
+    pub fn lock_both<'s>(
+        lhs: &'s Self,
+        rhs: &'s Self,
+    ) -> (TicketLockGuard<'s, T>, TicketLockGuard<'s, T>) {
+        RawTicketLock::lock_both(&lhs.lock, &rhs.lock);
+        (
+            TicketLockGuard {
+                lock: lhs,
+                _marker: PhantomData,
+            },
+            TicketLockGuard {
+                lock: rhs,
+                _marker: PhantomData,
+            },
+        )
+    }
+}
+
+pub struct TicketLockGuard<'s, T> {
+    lock: &'s TicketLock<T>,
+    _marker: PhantomData<*const ()>, // !Send + !Sync
+}
+
+unsafe impl<'s, T: Send> Send for TicketLockGuard<'s, T> {}
+unsafe impl<'s, T: Sync> Sync for TicketLockGuard<'s, T> {}
+
+impl<'s, T> Drop for TicketLockGuard<'s, T> {
+    fn drop(&mut self) {
+        self.lock.lock.unlock();
+    }
+}
+
+impl<'s, T> Deref for TicketLockGuard<'s, T> {
+    type Target = T;
+
+    fn deref(&self) -> &Self::Target {
+        unsafe { &*self.lock.data.get() }
+    }
+}
+
+impl<'s, T> DerefMut for TicketLockGuard<'s, T> {
+    fn deref_mut(&mut self) -> &mut Self::Target {
+        unsafe { &mut *self.lock.data.get() }
+    }
+}
+
 #[no_mangle]
 pub unsafe extern "C" fn sl_init(l: *mut RawSpinLock) {
     ptr::write(l, RawSpinLock::new());
@@ -202,3 +530,259 @@ pub unsafe extern "C" fn sl_lock(l: *const RawSpinLock) {
 pub unsafe extern "C" fn sl_unlock(l: *const RawSpinLock) {
     (*l).unlock();
 }
+
+#[no_mangle]
+pub unsafe extern "C" fn tl_init(l: *mut RawTicketLock) {
+    ptr::write(l, RawTicketLock::new());
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn tl_lock(l: *const RawTicketLock) {
+    (*l).lock();
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn tl_unlock(l: *const RawTicketLock) {
+    (*l).unlock();
+}
+
+/// Bits of `RawRwLock::state`: the writer holds `RWLOCK_WRITER`, each reader
+/// adds `RWLOCK_READER`.
+const RWLOCK_WRITER: usize = 1;
+const RWLOCK_READER: usize = 2;
+
+/// A writer-preferring spinning read-write lock. Readers only synchronize
+/// with writers, so read-mostly paths from different CPUs no longer serialize
+/// behind each other. A pending writer claims the writer bit first and then
+/// waits for readers to drain, which keeps it from starving.
+#[repr(C)]
+pub struct RawRwLock {
+    state: AtomicUsize,
+}
+
+impl RawRwLock {
+    pub const fn new() -> Self {
+        Self {
+            state: AtomicUsize::new(0),
+        }
+    }
+
+    pub fn read_lock(&self) {
+        loop {
+            let state = self.state.load(Ordering::Relaxed);
+            if state & RWLOCK_WRITER == 0
+                && self
+                    .state
+                    .compare_exchange_weak(
+                        state,
+                        state + RWLOCK_READER,
+                        Ordering::Acquire,
+                        Ordering::Relaxed,
+                    )
+                    .is_ok()
+            {
+                return;
+            }
+            spin_loop_hint();
+        }
+    }
+
+    pub fn read_unlock(&self) {
+        self.state.fetch_sub(RWLOCK_READER, Ordering::Release);
+    }
+
+    pub fn write_lock(&self) {
+        // Claim the writer bit, keeping new readers out, then wait for the
+        // remaining readers to drain.
+        while self.state.fetch_or(RWLOCK_WRITER, Ordering::Acquire) & RWLOCK_WRITER != 0 {
+            spin_loop_hint();
+        }
+
+        while self.state.load(Ordering::Acquire) != RWLOCK_WRITER {
+            spin_loop_hint();
+        }
+    }
+
+    pub fn try_write_lock(&self) -> bool {
+        self.state
+            .compare_exchange(0, RWLOCK_WRITER, Ordering::Acquire, Ordering::Relaxed)
+            .is_ok()
+    }
+
+    pub fn write_unlock(&self) {
+        self.state.fetch_and(!RWLOCK_WRITER, Ordering::Release);
+    }
+
+    /// Write-locks both locks, enforcing the lowest address first ordering
+    /// for locks of the same kind.
+    pub fn write_lock_both(lhs: &Self, rhs: &Self) {
+        if (lhs as *const _) < (rhs as *const _) {
+            lhs.write_lock();
+            rhs.write_lock();
+        } else {
+            rhs.write_lock();
+            lhs.write_lock();
+        }
+    }
+}
+
+/// A value protected by a read-write lock. Writers use the same interface as
+/// `SpinLock` (`lock()` et al.), readers additionally get `read()`.
+#[repr(C)]
+pub struct RwLock<T> {
+    lock: RawRwLock,
+    data: UnsafeCell<T>,
+}
+
+unsafe impl<'s, T: Send> Send for RwLock<T> {}
+unsafe impl<'s, T: Send + Sync> Sync for RwLock<T> {}
+
+impl<T> RwLock<T> {
+    pub const fn new(data: T) -> Self {
+        Self {
+            lock: RawRwLock::new(),
+            data: UnsafeCell::new(data),
+        }
+    }
+
+    pub fn into_inner(self) -> T {
+        self.data.into_inner()
+    }
+
+    /// Locks for exclusive (write) access.
+    pub fn lock(&self) -> RwLockWriteGuard<T> {
+        self.lock.write_lock();
+        RwLockWriteGuard {
+            lock: self,
+            _marker: PhantomData,
+        }
+    }
+
+    pub fn try_lock(&self) -> Result<RwLockWriteGuard<T>, ()> {
+        if self.lock.try_write_lock() {
+            Ok(RwLockWriteGuard {
+                lock: self,
+                _marker: PhantomData,
+            })
+        } else {
+            Err(())
+        }
+    }
+
+    /// Locks for shared (read-only) access.
+    pub fn read(&self) -> RwLockReadGuard<T> {
+        self.lock.read_lock();
+        RwLockReadGuard {
+            lock: self,
+            _marker: PhantomData,
+        }
+    }
+
+    pub unsafe fn unlock_unchecked(&self) {
+        self.lock.write_unlock();
+    }
+
+    pub unsafe fn get_unchecked(&self) -> &T {
+        &*self.data.get()
+    }
+
+    pub fn get_mut(&mut self) -> &mut T {
+        unsafe { &mut *self.data.get() }
+    }
+
+    #[allow(clippy::mut_from_ref)]
+    pub unsafe fn get_mut_unchecked(&self) -> &mut T {
+        &mut *self.data.get()
+    }
+
+    pub fn lock_both<'s>(
+        lhs: &'s Self,
+        rhs: &'s Self,
+    ) -> (RwLockWriteGuard<'s, T>, RwLockWriteGuard<'s, T>) {
+        RawRwLock::write_lock_both(&lhs.lock, &rhs.lock);
+        (
+            RwLockWriteGuard {
+                lock: lhs,
+                _marker: PhantomData,
+            },
+            RwLockWriteGuard {
+                lock: rhs,
+                _marker: PhantomData,
+            },
+        )
+    }
+}
+
+pub struct RwLockWriteGuard<'s, T> {
+    lock: &'s RwLock<T>,
+    _marker: PhantomData<*const ()>, // !Send + !Sync
+}
+
+unsafe impl<'s, T: Send> Send for RwLockWriteGuard<'s, T> {}
+unsafe impl<'s, T: Sync> Sync for RwLockWriteGuard<'s, T> {}
+
+impl<'s, T> Drop for RwLockWriteGuard<'s, T> {
+    fn drop(&mut self) {
+        self.lock.lock.write_unlock();
+    }
+}
+
+impl<'s, T> Deref for RwLockWriteGuard<'s, T> {
+    type Target = T;
+
+    fn deref(&self) -> &Self::Target {
+        unsafe { &*self.lock.data.get() }
+    }
+}
+
+impl<'s, T> DerefMut for RwLockWriteGuard<'s, T> {
+    fn deref_mut(&mut self) -> &mut Self::Target {
+        unsafe { &mut *self.lock.data.get() }
+    }
+}
+
+pub struct RwLockReadGuard<'s, T> {
+    lock: &'s RwLock<T>,
+    _marker: PhantomData<*const ()>, // !Send + !Sync
+}
+
+unsafe impl<'s, T: Sync> Sync for RwLockReadGuard<'s, T> {}
+
+impl<'s, T> Drop for RwLockReadGuard<'s, T> {
+    fn drop(&mut self) {
+        self.lock.lock.read_unlock();
+    }
+}
+
+impl<'s, T> Deref for RwLockReadGuard<'s, T> {
+    type Target = T;
+
+    fn deref(&self) -> &Self::Target {
+        unsafe { &*self.lock.data.get() }
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rw_init(l: *mut RawRwLock) {
+    ptr::write(l, RawRwLock::new());
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rw_read_lock(l: *const RawRwLock) {
+    (*l).read_lock();
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rw_read_unlock(l: *const RawRwLock) {
+    (*l).read_unlock();
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rw_write_lock(l: *const RawRwLock) {
+    (*l).write_lock();
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn rw_write_unlock(l: *const RawRwLock) {
+    (*l).write_unlock();
+}
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+use core::mem;
 use core::ptr;
 
 use crate::types::*;
@@ -106,6 +107,72 @@ pub unsafe extern "C" fn memmove_s(
     ptr::copy(src as *const u8, dest as *mut u8, count);
 }
 
+extern "C" {
+    fn memcpy_nt(dst: *mut c_void, src: *const c_void, n: size_t) -> *mut c_void;
+}
+
+/// Payload size above which copies use non-temporal accesses.
+const MEMCPY_NT_THRESHOLD: usize = 1024;
+
+/// Copies a payload the hypervisor itself never reads. Above a threshold the
+/// copy is non-temporal, so a 4 KiB message doesn't evict the hypervisor's
+/// working-set lines (vm/vcpu structures, page tables) from the data cache.
+pub unsafe fn memcpy_payload(dst: *mut u8, src: *const u8, n: usize) {
+    if n >= MEMCPY_NT_THRESHOLD {
+        memcpy_nt(dst as *mut c_void, src as *const c_void, n);
+    } else {
+        ptr::copy_nonoverlapping(src, dst, n);
+    }
+}
+
+/// SWAR constants: `SWAR_LOW` has the lowest bit of every byte set,
+/// `SWAR_HIGH` the highest.
+const SWAR_LOW: u64 = 0x0101_0101_0101_0101;
+const SWAR_HIGH: u64 = 0x8080_8080_8080_8080;
+
+/// Returns whether any byte of the word is zero, using the classic
+/// word-at-a-time bit trick.
+#[inline]
+fn swar_has_zero_byte(word: u64) -> bool {
+    word.wrapping_sub(SWAR_LOW) & !word & SWAR_HIGH != 0
+}
+
+/// Finds the first occurrence of `byte` in the `len` bytes at `ptr`, scanning
+/// a word at a time once the cursor is aligned, so archive and string walks
+/// don't run byte by byte. Returns `len` if the byte doesn't occur.
+pub unsafe fn memchr_rs(ptr: *const u8, byte: u8, len: usize) -> usize {
+    let pattern = SWAR_LOW.wrapping_mul(u64::from(byte));
+    let mut i = 0;
+
+    // Head: up to the first aligned word.
+    while i < len && ptr.add(i) as usize % mem::size_of::<u64>() != 0 {
+        if *ptr.add(i) == byte {
+            return i;
+        }
+        i += 1;
+    }
+
+    // Body: whole words.
+    while i + mem::size_of::<u64>() <= len {
+        #[allow(clippy::cast_ptr_alignment)]
+        let word = *(ptr.add(i) as *const u64);
+        if swar_has_zero_byte(word ^ pattern) {
+            break;
+        }
+        i += mem::size_of::<u64>();
+    }
+
+    // Tail: remaining bytes, or the word that contained the match.
+    while i < len {
+        if *ptr.add(i) == byte {
+            return i;
+        }
+        i += 1;
+    }
+
+    len
+}
+
 /// Returns the length of the null-terminated byte string `str`, examining at most `strsz` bytes.
 ///
 /// If `str` is a NULL pointer, it returns zero.
@@ -116,29 +183,37 @@ pub unsafe extern "C" fn strnlen_s(str: *const c_char, strsz: size_t) -> size_t
         return 0;
     }
 
-    for i in 0..strsz {
-        if *str.add(i) == b'\0' {
-            return i;
-        }
-    }
-
-    // NULL character not found.
-    strsz
+    memchr_rs(str, b'\0', strsz)
 }
 
-pub(crate) unsafe fn memcmp_rs(a: *const c_void, b: *const c_void, mut n: size_t) -> c_int {
-    let mut a = a as *const u8;
-    let mut b = b as *const u8;
-
-    while n > 0 {
-        let cmp = *a - *b;
-        if cmp != 0 {
-            return c_int::from(cmp);
+pub(crate) unsafe fn memcmp_rs(a: *const c_void, b: *const c_void, n: size_t) -> c_int {
+    let a = a as *const u8;
+    let b = b as *const u8;
+    let mut i = 0;
+
+    // Word-at-a-time: XOR the words and locate the first differing byte via
+    // the lowest nonzero byte (little-endian), instead of a byte loop. Name
+    // matching over large manifests and archives lives on this.
+    while i + mem::size_of::<u64>() <= n {
+        #[allow(clippy::cast_ptr_alignment)]
+        let wa = ptr::read_unaligned(a.add(i) as *const u64);
+        #[allow(clippy::cast_ptr_alignment)]
+        let wb = ptr::read_unaligned(b.add(i) as *const u64);
+        let diff = wa ^ wb;
+
+        if diff != 0 {
+            let byte = (diff.trailing_zeros() / 8) as usize;
+            return c_int::from(*a.add(i + byte)) - c_int::from(*b.add(i + byte));
         }
 
-        a = a.add(1);
-        b = b.add(1);
-        n -= 1;
+        i += mem::size_of::<u64>();
+    }
+
+    while i < n {
+        if *a.add(i) != *b.add(i) {
+            return c_int::from(*a.add(i)) - c_int::from(*b.add(i));
+        }
+        i += 1;
     }
 
     0
@@ -54,6 +54,10 @@ pub const HF_NUM_INTIDS: intid_t = 64;
 /// Interrupt ID returned when there is no interrupt pending.
 pub const HF_INVALID_INTID: intid_t = 0xffff_ffff;
 
+/// The virtual interrupt ID used to notify a waiting VM that a mailbox it
+/// wants to send to became writable.
+pub const HF_MAILBOX_WRITABLE_INTID: intid_t = 2;
+
 /// The virtual interrupt ID used for the virtual timer.
 pub const HF_VIRTUAL_TIMER_INTID: intid_t = 3;
 
@@ -73,6 +77,12 @@ pub const MAX_VMS: usize = 6;
 #[cfg(target_arch = "aarch64")]
 pub const MAX_VMS: usize = 16;
 
+/// The cache line size of the platform's cores, used to pad per-CPU data so
+/// adjacent entries do not falsely share a line. This mirrors the
+/// `plat_cache_line_size` build argument (which should match the DminLine
+/// field of CTR_EL0); keep in sync manually, like the constants above.
+pub const CACHE_LINE_SIZE: usize = 64;
+
 /// An offset to use when assigning VM IDs.
 /// The offset is needed because VM ID 0 is reserved.
 pub const HF_VM_ID_OFFSET: spci_vm_id_t = 1;
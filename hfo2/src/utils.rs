@@ -43,14 +43,9 @@ pub fn spin_loop() -> ! {
 }
 
 pub fn as_asciz(bytes: &[u8]) -> &[u8] {
-    bytes
-        .split_at(
-            bytes
-                .iter()
-                .position(|&c| c == b'\0')
-                .unwrap_or(bytes.len()),
-        )
-        .0
+    // Word-at-a-time scan; manifest names are read repeatedly during boot.
+    let len = unsafe { crate::std::memchr_rs(bytes.as_ptr(), b'\0', bytes.len()) };
+    bytes.split_at(len).0
 }
 
 #[inline]
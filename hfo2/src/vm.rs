@@ -16,8 +16,9 @@
 
 use core::mem::{self, MaybeUninit};
 use core::ptr;
+use core::cmp;
 use core::str;
-use core::sync::atomic::AtomicBool;
+use core::sync::atomic::{fence, AtomicBool, AtomicU32, AtomicU64, AtomicUsize, Ordering};
 
 use arrayvec::ArrayVec;
 use scopeguard::guard;
@@ -25,6 +26,7 @@ use scopeguard::guard;
 use crate::addr::*;
 use crate::arch::*;
 use crate::cpu::*;
+use crate::init::*;
 use crate::list::*;
 use crate::mm::*;
 use crate::mpool::*;
@@ -34,19 +36,43 @@ use crate::spinlock::*;
 use crate::std::*;
 use crate::types::*;
 
-const LOG_BUFFER_SIZE: usize = 256;
+/// Default and maximum per-VM log line buffer sizes; the actual size is
+/// negotiable per VM through the manifest.
+const LOG_BUFFER_DEFAULT: usize = 256;
+pub const LOG_BUFFER_MAX: usize = 1024;
 
-#[repr(C)]
+/// The capacity of the pending-message ring of each mailbox.
+pub const MAILBOX_QUEUE_SIZE: usize = 4;
+
+/// The largest negotiable mailbox size, in pages (64 KiB).
+pub const MAILBOX_MAX_PAGES: usize = 16;
+
+#[repr(u32)]
 #[derive(PartialEq, Debug, Clone, Copy)]
 pub enum MailboxState {
     /// There is no message in the mailbox.
-    Empty,
+    Empty = 0,
 
     /// There is a message in the mailbox that is waiting for a reader.
-    Received,
+    Received = 1,
 
     /// There is a message in the mailbox that has been read.
-    Read,
+    Read = 2,
+
+    /// A sender has reserved the mailbox and is copying a message into it
+    /// without holding the VM lock; treated as busy by everyone else.
+    Filling = 3,
+}
+
+impl MailboxState {
+    fn from_u32(v: u32) -> Self {
+        match v {
+            0 => MailboxState::Empty,
+            1 => MailboxState::Received,
+            3 => MailboxState::Filling,
+            _ => MailboxState::Read,
+        }
+    }
 }
 
 #[repr(C)]
@@ -57,20 +83,25 @@ pub struct WaitEntry {
     /// Links used to add entry to a VM's waiter_list. This is protected by the notifying VM's lock.
     wait_links: ListEntry,
 
-    /// Links used to add entry to a VM's ready_list. This is protected by the waiting VM's lock.
-    ready_links: ListEntry,
-}
+    /// Link in the waiting VM's lock-free MPSC ready stack (0 when not
+    /// linked); pushed with a CAS from any core.
+    ready_next: AtomicUsize,
 
-impl WaitEntry {
-    #[inline]
-    pub fn is_in_ready_list(&self) -> bool {
-        unsafe { !list_empty(&self.ready_links) }
-    }
+    /// Guards against double-queuing on the ready stack.
+    in_ready: AtomicBool,
 }
 
 #[repr(C)]
 pub struct Mailbox {
-    state: MailboxState,
+    /// The state word is atomic so the transitions that are single-word
+    /// updates (message read acknowledgement, send-side emptiness checks)
+    /// don't need the VM lock; everything that couples the state to other
+    /// mailbox bookkeeping still runs under the lock.
+    state: AtomicU32,
+
+    /// The size in bytes of each of the send and receive buffers; a multiple
+    /// of the page size, negotiated at configure time.
+    size: usize,
 
     // Addresses to page used for receiving and sending messages.
     // Those pages are not protected by lock -- sender and receiver should
@@ -78,33 +109,207 @@ pub struct Mailbox {
     recv: *mut SpciMessage,
     send: *const SpciMessage,
 
+    /// Configuration generation: 0 until the buffers are configured, bumped
+    /// with release ordering once the pointers and size are written.
+    /// Configuration happens at most once per boot, so a nonzero generation
+    /// guarantees the pointers above are stable and may be read lock-free.
+    generation: AtomicU32,
+
+    /// Ring of messages accepted while the mailbox was busy, oldest first.
+    /// Slots are pages allocated from the page pool on demand and freed once
+    /// the message is moved into the receive buffer, so an idle mailbox costs
+    /// nothing. This is protected by the VM lock.
+    queue: [*mut SpciMessage; MAILBOX_QUEUE_SIZE],
+    queue_head: usize,
+    queue_len: usize,
+
+    /// The sender page currently mapped read-only into this VM for a
+    /// zero-copy message, or null. It is unmapped again when the mailbox is
+    /// cleared. This is protected by the VM lock.
+    zero_copy_page: *const SpciMessage,
+
+    /// Reserved priority slot: one urgent message accepted while the normal
+    /// buffer was occupied, delivered ahead of the pending ring on the next
+    /// clear. Null when empty; protected by the VM lock.
+    urgent_slot: *mut SpciMessage,
+
+    /// State of an in-flight streamed transfer into this mailbox: the source
+    /// VM, the cursor into its buffer and the bytes still to deliver. This is
+    /// protected by the VM lock.
+    stream_src_vm: spci_vm_id_t,
+    stream_cursor: usize,
+    stream_remaining: usize,
+
     /// List of wait_entry structs representing VMs that want to be notified
     /// when the mailbox becomes writable. Once the mailbox does become
     /// writable, the entry is removed from this list and added to the waiting
     /// VM's ready_list.
     waiter_list: ListEntry,
 
-    /// List of wait_entry structs representing VMs whose mailboxes became
-    /// writable since the owner of the mailbox registers for notification.
-    ready_list: ListEntry,
+    /// Lock-free MPSC stack of wait_entry structs representing VMs whose
+    /// mailboxes became writable since the owner registered for
+    /// notification: producers push with a CAS from any core, only the
+    /// mailbox owner consumes. `ready_stash` is the consumer-local remainder
+    /// of the last take-all, protected by the VM lock.
+    ready_head: AtomicUsize,
+    ready_stash: usize,
 }
 
 impl Mailbox {
     /// Initializes the mailbox.
     /// TODO(HfO2): Refactor `vm_init` and make `Mailbox::new()` instead of this.
     pub unsafe fn init(&mut self) {
-        self.state = MailboxState::Empty;
+        self.state = AtomicU32::new(MailboxState::Empty as u32);
+        self.generation = AtomicU32::new(0);
+        self.size = PAGE_SIZE;
         self.recv = ptr::null_mut();
         self.send = ptr::null();
+        self.queue = [ptr::null_mut(); MAILBOX_QUEUE_SIZE];
+        self.queue_head = 0;
+        self.queue_len = 0;
+        self.zero_copy_page = ptr::null();
+        self.urgent_slot = ptr::null_mut();
+        self.stream_src_vm = 0;
+        self.stream_cursor = 0;
+        self.stream_remaining = 0;
 
         list_init(&mut self.waiter_list);
-        list_init(&mut self.ready_list);
+        self.ready_head = AtomicUsize::new(0);
+        self.ready_stash = 0;
+    }
+
+    /// Copies a message (validated header plus payload) into a freshly
+    /// allocated slot of the pending ring. Fails if the ring is full or no
+    /// page is available, in which case the sender falls back to the waiter
+    /// protocol.
+    pub fn queue_push(
+        &mut self,
+        header: &SpciMessage,
+        payload: &[u8],
+        mpool: &MPool,
+    ) -> Result<(), ()> {
+        if self.queue_len == MAILBOX_QUEUE_SIZE {
+            return Err(());
+        }
+
+        let page = mpool.alloc()?;
+        let slot = page.into_raw() as *mut SpciMessage;
+
+        unsafe {
+            ptr::write(slot, header.clone());
+            ptr::copy_nonoverlapping(
+                payload.as_ptr(),
+                (*slot).payload.as_mut_ptr(),
+                payload.len(),
+            );
+        }
+
+        self.queue[(self.queue_head + self.queue_len) % MAILBOX_QUEUE_SIZE] = slot;
+        self.queue_len += 1;
+        Ok(())
+    }
+
+    /// Drops the oldest queued message, freeing its page. Returns false if
+    /// the ring is empty.
+    pub fn refill_from_queue_drop(&mut self) -> bool {
+        if self.queue_len == 0 {
+            return false;
+        }
+
+        let slot = self.queue[self.queue_head];
+        self.queue[self.queue_head] = ptr::null_mut();
+        self.queue_head = (self.queue_head + 1) % MAILBOX_QUEUE_SIZE;
+        self.queue_len -= 1;
+
+        unsafe {
+            crate::init::hypervisor()
+                .mpool
+                .free(Page::from_raw(slot as *mut RawPage));
+        }
+        true
+    }
+
+    /// Accepts an urgent message into the reserved priority slot. Fails if
+    /// the slot is occupied or no page is available.
+    pub fn urgent_push(
+        &mut self,
+        header: &SpciMessage,
+        payload: &[u8],
+        mpool: &MPool,
+    ) -> Result<(), ()> {
+        if !self.urgent_slot.is_null() {
+            return Err(());
+        }
+
+        let page = mpool.alloc()?;
+        let slot = page.into_raw() as *mut SpciMessage;
+
+        unsafe {
+            ptr::write(slot, header.clone());
+            ptr::copy_nonoverlapping(
+                payload.as_ptr(),
+                (*slot).payload.as_mut_ptr(),
+                payload.len(),
+            );
+        }
+
+        self.urgent_slot = slot;
+        Ok(())
+    }
+
+    /// Moves the urgent message, if any, into the receive buffer — ahead of
+    /// everything else — and marks the mailbox received.
+    pub fn refill_from_urgent(&mut self, mpool: &MPool) -> bool {
+        let slot = self.urgent_slot;
+        if slot.is_null() {
+            return false;
+        }
+        self.urgent_slot = ptr::null_mut();
+
+        unsafe {
+            let length = (*slot).length as usize;
+            ptr::copy_nonoverlapping(
+                slot as *const u8,
+                self.recv as *mut u8,
+                mem::size_of::<SpciMessage>() + length,
+            );
+            mpool.free(Page::from_raw(slot as *mut RawPage));
+        }
+
+        self.set_received();
+        true
+    }
+
+    /// Moves the oldest queued message into the receive buffer and marks the
+    /// mailbox received. Returns false if the ring is empty.
+    pub fn refill_from_queue(&mut self, mpool: &MPool) -> bool {
+        if self.queue_len == 0 {
+            return false;
+        }
+
+        let slot = self.queue[self.queue_head];
+        self.queue[self.queue_head] = ptr::null_mut();
+        self.queue_head = (self.queue_head + 1) % MAILBOX_QUEUE_SIZE;
+        self.queue_len -= 1;
+
+        unsafe {
+            let length = (*slot).length as usize;
+            ptr::copy_nonoverlapping(
+                slot as *const u8,
+                self.recv as *mut u8,
+                mem::size_of::<SpciMessage>() + length,
+            );
+            mpool.free(Page::from_raw(slot as *mut RawPage));
+        }
+
+        self.set_received();
+        true
     }
 
     /// Retrieves the next waiter and removes it from the wait list if the VM's
     /// mailbox is in a writable state.
     pub fn fetch_waiter(&mut self) -> *mut WaitEntry {
-        if self.state != MailboxState::Empty
+        if self.get_state() != MailboxState::Empty
             || self.recv.is_null()
             || unsafe { list_empty(&self.waiter_list) }
         {
@@ -120,30 +325,83 @@ impl Mailbox {
         )
     }
 
+    /// Like `fetch_waiter`, but only removes the front waiter if `pred`
+    /// holds for the VM it belongs to; otherwise the list is left untouched
+    /// and null is returned.
+    pub fn fetch_waiter_if<F>(&mut self, pred: F) -> *mut WaitEntry
+    where
+        F: Fn(&Vm) -> bool,
+    {
+        let entry = self.fetch_waiter();
+        if entry.is_null() {
+            return entry;
+        }
+
+        let waiting_vm = unsafe { &*(*entry).waiting_vm };
+        if pred(waiting_vm) {
+            entry
+        } else {
+            // Put it back at the front for the classic notification flow.
+            unsafe {
+                list_prepend(&mut self.waiter_list, &mut (*entry).wait_links);
+            }
+            ptr::null_mut()
+        }
+    }
+
     /// Checks if any waiters exists.
     pub fn is_waiter_list_empty(&self) -> bool {
         unsafe { list_empty(&self.waiter_list) }
     }
 
+    /// Reads the current state.
+    pub fn get_state(&self) -> MailboxState {
+        MailboxState::from_u32(self.state.load(Ordering::Acquire))
+    }
+
     /// Checks whether there exists a pending message. If one exists, marks the
-    /// mailbox read.
-    pub fn try_read(&mut self) -> Result<(), ()> {
-        if self.state == MailboxState::Received {
-            self.state = MailboxState::Read;
-            Ok(())
-        } else {
-            Err(())
-        }
+    /// mailbox read. A single CAS, so callers that need nothing else from the
+    /// mailbox don't have to hold the VM lock.
+    pub fn try_read(&self) -> Result<(), ()> {
+        self.state
+            .compare_exchange(
+                MailboxState::Received as u32,
+                MailboxState::Read as u32,
+                Ordering::AcqRel,
+                Ordering::Acquire,
+            )
+            .map(|_| ())
+            .map_err(|_| ())
+    }
+
+    /// Reserves an empty mailbox for a lock-free fill: Empty -> Filling in
+    /// one CAS. Until the sender commits, everyone else sees the mailbox as
+    /// busy.
+    pub fn try_begin_fill(&self) -> bool {
+        self.state
+            .compare_exchange(
+                MailboxState::Empty as u32,
+                MailboxState::Filling as u32,
+                Ordering::AcqRel,
+                Ordering::Acquire,
+            )
+            .is_ok()
+    }
+
+    /// Abandons a reservation made with `try_begin_fill`.
+    pub fn abort_fill(&self) {
+        self.state
+            .store(MailboxState::Empty as u32, Ordering::Release);
     }
 
     /// Set the arrived message is read.
     pub fn set_read(&mut self) {
-        self.state = MailboxState::Read;
+        self.state.store(MailboxState::Read as u32, Ordering::Release);
     }
 
     /// Set a message is arrived.
     pub fn set_received(&mut self) {
-        self.state = MailboxState::Received;
+        self.state.store(MailboxState::Received as u32, Ordering::Release);
     }
 
     /// Configures the hypervisor's stage-1 view of the send and receive pages.
@@ -197,6 +455,10 @@ impl Mailbox {
         mem::forget(ptable);
         self.send = pa_addr(pa_send_begin) as usize as *const SpciMessage;
         self.recv = pa_addr(pa_recv_begin) as usize as *mut SpciMessage;
+
+        // Publish the configuration for lock-free readers: the generation is
+        // only ever bumped after the pointers are in place.
+        self.generation.fetch_add(1, Ordering::Release);
         Ok(())
     }
 
@@ -209,9 +471,137 @@ impl Mailbox {
     }
 }
 
+/// The number of recently freed table pages each VM keeps for itself; see
+/// `VmPtable::pool`.
+const PTABLE_POOL_KEEP: usize = 32;
+
+/// A kernel image to be copied into the VM's memory page by page, on first
+/// access, instead of in one bulk copy at load time.
+#[derive(Clone, Copy)]
+pub struct LazyImage {
+    /// Physical address of the master image (inside the ramdisk).
+    pub src: usize,
+
+    /// Length of the master image in bytes; the rest of the range reads as
+    /// zeros.
+    pub src_len: usize,
+
+    /// The VM memory range backed by the image, identity-mapped.
+    pub begin: usize,
+    pub end: usize,
+}
+
+/// Stage-2 address-space state of a VM, locked independently of the mailbox
+/// (see the lock ordering note in api.rs: vm::inner is acquired before
+/// vm::ptable where both are needed), so a long mapping operation no longer
+/// blocks unrelated message deliveries to the same VM.
+pub struct VmPtable {
+    pub table: PageTable<Stage2>,
+
+    /// Cache of recently freed stage-2 table pages, falling back to the
+    /// global page pool; see the trim policy below.
+    pub pool: MPool,
+
+    /// Deferred kernel image population, if this VM's memory is filled
+    /// lazily; see `LazyImage`.
+    pub lazy_image: Option<LazyImage>,
+
+    /// Recently validated (range, mode) tuples from memory-sharing
+    /// operations, tagged with the table's sequence counter at record time.
+    /// An entry whose tag no longer matches the counter — i.e. the table
+    /// has been modified since — is dead, so stale hits are impossible by
+    /// construction. Guests re-share the same few DMA windows over and
+    /// over; a hit spares the validation walk entirely.
+    pub validated: [ValidatedRange; VALIDATED_RANGES],
+
+    /// Next `validated` slot to overwrite.
+    pub validated_next: usize,
+}
+
+/// Number of validated-range cache entries per VM.
+pub const VALIDATED_RANGES: usize = 4;
+
+/// One validated-range cache entry; `end == 0` means empty.
+#[derive(Clone, Copy)]
+pub struct ValidatedRange {
+    pub begin: usize,
+    pub end: usize,
+    pub mode: Mode,
+    pub seq: usize,
+}
+
+impl ValidatedRange {
+    pub const fn empty() -> Self {
+        Self {
+            begin: 0,
+            end: 0,
+            mode: Mode::empty(),
+            seq: 0,
+        }
+    }
+}
+
+impl VmPtable {
+    /// Trims the table page cache back to its bound.
+    pub fn trim_pool(&mut self) {
+        self.pool.trim(PTABLE_POOL_KEEP);
+    }
+
+    /// Returns the cached mode of `[begin, end)` if it was recorded and the
+    /// table has not been modified since.
+    pub fn validated_lookup(&self, begin: usize, end: usize) -> Option<Mode> {
+        let seq = self.table.read_seq();
+
+        self.validated
+            .iter()
+            .find(|entry| {
+                entry.end != 0 && entry.begin == begin && entry.end == end && entry.seq == seq
+            })
+            .map(|entry| entry.mode)
+    }
+
+    /// Records the current mode of `[begin, end)`, tagged with the table's
+    /// current sequence counter.
+    pub fn validated_record(&mut self, begin: usize, end: usize, mode: Mode) {
+        let seq = self.table.read_seq();
+
+        self.validated[self.validated_next] = ValidatedRange {
+            begin,
+            end,
+            mode,
+            seq,
+        };
+        self.validated_next = (self.validated_next + 1) % VALIDATED_RANGES;
+    }
+}
+
 pub struct VmInner {
-    log_buffer: ArrayVec<[c_char; LOG_BUFFER_SIZE]>,
-    pub ptable: PageTable<Stage2>,
+    /// Per-VM log accumulation buffer: each VM batches its own output and
+    /// flushes whole lines, so one VM's log volume never interleaves with or
+    /// delays another's. `log_limit` is the manifest-negotiated flush
+    /// threshold.
+    log_buffer: [c_char; LOG_BUFFER_MAX],
+    log_len: usize,
+    log_limit: usize,
+
+    /// Duplicate suppression: hash of the last flushed line and how many
+    /// identical repeats were swallowed since it was printed.
+    log_last_hash: u64,
+    log_repeats: u64,
+
+    /// Per-VM log rate limiting (lines per second from the manifest, 0 =
+    /// unlimited): a token bucket refilled from the counter, with a count of
+    /// lines dropped while it was empty.
+    log_rate: u64,
+    log_tokens: u64,
+    log_refill_at: u64,
+    log_dropped: u64,
+
+    /// Whether this VM wants the hypervisor to inject
+    /// HF_MAILBOX_WRITABLE_INTID into its first vCPU directly when a mailbox
+    /// it is waiting on becomes writable, instead of being notified through
+    /// the primary VM's waiter polling.
+    pub direct_writable_notify: bool,
     mailbox: Mailbox,
 
     /// Wait entries to be used when waiting on other VM mailboxes.
@@ -223,16 +613,23 @@ impl VmInner {
     /// Initializes VmInner.
     pub unsafe fn init(&mut self, vm: *mut Vm, ppool: &MPool) -> Result<(), ()> {
         self.mailbox.init();
-
-        if !mm_vm_init(&mut self.ptable, ppool) {
-            return Err(());
-        }
+        self.log_len = 0;
+        self.log_limit = LOG_BUFFER_DEFAULT;
+        self.log_last_hash = 0;
+        self.log_repeats = 0;
+        self.log_rate = 0;
+        self.log_tokens = 0;
+        self.log_refill_at = 0;
+        self.log_dropped = 0;
+        self.direct_writable_notify = false;
+        let _ = ppool;
 
         // Initialise waiter entries.
         for i in 0..MAX_VMS {
             self.wait_entries[i].waiting_vm = vm;
             list_init(&mut self.wait_entries[i].wait_links);
-            list_init(&mut self.wait_entries[i].ready_links);
+            self.wait_entries[i].ready_next = AtomicUsize::new(0);
+            self.wait_entries[i].in_ready = AtomicBool::new(false);
         }
 
         Ok(())
@@ -244,14 +641,22 @@ impl VmInner {
         self.mailbox.fetch_waiter()
     }
 
+    /// Retrieves the next waiter only if `pred` holds for the waiting VM.
+    pub fn fetch_waiter_if<F>(&mut self, pred: F) -> *mut WaitEntry
+    where
+        F: Fn(&Vm) -> bool,
+    {
+        self.mailbox.fetch_waiter_if(pred)
+    }
+
     /// Checks if any waiters exists.
     pub fn is_waiter_list_empty(&self) -> bool {
         self.mailbox.is_waiter_list_empty()
     }
 
     /// Checks whether there exists a pending message. If one exists, marks the
-    /// mailbox read.
-    pub fn try_read(&mut self) -> Result<(), ()> {
+    /// mailbox read. Safe without the VM lock; see `Mailbox::try_read`.
+    pub fn try_read(&self) -> Result<(), ()> {
         self.mailbox.try_read()
     }
 
@@ -265,6 +670,127 @@ impl VmInner {
         self.mailbox.set_received()
     }
 
+    /// Reserves the mailbox for a lock-free fill; see `Mailbox::try_begin_fill`.
+    pub fn try_begin_fill(&self) -> bool {
+        self.mailbox.try_begin_fill()
+    }
+
+    /// Abandons a fill reservation.
+    pub fn abort_fill(&self) {
+        self.mailbox.abort_fill()
+    }
+
+    /// Stores the mailbox state word.
+    pub fn mailbox_state_store(&self, state: MailboxState) {
+        self.mailbox.state.store(state as u32, Ordering::Release);
+    }
+
+    /// Clears all mailbox state for a VM reset: pending queue pages are
+    /// returned to the pool, streams and zero-copy records dropped and the
+    /// buffers deconfigured so the reborn guest negotiates them afresh. The
+    /// stage-1 mappings of the old buffers are left in place; they are
+    /// re-established identically on reconfiguration.
+    pub fn reset_mailbox(&mut self) {
+        while self.mailbox.refill_from_queue_drop() {}
+        if !self.mailbox.urgent_slot.is_null() {
+            unsafe {
+                crate::init::hypervisor()
+                    .mpool
+                    .free(Page::from_raw(self.mailbox.urgent_slot as *mut RawPage));
+            }
+            self.mailbox.urgent_slot = ptr::null_mut();
+        }
+        self.mailbox.stream_remaining = 0;
+        self.mailbox.zero_copy_page = ptr::null();
+        self.mailbox.recv = ptr::null_mut();
+        self.mailbox.send = ptr::null();
+        self.mailbox.size = PAGE_SIZE;
+        self.mailbox
+            .state
+            .store(MailboxState::Empty as u32, Ordering::Release);
+        self.log_len = 0;
+    }
+
+    /// Queues a message for delivery once the mailbox is cleared.
+    pub fn queue_push(
+        &mut self,
+        header: &SpciMessage,
+        payload: &[u8],
+        mpool: &MPool,
+    ) -> Result<(), ()> {
+        self.mailbox.queue_push(header, payload, mpool)
+    }
+
+    /// Moves the oldest queued message into the receive buffer, if any.
+    pub fn refill_from_queue(&mut self, mpool: &MPool) -> bool {
+        self.mailbox.refill_from_queue(mpool)
+    }
+
+    /// Accepts an urgent message into the reserved priority slot.
+    pub fn urgent_push(
+        &mut self,
+        header: &SpciMessage,
+        payload: &[u8],
+        mpool: &MPool,
+    ) -> Result<(), ()> {
+        self.mailbox.urgent_push(header, payload, mpool)
+    }
+
+    /// Delivers the urgent message ahead of everything else, if present.
+    pub fn refill_from_urgent(&mut self, mpool: &MPool) -> bool {
+        self.mailbox.refill_from_urgent(mpool)
+    }
+
+    /// Starts a streamed transfer into this mailbox.
+    pub fn stream_start(&mut self, src: spci_vm_id_t, cursor: usize, remaining: usize) {
+        self.mailbox.stream_src_vm = src;
+        self.mailbox.stream_cursor = cursor;
+        self.mailbox.stream_remaining = remaining;
+    }
+
+    /// Returns the state of the in-flight streamed transfer, if any.
+    pub fn stream_state(&self) -> Option<(spci_vm_id_t, usize, usize)> {
+        if self.mailbox.stream_remaining == 0 {
+            None
+        } else {
+            Some((
+                self.mailbox.stream_src_vm,
+                self.mailbox.stream_cursor,
+                self.mailbox.stream_remaining,
+            ))
+        }
+    }
+
+    /// Advances the streamed transfer by the given number of bytes.
+    pub fn stream_advance(&mut self, n: usize) {
+        self.mailbox.stream_cursor += n;
+        self.mailbox.stream_remaining -= n;
+    }
+
+    /// Abandons the in-flight streamed transfer, if any.
+    pub fn stream_clear(&mut self) {
+        self.mailbox.stream_remaining = 0;
+    }
+
+    /// Records the sender page delivered by reference to this VM.
+    pub fn set_zero_copy_page(&mut self, page: *const SpciMessage) {
+        debug_assert!(self.mailbox.zero_copy_page.is_null());
+        self.mailbox.zero_copy_page = page;
+    }
+
+    /// Takes the sender page delivered by reference, if any, so the caller
+    /// can unmap it.
+    pub fn take_zero_copy_page(&mut self) -> Option<*const SpciMessage> {
+        let page = self.mailbox.zero_copy_page;
+        self.mailbox.zero_copy_page = ptr::null();
+
+        if page.is_null() {
+            None
+        } else {
+            Some(page)
+        }
+    }
+
     /// Configures the send and receive pages in the VM stage-2 and hypervisor
     /// stage-1 page tables. Locking of the page tables combined with a local
     /// memory pool ensures there will always be enough memory to recover from
@@ -279,13 +805,14 @@ impl VmInner {
         pa_recv_end: paddr_t,
         orig_recv_mode: Mode,
         hypervisor_ptable: &SpinLock<PageTable<Stage1>>,
-        fallback_mpool: &MPool,
+        vm_ptable: &mut VmPtable,
     ) -> Result<(), ()> {
         // Create a local pool so any freed memory can't be used by another
         // thread. This is to ensure the original mapping can be restored if
-        // any stage of the process fails.
-        let local_page_pool: MPool = MPool::new_with_fallback(fallback_mpool);
-        let mut ptable = guard(&mut self.ptable, |_| ());
+        // any stage of the process fails. It drains into this VM's table page
+        // cache.
+        let local_page_pool: MPool = MPool::new_with_fallback(&vm_ptable.pool);
+        let mut ptable = guard(&mut vm_ptable.table, |_| ());
 
         // Take memory ownership away from the VM and mark as shared.
         ptable.identity_map(
@@ -343,9 +870,18 @@ impl VmInner {
         &mut self,
         send: ipaddr_t,
         recv: ipaddr_t,
+        pages: usize,
         hypervisor_ptable: &SpinLock<PageTable<Stage1>>,
-        fallback_mpool: &MPool,
+        vm_ptable: &SpinLock<VmPtable>,
     ) -> Result<(), ()> {
+        // Negotiated buffer size: 0 keeps the traditional single page; the
+        // size is capped so bookkeeping and copies stay bounded.
+        let pages = if pages == 0 { 1 } else { pages };
+        if pages > MAILBOX_MAX_PAGES {
+            return Err(());
+        }
+        let size = pages * PAGE_SIZE;
+
         // Fail if addresses are not page-aligned.
         if !is_aligned(ipa_addr(send), PAGE_SIZE) || !is_aligned(ipa_addr(recv), PAGE_SIZE) {
             return Err(());
@@ -353,13 +889,15 @@ impl VmInner {
 
         // Convert to physical addresses.
         let pa_send_begin = pa_from_ipa(send);
-        let pa_send_end = pa_add(pa_send_begin, PAGE_SIZE);
+        let pa_send_end = pa_add(pa_send_begin, size);
 
         let pa_recv_begin = pa_from_ipa(recv);
-        let pa_recv_end = pa_add(pa_recv_begin, PAGE_SIZE);
+        let pa_recv_end = pa_add(pa_recv_begin, size);
 
-        // Fail if the same page is used for the send and receive pages.
-        if pa_addr(pa_send_begin) == pa_addr(pa_recv_begin) {
+        // Fail if the buffers overlap.
+        if pa_addr(pa_send_begin) < pa_addr(pa_recv_end)
+            && pa_addr(pa_recv_begin) < pa_addr(pa_send_end)
+        {
             return Err(());
         }
 
@@ -368,18 +906,23 @@ impl VmInner {
             return Err(());
         }
 
+        // Lock ordering: vm::inner (held by the caller) before vm::ptable.
+        let mut vm_ptable = vm_ptable.lock();
+
         // Ensure the pages are valid, owned and exclusive to the VM and that
         // the VM has the required access to the memory.
-        let orig_send_mode = self.ptable.get_mode(send, ipa_add(send, PAGE_SIZE))?;
+        let orig_send_mode = vm_ptable.table.get_mode(send, ipa_add(send, size))?;
         if !(orig_send_mode.valid_owned_exclusive() && orig_send_mode.contains(Mode::R | Mode::W)) {
             return Err(());
         }
 
-        let orig_recv_mode = self.ptable.get_mode(recv, ipa_add(recv, PAGE_SIZE))?;
+        let orig_recv_mode = vm_ptable.table.get_mode(recv, ipa_add(recv, size))?;
         if !(orig_recv_mode.valid_owned_exclusive() && orig_recv_mode.contains(Mode::R)) {
             return Err(());
         }
 
+        self.mailbox.size = size;
+
         self.configure_pages(
             pa_send_begin,
             pa_send_end,
@@ -388,7 +931,7 @@ impl VmInner {
             pa_recv_end,
             orig_recv_mode,
             hypervisor_ptable,
-            fallback_mpool,
+            &mut vm_ptable,
         )
     }
 
@@ -399,37 +942,61 @@ impl VmInner {
 
     /// Checks whether mailbox is empty.
     pub fn is_empty(&self) -> bool {
-        self.mailbox.state == MailboxState::Empty
+        self.mailbox.get_state() == MailboxState::Empty
     }
 
-    pub fn dequeue_ready_list(&mut self) -> Option<spci_vm_id_t> {
-        unsafe {
-            if list_empty(&self.mailbox.ready_list) {
-                return None;
-            }
-
-            let list_entry = list_pop_front(&self.mailbox.ready_list);
-            let entry: *mut WaitEntry = container_of!(list_entry, WaitEntry, ready_links);
-            let ret = entry.offset_from(self.wait_entries.as_ptr()) as spci_vm_id_t;
-            Some(ret)
+    /// Refills the consumer-local stash by taking the whole MPSC stack in
+    /// one atomic swap, if the stash is empty.
+    fn ready_stash_refill(&mut self) {
+        if self.mailbox.ready_stash == 0 {
+            self.mailbox.ready_stash = self.mailbox.ready_head.swap(0, Ordering::Acquire);
         }
     }
 
-    pub fn enqueue_ready_list(&mut self, entry: &mut WaitEntry) {
-        debug_assert!(unsafe { list_empty(&entry.ready_links) });
+    pub fn dequeue_ready_list(&mut self) -> Option<spci_vm_id_t> {
+        self.ready_stash_refill();
+
+        let entry = self.mailbox.ready_stash as *mut WaitEntry;
+        if entry.is_null() {
+            return None;
+        }
 
         unsafe {
-            list_append(&mut self.mailbox.ready_list, &mut entry.ready_links);
+            self.mailbox.ready_stash = (*entry).ready_next.load(Ordering::Relaxed);
+            (*entry).ready_next.store(0, Ordering::Relaxed);
+            (*entry).in_ready.store(false, Ordering::Release);
+            Some(entry.offset_from(self.wait_entries.as_ptr()) as spci_vm_id_t)
         }
     }
 
+    /// Drains the ready stack — taken in one atomic swap — into `out`, up to
+    /// its length; the remainder stays stashed for the next call. Returns
+    /// the number of IDs written.
+    pub fn drain_ready_list(&mut self, out: &mut [spci_vm_id_t]) -> usize {
+        let mut count = 0;
+
+        while count < out.len() {
+            match self.dequeue_ready_list() {
+                Some(id) => {
+                    out[count] = id;
+                    count += 1;
+                }
+                None => break,
+            }
+        }
+
+        count
+    }
+
     pub fn get_state(&self) -> MailboxState {
-        self.mailbox.state
+        self.mailbox.get_state()
     }
 
     pub fn set_empty(&mut self) {
-        debug_assert_eq!(self.mailbox.state, MailboxState::Read);
-        self.mailbox.state = MailboxState::Empty;
+        debug_assert_eq!(self.mailbox.get_state(), MailboxState::Read);
+        self.mailbox
+            .state
+            .store(MailboxState::Empty as u32, Ordering::Release);
     }
 
     /// Adds `self` into the waiter list of `target`, if `self` is not waiting
@@ -448,6 +1015,20 @@ impl VmInner {
         Ok(())
     }
 
+    /// Removes this VM's wait entry from `target`'s waiter list, in O(1), if
+    /// it is still queued there. Called when the wait is no longer needed,
+    /// e.g. because a later send to the target succeeded.
+    pub fn cancel_wait_for(&mut self, target: &mut Self, target_id: spci_vm_id_t) {
+        let entry = &mut self.wait_entries[target_id as usize];
+
+        if unsafe { !list_empty(&(*entry).wait_links) } {
+            unsafe {
+                list_remove(&mut (*entry).wait_links);
+            }
+        }
+        let _ = target;
+    }
+
     pub fn get_send_ptr(&self) -> *const SpciMessage {
         self.mailbox.get_send_ptr()
     }
@@ -456,22 +1037,184 @@ impl VmInner {
         self.mailbox.get_recv_ptr()
     }
 
+    /// The negotiated size in bytes of each mailbox buffer.
+    pub fn mailbox_size(&self) -> usize {
+        self.mailbox.size
+    }
+
+    /// The mailbox configuration generation; see `Mailbox::generation`.
+    pub fn mailbox_generation(&self) -> u32 {
+        self.mailbox.generation.load(Ordering::Acquire)
+    }
+
+    /// Splices a whole buffer of guest log output into dlog under a single
+    /// lock acquisition, flushing complete lines as they are found.
+    pub fn debug_log_bytes(&mut self, id: spci_vm_id_t, bytes: &[u8]) {
+        for c in bytes.iter() {
+            self.debug_log(id, *c);
+        }
+    }
+
+    /// Sets the flush threshold of the log buffer, clamped to sane bounds;
+    /// from the manifest's log_buffer_size property.
+    pub fn set_log_limit(&mut self, limit: usize) {
+        self.log_limit = cmp::max(64, cmp::min(limit, LOG_BUFFER_MAX));
+    }
+
     pub fn debug_log(&mut self, id: spci_vm_id_t, c: c_char) {
         let flush = if c == b'\n' || c == b'\0' {
             true
         } else {
-            self.log_buffer.push(c);
-            self.log_buffer.is_full()
+            self.log_buffer[self.log_len] = c;
+            self.log_len += 1;
+            self.log_len == self.log_limit
         };
 
         if flush {
-            let log = str::from_utf8(&self.log_buffer).unwrap_or("non-UTF8 bytes");
-            dlog!("VM {}: {}\n", id, log);
-            self.log_buffer.clear();
+            self.flush_log_line(id);
+        }
+    }
+
+    /// Flushes the accumulated line, deduplicating identical repeats and
+    /// enforcing the VM's log token bucket: a flood of one message becomes a
+    /// single line plus a repeat summary, and a VM over its rate drops lines
+    /// (counted) instead of throttling the machine.
+    fn flush_log_line(&mut self, id: spci_vm_id_t) {
+        extern "C" {
+            fn arch_cpu_cycle_count() -> u64;
+            fn arch_timer_ticks_from_ns(ns: u64) -> u64;
+        }
+
+        // FNV-1a over the line for duplicate detection.
+        let mut hash: u64 = 0xcbf2_9ce4_8422_2325;
+        for &b in self.log_buffer[..self.log_len].iter() {
+            hash ^= u64::from(b);
+            hash = hash.wrapping_mul(0x100_0000_01b3);
+        }
+
+        if hash == self.log_last_hash && self.log_len != 0 {
+            self.log_repeats += 1;
+            self.log_len = 0;
+            return;
+        }
+
+        // Rate limit: refill one second's worth of tokens at a time.
+        if self.log_rate != 0 {
+            let now = unsafe { arch_cpu_cycle_count() };
+            let second = unsafe { arch_timer_ticks_from_ns(1_000_000_000) };
+            if now.wrapping_sub(self.log_refill_at) >= second {
+                self.log_tokens = self.log_rate;
+                self.log_refill_at = now;
+            }
+
+            if self.log_tokens == 0 {
+                self.log_dropped += 1;
+                self.log_len = 0;
+                return;
+            }
+            self.log_tokens -= 1;
+        }
+
+        if self.log_repeats > 0 {
+            dlog!("VM {}: last message repeated {} times\n", id, self.log_repeats);
+            self.log_repeats = 0;
+        }
+        if self.log_dropped > 0 {
+            dlog!("VM {}: {} lines dropped by rate limit\n", id, self.log_dropped);
+            self.log_dropped = 0;
+        }
+
+        let log = str::from_utf8(&self.log_buffer[..self.log_len]).unwrap_or("non-UTF8 bytes");
+        dlog!("VM {}: {}\n", id, log);
+        self.log_last_hash = hash;
+        self.log_len = 0;
+    }
+
+    /// Sets the VM's log rate limit in lines per second (0 = unlimited).
+    pub fn set_log_rate(&mut self, rate: u64) {
+        self.log_rate = rate;
+        self.log_tokens = rate;
+    }
+}
+
+/// An emulated-device MMIO handler: called with the faulting vCPU, the
+/// faulting IPA and the access decoded from the syndrome (write or read, the
+/// transfer register index and the access size in bytes). Returns true if the
+/// access was emulated and the instruction should be skipped.
+pub type MmioHandler = unsafe extern "C" fn(
+    vcpu: *const VCpu,
+    ipa: uintpaddr_t,
+    is_write: bool,
+    reg: u8,
+    size: u8,
+) -> bool;
+
+/// The number of emulated MMIO regions each VM can register.
+const MMIO_REGIONS: usize = 8;
+
+/// Sorted table of emulated MMIO regions, consulted straight from the
+/// data-abort path before any generic fault handling.
+pub struct MmioTable {
+    regions: [(usize, usize, Option<MmioHandler>); MMIO_REGIONS],
+    len: usize,
+}
+
+impl MmioTable {
+    pub const fn new() -> Self {
+        Self {
+            regions: [(0, 0, None); MMIO_REGIONS],
+            len: 0,
+        }
+    }
+
+    /// Registers a handler for [begin, end), keeping the table sorted.
+    pub fn register(&mut self, begin: usize, end: usize, handler: MmioHandler) -> Result<(), ()> {
+        if self.len == MMIO_REGIONS || begin >= end {
+            return Err(());
         }
+
+        let mut pos = self.len;
+        for i in 0..self.len {
+            if self.regions[i].0 > begin {
+                pos = i;
+                break;
+            }
+        }
+
+        let mut i = self.len;
+        while i > pos {
+            self.regions[i] = self.regions[i - 1];
+            i -= 1;
+        }
+        self.regions[pos] = (begin, end, Some(handler));
+        self.len += 1;
+        Ok(())
+    }
+
+    /// Finds the handler covering the given address by binary search.
+    pub fn lookup(&self, addr: usize) -> Option<MmioHandler> {
+        let mut lo = 0;
+        let mut hi = self.len;
+
+        while lo < hi {
+            let mid = (lo + hi) / 2;
+            let (begin, end, handler) = self.regions[mid];
+            if addr < begin {
+                hi = mid;
+            } else if addr >= end {
+                lo = mid + 1;
+            } else {
+                return handler;
+            }
+        }
+
+        None
     }
 }
 
+/// `repr(C)` with `id` first: the assembly hypercall fast path reads the ID
+/// of the calling VM directly (see VM_ID in offsets.h).
+#[repr(C)]
 pub struct Vm {
     pub id: spci_vm_id_t,
 
@@ -483,9 +1226,85 @@ pub struct Vm {
     ///      lock VmInner to acquire VCpuState.
     pub vcpus: ArrayVec<[VCpu; MAX_CPUS]>,
 
+    /// Emulated MMIO regions of this VM. Registration happens at set-up
+    /// time; the fault path reads without the VM lock.
+    pub mmio: SpinLock<MmioTable>,
+
+    /// Stage-2 address-space state; see api.c for the partial ordering on
+    /// locks (vm::inner before vm::ptable where both are needed).
+    pub ptable: SpinLock<VmPtable>,
+
     /// See api.c for the partial ordering on locks.
-    pub inner: SpinLock<VmInner>,
+    pub inner: RwLock<VmInner>,
     pub aborting: AtomicBool,
+
+    /// Whether stage-2 dirty page tracking is active for this VM. Read on
+    /// the fault path without the VM lock.
+    pub dirty_tracking: AtomicBool,
+
+    /// Whether wfi/wfe execute natively in this VM's vCPUs instead of
+    /// trapping; set from the manifest for VMs with a dedicated core.
+    pub wfi_passthrough: bool,
+
+    /// Placement policy from the manifest, immutable after load: the
+    /// physical-CPU affinity mask (0 = unrestricted), the priority class
+    /// (0 = default, lower is more urgent) and whether the affinity CPUs
+    /// are dedicated to this VM. Enforced by the schedulers, queried
+    /// through HF_VM_SCHED_ATTRS.
+    pub cpu_affinity: u64,
+    pub priority: u8,
+    pub dedicated_cores: bool,
+
+    /// Fast-path capabilities this VM advertised through SPCI_FEATURES, as
+    /// SpciFeatures bits. Read on hot paths without the VM lock.
+    pub features: AtomicU32,
+
+    /// Current adaptive halt-polling window for this VM's receivers, in
+    /// cycles: grown when a poll catches a message, shrunk when it expires
+    /// idle.
+    pub halt_poll_cycles: AtomicU32,
+
+    /// Per-VM performance telemetry, bumped with relaxed atomics from the
+    /// hot paths so host-wide slowdowns can be attributed to the guilty
+    /// guest; drained through HF_VM_TELEMETRY.
+    pub telemetry: VmTelemetry,
+
+    /// Set when the loader wrote executable image bytes for this VM whose
+    /// instruction-cache sync is still pending; consumed by the first vCPU
+    /// start, so standby images that never run skip icache maintenance
+    /// entirely.
+    pub pending_exec_sync: AtomicBool,
+}
+
+/// Per-VM counters; field indices match the HF_VM_TELEMETRY selector.
+#[repr(C)]
+pub struct VmTelemetry {
+    /// Stage-2 translation faults taken on this VM's behalf.
+    pub stage2_faults: AtomicU64,
+
+    /// TLB-invalidating stage-2 operations issued on its behalf.
+    pub tlb_invalidations: AtomicU64,
+
+    /// Defrag passes run over its table.
+    pub defrag_passes: AtomicU64,
+
+    /// Sends that found its mailbox busy.
+    pub mailbox_full: AtomicU64,
+}
+
+impl VmTelemetry {
+    /// Reads the counter selected by `field`, or None if out of range.
+    pub fn read(&self, field: usize) -> Option<u64> {
+        let counter = match field {
+            0 => &self.stage2_faults,
+            1 => &self.tlb_invalidations,
+            2 => &self.defrag_passes,
+            3 => &self.mailbox_full,
+            _ => return None,
+        };
+
+        Some(counter.load(Ordering::Relaxed))
+    }
 }
 
 impl Vm {
@@ -505,9 +1324,40 @@ impl Vm {
             self.vcpus = MaybeUninit::uninit().assume_init();
             self.vcpus.set_len(0);
         }
+        self.mmio = SpinLock::new(MmioTable::new());
         self.aborting = AtomicBool::new(false);
+        self.dirty_tracking = AtomicBool::new(false);
+        self.wfi_passthrough = false;
+        self.cpu_affinity = 0;
+        self.priority = 0;
+        self.dedicated_cores = false;
+        self.features = AtomicU32::new(0);
+        self.halt_poll_cycles = AtomicU32::new(2048);
+        self.pending_exec_sync = AtomicBool::new(false);
+        self.telemetry = VmTelemetry {
+            stage2_faults: AtomicU64::new(0),
+            tlb_invalidations: AtomicU64::new(0),
+            defrag_passes: AtomicU64::new(0),
+            mailbox_full: AtomicU64::new(0),
+        };
         unsafe {
             let self_ptr = self as *mut _;
+
+            // The per-VM table page cache falls back to the hypervisor's
+            // pool, whose location is stable by the time VMs are created
+            // (unlike the transient `ppool` argument).
+            let vm_ptable = self.ptable.get_mut();
+            ptr::write(
+                &mut vm_ptable.pool,
+                MPool::new_with_fallback(&hypervisor().mpool),
+            );
+            vm_ptable.lazy_image = None;
+            vm_ptable.validated = [ValidatedRange::empty(); VALIDATED_RANGES];
+            vm_ptable.validated_next = 0;
+            if !mm_vm_init(&mut vm_ptable.table, ppool) {
+                return Err(());
+            }
+
             self.inner.get_mut().init(self_ptr, ppool)?;
 
             for _ in 0..vcpu_count {
@@ -527,12 +1377,46 @@ impl Vm {
     /// during running. That's why this function returns `paddr_t` rather than
     /// `&[RawPageTable]`.
     pub fn get_ptable_raw(&self) -> paddr_t {
-        unsafe { self.inner.get_unchecked().ptable.as_raw() }
+        unsafe { self.ptable.get_unchecked().table.as_raw() }
+    }
+
+    /// Gets the mode of the given range of this VM's stage-2 page table
+    /// without acquiring the VM lock. This is safe because the lock-free read
+    /// path of the page table detects and retries racing updates; see
+    /// `PageTable::get_mode_lockfree()`.
+    pub fn get_mode_lockfree(&self, begin: ipaddr_t, end: ipaddr_t) -> Result<Mode, ()> {
+        unsafe { self.ptable.get_unchecked() }
+            .table
+            .get_mode_lockfree(begin, end)
     }
 
     pub fn debug_log(&self, c: c_char) {
         self.inner.lock().debug_log(self.id, c)
     }
+
+    /// Reads the mailbox state without taking the VM lock; the state word is
+    /// atomic.
+    pub fn mailbox_state_lockfree(&self) -> MailboxState {
+        unsafe { self.inner.get_unchecked() }.get_state()
+    }
+
+    /// Acknowledges a pending message without taking the VM lock; a single
+    /// CAS on the atomic state word.
+    pub fn try_read_lockfree(&self) -> Result<(), ()> {
+        unsafe { self.inner.get_unchecked() }.try_read()
+    }
+
+    /// Commits a lock-free fill: publishes the copied message as Received,
+    /// or directly as Read when it was consumed on delivery.
+    pub fn commit_fill_lockfree(&self, read: bool) {
+        let state = if read {
+            MailboxState::Read
+        } else {
+            MailboxState::Received
+        };
+        unsafe { self.inner.get_unchecked() }
+            .mailbox_state_store(state);
+    }
 }
 
 pub struct VmManager {
@@ -559,6 +1443,10 @@ impl VmManager {
 
         vm.init(id as u16, vcpu_count, ppool).ok()?;
 
+        // Publish the fully initialized slot before the length: readers of
+        // the manager index only the initialized prefix, which matters once
+        // VMs can also be created at runtime (vm_clone).
+        fence(Ordering::Release);
         unsafe {
             self.vms.set_len(idx + 1);
         }
@@ -614,3 +1502,170 @@ pub unsafe extern "C" fn vm_get_arch(vm: *const Vm) -> *mut ArchVm {
 pub unsafe extern "C" fn vm_get_vcpu_count(vm: *const Vm) -> spci_vcpu_count_t {
     (*vm).vcpus.len() as _
 }
+
+/// Returns the VM's send buffer, or null if the mailbox has not been
+/// configured yet. The send buffer address never changes once configured.
+#[no_mangle]
+pub unsafe extern "C" fn vm_get_send_ptr(vm: *const Vm) -> *const SpciMessage {
+    (*vm).inner.read().get_send_ptr()
+}
+
+/// Returns the VM's receive buffer if the mailbox is currently empty, or null
+/// otherwise. The caller must make sure no message is delivered while it uses
+/// the buffer.
+#[no_mangle]
+pub unsafe extern "C" fn vm_get_empty_recv_ptr(vm: *const Vm) -> *mut SpciMessage {
+    let inner = (*vm).inner.lock();
+    if inner.is_empty() {
+        inner.get_recv_ptr()
+    } else {
+        ptr::null_mut()
+    }
+}
+
+/// Whether the VM runs on cores dedicated to it (manifest dedicated_cores).
+#[no_mangle]
+pub unsafe extern "C" fn vm_get_dedicated_cores(vm: *const Vm) -> bool {
+    (*vm).dedicated_cores
+}
+
+/// Reserves the VM's receive buffer with the Empty->Filling CAS that message
+/// delivery uses, so result-page writers on the debug surface can neither
+/// clobber a concurrent delivery nor be clobbered by one. Returns NULL when
+/// the buffer is busy or the mailbox unconfigured; the caller releases the
+/// reservation with vm_release_recv() once its writes are done.
+#[no_mangle]
+pub unsafe extern "C" fn vm_try_reserve_recv(vm: *const Vm) -> *mut SpciMessage {
+    let inner = (*vm).inner.get_unchecked();
+
+    if !inner.is_configured() || !inner.try_begin_fill() {
+        return ptr::null_mut();
+    }
+
+    inner.get_recv_ptr()
+}
+
+/// Releases a reservation taken with vm_try_reserve_recv(), back to Empty:
+/// the written content is a raw result page for the caller to read, not a
+/// message to acknowledge.
+#[no_mangle]
+pub unsafe extern "C" fn vm_release_recv(vm: *const Vm) {
+    (*vm).inner.get_unchecked().abort_fill();
+}
+
+/// Publishes a multicall result array into the VM's receive buffer under the
+/// same reservation. Returns false, writing nothing, when the buffer is not
+/// free.
+#[no_mangle]
+pub unsafe extern "C" fn vm_publish_multicall_results(
+    vm: *const Vm,
+    results: *const i64,
+    count: size_t,
+) -> bool {
+    let recv = vm_try_reserve_recv(vm);
+
+    if recv.is_null() {
+        return false;
+    }
+
+    ptr::copy_nonoverlapping(results, recv as *mut i64, count);
+    vm_release_recv(vm);
+    true
+}
+
+/// Registers an emulated MMIO region for the given VM; used by device
+/// emulation code at set-up time.
+#[no_mangle]
+pub unsafe extern "C" fn vm_mmio_register(
+    vm: *mut Vm,
+    begin: uintpaddr_t,
+    end: uintpaddr_t,
+    handler: MmioHandler,
+) -> bool {
+    (*vm).mmio.lock().register(begin, end, handler).is_ok()
+}
+
+impl Vm {
+    /// Pushes a wait entry onto this VM's ready stack with a single CAS and
+    /// no lock: producers on any core never contend with the mailbox
+    /// owner's lock. A no-op if the entry is already queued.
+    pub fn ready_push(&self, entry: &WaitEntry) {
+        if entry
+            .in_ready
+            .compare_exchange(false, true, Ordering::AcqRel, Ordering::Acquire)
+            .is_err()
+        {
+            return;
+        }
+
+        let mailbox = unsafe { &self.inner.get_unchecked().mailbox };
+        let mut head = mailbox.ready_head.load(Ordering::Relaxed);
+        loop {
+            entry.ready_next.store(head, Ordering::Relaxed);
+            match mailbox.ready_head.compare_exchange_weak(
+                head,
+                entry as *const WaitEntry as usize,
+                Ordering::Release,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => return,
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    /// Reads the negotiated mailbox buffer size without the VM lock; like
+    /// the buffer addresses, it is set at most once.
+    pub fn mailbox_size_lockfree(&self) -> usize {
+        unsafe { self.inner.get_unchecked() }.mailbox_size()
+    }
+
+    /// Reserves the receive buffer via the Empty->Filling CAS, hands the
+    /// pointer to `fill`, and releases the reservation back to Empty once it
+    /// returns: concurrent senders can neither clobber the write nor have a
+    /// delivery clobbered. Returns false, calling nothing, when the buffer
+    /// is busy or the mailbox unconfigured.
+    pub unsafe fn with_reserved_recv<F: FnOnce(*mut SpciMessage)>(&self, fill: F) -> bool {
+        let inner = self.inner.get_unchecked();
+
+        if !inner.is_configured() || !inner.try_begin_fill() {
+            return false;
+        }
+
+        fill(inner.get_recv_ptr());
+        inner.abort_fill();
+        true
+    }
+
+    /// Reads the receive buffer pointer without any lock, under the same
+    /// generation guarantee as the send pointer. The buffers are pinned in
+    /// the hypervisor's stage-1 tables from configuration until reboot, so
+    /// the returned address needs no per-use translation or remapping work.
+    pub fn get_recv_ptr_lockfree(&self) -> Option<*mut SpciMessage> {
+        let inner = unsafe { self.inner.get_unchecked() };
+        if inner.mailbox_generation() == 0 {
+            None
+        } else {
+            Some(inner.get_recv_ptr())
+        }
+    }
+
+    /// Reads the send buffer pointer without any lock: configuration is a
+    /// once-per-boot event published through the mailbox generation, so a
+    /// nonzero generation (acquire) guarantees a stable pointer. Returns
+    /// None while unconfigured.
+    pub fn get_send_ptr_lockfree(&self) -> Option<*const SpciMessage> {
+        let inner = unsafe { self.inner.get_unchecked() };
+        if inner.mailbox_generation() == 0 {
+            None
+        } else {
+            Some(inner.get_send_ptr())
+        }
+    }
+}
+
+/// Returns the VM's negotiated SPCI feature bits; lock-free.
+#[no_mangle]
+pub unsafe extern "C" fn vm_get_features(vm: *const Vm) -> u32 {
+    (*vm).features.load(Ordering::Relaxed)
+}
@@ -24,6 +24,15 @@
 
 spci_vm_id_t api_vm_get_id(const struct vcpu *current);
 spci_vm_count_t api_vm_get_count(void);
+int64_t api_vm_sched_attrs(spci_vm_id_t vm_id, const struct vcpu *current);
+int64_t api_vm_telemetry(spci_vm_id_t vm_id, size_t field,
+			 const struct vcpu *current);
+spci_return_t api_page_grant(uintreg_t encoded, spci_vm_id_t target,
+			     const struct vcpu *current);
+int64_t api_vm_clone(spci_vm_id_t template_id, uintreg_t entry, uintreg_t arg,
+		     const struct vcpu *current);
+int64_t api_idle_residency(size_t cpu_index, size_t field,
+			   const struct vcpu *current);
 spci_vcpu_count_t api_vcpu_get_count(spci_vm_id_t vm_id,
 				     const struct vcpu *current);
 void api_regs_state_saved(struct vcpu *vcpu);
@@ -31,14 +40,38 @@ uint64_t api_vcpu_run(spci_vm_id_t vm_id,
 				       spci_vcpu_index_t vcpu_idx,
 				       const struct vcpu *current,
 				       struct vcpu **next);
-int64_t api_vm_configure(ipaddr_t send, ipaddr_t recv, struct vcpu *current,
-			 struct vcpu **next);
+int64_t api_vm_configure(ipaddr_t send, ipaddr_t recv, size_t pages,
+			 struct vcpu *current, struct vcpu **next);
 int64_t api_mailbox_clear(struct vcpu *current, struct vcpu **next);
 int64_t api_mailbox_writable_get(const struct vcpu *current);
+int64_t api_mailbox_writable_get_bulk(struct vcpu *current);
 int64_t api_mailbox_waiter_get(spci_vm_id_t vm_id, const struct vcpu *current);
+int64_t api_mailbox_writable_notify(bool enable, struct vcpu *current);
+int64_t api_dirty_track(spci_vm_id_t vm_id, bool enable,
+			struct vcpu *current);
+int64_t api_dirty_log_read(spci_vm_id_t vm_id, spci_vcpu_index_t vcpu_idx,
+			   struct vcpu *current);
+int64_t api_lock_profile_read(uint64_t arg, struct vcpu *current);
+int64_t api_interrupt_status_page(ipaddr_t ipa, struct vcpu *current);
+int64_t api_vcpu_sleep_info(spci_vm_id_t vm_id, struct vcpu *current);
+int64_t api_interrupt_enable_bulk(struct vcpu *current);
+int64_t api_vcpu_cycles(spci_vm_id_t vm_id, struct vcpu *current);
+int64_t api_boot_trace_read(size_t index, struct vcpu *current);
+int64_t api_vm_reset(spci_vm_id_t vm_id, struct vcpu *current);
+int64_t api_wset_sample(uint64_t arg, uintpaddr_t begin, size_t size,
+			struct vcpu *current);
+int64_t api_vcpu_token(spci_vm_id_t vm_id, spci_vcpu_index_t vcpu_idx,
+		       struct vcpu *current);
+uint64_t api_vcpu_run_token(uint64_t token, struct vcpu *current,
+			    struct vcpu **next);
+int64_t api_vcpu_telem_page(struct vcpu *current);
+int64_t api_mpool_stat(uint32_t field, struct vcpu *current);
+int64_t api_share_memory_revoke(spci_memory_handle_t handle,
+				struct vcpu *current);
 int64_t api_share_memory(spci_vm_id_t vm_id, ipaddr_t addr, size_t size,
 			 enum hf_share share, struct vcpu *current);
 int64_t api_debug_log(char c, struct vcpu *current);
+int64_t api_debug_log_buffer(size_t count, struct vcpu *current);
 
 struct vcpu *api_preempt(struct vcpu *current);
 struct vcpu *api_wait_for_interrupt(struct vcpu *current);
@@ -54,10 +87,14 @@ int64_t api_interrupt_inject(spci_vm_id_t target_vm_id,
 
 spci_return_t api_spci_msg_send(uint32_t attributes, struct vcpu *current,
 				struct vcpu **next);
-int32_t api_spci_msg_recv(uint32_t attributes, struct vcpu *current,
-			  struct vcpu **next);
-int32_t api_spci_yield(struct vcpu *current, struct vcpu **next);
+spci_return_t api_spci_msg_send_direct(uintreg_t target, struct vcpu *current,
+				       struct vcpu **next);
+int32_t api_spci_msg_recv(uint32_t attributes, uint64_t timeout_ns,
+			  struct vcpu *current, struct vcpu **next);
+int32_t api_spci_yield(uint64_t deadline_ns, struct vcpu *current,
+		       struct vcpu **next);
 int32_t api_spci_version(void);
+int32_t api_spci_features(uint32_t requested, struct vcpu *current);
 spci_return_t api_spci_share_memory(struct vm_locked to_locked,
 				    struct vm_locked from_locked,
 				    struct spci_memory_region *memory_region,
@@ -59,3 +59,49 @@ void arch_regs_set_pc_arg(struct arch_regs *r, ipaddr_t pc, uintreg_t arg);
  * by any other physical CPU.
  */
 void arch_regs_set_retval(struct arch_regs *r, uintreg_t v);
+
+/**
+ * Returns the index of the currently executing CPU, used to index per-CPU
+ * state.
+ */
+size_t arch_cpu_index_current(void);
+
+/**
+ * Tries to inject the given virtual interrupt directly into a GICv3 list
+ * register of the current CPU, for delivery to the vCPU that is (about to be)
+ * running on it. Returns false if no list register is available or the GIC
+ * doesn't support it, in which case the caller falls back to the software
+ * pending path.
+ */
+bool arch_gicv3_try_inject_current(uint32_t intid);
+
+/**
+ * Interrupts the given physical CPU, so that if it is running a vCPU it traps
+ * back to the hypervisor promptly. Used to make a remote vCPU observe a newly
+ * injected interrupt without waiting for its next natural exit.
+ */
+void arch_cpu_kick(cpu_id_t id);
+
+/**
+ * Returns a free-running cycle-granularity counter, used for lock hold time
+ * accounting in instrumented builds.
+ */
+uint64_t arch_cpu_cycle_count(void);
+
+/**
+ * Returns the locality (cluster) of the currently executing CPU, used to
+ * prefer memory chunks close to it.
+ */
+uint32_t arch_cpu_locality_current(void);
+
+/** Waits for an event; used for adaptive lock waiting. */
+void arch_cpu_wfe(void);
+
+/** Signals an event to waiting CPUs. */
+void arch_cpu_sev(void);
+
+/**
+ * Configures the given registers so that wfi/wfe execute natively in the
+ * guest instead of trapping, for VMs with a dedicated physical core.
+ */
+void arch_regs_set_wfi_passthrough(struct arch_regs *r);
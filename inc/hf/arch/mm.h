@@ -90,6 +90,15 @@ paddr_t arch_mm_block_from_pte(pte_t pte, uint8_t level);
  */
 paddr_t arch_mm_table_from_pte(pte_t pte, uint8_t level);
 
+/**
+ * Software-maintained summary on table descriptors: marks, checks or clears
+ * the "subtree attribute-uniform" bit, letting range-attribute queries stop
+ * at the first level that covers the range.
+ */
+pte_t arch_mm_table_pte_set_uniform(pte_t pte);
+pte_t arch_mm_table_pte_clear_uniform(pte_t pte);
+bool arch_mm_table_pte_is_uniform(pte_t pte);
+
 /**
  * Extracts the attributes of the PTE.
  */
@@ -111,6 +120,26 @@ void arch_mm_invalidate_stage1_range(vaddr_t va_begin, vaddr_t va_end);
  */
 void arch_mm_invalidate_stage2_range(ipaddr_t va_begin, ipaddr_t va_end);
 
+/**
+ * Returns the hardware VMID for the VM owning the generation-tagged `slot`,
+ * allocating from the live generation when needed. Flushes the TLB only when
+ * the VMID space rolls over.
+ */
+uint64_t arch_mm_assign_vmid(uint64_t *slot, size_t cpu_index);
+
+/**
+ * Enables the MMU behind a coarse boot table on the boot CPU, so the rest of
+ * one-time init runs cached. Replaced by the fine-grained table when
+ * arch_mm_enable() runs.
+ */
+void arch_mm_early_init(void);
+
+/**
+ * Publishes all recently loaded executable images to the instruction
+ * caches in one batched invalidation.
+ */
+void arch_mm_sync_icache(void);
+
 /**
  * Writes back the given range of virtual memory to such a point that all cores
  * and devices will see the updated values. The corresponding cache lines are
@@ -158,6 +187,29 @@ uint64_t arch_mm_mode_to_stage2_attrs(int mode);
  */
 int arch_mm_stage2_attrs_to_mode(uint64_t attrs);
 
+/**
+ * Returns the given stage-2 attributes with write access removed, for dirty
+ * page tracking.
+ */
+uint64_t arch_mm_stage2_attrs_to_readonly(uint64_t attrs);
+
+/*
+ * Manipulates the contiguous hint of block/page attributes; a no-op on
+ * architectures without one.
+ */
+uint64_t arch_mm_attrs_set_cont(uint64_t attrs);
+
+/** Clears the access flag from the given attributes, for AF sampling. */
+uint64_t arch_mm_attrs_clear_af(uint64_t attrs);
+
+/** Returns whether the access flag is set in the given attributes. */
+bool arch_mm_attrs_has_af(uint64_t attrs);
+
+/** Cleans (without invalidating) the data cache over the given range. */
+void arch_mm_clean_dcache(void *base, size_t size);
+uint64_t arch_mm_attrs_clear_cont(uint64_t attrs);
+bool arch_mm_attrs_is_cont(uint64_t attrs);
+
 /**
  * Initializes the arch specific memory management.
  */
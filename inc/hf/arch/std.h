@@ -108,3 +108,9 @@ int strcmp(const char *a, const char *b);
 
 #endif
 #endif
+
+/**
+ * Copies like memcpy but with non-temporal accesses, for payloads the caller
+ * itself never reads.
+ */
+void *memcpy_nt(void *dst, const void *src, size_t n);
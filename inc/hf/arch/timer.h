@@ -17,10 +17,13 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "hf/arch/types.h"
 
+struct vcpu;
+
 /**
  * Sets the bit to mask virtual timer interrupts.
  */
@@ -75,3 +78,17 @@ uint64_t arch_timer_remaining_ticks_current(void);
  * the timer is not enabled.
  */
 uint64_t arch_timer_remaining_ns_current(void);
+
+/*
+ * Per-CPU aggregation of blocked vCPU timer deadlines, so the physical timer
+ * is programmed once to the earliest deadline and expiry wakes all due vCPUs
+ * in one pass.
+ */
+void arch_timer_queue_record(size_t cpu_index, struct vcpu *vcpu,
+			     struct arch_regs *regs);
+void arch_timer_queue_cancel(size_t cpu_index, struct vcpu *vcpu);
+size_t arch_timer_queue_expire(size_t cpu_index);
+void arch_timer_queue_commit(size_t cpu_index);
+
+/** Converts a duration in nanoseconds to counter ticks. */
+uint64_t arch_timer_ticks_from_ns(uint64_t ns);
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/* Keep macro alignment */
+/* clang-format off */
+
+/** Branch prediction hints for hot dispatch paths. */
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/**
+ * Places a rarely executed function (error formatting, abort paths) in the
+ * cold text region (collected after the hot text by the linker script), so
+ * the trap fast path stays within a few I-cache lines.
+ */
+#define COLD __attribute__((cold, noinline, section(".cold.text")))
+
+/* clang-format on */
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <stdalign.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -58,6 +60,19 @@ struct interrupts {
 	 * interrupt_pending.
 	 */
 	uint32_t enabled_and_pending_count;
+
+	/**
+	 * Summary bitmap with one bit per word of enabled & pending, so the
+	 * next deliverable interrupt is found with two CLZ/CTZ operations
+	 * instead of a linear scan over the words.
+	 */
+	uint32_t summary;
+
+	/**
+	 * Optional page, mapped read-only into the guest, mirroring the
+	 * pending state. NULL until the guest registers one.
+	 */
+	struct hf_interrupt_status_page *status_page;
 };
 
 struct vcpu_fault_info {
@@ -82,10 +97,13 @@ struct vcpu_execution_locked {
 	struct vcpu *vcpu;
 };
 
-/* TODO: Update alignment such that cpus are in different cache lines. */
+/**
+ * Aligned so that each entry of the global CPU array starts on its own cache
+ * line, avoiding false sharing between CPUs.
+ */
 struct cpu {
 	/** CPU identifier. Doesn't have to be contiguous. */
-	cpu_id_t id;
+	alignas(CACHE_LINE_SIZE) cpu_id_t id;
 
 	/** Pointer to bottom of the stack. */
 	void *stack_bottom;
@@ -95,9 +113,61 @@ struct cpu {
 
 	/** Determines whether or not the cpu is currently on. */
 	bool is_on;
+
+	/**
+	 * Lock-free mirror of is_on, release-stored by cpu_on/cpu_off and
+	 * read with one acquire load by the AFFINITY_INFO handler.
+	 */
+	atomic_bool online;
+
+	/**
+	 * Per-CPU run queue of the in-hypervisor scheduling tier (only used
+	 * when the hypervisor is built with the sched_tier feature).
+	 */
+	struct spinlock run_queue_lock;
+	const struct vcpu *run_queue[8];
+	size_t run_queue_head;
+	size_t run_queue_len;
 };
 
+/**
+ * An emulated-device MMIO handler; see vm_mmio_register().
+ */
+typedef bool (*mmio_handler_t)(const struct vcpu *vcpu, uintpaddr_t ipa,
+			       bool is_write, uint8_t reg, uint8_t size);
+
+bool vm_mmio_register(struct vm *vm, uintpaddr_t begin, uintpaddr_t end,
+		      mmio_handler_t handler);
+bool vcpu_mmio_dispatch(const struct vcpu *vcpu, uintpaddr_t ipa,
+			bool is_write, uint8_t reg, uint8_t size);
+
+/*
+ * Fast single-load accessors for the hot trap paths. By convention TPIDR_EL2
+ * always holds the running vCPU pointer (maintained by the entry code), the
+ * vm pointer is the first field of struct vcpu and the register file sits at
+ * VCPU_REGS — both pinned by repr(C) and checked against offsets.h at boot —
+ * so these replace cross-language function calls and their dependent-load
+ * chains with one load each.
+ */
+static inline struct vm *vcpu_get_vm_fast(const struct vcpu *vcpu)
+{
+	return *(struct vm *const *)vcpu;
+}
+
+static inline struct arch_regs *vcpu_get_regs_fast(struct vcpu *vcpu)
+{
+	return (struct arch_regs *)((char *)vcpu + 32);
+}
+
+static inline spci_vm_id_t vcpu_get_vm_id_fast(const struct vcpu *vcpu)
+{
+	/* The VM ID is the first field of struct vm. */
+	return *(const spci_vm_id_t *)vcpu_get_vm_fast(vcpu);
+}
+
+void vcpu_add_cycles(const struct vcpu *vcpu, uint64_t cycles);
 size_t cpu_index(struct cpu *c);
+cpu_id_t cpu_id_of_index(size_t index);
 bool cpu_on(struct cpu *c, ipaddr_t entry, uintreg_t arg);
 void cpu_off(struct cpu *c);
 struct cpu *cpu_find(cpu_id_t id);
@@ -110,6 +180,11 @@ struct arch_regs *vcpu_get_regs(struct vcpu *vcpu);
 const struct arch_regs *vcpu_get_regs_const(const struct vcpu *vcpu);
 struct vm *vcpu_get_vm(struct vcpu *vcpu);
 struct cpu *vcpu_get_cpu(struct vcpu *vcpu);
+void vcpu_interrupt_repend(struct vcpu *vcpu, uint32_t intid);
+uint32_t vcpu_interrupt_pop(const struct vcpu *vcpu);
+void vcpu_record_switch_in(const struct vcpu *vcpu);
+void vcpu_drain_remote_intids(const struct vcpu *vcpu);
+bool cpu_is_on_lockfree(const struct cpu *c);
 bool vcpu_is_interrupted(struct vcpu *vcpu);
 bool vcpu_is_off(struct vcpu_execution_locked vcpu);
 bool vcpu_secondary_reset_and_start(struct vcpu *vcpu, ipaddr_t entry,
@@ -23,9 +23,58 @@
 
 #define DLOG_BUFFER_SIZE 8192
 
+/*
+ * Compile-time log levels. The build sets the global threshold through
+ * DLOG_LEVEL (defaulting to INFO); a translation unit may override it for
+ * itself by defining DLOG_MODULE_LEVEL before including this header. Calls
+ * at disabled levels compile to nothing: the level check is a compile-time
+ * constant, so neither the call nor its argument expressions survive, which
+ * keeps verbose instrumentation free in production images.
+ */
+#define DLOG_LEVEL_NONE 0
+#define DLOG_LEVEL_ERROR 1
+#define DLOG_LEVEL_NOTICE 2
+#define DLOG_LEVEL_INFO 3
+#define DLOG_LEVEL_VERBOSE 4
+
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL DLOG_LEVEL_INFO
+#endif
+
+#ifdef DLOG_MODULE_LEVEL
+#define DLOG_ACTIVE_LEVEL DLOG_MODULE_LEVEL
+#else
+#define DLOG_ACTIVE_LEVEL DLOG_LEVEL
+#endif
+
+#define dlog_at_level(level, ...)                   \
+	do {                                        \
+		if ((level) <= DLOG_ACTIVE_LEVEL) { \
+			dlog(__VA_ARGS__);          \
+		}                                   \
+	} while (0)
+
+#define dlog_error(...) dlog_at_level(DLOG_LEVEL_ERROR, __VA_ARGS__)
+#define dlog_notice(...) dlog_at_level(DLOG_LEVEL_NOTICE, __VA_ARGS__)
+#define dlog_info(...) dlog_at_level(DLOG_LEVEL_INFO, __VA_ARGS__)
+#define dlog_verbose(...) dlog_at_level(DLOG_LEVEL_VERBOSE, __VA_ARGS__)
+
+/** First byte of a binary log record in the log buffer. */
+#define DLOG_BINARY_MAGIC 0xb1
+
+/** The maximum number of raw argument words recorded per binary log entry. */
+#define DLOG_BINARY_MAX_ARGS 8
+
 extern size_t dlog_buffer_offset;
 extern char dlog_buffer[];
 
+/**
+ * Switches dlog to binary mode: log calls record the format string pointer
+ * and raw argument words into the log buffer instead of formatting at call
+ * time. The records are formatted offline by a host-side decoder.
+ */
+void dlog_enable_binary(void);
+
 #if DEBUG
 void dlog_enable_lock(void);
 void dlog(const char *fmt, ...);
@@ -292,3 +292,57 @@ static inline void io_write64_array_mb(io64_array_t io, size_t n, uint64_t v)
 	data_sync_barrier();
 	io_write64_array(io, n, v);
 }
+
+/*
+ * Relaxed accessors and batch barriers.
+ *
+ * The plain io_read and io_write accessors are already barrier-free; the
+ * _relaxed aliases make that intent explicit at call sites. A multi-register
+ * device sequence brackets its accesses with io_batch_begin() (orders prior
+ * memory accesses before the batch) and io_batch_end() (makes the whole
+ * batch observable before execution continues), paying two barriers per
+ * sequence instead of one per access. Accesses to the same peripheral are
+ * ordered by the device memory type in between.
+ */
+
+static inline uint8_t io_read8_relaxed(io8_t io)
+{
+	return io_read8(io);
+}
+
+static inline uint32_t io_read32_relaxed(io32_t io)
+{
+	return io_read32(io);
+}
+
+static inline uint64_t io_read64_relaxed(io64_t io)
+{
+	return io_read64(io);
+}
+
+static inline void io_write8_relaxed(io8_t io, uint8_t v)
+{
+	io_write8(io, v);
+}
+
+static inline void io_write32_relaxed(io32_t io, uint32_t v)
+{
+	io_write32(io, v);
+}
+
+static inline void io_write64_relaxed(io64_t io, uint64_t v)
+{
+	io_write64(io, v);
+}
+
+/** Opens a batch of relaxed IO accesses. */
+static inline void io_batch_begin(void)
+{
+	data_sync_barrier();
+}
+
+/** Closes a batch of relaxed IO accesses. */
+static inline void io_batch_end(void)
+{
+	data_sync_barrier();
+}
@@ -27,6 +27,8 @@ paddr_t layout_rodata_end(void);
 paddr_t layout_data_begin(void);
 paddr_t layout_data_end(void);
 
+paddr_t layout_init_begin(void);
+paddr_t layout_init_end(void);
 paddr_t layout_initrd_begin(void);
 paddr_t layout_initrd_end(void);
 
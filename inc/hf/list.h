@@ -66,3 +66,23 @@ static inline void list_remove(struct list_entry *e)
 	e->next->prev = e->prev;
 	list_init(e);
 }
+
+/**
+ * Moves the whole content of list `from` to the end of list `to` in O(1),
+ * leaving `from` empty. Draining a list this way costs one pointer swap
+ * instead of a pop per entry under the lock.
+ */
+static inline void list_splice_init(struct list_entry *from,
+				    struct list_entry *to)
+{
+	if (list_empty(from)) {
+		return;
+	}
+
+	from->next->prev = to->prev;
+	from->prev->next = to;
+	to->prev->next = from->next;
+	to->prev = from->prev;
+
+	list_init(from);
+}
@@ -27,4 +27,10 @@ struct memiter {
 
 void memiter_init(struct memiter *it, const void *data, size_t size);
 bool memiter_parse_str(struct memiter *it, struct memiter *str);
+/**
+ * Claims n bytes as a directly accessible window after one bounds check;
+ * returns NULL if the iterator doesn't have that many bytes left.
+ */
+const void *memiter_claim(struct memiter *it, size_t n);
+
 bool memiter_iseq(const struct memiter *it, const char *str);
@@ -74,6 +74,14 @@
 #define MM_FLAG_UNMAP   0x02
 #define MM_FLAG_STAGE1  0x04
 
+/*
+ * Batch TLB invalidation: accumulate the range affected by the update and
+ * issue a single ranged invalidation (or a full invalidation when the range
+ * is large) once the update is complete, instead of invalidating during the
+ * walk.
+ */
+#define MM_FLAG_TLBI_BATCH 0x08
+
 /* clang-format on */
 
 struct mm_page_table {
@@ -87,6 +95,27 @@ static_assert(alignof(struct mm_page_table) == PAGE_SIZE,
 struct mm_ptable {
 	/** Address of the root of the page table. */
 	paddr_t root;
+
+	/**
+	 * Index of the next root-level entry to be visited by incremental
+	 * defrag.
+	 */
+	size_t defrag_cursor;
+
+	/**
+	 * Walk memoization cursor: the deepest table page the last map
+	 * operation fit under, the level of its entries and its address span.
+	 */
+	uintptr_t cursor_table;
+	uint8_t cursor_level;
+	uintvaddr_t cursor_span_begin;
+	uintvaddr_t cursor_span_end;
+
+	/**
+	 * Sequence counter protecting the lock-free read path. It is odd while
+	 * a writer is updating the table.
+	 */
+	size_t seq;
 };
 
 /** The type of addresses stored in the page table. */
@@ -108,6 +137,7 @@ bool mm_vm_unmap(struct mm_ptable *t, paddr_t begin, paddr_t end,
 		 struct mpool *ppool);
 bool mm_vm_unmap_hypervisor(struct mm_ptable *t, struct mpool *ppool);
 void mm_vm_defrag(struct mm_ptable *t, struct mpool *ppool);
+bool mm_vm_defrag_incremental(struct mm_ptable *t, struct mpool *ppool);
 bool mm_vm_get_mode(struct mm_ptable *t, ipaddr_t begin, ipaddr_t end,
 		    int *mode);
 
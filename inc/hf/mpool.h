@@ -16,15 +16,50 @@
 
 #pragma once
 
+#include <stdalign.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "hf/spinlock.h"
 
+/** The number of free pages kept in each per-CPU front-end cache. */
+#define MPOOL_CACHE_SIZE 8
+
+/**
+ * Per-CPU front-end cache of free pages. The common alloc/free path only
+ * touches the cache of the executing CPU, so its lock is effectively
+ * uncontended.
+ */
+struct mpool_cache {
+	/** Each per-CPU cache sits on its own cache line. */
+	alignas(CACHE_LINE_SIZE) struct spinlock lock;
+	void *pages[MPOOL_CACHE_SIZE];
+	size_t len;
+};
+
 struct mpool {
-	struct spinlock lock;
+	struct ticket_lock lock;
 	struct mpool_chunk *chunk_list;
-	struct mpool_entry *entry_list;
+
+	/** Observability counters; see mpool_stat(). */
+	struct {
+		atomic_uint_fast64_t allocs;
+		atomic_uint_fast64_t frees;
+		atomic_uint_fast64_t fallback_allocs;
+		atomic_uint_fast64_t free_low_watermark;
+	} stats;
+
+	/**
+	 * Lock-free stack of free single pages: the head word packs the page
+	 * address (low 48 bits) with an ABA tag (high 16 bits); the count
+	 * beside it is advisory. The ticket lock above only covers chunk
+	 * carving.
+	 */
+	atomic_uint_fast64_t free_stack;
+	atomic_size_t free_count;
+
+	struct mpool_cache caches[MAX_CPUS];
 	struct mpool *fallback;
 };
 
@@ -33,6 +68,10 @@ void mpool_init_from(struct mpool *p, struct mpool *from);
 void mpool_init_with_fallback(struct mpool *p, struct mpool *fallback);
 void mpool_fini(struct mpool *p);
 bool mpool_add_chunk(struct mpool *p, void *begin, size_t size);
+bool mpool_add_chunk_tagged(struct mpool *p, void *begin, size_t size,
+			    uint32_t locality);
 void *mpool_alloc(struct mpool *p);
+size_t mpool_alloc_bulk(struct mpool *p, size_t n, void **out);
 void *mpool_alloc_contiguous(struct mpool *p, size_t count, size_t align);
 void mpool_free(struct mpool *p, void *ptr);
+uint64_t mpool_stat(const struct mpool *p, uint32_t field);
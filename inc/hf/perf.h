@@ -0,0 +1,58 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hf/cpu.h"
+
+#include "vmapi/hf/types.h"
+
+/* Keep macro alignment */
+/* clang-format off */
+
+/*
+ * ABI call classes tracked separately by the latency instrumentation. Keep in
+ * sync with hfo2/src/perf.rs.
+ */
+#define PERF_CALL_VCPU_RUN     0
+#define PERF_CALL_MSG_SEND     1
+#define PERF_CALL_SHARE_MEMORY 2
+#define PERF_CALL_OTHER        3
+#define PERF_NUM_CALLS         4
+
+/*
+ * Histogram buckets: bucket i counts calls that took [2^i, 2^(i+1)) timer
+ * cycles, with the last bucket open-ended.
+ */
+#define PERF_NUM_BUCKETS 16
+
+/* clang-format on */
+
+/**
+ * Records one completed ABI call of the given class, made by the given VM,
+ * that took the given number of timer cycles.
+ */
+void perf_record(size_t call, spci_vm_id_t vm_id, uint64_t cycles);
+
+/**
+ * Reads one histogram bucket, summed over all CPUs. Only the primary VM is
+ * allowed to read the statistics. The argument packs the query: bits [15:0]
+ * the VM ID, bits [23:16] the call class and bits [31:24] the bucket index.
+ */
+int64_t api_perf_read(uint64_t arg, const struct vcpu *current);
@@ -28,3 +28,22 @@ void plat_console_mm_init(struct mm_stage1_locked stage1_locked,
 
 /** Puts a single character on the console. */
 void plat_console_putchar(char c);
+
+/**
+ * Switches the console to buffered output: putchar completes at memory speed
+ * into a TX ring which is drained as the hardware FIFO empties. Drivers
+ * without buffering support may implement this as a no-op.
+ */
+void plat_console_enable_buffered(void);
+
+/**
+ * Drains any buffered output to the hardware, spinning until it is out. Also
+ * reverts to synchronous output, so it is safe to call from the panic path.
+ */
+void plat_console_flush_sync(void);
+
+/**
+ * Drains as much buffered output to the hardware as currently fits, without
+ * spinning. Called from the TX interrupt and from scheduling slack.
+ */
+void plat_console_drain(void);
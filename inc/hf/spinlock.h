@@ -30,3 +30,39 @@ struct spinlock {
 void sl_init(struct spinlock *l);
 void sl_lock(struct spinlock *l);
 void sl_unlock(struct spinlock *l);
+
+/**
+ * A fair FIFO ticket lock. Contenders draw a ticket and spin reading only the
+ * owner counter, so handover happens in arrival order and the cache line is
+ * not ping-ponged by test-and-set retries. Used for locks that see real
+ * contention, such as the VM locks and the page pool.
+ */
+struct ticket_lock {
+	atomic_ushort next;
+	atomic_ushort owner;
+};
+
+#define TICKET_LOCK_INIT                                    \
+	{                                                   \
+		.next = ATOMIC_VAR_INIT(0),                 \
+		.owner = ATOMIC_VAR_INIT(0)                 \
+	}
+
+void tl_init(struct ticket_lock *l);
+void tl_lock(struct ticket_lock *l);
+void tl_unlock(struct ticket_lock *l);
+
+/**
+ * A writer-preferring spinning read-write lock: the writer holds the low bit
+ * of the state, each reader adds two. Read-mostly paths take the read side so
+ * they no longer serialize behind each other; used for the VM locks.
+ */
+struct rwlock {
+	atomic_size_t state;
+};
+
+void rw_init(struct rwlock *l);
+void rw_read_lock(struct rwlock *l);
+void rw_read_unlock(struct rwlock *l);
+void rw_write_lock(struct rwlock *l);
+void rw_write_unlock(struct rwlock *l);
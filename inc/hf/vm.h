@@ -51,17 +51,74 @@ struct wait_entry {
 	struct list_entry wait_links;
 
 	/**
-	 * Links used to add entry to a VM's ready_list. This is protected by
-	 * the waiting VM's lock.
+	 * Link in the waiting VM's lock-free MPSC ready stack (0 when not
+	 * linked), pushed with a CAS from any core.
 	 */
-	struct list_entry ready_links;
+	atomic_uintptr_t ready_next;
+
+	/** Guards against double-queuing on the ready stack. */
+	atomic_bool in_ready;
 };
 
+/** The capacity of the pending-message ring of each mailbox. */
+#define MAILBOX_QUEUE_SIZE 4
+
 struct mailbox {
-	enum mailbox_state state;
+	/**
+	 * The state word is atomic so single-word transitions (read
+	 * acknowledgement, emptiness checks) don't need the VM lock; values
+	 * are from enum mailbox_state.
+	 */
+	atomic_uint state;
+
+	/**
+	 * The size in bytes of each of the send and receive buffers; a
+	 * multiple of the page size, negotiated at configure time.
+	 */
+	size_t size;
 	struct spci_message *recv;
 	const struct spci_message *send;
 
+	/**
+	 * Configuration generation: 0 until the buffers are configured,
+	 * bumped (release) once the pointers and size are written, so they
+	 * may be read lock-free afterwards.
+	 */
+	atomic_uint generation;
+
+	/**
+	 * Ring of messages accepted while the mailbox was busy, oldest first.
+	 * Slots are pages allocated from the page pool on demand and freed
+	 * once the message is moved into the receive buffer. This is protected
+	 * by the VM lock.
+	 */
+	struct spci_message *queue[MAILBOX_QUEUE_SIZE];
+	size_t queue_head;
+	size_t queue_len;
+
+	/**
+	 * The sender page currently mapped read-only into this VM for a
+	 * zero-copy message, or NULL. It is unmapped again when the mailbox
+	 * is cleared. This is protected by the VM lock.
+	 */
+	const struct spci_message *zero_copy_page;
+
+	/**
+	 * Reserved priority slot: one urgent message accepted while the
+	 * normal buffer was occupied, delivered ahead of the pending ring.
+	 * NULL when empty; protected by the VM lock.
+	 */
+	struct spci_message *urgent_slot;
+
+	/**
+	 * State of an in-flight streamed transfer into this mailbox: the
+	 * source VM, the cursor into its buffer and the bytes still to
+	 * deliver. This is protected by the VM lock.
+	 */
+	spci_vm_id_t stream_src_vm;
+	size_t stream_cursor;
+	size_t stream_remaining;
+
 	/**
 	 * List of wait_entry structs representing VMs that want to be notified
 	 * when the mailbox becomes writable. Once the mailbox does become
@@ -71,10 +128,13 @@ struct mailbox {
 	struct list_entry waiter_list;
 
 	/**
-	 * List of wait_entry structs representing VMs whose mailboxes became
-	 * writable since the owner of the mailbox registers for notification.
+	 * Lock-free MPSC stack of wait_entry structs representing VMs whose
+	 * mailboxes became writable since the owner registered for
+	 * notification, plus the owner's local remainder of the last
+	 * take-all.
 	 */
-	struct list_entry ready_list;
+	atomic_uintptr_t ready_head;
+	uintptr_t ready_stash;
 };
 
 /**
@@ -97,3 +157,11 @@ struct vcpu *vm_get_vcpu(struct vm *vm, spci_vcpu_index_t vcpu_index);
 spci_vm_id_t vm_get_id(struct vm *vm);
 struct arch_vm *vm_get_arch(struct vm *vm);
 spci_vcpu_count_t vm_get_vcpu_count(struct vm *vm);
+const struct spci_message *vm_get_send_ptr(struct vm *vm);
+uint32_t vm_get_features(const struct vm *vm);
+bool vm_get_dedicated_cores(const struct vm *vm);
+bool vm_publish_multicall_results(const struct vm *vm, const int64_t *results,
+				  size_t count);
+struct spci_message *vm_try_reserve_recv(const struct vm *vm);
+void vm_release_recv(const struct vm *vm);
+struct spci_message *vm_get_empty_recv_ptr(struct vm *vm);
@@ -94,6 +94,7 @@ struct hf_vcpu_run_return {
 		} wake_up;
 		struct {
 			spci_vm_id_t vm_id;
+			uint32_t size;
 		} message;
 		struct {
 			uint64_t ns;
@@ -130,6 +131,14 @@ static inline struct hf_vcpu_run_return hf_vcpu_run_return_decode(uint64_t res)
 		.code = (enum hf_vcpu_run_code)(res & 0xff),
 	};
 
+	/*
+	 * The dominant cases carry no data: preempted and yield decode to the
+	 * raw constants 0 and 1, so skip the switch entirely for them.
+	 */
+	if (res <= HF_VCPU_RUN_YIELD) {
+		return ret;
+	}
+
 	/* Some codes include more data. */
 	switch (ret.code) {
 	case HF_VCPU_RUN_WAKE_UP:
@@ -138,9 +147,15 @@ static inline struct hf_vcpu_run_return hf_vcpu_run_return_decode(uint64_t res)
 		break;
 	case HF_VCPU_RUN_MESSAGE:
 		ret.message.vm_id = res >> 8;
+		ret.message.size = res >> 32;
 		break;
+	case HF_VCPU_RUN_YIELD:
 	case HF_VCPU_RUN_WAIT_FOR_INTERRUPT:
 	case HF_VCPU_RUN_WAIT_FOR_MESSAGE:
+		/*
+		 * For yield, a nonzero value hints that re-running the vCPU
+		 * earlier than this is pointless.
+		 */
 		ret.sleep.ns = res >> 8;
 		break;
 	default:
@@ -149,3 +164,13 @@ static inline struct hf_vcpu_run_return hf_vcpu_run_return_decode(uint64_t res)
 
 	return ret;
 }
+
+/**
+ * A single entry of an HF_SMC_BATCH request. The caller places an array of
+ * these in its send buffer; the results are written to its receive buffer as
+ * an array of four-register tuples in the same order.
+ */
+struct hf_smc_batch_call {
+	uint64_t func;
+	uint64_t args[6];
+};
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Batched submission interface between Linux userspace and the Hafnium
+ * kernel driver.
+ *
+ * Driving the hypervisor one syscall+hypercall at a time caps the call rate
+ * the Linux-side tests can generate well below the levels needed to
+ * reproduce production contention. With this interface, userspace fills an
+ * array of descriptors and submits them in one ioctl; the driver walks the
+ * array in kernel space, issuing one hypercall per descriptor and writing
+ * each result back, so the syscall cost is amortized over the whole batch.
+ *
+ * This header is the shared ABI: the driver module (maintained out of tree,
+ * see driver/BUILD.gn) and the tests in test/linux both include it.
+ */
+
+/** Maximum number of descriptors per submission. */
+#define HF_BATCH_MAX 64
+
+/** Operations a descriptor can request. */
+#define HF_BATCH_OP_VCPU_RUN 0
+#define HF_BATCH_OP_MSG_SEND 1
+
+/**
+ * One submitted operation. For HF_BATCH_OP_VCPU_RUN, `vm_id`/`vcpu` name the
+ * target and `arg` is unused. For HF_BATCH_OP_MSG_SEND, the message must
+ * already be in the sender's TX buffer and `arg` carries the send
+ * attributes; `vm_id`/`vcpu` are unused (the target is in the message
+ * header).
+ */
+struct hf_batch_desc {
+	uint16_t op;
+	uint16_t vm_id;
+	uint16_t vcpu;
+	uint16_t reserved;
+	uint64_t arg;
+};
+
+/**
+ * A whole submission: `count` descriptors in, `completed` results out. The
+ * driver stops early if a descriptor is malformed; `completed` tells
+ * userspace how far it got, and `result[i]` holds the raw return of each
+ * performed call.
+ */
+struct hf_batch {
+	uint32_t count;
+	uint32_t completed;
+	struct hf_batch_desc desc[HF_BATCH_MAX];
+	int64_t result[HF_BATCH_MAX];
+};
+
+/**
+ * The ioctl request, when the including environment provides the encoding
+ * macros (the driver and Linux userspace both do).
+ */
+#ifdef _IOWR
+#define HF_BATCH_IOCTL _IOWR(0xb6, 1, struct hf_batch)
+#endif
@@ -36,6 +36,34 @@
 #define HF_INTERRUPT_GET        0xff0c
 #define HF_INTERRUPT_INJECT     0xff0d
 #define HF_SHARE_MEMORY         0xff0e
+#define HF_PERF_READ            0xff0f
+#define HF_SMC_BATCH            0xff10
+#define HF_SHARE_MEMORY_REVOKE  0xff11
+#define HF_MAILBOX_WRITABLE_NOTIFY 0xff12
+#define HF_DIRTY_TRACK          0xff13
+#define HF_DIRTY_LOG_READ       0xff14
+#define HF_LOCK_PROFILE_READ    0xff15
+#define HF_DEBUG_LOG_BUFFER     0xff16
+#define HF_INTERRUPT_STATUS_PAGE 0xff17
+#define HF_PMU_READ             0xff18
+#define HF_VCPU_SLEEP_INFO      0xff19
+#define HF_INTERRUPT_ENABLE_BULK 0xff1a
+#define HF_VCPU_CYCLES          0xff1b
+#define HF_BOOT_TRACE           0xff1c
+#define HF_THROTTLE_SET         0xff1d
+#define HF_MAILBOX_WRITABLE_GET_BULK 0xff1e
+#define HF_VM_RESET             0xff1f
+#define HF_WSET_SAMPLE          0xff20
+#define HF_VCPU_TOKEN           0xff21
+#define HF_VCPU_RUN_TOKEN       0xff22
+#define HF_VCPU_TELEM_PAGE      0xff23
+#define HF_MPOOL_STAT           0xff24
+#define HF_MULTICALL            0xff25
+#define HF_VM_SCHED_ATTRS       0xff26
+#define HF_VM_TELEMETRY         0xff27
+#define HF_PAGE_GRANT           0xff28
+#define HF_VM_CLONE             0xff29
+#define HF_IDLE_RESIDENCY       0xff2a
 
 /* This matches what Trusty and its ATF module currently use. */
 #define HF_DEBUG_LOG            0xbd000000
@@ -93,6 +121,16 @@ static inline int64_t spci_yield(void)
 	return hf_call(SPCI_YIELD_32, 0, 0, 0);
 }
 
+/**
+ * Like spci_yield, but hints that re-running this vCPU within `deadline_ns`
+ * nanoseconds is pointless; the scheduler receives the hint in the yield
+ * run-return's sleep value.
+ */
+static inline int64_t spci_yield_deadline(uint64_t deadline_ns)
+{
+	return hf_call(SPCI_YIELD_32, deadline_ns, 0, 0);
+}
+
 /**
  * Configures the pages to send/receive data through. The pages must not be
  * shared.
@@ -108,6 +146,18 @@ static inline int64_t hf_vm_configure(hf_ipaddr_t send, hf_ipaddr_t recv)
 	return hf_call(HF_VM_CONFIGURE, send, recv, 0);
 }
 
+/**
+ * Like hf_vm_configure, but negotiates `pages` pages (up to 16) for each of
+ * the send and receive buffers, raising the per-trap payload limit
+ * accordingly. The buffers must be page aligned, contiguous and must not
+ * overlap.
+ */
+static inline int64_t hf_vm_configure_pages(hf_ipaddr_t send, hf_ipaddr_t recv,
+					    size_t pages)
+{
+	return hf_call(HF_VM_CONFIGURE, send, recv, pages);
+}
+
 /**
  * Copies data from the sender's send buffer to the recipient's receive buffer.
  *
@@ -124,6 +174,376 @@ static inline int64_t spci_msg_send(uint32_t attributes)
 	return hf_call(SPCI_MSG_SEND_32, attributes, 0, 0);
 }
 
+/**
+ * Registers a read-only per-vCPU interrupt status page mirroring the pending
+ * interrupt state (see struct hf_interrupt_status_page), so the guest only
+ * traps into hf_interrupt_get when the page shows pending work.
+ *
+ * Returns the IPA at which the page is mapped, or -1 on failure. The hint
+ * argument must be page aligned; the current implementation identity-maps
+ * the page and returns its actual address.
+ */
+static inline int64_t hf_interrupt_status_page(hf_ipaddr_t ipa)
+{
+	return hf_call(HF_INTERRUPT_STATUS_PAGE, ipa, 0, 0);
+}
+
+/**
+ * Splices up to `count` bytes accumulated in the caller's send buffer into
+ * the hypervisor debug log with a single trap, instead of one hf_debug_log
+ * trap per character.
+ *
+ * Returns the number of bytes consumed, or -1 on failure.
+ */
+static inline int64_t hf_debug_log_buffer(size_t count)
+{
+	return hf_call(HF_DEBUG_LOG_BUFFER, count, 0, 0);
+}
+
+/**
+ * Reads one field of the hypervisor's lock contention profile (built with
+ * the lock_profile feature): `field` is 0 for the lock address, 1 for
+ * acquisitions, 2 for spin iterations, 3 for hold cycles. Only the primary
+ * VM may read.
+ */
+static inline int64_t hf_lock_profile_read(uint8_t cpu, uint8_t slot,
+					   uint8_t field)
+{
+	return hf_call(HF_LOCK_PROFILE_READ,
+		       (uint64_t)cpu << 16 | (uint64_t)field << 8 | slot, 0,
+		       0);
+}
+
+/**
+ * Enables or disables stage-2 dirty page tracking for the given VM. Only the
+ * primary VM may call this.
+ */
+static inline int64_t hf_dirty_track(spci_vm_id_t vm_id, bool enable)
+{
+	return hf_call(HF_DIRTY_TRACK, vm_id, enable, 0);
+}
+
+/**
+ * Pops one entry from the dirty ring of the given vCPU. Returns the
+ * page-aligned IPA of a dirtied page, -2 if the ring overflowed (every page
+ * must then be considered dirty), or -1 if the ring is empty. Only the
+ * primary VM may call this.
+ */
+static inline int64_t hf_dirty_log_read(spci_vm_id_t vm_id,
+					spci_vcpu_index_t vcpu_idx)
+{
+	return hf_call(HF_DIRTY_LOG_READ, vm_id, vcpu_idx, 0);
+}
+
+/**
+ * Opts the calling VM in or out of direct mailbox-writable notification: when
+ * enabled, the hypervisor injects HF_MAILBOX_WRITABLE_INTID into the VM's
+ * first vCPU as soon as a mailbox it is waiting on becomes writable, cutting
+ * the primary VM's waiter polling out of the handoff.
+ */
+static inline int64_t hf_mailbox_writable_notify(bool enable)
+{
+	return hf_call(HF_MAILBOX_WRITABLE_NOTIFY, enable, 0, 0);
+}
+
+/**
+ * Revokes a memory share previously established with hf_share_memory(), by
+ * the handle that call returned. The recorded extent is restored to its
+ * original mode in both VMs. Only the sharing VM may revoke.
+ *
+ * Returns 0 on success, or -1 if the handle is unknown or the caller did not
+ * establish the share.
+ */
+static inline int64_t hf_share_memory_revoke(uint32_t handle)
+{
+	return hf_call(HF_SHARE_MEMORY_REVOKE, handle, 0, 0);
+}
+
+/**
+ * Submits a batch of `count` SMCs previously written to the caller's send
+ * buffer as an array of struct hf_smc_batch_call, receiving all results in
+ * the receive buffer with a single trap. The mailbox must be empty and must
+ * not receive a message while the batch runs.
+ *
+ * Returns the number of calls executed, or -1 on failure.
+ */
+static inline int64_t hf_smc_batch(uint64_t count)
+{
+	return hf_call(HF_SMC_BATCH, count, 0, 0);
+}
+
+/**
+ * Reads one counter of the hypervisor page pool's statistics: 0 allocs,
+ * 1 frees, 2 fallback promotions, 3 current free pages, 4 free-page low
+ * watermark. Only the primary VM may read.
+ */
+static inline int64_t hf_mpool_stat(uint32_t field)
+{
+	return hf_call(HF_MPOOL_STAT, field, 0, 0);
+}
+
+/**
+ * Registers a read-only per-vCPU telemetry page (struct hf_vcpu_telemetry)
+ * carrying cumulative run cycles, steal cycles and preemption counts,
+ * updated by the world-switch path. Returns the IPA the page is mapped at,
+ * or -1 on failure.
+ */
+static inline int64_t hf_vcpu_telem_page(void)
+{
+	return hf_call(HF_VCPU_TELEM_PAGE, 0, 0, 0);
+}
+
+/**
+ * Executes up to HF_MULTICALL_MAX hypercalls described by an array of
+ * struct hf_multicall_entry at the start of the send buffer, in one trap.
+ * Per-call results are written as int64_t values at the start of the
+ * receive buffer, which must be empty. Only HF_* hypercalls may be batched;
+ * a call that switches vCPUs (e.g. HF_VCPU_RUN) ends the batch after being
+ * performed.
+ *
+ * Returns the number of calls executed, or -1 if `count` is out of range or
+ * either buffer is unavailable.
+ */
+static inline int64_t hf_multicall(size_t count)
+{
+	return hf_call(HF_MULTICALL, count, 0, 0);
+}
+
+/**
+ * Returns the manifest scheduling attributes of a VM, packed as
+ * affinity[31:0] | priority[39:32] | dedicated[40], or -1 if the VM does not
+ * exist or the caller may not query it. The primary VM's scheduler uses this
+ * to enforce pinned placement without a userspace configuration channel.
+ */
+static inline int64_t hf_vm_sched_attrs(spci_vm_id_t vm_id)
+{
+	return hf_call(HF_VM_SCHED_ATTRS, vm_id, 0, 0);
+}
+
+/**
+ * Reads a per-VM telemetry counter: field 0 counts stage-2 faults, 1 TLB
+ * invalidations issued on the VM's behalf, 2 defrag passes, 3 sends that
+ * found its mailbox full. Primary VM only; returns -1 on a bad VM or field.
+ */
+static inline int64_t hf_vm_telemetry(spci_vm_id_t vm_id, size_t field)
+{
+	return hf_call(HF_VM_TELEMETRY, vm_id, field, 0);
+}
+
+/**
+ * Lends a single page to the target VM, the whole request encoded in
+ * registers: the page address with the access bits in its low bits
+ * (bit 0 = R, bit 1 = W, bit 2 = X). No TX-page descriptor is parsed, so
+ * virtio-style drivers can grant pages at high frequency; multi-constituent
+ * shares keep the descriptor flow. Returns an SPCI status code.
+ */
+static inline int64_t hf_page_grant(hf_ipaddr_t page, uint64_t access,
+				    spci_vm_id_t target)
+{
+	return hf_call(HF_PAGE_GRANT, page | access, target, 0);
+}
+
+/**
+ * Clones a template VM: the new VM gets the same vCPU count and the
+ * template's image mapped read-only in place, costing no copies. A nonzero
+ * `entry` readies vCPU 0 to boot there with `arg` in x0 (typically after
+ * the caller donates writable memory through the share hypercalls); with
+ * entry 0 every vCPU stays OFF. Primary VM only; returns the new vm-id
+ * or -1.
+ */
+static inline int64_t hf_vm_clone(spci_vm_id_t template_id, hf_ipaddr_t entry,
+				  uint64_t arg)
+{
+	return hf_call(HF_VM_CLONE, template_id, entry, arg);
+}
+
+/**
+ * Reads per-CPU idle statistics of the in-hypervisor scheduling tier:
+ * field 0 is idle residency in cycles, field 1 the wakeups that found work.
+ * Primary VM only.
+ */
+static inline int64_t hf_idle_residency(size_t cpu_index, size_t field)
+{
+	return hf_call(HF_IDLE_RESIDENCY, cpu_index, field, 0);
+}
+
+/**
+ * Obtains an opaque run token for (vm_id, vcpu_idx), verified with a single
+ * tag compare by hf_vcpu_run_token instead of per-call id validation.
+ * Returns -1 on failure. Primary only.
+ */
+static inline int64_t hf_vcpu_token(spci_vm_id_t vm_id,
+				    spci_vcpu_index_t vcpu_idx)
+{
+	return hf_call(HF_VCPU_TOKEN, vm_id, vcpu_idx, 0);
+}
+
+/**
+ * Runs the vCPU identified by a token from hf_vcpu_token.
+ */
+static inline struct hf_vcpu_run_return hf_vcpu_run_token(uint64_t token)
+{
+	return hf_vcpu_run_return_decode(
+		hf_call(HF_VCPU_RUN_TOKEN, token, 0, 0));
+}
+
+/**
+ * Working-set sampling over a VM's stage-2 range: with `harvest` false,
+ * clears the access flags so hardware repopulates them; with `harvest` true,
+ * writes a one-bit-per-page accessed bitmap into the caller's empty receive
+ * buffer. Returns the number of pages covered, or -1 on failure. Only the
+ * primary VM may call this.
+ */
+static inline int64_t hf_wset_sample(spci_vm_id_t vm_id, bool harvest,
+				     hf_ipaddr_t begin, size_t size)
+{
+	return hf_call(HF_WSET_SAMPLE, (uint64_t)harvest << 16 | vm_id, begin,
+		       size);
+}
+
+/**
+ * Resets a single secondary VM in place for crash recovery, leaving all
+ * other VMs running: vCPUs are re-initialised, the stage-2 table rebuilt,
+ * the mailbox cleared, and memory re-imaged lazily from the retained
+ * ramdisk. Only the primary VM may call this; fails if any of the VM's
+ * vCPUs is currently running.
+ */
+static inline int64_t hf_vm_reset(spci_vm_id_t vm_id)
+{
+	return hf_call(HF_VM_RESET, vm_id, 0, 0);
+}
+
+/**
+ * Drains the caller's entire writable-notification list in one trap: the IDs
+ * of all VMs whose mailboxes became writable are written into the caller's
+ * empty receive buffer as 16-bit VM IDs. Returns the count, or -1 on
+ * failure. Replaces a loop of hf_mailbox_writable_get calls.
+ */
+static inline int64_t hf_mailbox_writable_get_bulk(void)
+{
+	return hf_call(HF_MAILBOX_WRITABLE_GET_BULK, 0, 0, 0);
+}
+
+/**
+ * Sets the hypercall rate limit of a (VM, call class) token bucket: `rate`
+ * calls per second with a one-second burst, 0 to disable. `call` is a
+ * PERF_CALL_* class. Throttled senders see SPCI_RETRY (message sends) or -1
+ * (memory shares). Only the primary VM may configure limits.
+ */
+static inline int64_t hf_throttle_set(spci_vm_id_t vm_id, uint8_t call,
+				      uint64_t rate)
+{
+	return hf_call(HF_THROTTLE_SET, (uint64_t)call << 16 | vm_id, rate, 0);
+}
+
+/**
+ * Reads the counter stamp of the given boot phase index from the boot
+ * timeline, or -1 when out of range. Only the primary VM may read. Phase
+ * names are printed to the log at boot.
+ */
+static inline int64_t hf_boot_trace(size_t index)
+{
+	return hf_call(HF_BOOT_TRACE, index, 0, 0);
+}
+
+/**
+ * Writes the per-vCPU consumed-cycle vector of the given VM (one 64-bit
+ * monotonic counter per vCPU) into the caller's empty receive buffer.
+ * Returns the number of vCPUs reported, or -1 on failure. Only the primary
+ * VM may call this.
+ */
+static inline int64_t hf_vcpu_cycles(spci_vm_id_t vm_id)
+{
+	return hf_call(HF_VCPU_CYCLES, vm_id, 0, 0);
+}
+
+/**
+ * Applies a batch of interrupt enable/disable changes in one trap. The send
+ * buffer holds two HF_NUM_INTIDS-bit bitmaps: the mask of interrupt IDs to
+ * touch, then the new enable value for each masked ID.
+ *
+ * Returns the number of interrupts touched, or -1 on failure.
+ */
+static inline int64_t hf_interrupt_enable_bulk(void)
+{
+	return hf_call(HF_INTERRUPT_ENABLE_BULK, 0, 0, 0);
+}
+
+/**
+ * Writes a snapshot of the given VM's sleeping vCPUs into the caller's empty
+ * receive buffer: a 64-bit bitmap of blocked vCPUs followed by one 64-bit
+ * deadline (ns, HF_SLEEP_INDEFINITE when no timer is armed) per vCPU.
+ * Returns the number of vCPUs reported, or -1 on failure. Only the primary
+ * VM may call this.
+ */
+static inline int64_t hf_vcpu_sleep_info(spci_vm_id_t vm_id)
+{
+	return hf_call(HF_VCPU_SLEEP_INFO, vm_id, 0, 0);
+}
+
+/**
+ * Reads (and optionally resets) one accumulated hypervisor PMU value:
+ * `counter` 0 is cycles, 1 and 2 the programmed events; `call` is a
+ * PERF_CALL_* class. Only the primary VM may read.
+ */
+static inline int64_t hf_pmu_read(uint8_t cpu, uint8_t call, uint8_t counter,
+				  bool reset)
+{
+	return hf_call(HF_PMU_READ,
+		       (uint64_t)reset << 24 | (uint64_t)cpu << 16 |
+			       (uint64_t)counter << 8 | call,
+		       0, 0);
+}
+
+/**
+ * Reads one bucket of the hypervisor's hypercall latency histograms, summed
+ * over all CPUs. Only the primary VM may call this. `call` is one of the
+ * PERF_CALL_* classes and `bucket` indexes the log2 cycle histogram.
+ *
+ * Returns the bucket count, or -1 on an invalid query.
+ */
+static inline int64_t hf_perf_read(spci_vm_id_t vm_id, uint8_t call,
+				   uint8_t bucket)
+{
+	return hf_call(HF_PERF_READ,
+		       (uint64_t)bucket << 24 | (uint64_t)call << 16 | vm_id,
+		       0, 0);
+}
+
+/**
+ * Advertises the calling VM's fast-path capabilities (SPCI_FEATURE_* bits)
+ * to the hypervisor. Returns the granted subset; fast paths such as direct
+ * messages are only used with VMs that negotiated them.
+ */
+static inline int64_t spci_features(uint32_t requested)
+{
+	return hf_call(SPCI_FEATURES_32, requested, 0, 0);
+}
+
+/**
+ * Sends a short register-based message directly to a vCPU of the target VM,
+ * bypassing the mailbox. The target vCPU must be blocked waiting for a
+ * message; it wakes up with the payload in its return registers and the
+ * sender's ID (with the direct-delivery marker, bit 16, set) in x1.
+ *
+ * The ABI carries up to six payload registers (x2..x7); this wrapper covers
+ * the two that fit through hf_call.
+ *
+ * Returns SPCI_SUCCESS if the message is delivered, an error code otherwise:
+ *  - INVALID_PARAMETERS: the target VM or vCPU does not exist, or the request
+ *    is reflexive.
+ *  - BUSY: the target vCPU is currently running on another physical CPU.
+ *  - RETRY: the target vCPU is not blocked waiting for a message.
+ */
+static inline int64_t spci_msg_send_direct(spci_vm_id_t target_vm_id,
+					   spci_vcpu_index_t target_vcpu_idx,
+					   uint64_t payload0, uint64_t payload1)
+{
+	return hf_call(SPCI_MSG_SEND_DIRECT_32,
+		       (uint64_t)target_vcpu_idx << 16 | target_vm_id,
+		       payload0, payload1);
+}
+
 /**
  * Called by secondary VMs to receive a message. The call can optionally block
  * until a message is received.
@@ -148,6 +568,17 @@ static inline int32_t spci_msg_recv(int32_t attributes)
 	return hf_call(SPCI_MSG_RECV_32, attributes, 0, 0);
 }
 
+/**
+ * Like spci_msg_recv with SPCI_MSG_RECV_BLOCK, but wakes with SPCI_RETRY
+ * after `timeout_ns` nanoseconds if no message arrived first: one trap in,
+ * one trap out, with no guest-side timer arming and cancelling.
+ */
+static inline int32_t spci_msg_recv_timeout(int32_t attributes,
+					    uint64_t timeout_ns)
+{
+	return hf_call(SPCI_MSG_RECV_32, attributes, timeout_ns, 0);
+}
+
 /**
  * Clears the caller's mailbox so a new message can be received.
  *
@@ -235,7 +666,10 @@ static inline int64_t hf_interrupt_inject(spci_vm_id_t target_vm_id,
 /**
  * Shares a region of memory with another VM.
  *
- * Returns 0 on success or -1 if the sharing was not allowed or failed.
+ * Returns the (non-negative) handle of the established share on success, -1
+ * if the sharing was not allowed or failed, or -2 if a bounded chunk of a
+ * large region was processed and the call must be repeated with the same
+ * arguments to continue.
  *
  * TODO: replace this with a better API once we have decided what that should
  *       look like.
@@ -34,6 +34,8 @@
 #define SPCI_MSG_SEND_REC_32          0x84000065
 #define SPCI_RUN_32                   0x84000066
 #define SPCI_YIELD_32                 0x84000067
+#define SPCI_MSG_SEND_DIRECT_32       0x84000068
+#define SPCI_FEATURES_32              0x84000069
 
 /* SPCI return codes. */
 #define SPCI_SUCCESS            INT32_C(0)
@@ -61,9 +63,72 @@ enum spci_memory_share {
 #define SPCI_MESSAGE_IMPDEF      0x1
 #define SPCI_MESSAGE_IMPDEF_MASK 0x1
 
+/**
+ * The payload was delivered by reference: the message body carries the
+ * address of the sender's send buffer page, mapped read-only into the
+ * receiver until the mailbox is cleared.
+ */
+#define SPCI_MESSAGE_ZERO_COPY 0x2
+
+/**
+ * This message is a chunk of a streamed transfer and more chunks follow;
+ * clearing the mailbox delivers the next one.
+ */
+#define SPCI_MESSAGE_STREAM_MORE 0x4
+
+/**
+ * Urgent message: may use the reserved priority slot when the normal mailbox
+ * is occupied, and wakes the receiver immediately. Only valid together with
+ * SPCI_MESSAGE_IMPDEF.
+ */
+#define SPCI_MESSAGE_URGENT 0x8
+
 #define SPCI_MSG_SEND_NOTIFY 0x1
+
+/**
+ * Deliver the payload without copying it. The sender must not reuse its send
+ * buffer until the receiver clears its mailbox.
+ */
+#define SPCI_MSG_SEND_ZERO_COPY 0x2
+
+/**
+ * Donate the rest of the sender's timeslice to the receiver, switching to a
+ * blocked receiver vCPU directly instead of going through the primary
+ * scheduler.
+ */
+#define SPCI_MSG_SEND_DIRECT_YIELD 0x4
+
+/**
+ * Asynchronous send: return to the sender immediately once the message has
+ * been accepted (delivered or queued), without a scheduler round trip.
+ */
+#define SPCI_MSG_SEND_ASYNC 0x8
+
+/**
+ * Streamed send: the payload is a descriptor (64-bit address, 64-bit length)
+ * of a multi-page buffer in the sender's memory, delivered to the receiver in
+ * pipelined mailbox-size chunks as it clears its mailbox.
+ */
+#define SPCI_MSG_SEND_STREAM 0x10
+
+/**
+ * Multicast send: the payload starts with a little-endian uint16_t recipient
+ * count followed by that many uint16_t vm-ids; the body after the list is
+ * copied once by the hypervisor and delivered to every listed recipient
+ * whose mailbox is free. A per-recipient delivery bitmap is written to the
+ * sender's empty receive buffer. Implies asynchronous semantics.
+ */
+#define SPCI_MSG_SEND_MULTICAST 0x20
 #define SPCI_MSG_RECV_BLOCK  0x1
 
+/* Fast-path capabilities negotiated through SPCI_FEATURES_32. */
+#define SPCI_FEATURE_DIRECT_MSG      0x1
+#define SPCI_FEATURE_ASYNC_SEND      0x2
+#define SPCI_FEATURE_STATUS_PAGE     0x4
+#define SPCI_FEATURE_WRITABLE_NOTIFY 0x8
+#define SPCI_FEATURE_GICV3_NATIVE    0x10
+#define SPCI_FEATURE_ALIGNED_V2      0x20
+
 /* The maximum length possible for a single message. */
 #define SPCI_MSG_PAYLOAD_MAX (HF_MAILBOX_SIZE - sizeof(struct spci_message))
 
@@ -248,6 +313,28 @@ struct spci_memory_lend {
 	uint8_t payload[];
 };
 
+/**
+ * V2 memory region layout, negotiated with SPCI_FEATURE_ALIGNED_V2 in the
+ * feature exchange: the extra reserved doubleword places the constituent
+ * array on a 16-byte boundary within the message, so the parser's
+ * coalescing pre-pass can read constituents with aligned 16-byte loads
+ * instead of byte-wise assembly. Constituent entries are unchanged.
+ *
+ * Memory-sharing descriptors are forwarded to the receiver verbatim, so
+ * BOTH endpoints of a share must negotiate the same layout version; the
+ * hypervisor rejects a share between a v1 and a v2 endpoint with
+ * SPCI_INVALID_PARAMETERS rather than let one of them parse the
+ * constituent array at the wrong offset.
+ */
+struct spci_memory_region_v2 {
+	spci_memory_handle_t handle;
+	uint32_t count;
+
+	uint64_t reserved;
+
+	struct spci_memory_region_constituent constituents[];
+};
+
 /* TODO: Move all the functions below this line to a support library. */
 /**
  * Fill all the fields, except for the flags, in the SPCI message common header.
@@ -16,6 +16,14 @@
 
 #pragma once
 
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hf/call.h"
+#include "hf/spci.h"
+
 /**
  * Header for Hafnium messages
  *
@@ -26,3 +34,171 @@ struct hf_msg_hdr {
 	uint64_t src_port;
 	uint64_t dst_port;
 };
+
+/*
+ * Descriptor-ring transport over guest-shared memory.
+ *
+ * Two VMs that have shared a memory region (e.g. via hf_share_memory) lay a
+ * pair of unidirectional rings over it. The producer fills descriptors and
+ * publishes them by advancing the avail index; the consumer processes them
+ * and returns them through the used index. Indices are free-running and only
+ * ever written by their owning side, so no locks cross the VM boundary.
+ *
+ * Hypercalls are only used as doorbells: the producer sends one (empty)
+ * spci_msg_send per burst after publishing a batch of descriptors, and only
+ * when the consumer advertised that it is waiting (ring_consumer_wait), so a
+ * busy consumer costs no traps at all. Target: far fewer than one trap per
+ * 64 messages on a loaded channel.
+ */
+
+/** Number of descriptors per ring; must be a power of two. */
+#define HF_RING_SIZE 256
+
+/** A single buffer descriptor: an offset/length pair within the shared
+ * region. */
+struct hf_ring_desc {
+	uint64_t offset;
+	uint32_t length;
+	uint32_t flags;
+};
+
+struct hf_ring {
+	/* Written by the producer only. */
+	alignas(64) volatile uint32_t avail;
+
+	/* Written by the consumer only. */
+	alignas(64) volatile uint32_t used;
+
+	/*
+	 * Set by the consumer when it is about to block; tells the producer a
+	 * doorbell is needed for the next publish.
+	 */
+	alignas(64) volatile uint32_t consumer_waiting;
+
+	alignas(64) struct hf_ring_desc desc[HF_RING_SIZE];
+};
+
+/** Producer-side endpoint state. */
+struct hf_ring_producer {
+	struct hf_ring *ring;
+	spci_vm_id_t peer;
+	uint32_t pending; /* Descriptors written but not yet published. */
+};
+
+/** Consumer-side endpoint state. */
+struct hf_ring_consumer {
+	struct hf_ring *ring;
+	uint32_t next; /* Next descriptor index to process. */
+};
+
+static inline void hf_ring_init(struct hf_ring *ring)
+{
+	ring->avail = 0;
+	ring->used = 0;
+	ring->consumer_waiting = 0;
+}
+
+static inline void hf_ring_producer_init(struct hf_ring_producer *p,
+					 struct hf_ring *ring,
+					 spci_vm_id_t peer)
+{
+	p->ring = ring;
+	p->peer = peer;
+	p->pending = 0;
+}
+
+static inline void hf_ring_consumer_init(struct hf_ring_consumer *c,
+					 struct hf_ring *ring)
+{
+	c->ring = ring;
+	c->next = 0;
+}
+
+/** Returns how many descriptors the producer can still write. */
+static inline uint32_t hf_ring_space(const struct hf_ring_producer *p)
+{
+	return HF_RING_SIZE -
+	       ((p->ring->avail + p->pending) - p->ring->used);
+}
+
+/**
+ * Writes one descriptor without publishing it. Returns false if the ring is
+ * full.
+ */
+static inline bool hf_ring_push(struct hf_ring_producer *p, uint64_t offset,
+				uint32_t length, uint32_t flags)
+{
+	uint32_t slot;
+
+	if (hf_ring_space(p) == 0) {
+		return false;
+	}
+
+	slot = (p->ring->avail + p->pending) & (HF_RING_SIZE - 1);
+	p->ring->desc[slot].offset = offset;
+	p->ring->desc[slot].length = length;
+	p->ring->desc[slot].flags = flags;
+	p->pending++;
+	return true;
+}
+
+/**
+ * Publishes all pushed descriptors and rings the doorbell only if the
+ * consumer said it is waiting: one hypercall per burst at most, none on a
+ * busy channel.
+ */
+static inline void hf_ring_publish(struct hf_ring_producer *p,
+				   struct spci_message *send_buf)
+{
+	if (p->pending == 0) {
+		return;
+	}
+
+	/* Make the descriptors visible before the index. */
+	atomic_thread_fence(memory_order_release);
+	p->ring->avail += p->pending;
+	p->pending = 0;
+
+	if (p->ring->consumer_waiting) {
+		p->ring->consumer_waiting = 0;
+		spci_message_init(send_buf, 0, p->peer, hf_vm_get_id());
+		spci_msg_send(SPCI_MSG_SEND_ASYNC);
+	}
+}
+
+/**
+ * Takes the next available descriptor, or returns false if the ring is
+ * empty. The descriptor is returned to the producer with
+ * hf_ring_complete().
+ */
+static inline bool hf_ring_pop(struct hf_ring_consumer *c,
+			       struct hf_ring_desc *out)
+{
+	if (c->next == c->ring->avail) {
+		return false;
+	}
+
+	*out = c->ring->desc[c->next & (HF_RING_SIZE - 1)];
+	atomic_thread_fence(memory_order_acquire);
+	c->next++;
+	return true;
+}
+
+/** Returns processed descriptors to the producer. */
+static inline void hf_ring_complete(struct hf_ring_consumer *c)
+{
+	atomic_thread_fence(memory_order_release);
+	c->ring->used = c->next;
+}
+
+/**
+ * Declares the intent to block until the next publish: the producer will
+ * ring the doorbell for it. The caller should re-check the ring once more
+ * after this before actually blocking, to close the race with a concurrent
+ * publish.
+ */
+static inline void hf_ring_consumer_wait(struct hf_ring_consumer *c)
+{
+	c->ring->consumer_waiting = 1;
+	atomic_thread_fence(memory_order_seq_cst);
+}
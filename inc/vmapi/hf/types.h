@@ -67,3 +67,38 @@ typedef uintptr_t hf_ipaddr_t;
 
 /** The virtual interrupt ID used for the virtual timer. */
 #define HF_VIRTUAL_TIMER_INTID 3
+
+/** Maximum number of hypercalls in one multicall batch. */
+#define HF_MULTICALL_MAX 8
+
+/**
+ * One entry of a multicall batch; see hf_multicall(). The guest fills an
+ * array of these at the start of its send buffer; the hypervisor writes the
+ * per-call results, in order, as an array of int64_t at the start of the
+ * (empty) receive buffer.
+ */
+struct hf_multicall_entry {
+	uint64_t func;
+	uint64_t args[3];
+};
+
+/**
+ * Layout of the per-vCPU interrupt status page shared read-only with the
+ * guest; see hf_interrupt_status_page(). Keep in sync with
+ * hfo2/src/cpu.rs.
+ */
+struct hf_interrupt_status_page {
+	uint32_t enabled_and_pending_count;
+	uint32_t summary;
+	uint32_t pending[HF_NUM_INTIDS / 32];
+};
+
+/**
+ * Layout of the per-vCPU telemetry page shared read-only with the guest; see
+ * hf_vcpu_telem_page(). Keep in sync with hfo2/src/cpu.rs.
+ */
+struct hf_vcpu_telemetry {
+	uint64_t run_cycles;
+	uint64_t steal_cycles;
+	uint64_t preemptions;
+};
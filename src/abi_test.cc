@@ -87,6 +87,7 @@ TEST(abi, hf_vcpu_run_return_decode_message)
 		hf_vcpu_run_return_decode(0x1123581314916205);
 	EXPECT_THAT(res.code, Eq(HF_VCPU_RUN_MESSAGE));
 	EXPECT_THAT(res.message.vm_id, Eq(0x9162));
+	EXPECT_THAT(res.message.size, Eq(0x11235813));
 }
 
 /**
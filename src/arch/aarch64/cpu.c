@@ -21,9 +21,12 @@
 #include <stdint.h>
 
 #include "hf/addr.h"
+#include "hf/arch/barriers.h"
+#include "hf/cpu.h"
 #include "hf/std.h"
 
 #include "hypervisor/debug_el1.h"
+#include "msr.h"
 
 void arch_irq_disable(void)
 {
@@ -77,7 +80,8 @@ void arch_regs_reset(struct arch_regs *r, bool is_primary, spci_vm_id_t vm_id,
 	      (1u << 2) |  /* PTW, Protected Table Walk. */
 	      (1u << 0);   /* VM: enable stage-2 translation. */
 
-	cptr = 0;
+	/* Arm the lazy FP/SIMD switch: first use traps and loads the state. */
+	cptr = (1u << 10); /* TFP bit. */
 	cnthctl = 0;
 
 	if (is_primary) {
@@ -90,14 +94,16 @@ void arch_regs_reset(struct arch_regs *r, bool is_primary, spci_vm_id_t vm_id,
 		       (1u << 10) | /* BSU bits set to inner-sh. */
 		       (3u << 13);  /* TWI, TWE bits. */
 
-		/* TODO: Trap fp access once handler logic is in place. */
-
 		/* TODO: Investigate fpexc32_el2 for 32bit EL0 support. */
 	}
 
 	r->lazy.hcr_el2 = hcr;
 	r->lazy.cptr_el2 = cptr;
 	r->lazy.cnthctl_el2 = cnthctl;
+	/*
+	 * The VMID field is a placeholder: every entry path retags it with a
+	 * VMID from the live generation (see arch_mm_assign_vmid).
+	 */
 	r->lazy.vttbr_el2 = pa_addr(table) | ((uint64_t)vm_id << 48);
 	r->lazy.vmpidr_el2 = vcpu_id;
 	/* TODO: Use constant here. */
@@ -129,3 +135,94 @@ void arch_regs_set_retval(struct arch_regs *r, uintreg_t v)
 {
 	r->r[0] = v;
 }
+
+size_t arch_cpu_index_current(void)
+{
+	struct vcpu *vcpu = (struct vcpu *)read_msr(tpidr_el2);
+
+	/* Until the first vCPU is run, only the boot CPU executes. */
+	if (vcpu == NULL) {
+		return 0;
+	}
+
+	return cpu_index(vcpu_get_cpu(vcpu));
+}
+
+void arch_cpu_kick(cpu_id_t id)
+{
+#if GIC_VERSION == 3 || GIC_VERSION == 4
+	uint64_t aff0 = id & 0xff;
+	uint64_t aff1 = (id >> 8) & 0xff;
+	uint64_t aff2 = (id >> 16) & 0xff;
+	uint64_t aff3 = (id >> 32) & 0xff;
+
+	/*
+	 * Make everything posted for the target (e.g. the lock-free intid
+	 * words) observable before the SGI is generated.
+	 */
+	dsb(ish);
+	write_msr(icc_sgi1r_el1,
+		  ((uint64_t)HF_KICK_SGI_INTID << 24) | (aff3 << 48) |
+			  (aff2 << 32) | (aff1 << 16) |
+			  (UINT64_C(1) << (aff0 & 0xf)));
+#else
+	(void)id;
+#endif
+}
+
+uint64_t arch_cpu_cycle_count(void)
+{
+	return read_msr(cntvct_el0);
+}
+
+uint32_t arch_cpu_locality_current(void)
+{
+	/* The cluster is affinity level 1 of the MPIDR. */
+	return (read_msr(mpidr_el1) >> 8) & 0xff;
+}
+
+void arch_cpu_wfe(void)
+{
+	__asm__ volatile("wfe");
+}
+
+void arch_cpu_sev(void)
+{
+	__asm__ volatile("sev");
+}
+
+/**
+ * Turns the ARM event stream on for the idle WFE loop: events fire every
+ * 2^4 counter ticks (CNTHCTL_EL2.EVNTI = 4, EVNTEN = 1), bounding the wait
+ * latency even if a wakeup sev is lost. The guest's own cnthctl value is
+ * restored by the next vcpu entry, so this only affects time spent in EL2.
+ */
+void arch_cpu_event_stream_enable(void)
+{
+	write_msr(cnthctl_el2,
+		  read_msr(cnthctl_el2) | (1u << 2) | (4u << 4));
+	isb();
+}
+
+void arch_cpu_event_stream_disable(void)
+{
+	write_msr(cnthctl_el2,
+		  read_msr(cnthctl_el2) & ~((1u << 2) | (0xfu << 4)));
+	isb();
+}
+
+void arch_regs_set_wfi_passthrough(struct arch_regs *r)
+{
+	/* Clear TWI and TWE so wfi/wfe execute natively in the guest. */
+	r->lazy.hcr_el2 &= ~((1u << 13) | (1u << 14));
+}
+
+void arch_regs_set_timer_passthrough(struct arch_regs *r)
+{
+	/*
+	 * EL1PCTEN and EL1PCEN: the EL1 physical counter and timer are used
+	 * natively, no traps. Only set for dedicated-core VMs, where no
+	 * other vCPU can share the core's timer.
+	 */
+	r->lazy.cnthctl_el2 |= (1u << 0) | (1u << 1);
+}
@@ -17,9 +17,11 @@
 #include "debug_el1.h"
 
 #include "hf/check.h"
+#include "hf/cpu.h"
 #include "hf/dlog.h"
 #include "hf/panic.h"
 #include "hf/types.h"
+#include "hf/vm.h"
 
 #include "msr.h"
 
@@ -122,12 +124,24 @@
 
 /**
  * Definitions of read-only debug registers' ISS signatures.
+ *
+ * MDRAR_EL1 and DBGAUTHSTATUS_EL1 are architecturally invariant and are
+ * served from a per-VM cache below; OSLSR_EL1 stays uncached as its OSLK
+ * bit is in principle writable through OSLAR_EL1.
  */
 #define EL1_DEBUG_REGISTERS_READ       \
 	X(MDRAR_EL1, 0x200400)         \
 	X(DBGAUTHSTATUS_EL1, 0x2c1c1c) \
 	X(OSLSR_EL1, 0x280402)
 
+/** ISS signatures of the cached invariant registers. */
+#define ISS_SIG_MDRAR_EL1 0x200400
+#define ISS_SIG_DBGAUTHSTATUS_EL1 0x2c1c1c
+
+/** Bits of arch_vm.sysreg_cache_valid. */
+#define SYSREG_CACHE_MDRAR (1u << 0)
+#define SYSREG_CACHE_DBGAUTHSTATUS (1u << 1)
+
 /**
  * Definitions of readable and writeable debug registers' ISS signatures.
  */
@@ -291,6 +305,44 @@ bool debug_el1_process_access(struct vcpu *vcpu, spci_vm_id_t vm_id,
 	CHECK(rt_register < NUM_GP_REGS);
 
 	if (ISS_IS_READ(esr_el2)) {
+		struct arch_vm *arch_vm = vm_get_arch(vcpu_get_vm(vcpu));
+
+		/*
+		 * Invariant registers are served from the per-VM cache;
+		 * guest driver probing hammers them at boot. MDRAR_EL1 is
+		 * also the only EL1 register MDCR_EL2.TDRA traps and its
+		 * value is returned raw, so once read, stop trapping it on
+		 * this vCPU altogether.
+		 */
+		switch (sys_register) {
+		case ISS_SIG_MDRAR_EL1:
+			if (!(arch_vm->sysreg_cache_valid &
+			      SYSREG_CACHE_MDRAR)) {
+				arch_vm->sysreg_mdrar = read_msr(MDRAR_EL1);
+				arch_vm->sysreg_cache_valid |=
+					SYSREG_CACHE_MDRAR;
+			}
+			vcpu_get_regs(vcpu)->r[rt_register] =
+				arch_vm->sysreg_mdrar;
+			vcpu_get_regs(vcpu)->lazy.mdcr_el2 &= ~MDCR_EL2_TDRA;
+			write_msr(MDCR_EL2,
+				  vcpu_get_regs(vcpu)->lazy.mdcr_el2);
+			return true;
+		case ISS_SIG_DBGAUTHSTATUS_EL1:
+			if (!(arch_vm->sysreg_cache_valid &
+			      SYSREG_CACHE_DBGAUTHSTATUS)) {
+				arch_vm->sysreg_dbgauthstatus =
+					read_msr(DBGAUTHSTATUS_EL1);
+				arch_vm->sysreg_cache_valid |=
+					SYSREG_CACHE_DBGAUTHSTATUS;
+			}
+			vcpu_get_regs(vcpu)->r[rt_register] =
+				arch_vm->sysreg_dbgauthstatus;
+			return true;
+		default:
+			break;
+		}
+
 		switch (sys_register) {
 #define X(reg_name, reg_sig)                \
 	case reg_sig:                       \
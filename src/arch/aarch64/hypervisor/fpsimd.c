@@ -0,0 +1,170 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fpsimd.h"
+
+#include <stddef.h>
+
+#include "hf/arch/barriers.h"
+#include "hf/arch/cpu.h"
+
+#include "msr.h"
+
+/*
+ * Lazy FP/SIMD state switching.
+ *
+ * The world switch no longer saves and restores the 32 vector registers
+ * eagerly. Instead, a vCPU whose FP state is not live in the registers runs
+ * with CPTR_EL2.TFP set; its first FP/SIMD access traps to EL2, where the
+ * previous owner's state is saved and the new owner's state is restored.
+ * Secondary VMs that never touch FP/SIMD between traps pay nothing.
+ *
+ * Hafnium itself is compiled without FP register usage, so EL2 never
+ * clobbers the live state.
+ */
+
+/**
+ * The vCPU whose FP/SIMD state is live in the registers of each physical CPU,
+ * or NULL. Only accessed by the owning physical CPU.
+ */
+static struct vcpu *fpsimd_owner[MAX_CPUS];
+
+/**
+ * Saves the live FP/SIMD register state into the given register file.
+ */
+static void fpsimd_save_state(struct arch_regs *regs)
+{
+	struct float_reg *fp = regs->fp;
+
+	__asm__ volatile(
+		"stp q0, q1, [%0, #32 * 0]\n"
+		"stp q2, q3, [%0, #32 * 1]\n"
+		"stp q4, q5, [%0, #32 * 2]\n"
+		"stp q6, q7, [%0, #32 * 3]\n"
+		"stp q8, q9, [%0, #32 * 4]\n"
+		"stp q10, q11, [%0, #32 * 5]\n"
+		"stp q12, q13, [%0, #32 * 6]\n"
+		"stp q14, q15, [%0, #32 * 7]\n"
+		"stp q16, q17, [%0, #32 * 8]\n"
+		"stp q18, q19, [%0, #32 * 9]\n"
+		"stp q20, q21, [%0, #32 * 10]\n"
+		"stp q22, q23, [%0, #32 * 11]\n"
+		"stp q24, q25, [%0, #32 * 12]\n"
+		"stp q26, q27, [%0, #32 * 13]\n"
+		"stp q28, q29, [%0, #32 * 14]\n"
+		"stp q30, q31, [%0, #32 * 15]\n"
+		:
+		: "r"(fp)
+		: "memory");
+
+	regs->fpsr = read_msr(fpsr);
+	regs->fpcr = read_msr(fpcr);
+}
+
+/**
+ * Restores the FP/SIMD register state from the given register file.
+ */
+static void fpsimd_restore_state(struct arch_regs *regs)
+{
+	struct float_reg *fp = regs->fp;
+
+	__asm__ volatile(
+		"ldp q0, q1, [%0, #32 * 0]\n"
+		"ldp q2, q3, [%0, #32 * 1]\n"
+		"ldp q4, q5, [%0, #32 * 2]\n"
+		"ldp q6, q7, [%0, #32 * 3]\n"
+		"ldp q8, q9, [%0, #32 * 4]\n"
+		"ldp q10, q11, [%0, #32 * 5]\n"
+		"ldp q12, q13, [%0, #32 * 6]\n"
+		"ldp q14, q15, [%0, #32 * 7]\n"
+		"ldp q16, q17, [%0, #32 * 8]\n"
+		"ldp q18, q19, [%0, #32 * 9]\n"
+		"ldp q20, q21, [%0, #32 * 10]\n"
+		"ldp q22, q23, [%0, #32 * 11]\n"
+		"ldp q24, q25, [%0, #32 * 12]\n"
+		"ldp q26, q27, [%0, #32 * 13]\n"
+		"ldp q28, q29, [%0, #32 * 14]\n"
+		"ldp q30, q31, [%0, #32 * 15]\n"
+		:
+		: "r"(fp));
+
+	write_msr(fpsr, regs->fpsr);
+
+	/*
+	 * Only restore FPCR if changed, to avoid expensive self-synchronising
+	 * operation where possible.
+	 */
+	if (read_msr(fpcr) != regs->fpcr) {
+		write_msr(fpcr, regs->fpcr);
+	}
+}
+
+/**
+ * Called while the given vCPU's state is being saved on a world switch. If it
+ * owns the live FP/SIMD state it must be saved now, as the vCPU may migrate
+ * to another physical CPU before it runs again.
+ */
+void fpsimd_complete_save(struct vcpu *vcpu)
+{
+	size_t cpu = arch_cpu_index_current();
+
+	if (fpsimd_owner[cpu] == vcpu) {
+		fpsimd_save_state(vcpu_get_regs(vcpu));
+		fpsimd_owner[cpu] = NULL;
+	}
+}
+
+/**
+ * Called while the given vCPU's state is being restored on a world switch.
+ * Arms the FP/SIMD trap unless the vCPU's state is already live, so the
+ * register file is only moved on first use.
+ */
+void fpsimd_prepare_switch(struct vcpu *vcpu)
+{
+	struct arch_regs *regs = vcpu_get_regs(vcpu);
+
+	if (fpsimd_owner[arch_cpu_index_current()] == vcpu) {
+		regs->lazy.cptr_el2 &= ~CPTR_EL2_TFP;
+	} else {
+		regs->lazy.cptr_el2 |= CPTR_EL2_TFP;
+	}
+}
+
+/**
+ * Handles a trapped FP/SIMD access (EC = 0b000111): moves the live state to
+ * its owner, restores the current vCPU's state and disarms the trap so the
+ * faulting instruction can be restarted.
+ */
+void fpsimd_handle_trap(struct vcpu *vcpu)
+{
+	size_t cpu = arch_cpu_index_current();
+	struct arch_regs *regs = vcpu_get_regs(vcpu);
+
+	/*
+	 * Disarm the trap first: with TFP set, the save/restore sequences
+	 * below would themselves trap.
+	 */
+	regs->lazy.cptr_el2 &= ~CPTR_EL2_TFP;
+	write_msr(cptr_el2, read_msr(cptr_el2) & ~CPTR_EL2_TFP);
+	isb();
+
+	if (fpsimd_owner[cpu] != NULL) {
+		fpsimd_save_state(vcpu_get_regs(fpsimd_owner[cpu]));
+	}
+
+	fpsimd_restore_state(regs);
+	fpsimd_owner[cpu] = vcpu;
+}
@@ -17,22 +17,29 @@
 #include <stdnoreturn.h>
 
 #include "hf/arch/barriers.h"
+#include "hf/arch/std.h"
 #include "hf/arch/init.h"
 #include "hf/arch/mm.h"
 
 #include "hf/api.h"
 #include "hf/check.h"
+#include "hf/compiler.h"
 #include "hf/cpu.h"
 #include "hf/dlog.h"
 #include "hf/panic.h"
+#include "hf/perf.h"
+#include "hf/plat/console.h"
 #include "hf/spci.h"
 #include "hf/vm.h"
 
 #include "vmapi/hf/call.h"
 
 #include "debug_el1.h"
+#include "fpsimd.h"
 #include "msr.h"
+#include "pmu.h"
 #include "psci.h"
+#include "watchdog.h"
 #include "psci_handler.h"
 #include "smc.h"
 
@@ -62,14 +69,184 @@ static struct vcpu *current(void)
 	return (struct vcpu *)read_msr(tpidr_el2);
 }
 
+#if GIC_VERSION == 3 || GIC_VERSION == 4
+
+/* ICH_LR<n>_EL2 fields used for direct virtual interrupt injection. */
+#define ICH_LR_STATE_MASK (UINT64_C(3) << 62)
+#define ICH_LR_STATE_PENDING (UINT64_C(1) << 62)
+#define ICH_LR_GROUP1 (UINT64_C(1) << 60)
+#define ICH_LR_VINTID_MASK UINT64_C(0xffffffff)
+
+bool arch_gicv3_try_inject_current(uint32_t intid)
+{
+	uint64_t lr = read_msr(ICH_LR0_EL2);
+
+	/* Only use the list register if it isn't holding an interrupt. */
+	if ((lr & ICH_LR_STATE_MASK) != 0) {
+		return false;
+	}
+
+	write_msr(ICH_LR0_EL2, ICH_LR_STATE_PENDING | ICH_LR_GROUP1 | intid);
+	return true;
+}
+
+/** The number of list registers managed for direct injection and refill. */
+#define GICV3_NUM_LRS 4
+
+static uint64_t gicv3_lr_read(size_t i)
+{
+	switch (i) {
+	case 0:
+		return read_msr(ICH_LR0_EL2);
+	case 1:
+		return read_msr(ICH_LR1_EL2);
+	case 2:
+		return read_msr(ICH_LR2_EL2);
+	default:
+		return read_msr(ICH_LR3_EL2);
+	}
+}
+
+static void gicv3_lr_write(size_t i, uint64_t v)
+{
+	switch (i) {
+	case 0:
+		write_msr(ICH_LR0_EL2, v);
+		break;
+	case 1:
+		write_msr(ICH_LR1_EL2, v);
+		break;
+	case 2:
+		write_msr(ICH_LR2_EL2, v);
+		break;
+	default:
+		write_msr(ICH_LR3_EL2, v);
+		break;
+	}
+}
+
+/**
+ * Reclaims interrupts still sitting in the list registers when the vCPU is
+ * switched out, moving them back to the software pending state so they are
+ * not leaked to the next vCPU or lost.
+ */
+static void gicv3_lr_save(struct vcpu *vcpu)
+{
+	size_t i;
+
+	for (i = 0; i < GICV3_NUM_LRS; i++) {
+		uint64_t lr = gicv3_lr_read(i);
+
+		if ((lr & ICH_LR_STATE_MASK) == ICH_LR_STATE_PENDING) {
+			vcpu_interrupt_repend(vcpu, lr & ICH_LR_VINTID_MASK);
+		}
+		gicv3_lr_write(i, 0);
+	}
+}
+
+/**
+ * Bulk-refills every free list register from the vCPU's pending bitmap, so a
+ * storm of virtual interrupts is delivered a batch at a time instead of one
+ * trap per acknowledgement. Only VMs that negotiated GICv3-native delivery
+ * take this path; underflow maintenance interrupts are enabled while more
+ * software-pending interrupts remain, so the next refill happens as the LRs
+ * drain.
+ */
+static void gicv3_lr_refill(struct vcpu *vcpu)
+{
+	size_t i;
+	bool more = false;
+
+	if (!(vm_get_features(vcpu_get_vm_fast(vcpu)) &
+	      SPCI_FEATURE_GICV3_NATIVE)) {
+		return;
+	}
+
+	for (i = 0; i < GICV3_NUM_LRS; i++) {
+		uint32_t intid;
+
+		if ((gicv3_lr_read(i) & ICH_LR_STATE_MASK) != 0) {
+			continue;
+		}
+
+		intid = vcpu_interrupt_pop(vcpu);
+		if (intid == HF_INVALID_INTID) {
+			break;
+		}
+
+		gicv3_lr_write(i, ICH_LR_STATE_PENDING | ICH_LR_GROUP1 |
+					  intid);
+	}
+
+	more = vcpu_is_interrupted(vcpu);
+
+	/* UIE: maintenance interrupt when the LRs run dry. */
+	if (more) {
+		write_msr(ich_hcr_el2, read_msr(ich_hcr_el2) | (1u << 1));
+	} else {
+		write_msr(ich_hcr_el2, read_msr(ich_hcr_el2) & ~(1u << 1));
+	}
+}
+
+#else /* GIC_VERSION */
+
+bool arch_gicv3_try_inject_current(uint32_t intid)
+{
+	(void)intid;
+
+	return false;
+}
+
+static void gicv3_lr_save(struct vcpu *vcpu)
+{
+	(void)vcpu;
+}
+
+static void gicv3_lr_refill(struct vcpu *vcpu)
+{
+	(void)vcpu;
+}
+
+#endif /* GIC_VERSION */
+
 /**
  * Saves the state of per-vCPU peripherals, such as the virtual timer, and
  * informs the arch-independent sections that registers have been saved.
  */
+/** The counter value at which each CPU last started running a vCPU. */
+static uint64_t vcpu_run_begin[MAX_CPUS];
+
 void complete_saving_state(struct vcpu *vcpu)
 {
-	vcpu_get_regs(vcpu)->peripherals.cntv_cval_el0 = read_msr(cntv_cval_el0);
-	vcpu_get_regs(vcpu)->peripherals.cntv_ctl_el0 = read_msr(cntv_ctl_el0);
+	/*
+	 * Account the cycles this vCPU consumed since it was switched in,
+	 * while its registers are still owned by this CPU.
+	 */
+	vcpu_add_cycles(vcpu, read_msr(cntvct_el0) -
+				      vcpu_run_begin[cpu_index(
+					      vcpu_get_cpu(vcpu))]);
+
+	/* Reclaim any directly injected interrupt before the state is saved. */
+	gicv3_lr_save(vcpu);
+
+	/*
+	 * Move the live FP/SIMD state out before the registers are published
+	 * as saved, as the vCPU may then be picked up by another physical CPU.
+	 */
+	fpsimd_complete_save(vcpu);
+
+	vcpu_get_regs_fast(vcpu)->peripherals.cntv_cval_el0 = read_msr(cntv_cval_el0);
+	vcpu_get_regs_fast(vcpu)->peripherals.cntv_ctl_el0 = read_msr(cntv_ctl_el0);
+
+	/*
+	 * Track a blocked secondary's timer deadline on this CPU. This must
+	 * happen before the registers are published as saved, as the vCPU may
+	 * then migrate and run elsewhere.
+	 */
+	if (vcpu_get_vm_id_fast(vcpu) != HF_PRIMARY_VM_ID) {
+		arch_timer_queue_record(cpu_index(vcpu_get_cpu(vcpu)), vcpu,
+					vcpu_get_regs_fast(vcpu));
+	}
 
 	api_regs_state_saved(vcpu);
 
@@ -79,7 +256,7 @@ void complete_saving_state(struct vcpu *vcpu)
 	 * This is used to emulate the virtual timer for the primary in case it
 	 * should fire while the secondary is running.
 	 */
-	if (vm_get_id(vcpu_get_vm(vcpu)) == HF_PRIMARY_VM_ID) {
+	if (vcpu_get_vm_id_fast(vcpu) == HF_PRIMARY_VM_ID) {
 		/*
 		 * Clear timer control register before copying compare value, to
 		 * avoid a spurious timer interrupt. This could be a problem if
@@ -90,6 +267,9 @@ void complete_saving_state(struct vcpu *vcpu)
 		write_msr(cnthp_cval_el2, read_msr(cntv_cval_el0));
 		write_msr(cnthp_ctl_el2, read_msr(cntv_ctl_el0));
 	}
+
+	/* Pull the physical timer forward to the earliest tracked deadline. */
+	arch_timer_queue_commit(cpu_index(vcpu_get_cpu(vcpu)));
 }
 
 /**
@@ -97,24 +277,73 @@ void complete_saving_state(struct vcpu *vcpu)
  */
 void begin_restoring_state(struct vcpu *vcpu)
 {
+	/* Account off-CPU time of a preempted vCPU as steal. */
+	vcpu_record_switch_in(vcpu);
+
+	/* Fold in interrupts posted lock-free by other physical CPUs. */
+	vcpu_drain_remote_intids(vcpu);
+
+	/* Batch-load the list registers for GICv3-native VMs. */
+	gicv3_lr_refill(vcpu);
+
+	/*
+	 * Retag the stage-2 translation with a VMID from the live generation
+	 * before vttbr_el2 is restored from the saved state below. On the
+	 * common path the VM already holds a live VMID and this is two loads
+	 * and a store; only a rollover of the VMID space flushes the TLB.
+	 */
+	{
+		struct arch_regs *regs = vcpu_get_regs_fast(vcpu);
+		uint64_t vmid = arch_mm_assign_vmid(
+			&vm_get_arch(vcpu_get_vm(vcpu))->vmid,
+			cpu_index(vcpu_get_cpu(vcpu)));
+
+		regs->lazy.vttbr_el2 =
+			(regs->lazy.vttbr_el2 & ((UINT64_C(1) << 48) - 1)) |
+			(vmid << 48);
+	}
+
+	/* Start the cycle account for the incoming vCPU. */
+	vcpu_run_begin[cpu_index(vcpu_get_cpu(vcpu))] = read_msr(cntvct_el0);
+
+	/*
+	 * Arm or disarm the FP/SIMD trap before cptr_el2 is restored from the
+	 * saved state below.
+	 */
+	fpsimd_prepare_switch(vcpu);
+
+	/*
+	 * Dedicated-core VMs use the EL1 physical timer natively and nothing
+	 * else programs this core's timers, so the virtual-timer restore and
+	 * the EL2 deadline machinery below are skipped on their switches.
+	 */
+	if (vm_get_dedicated_cores(vcpu_get_vm(vcpu))) {
+		return;
+	}
+
 	/*
 	 * Clear timer control register before restoring compare value, to avoid
 	 * a spurious timer interrupt. This could be a problem if the interrupt
 	 * is configured as edge-triggered, as it would then be latched in.
 	 */
 	write_msr(cntv_ctl_el0, 0);
-	write_msr(cntv_cval_el0, vcpu_get_regs(vcpu)->peripherals.cntv_cval_el0);
-	write_msr(cntv_ctl_el0, vcpu_get_regs(vcpu)->peripherals.cntv_ctl_el0);
+	write_msr(cntv_cval_el0, vcpu_get_regs_fast(vcpu)->peripherals.cntv_cval_el0);
+	write_msr(cntv_ctl_el0, vcpu_get_regs_fast(vcpu)->peripherals.cntv_ctl_el0);
 
 	/*
 	 * If we are switching (back) to the primary, disable the EL2 physical
 	 * timer which was being used to emulate the EL0 virtual timer, as the
 	 * virtual timer is now running for the primary again.
 	 */
-	if (vm_get_id(vcpu_get_vm(vcpu)) == HF_PRIMARY_VM_ID) {
+	if (vcpu_get_vm_id_fast(vcpu) == HF_PRIMARY_VM_ID) {
 		write_msr(cnthp_ctl_el2, 0);
 		write_msr(cnthp_cval_el2, 0);
+	} else {
+		/* The vCPU is about to run, so stop tracking its deadline. */
+		arch_timer_queue_cancel(cpu_index(vcpu_get_cpu(vcpu)), vcpu);
 	}
+
+	arch_timer_queue_commit(cpu_index(vcpu_get_cpu(vcpu)));
 }
 
 /**
@@ -173,7 +402,7 @@ void maybe_invalidate_tlb(struct vcpu *vcpu)
 	}
 }
 
-noreturn void irq_current_exception(uintreg_t elr, uintreg_t spsr)
+COLD noreturn void irq_current_exception(uintreg_t elr, uintreg_t spsr)
 {
 	(void)elr;
 	(void)spsr;
@@ -181,7 +410,7 @@ noreturn void irq_current_exception(uintreg_t elr, uintreg_t spsr)
 	panic("IRQ from current");
 }
 
-noreturn void fiq_current_exception(uintreg_t elr, uintreg_t spsr)
+COLD noreturn void fiq_current_exception(uintreg_t elr, uintreg_t spsr)
 {
 	(void)elr;
 	(void)spsr;
@@ -189,7 +418,7 @@ noreturn void fiq_current_exception(uintreg_t elr, uintreg_t spsr)
 	panic("FIQ from current");
 }
 
-noreturn void serr_current_exception(uintreg_t elr, uintreg_t spsr)
+COLD noreturn void serr_current_exception(uintreg_t elr, uintreg_t spsr)
 {
 	(void)elr;
 	(void)spsr;
@@ -197,7 +426,7 @@ noreturn void serr_current_exception(uintreg_t elr, uintreg_t spsr)
 	panic("SERR from current");
 }
 
-noreturn void sync_current_exception(uintreg_t elr, uintreg_t spsr)
+COLD noreturn void sync_current_exception(uintreg_t elr, uintreg_t spsr)
 {
 	uintreg_t esr = read_msr(esr_el2);
 	uintreg_t ec = GET_EC(esr);
@@ -274,20 +503,197 @@ static bool smc_check_client_privileges(const struct vcpu *vcpu)
 static bool smc_forwarder(const struct vcpu *vcpu_, smc_res_t *ret)
 {
 	struct vcpu *vcpu = (struct vcpu *)vcpu_;
-	uint32_t func = vcpu_get_regs(vcpu)->r[0];
+	uint32_t func = vcpu_get_regs_fast(vcpu)->r[0];
 	/* TODO(b/132421503): obtain vmid according to new scheme. */
-	uint32_t client_id = vm_get_id(vcpu_get_vm(vcpu));
+	uint32_t client_id = vcpu_get_vm_id_fast(vcpu);
 
 	if (smc_check_client_privileges(vcpu)) {
-		*ret = smc_forward(func, vcpu_get_regs(vcpu)->r[1], vcpu_get_regs(vcpu)->r[2],
-			     vcpu_get_regs(vcpu)->r[3], vcpu_get_regs(vcpu)->r[4], vcpu_get_regs(vcpu)->r[5],
-			     vcpu_get_regs(vcpu)->r[6], client_id);
+		struct arch_regs *regs = vcpu_get_regs_fast(vcpu);
+		uint64_t args[SMC_WIDE_REGS];
+		size_t i;
+
+		/*
+		 * Idempotent discovery queries keep the narrow cached path;
+		 * everything else forwards the full SMCCC v1.2 x0-x17 window
+		 * in one trap (the slow exception path saved all of x0-x17,
+		 * so they are available and written back here).
+		 */
+		if (smc_is_cacheable(func)) {
+			*ret = smc_forward_cached(func, regs->r[1],
+						  regs->r[2], regs->r[3],
+						  regs->r[4], regs->r[5],
+						  regs->r[6], client_id);
+			return true;
+		}
+
+		for (i = 0; i < SMC_WIDE_REGS; i++) {
+			args[i] = regs->r[i];
+		}
+
+		smc_forward_wide(args);
+
+		for (i = 0; i < SMC_WIDE_REGS; i++) {
+			regs->r[i] = args[i];
+		}
+
+		ret->res0 = args[0];
+		ret->res1 = args[1];
+		ret->res2 = args[2];
+		ret->res3 = args[3];
 		return true;
 	}
 
 	return false;
 }
 
+/**
+ * Executes a batch of SMCs submitted through the caller's send buffer,
+ * writing the results into its receive buffer, so several firmware calls cost
+ * a single trap. The mailbox must be empty and the caller must make sure no
+ * message is delivered to it while the batch runs.
+ *
+ * Returns the number of calls executed, or -1 on failure.
+ */
+static int64_t smc_batch(uintreg_t count, struct vcpu *vcpu)
+{
+	struct vm *vm = vcpu_get_vm(vcpu);
+	const struct spci_message *send = vm_get_send_ptr(vm);
+	struct spci_message *recv;
+	const struct hf_smc_batch_call *calls;
+	uint64_t (*results)[4];
+	uint32_t client_id = vm_get_id(vm);
+	size_t i;
+
+	if (send == NULL || !smc_check_client_privileges(vcpu)) {
+		return -1;
+	}
+
+	if (count > SPCI_MSG_PAYLOAD_MAX / sizeof(struct hf_smc_batch_call)) {
+		return -1;
+	}
+
+	/*
+	 * Hold the Empty->Filling reservation across the whole batch: the
+	 * result area is written while the SMCs run, and a concurrent sender
+	 * must neither deliver over it nor have its message overwritten.
+	 */
+	recv = vm_try_reserve_recv(vm);
+	if (recv == NULL) {
+		return -1;
+	}
+
+	calls = (const struct hf_smc_batch_call *)send->payload;
+	results = (uint64_t(*)[4])recv->payload;
+
+	for (i = 0; i < count; i++) {
+		smc_res_t res = smc_forward_cached(
+			calls[i].func, calls[i].args[0], calls[i].args[1],
+			calls[i].args[2], calls[i].args[3], calls[i].args[4],
+			calls[i].args[5], client_id);
+		results[i][0] = res.res0;
+		results[i][1] = res.res1;
+		results[i][2] = res.res2;
+		results[i][3] = res.res3;
+	}
+
+	vm_release_recv(vm);
+
+	return count;
+}
+
+/*
+ * Token-bucket rate limiting per (VM, call class), for performance isolation:
+ * a guest flooding a throttled class gets a retry status early in dispatch
+ * instead of degrading every other VM through lock contention and waiter
+ * growth. Rates are in calls per second (0, the default, disables the
+ * bucket) with a burst of one second's worth, and are set by the primary VM.
+ */
+static struct {
+	struct spinlock lock;
+	uint64_t rate;
+	uint64_t tokens;
+	uint64_t last;
+} throttle[MAX_VMS][PERF_NUM_CALLS];
+
+/**
+ * Takes one token from the calling VM's bucket for the class; returns true
+ * if the bucket is empty and the call must be throttled.
+ */
+static bool throttle_exceeded(struct vcpu *vcpu, size_t class)
+{
+	spci_vm_id_t id = vcpu_get_vm_id_fast(vcpu);
+	size_t index;
+	uint64_t now;
+	uint64_t freq;
+	bool exceeded = false;
+
+	if (id < HF_VM_ID_OFFSET ||
+	    (size_t)(id - HF_VM_ID_OFFSET) >= MAX_VMS ||
+	    class >= PERF_NUM_CALLS) {
+		return false;
+	}
+	index = id - HF_VM_ID_OFFSET;
+
+	if (throttle[index][class].rate == 0) {
+		return false;
+	}
+
+	sl_lock(&throttle[index][class].lock);
+	now = read_msr(cntvct_el0);
+	freq = read_msr(cntfrq_el0);
+
+	throttle[index][class].tokens +=
+		(now - throttle[index][class].last) *
+		throttle[index][class].rate / freq;
+	if (throttle[index][class].tokens > throttle[index][class].rate) {
+		throttle[index][class].tokens = throttle[index][class].rate;
+	}
+	throttle[index][class].last = now;
+
+	if (throttle[index][class].tokens == 0) {
+		exceeded = true;
+	} else {
+		throttle[index][class].tokens--;
+	}
+	sl_unlock(&throttle[index][class].lock);
+
+	return exceeded;
+}
+
+/**
+ * Sets the rate limit of one (VM, class) bucket; primary only. Returns 0 on
+ * success.
+ */
+static int64_t throttle_set(uintreg_t arg, uintreg_t rate, struct vcpu *vcpu)
+{
+	spci_vm_id_t id = arg & 0xffff;
+	size_t class = (arg >> 16) & 0xff;
+	size_t index;
+
+	if (vcpu_get_vm_id_fast(vcpu) != HF_PRIMARY_VM_ID) {
+		return -1;
+	}
+
+	if (id < HF_VM_ID_OFFSET ||
+	    (size_t)(id - HF_VM_ID_OFFSET) >= MAX_VMS ||
+	    class >= PERF_NUM_CALLS) {
+		return -1;
+	}
+	index = id - HF_VM_ID_OFFSET;
+
+	sl_lock(&throttle[index][class].lock);
+	throttle[index][class].rate = rate;
+	throttle[index][class].tokens = rate;
+	throttle[index][class].last = read_msr(cntvct_el0);
+	sl_unlock(&throttle[index][class].lock);
+
+	return 0;
+}
+
+/**
+ * Maps a hypercall function ID onto the call class tracked by the latency
+ * instrumentation.
+ */
 static bool spci_handler(uintreg_t func, uintreg_t arg1, uintreg_t arg2,
 			 uintreg_t arg3, uintreg_t *ret, struct vcpu **next)
 {
@@ -299,13 +705,23 @@ static bool spci_handler(uintreg_t func, uintreg_t arg1, uintreg_t arg2,
 		*ret = api_spci_version();
 		return true;
 	case SPCI_YIELD_32:
-		*ret = api_spci_yield(current(), next);
+		*ret = api_spci_yield(arg1, current(), next);
 		return true;
 	case SPCI_MSG_SEND_32:
+		if (throttle_exceeded(current(), PERF_CALL_MSG_SEND)) {
+			*ret = SPCI_RETRY;
+			return true;
+		}
 		*ret = api_spci_msg_send(arg1, current(), next);
 		return true;
+	case SPCI_FEATURES_32:
+		*ret = api_spci_features(arg1, current());
+		return true;
+	case SPCI_MSG_SEND_DIRECT_32:
+		*ret = api_spci_msg_send_direct(arg1, current(), next);
+		return true;
 	case SPCI_MSG_RECV_32:
-		*ret = api_spci_msg_recv(arg1, current(), next);
+		*ret = api_spci_msg_recv(arg1, arg2, current(), next);
 		return true;
 	}
 
@@ -341,17 +757,22 @@ static void update_vi(struct vcpu *next)
  */
 static bool smc_handler(struct vcpu *vcpu, smc_res_t *ret, struct vcpu **next)
 {
-	uint32_t func = vcpu_get_regs(vcpu)->r[0];
+	uint32_t func = vcpu_get_regs_fast(vcpu)->r[0];
 
-	if (psci_handler(vcpu, func, vcpu_get_regs(vcpu)->r[1], vcpu_get_regs(vcpu)->r[2],
-			 vcpu_get_regs(vcpu)->r[3], &ret->res0, next)) {
+	if (psci_handler(vcpu, func, vcpu_get_regs_fast(vcpu)->r[1], vcpu_get_regs_fast(vcpu)->r[2],
+			 vcpu_get_regs_fast(vcpu)->r[3], &ret->res0, next)) {
 		/* SMC PSCI calls are processed by the PSCI handler. */
 		return true;
 	}
 
 	switch (func & ~SMCCC_CONVENTION_MASK) {
+	case HF_DEBUG_LOG_BUFFER:
+		ret->res0 = api_debug_log_buffer(vcpu_get_regs_fast(vcpu)->r[1],
+						 vcpu);
+		return true;
+
 	case HF_DEBUG_LOG:
-		api_debug_log(vcpu_get_regs(vcpu)->r[1], vcpu);
+		api_debug_log(vcpu_get_regs_fast(vcpu)->r[1], vcpu);
 		return true;
 	}
 
@@ -359,92 +780,593 @@ static bool smc_handler(struct vcpu *vcpu, smc_res_t *ret, struct vcpu **next)
 	return smc_forwarder(vcpu, ret);
 }
 
+static size_t perf_call_class(uintreg_t func)
+{
+	switch ((uint32_t)func) {
+	case HF_VCPU_RUN:
+		return PERF_CALL_VCPU_RUN;
+	case SPCI_MSG_SEND_32:
+		return PERF_CALL_MSG_SEND;
+	case HF_SHARE_MEMORY:
+		return PERF_CALL_SHARE_MEMORY;
+	default:
+		return PERF_CALL_OTHER;
+	}
+}
+
+/**
+ * Records the elapsed cycles of the hypercall that is about to return.
+ */
+static void perf_record_call(uintreg_t func, uintreg_t begin,
+			     const uint64_t pmu_begin[PMU_NUM_COUNTERS])
+{
+	perf_record(perf_call_class(func), vcpu_get_vm_id_fast(current()),
+		    read_msr(cntvct_el0) - begin);
+	pmu_sample_end(perf_call_class(func), pmu_begin);
+}
+
+
+/*
+ * Hypercall adapters with a uniform signature, so HF_* dispatch is a single
+ * bounds check and an indexed call through hvc_table below instead of a
+ * branchy switch.
+ */
+typedef void (*hvc_fn_t)(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			 struct hvc_handler_return *ret);
+
+static void hvc_vm_get_id(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			  struct hvc_handler_return *ret)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_vm_get_id(current());
+}
+
+static void hvc_vm_get_count(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			     struct hvc_handler_return *ret)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_vm_get_count();
+}
+
+static void hvc_vcpu_get_count(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			       struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_vcpu_get_count(arg1, current());
+}
+
+static void hvc_vcpu_run(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			 struct hvc_handler_return *ret)
+{
+	(void)arg3;
+	ret->user_ret.res0 = api_vcpu_run(arg1, arg2, current(), &ret->new);
+}
+
+static void hvc_vm_configure(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			     struct hvc_handler_return *ret)
+{
+	ret->user_ret.res0 = api_vm_configure(ipa_init(arg1), ipa_init(arg2),
+					      arg3, current(), &ret->new);
+}
+
+static void hvc_mailbox_clear(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			      struct hvc_handler_return *ret)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_mailbox_clear(current(), &ret->new);
+}
+
+static void hvc_mailbox_writable_get_bulk(uintreg_t arg1, uintreg_t arg2,
+					  uintreg_t arg3,
+					  struct hvc_handler_return *ret)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_mailbox_writable_get_bulk(current());
+}
+
+static void hvc_mailbox_writable_get(uintreg_t arg1, uintreg_t arg2,
+				     uintreg_t arg3,
+				     struct hvc_handler_return *ret)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_mailbox_writable_get(current());
+}
+
+static void hvc_mailbox_waiter_get(uintreg_t arg1, uintreg_t arg2,
+				   uintreg_t arg3,
+				   struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_mailbox_waiter_get(arg1, current());
+}
+
+static void hvc_interrupt_enable(uintreg_t arg1, uintreg_t arg2,
+				 uintreg_t arg3,
+				 struct hvc_handler_return *ret)
+{
+	(void)arg3;
+	ret->user_ret.res0 = api_interrupt_enable(arg1, arg2, current());
+}
+
+static void hvc_interrupt_get(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			      struct hvc_handler_return *ret)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_interrupt_get(current());
+}
+
+static void hvc_interrupt_inject(uintreg_t arg1, uintreg_t arg2,
+				 uintreg_t arg3,
+				 struct hvc_handler_return *ret)
+{
+	ret->user_ret.res0 =
+		api_interrupt_inject(arg1, arg2, arg3, current(), &ret->new);
+}
+
+static void hvc_share_memory(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			     struct hvc_handler_return *ret)
+{
+	if (throttle_exceeded(current(), PERF_CALL_SHARE_MEMORY)) {
+		ret->user_ret.res0 = -1;
+		return;
+	}
+	ret->user_ret.res0 = api_share_memory(
+		arg1 >> 32, ipa_init(arg2), arg3, arg1 & 0xffffffff,
+		current());
+}
+
+static void hvc_perf_read(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			  struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_perf_read(arg1, current());
+}
+
+static void hvc_smc_batch(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			  struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = smc_batch(arg1, current());
+}
+
+static void hvc_share_memory_revoke(uintreg_t arg1, uintreg_t arg2,
+				    uintreg_t arg3,
+				    struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_share_memory_revoke(arg1, current());
+}
+
+static void hvc_mailbox_writable_notify(uintreg_t arg1, uintreg_t arg2,
+					uintreg_t arg3,
+					struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_mailbox_writable_notify(arg1, current());
+}
+
+static void hvc_dirty_track(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			    struct hvc_handler_return *ret)
+{
+	(void)arg3;
+	ret->user_ret.res0 = api_dirty_track(arg1, arg2, current());
+}
+
+static void hvc_dirty_log_read(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			       struct hvc_handler_return *ret)
+{
+	(void)arg3;
+	ret->user_ret.res0 = api_dirty_log_read(arg1, arg2, current());
+}
+
+static void hvc_lock_profile_read(uintreg_t arg1, uintreg_t arg2,
+				  uintreg_t arg3,
+				  struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_lock_profile_read(arg1, current());
+}
+
+static void hvc_debug_log_buffer(uintreg_t arg1, uintreg_t arg2,
+				 uintreg_t arg3,
+				 struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_debug_log_buffer(arg1, current());
+}
+
+static void hvc_interrupt_status_page(uintreg_t arg1, uintreg_t arg2,
+				      uintreg_t arg3,
+				      struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 =
+		api_interrupt_status_page(ipa_init(arg1), current());
+}
+
+static void hvc_pmu_read(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			 struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_pmu_read(arg1, current());
+}
+
+static void hvc_vcpu_sleep_info(uintreg_t arg1, uintreg_t arg2,
+				uintreg_t arg3,
+				struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_vcpu_sleep_info(arg1, current());
+}
+
+static void hvc_interrupt_enable_bulk(uintreg_t arg1, uintreg_t arg2,
+				      uintreg_t arg3,
+				      struct hvc_handler_return *ret)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_interrupt_enable_bulk(current());
+}
+
+static void hvc_vcpu_cycles(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			    struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_vcpu_cycles(arg1, current());
+}
+
+static void hvc_boot_trace(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			   struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_boot_trace_read(arg1, current());
+}
+
+static void hvc_mpool_stat(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			   struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_mpool_stat(arg1, current());
+}
+
+static void hvc_vcpu_telem_page(uintreg_t arg1, uintreg_t arg2,
+				uintreg_t arg3,
+				struct hvc_handler_return *ret)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_vcpu_telem_page(current());
+}
+
+static void hvc_vcpu_token(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			   struct hvc_handler_return *ret)
+{
+	(void)arg3;
+	ret->user_ret.res0 = api_vcpu_token(arg1, arg2, current());
+}
+
+static void hvc_vcpu_run_token(uintreg_t arg1, uintreg_t arg2,
+			       uintreg_t arg3,
+			       struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_vcpu_run_token(arg1, current(), &ret->new);
+}
+
+static void hvc_wset_sample(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			    struct hvc_handler_return *ret)
+{
+	ret->user_ret.res0 = api_wset_sample(arg1, arg2, arg3, current());
+}
+
+static void hvc_vm_reset(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			 struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_vm_reset(arg1, current());
+}
+
+static void hvc_throttle_set(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			     struct hvc_handler_return *ret)
+{
+	(void)arg3;
+	ret->user_ret.res0 = throttle_set(arg1, arg2, current());
+}
+
+/**
+ * Dispatch table for the dense HF_* function ID range, indexed by
+ * arg0 - HF_VM_GET_ID. NULL slots are unallocated IDs.
+ */
+static void hvc_multicall(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			  struct hvc_handler_return *ret);
+
+static void hvc_vm_sched_attrs(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			       struct hvc_handler_return *ret)
+{
+	(void)arg2;
+	(void)arg3;
+	ret->user_ret.res0 = api_vm_sched_attrs(arg1, current());
+}
+
+static void hvc_vm_telemetry(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			     struct hvc_handler_return *ret)
+{
+	(void)arg3;
+	ret->user_ret.res0 = api_vm_telemetry(arg1, arg2, current());
+}
+
+static void hvc_page_grant(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			   struct hvc_handler_return *ret)
+{
+	(void)arg3;
+	ret->user_ret.res0 = api_page_grant(arg1, arg2, current());
+}
+
+static void hvc_vm_clone(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			 struct hvc_handler_return *ret)
+{
+	ret->user_ret.res0 = api_vm_clone(arg1, arg2, arg3, current());
+}
+
+static void hvc_idle_residency(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			       struct hvc_handler_return *ret)
+{
+	(void)arg3;
+	ret->user_ret.res0 = api_idle_residency(arg1, arg2, current());
+}
+
+static hvc_fn_t const hvc_table[] = {
+	[HF_VM_GET_ID - 0xff00] = hvc_vm_get_id,
+	[HF_VM_GET_COUNT - 0xff00] = hvc_vm_get_count,
+	[HF_VCPU_GET_COUNT - 0xff00] = hvc_vcpu_get_count,
+	[HF_VCPU_RUN - 0xff00] = hvc_vcpu_run,
+	[HF_VM_CONFIGURE - 0xff00] = hvc_vm_configure,
+	[HF_MAILBOX_CLEAR - 0xff00] = hvc_mailbox_clear,
+	[HF_MAILBOX_WRITABLE_GET - 0xff00] = hvc_mailbox_writable_get,
+	[HF_MAILBOX_WAITER_GET - 0xff00] = hvc_mailbox_waiter_get,
+	[HF_INTERRUPT_ENABLE - 0xff00] = hvc_interrupt_enable,
+	[HF_INTERRUPT_GET - 0xff00] = hvc_interrupt_get,
+	[HF_INTERRUPT_INJECT - 0xff00] = hvc_interrupt_inject,
+	[HF_SHARE_MEMORY - 0xff00] = hvc_share_memory,
+	[HF_PERF_READ - 0xff00] = hvc_perf_read,
+	[HF_SMC_BATCH - 0xff00] = hvc_smc_batch,
+	[HF_SHARE_MEMORY_REVOKE - 0xff00] = hvc_share_memory_revoke,
+	[HF_MAILBOX_WRITABLE_NOTIFY - 0xff00] = hvc_mailbox_writable_notify,
+	[HF_DIRTY_TRACK - 0xff00] = hvc_dirty_track,
+	[HF_DIRTY_LOG_READ - 0xff00] = hvc_dirty_log_read,
+	[HF_LOCK_PROFILE_READ - 0xff00] = hvc_lock_profile_read,
+	[HF_DEBUG_LOG_BUFFER - 0xff00] = hvc_debug_log_buffer,
+	[HF_INTERRUPT_STATUS_PAGE - 0xff00] = hvc_interrupt_status_page,
+	[HF_PMU_READ - 0xff00] = hvc_pmu_read,
+	[HF_VCPU_SLEEP_INFO - 0xff00] = hvc_vcpu_sleep_info,
+	[HF_INTERRUPT_ENABLE_BULK - 0xff00] = hvc_interrupt_enable_bulk,
+	[HF_VCPU_CYCLES - 0xff00] = hvc_vcpu_cycles,
+	[HF_BOOT_TRACE - 0xff00] = hvc_boot_trace,
+	[HF_THROTTLE_SET - 0xff00] = hvc_throttle_set,
+	[HF_MAILBOX_WRITABLE_GET_BULK - 0xff00] = hvc_mailbox_writable_get_bulk,
+	[HF_VM_RESET - 0xff00] = hvc_vm_reset,
+	[HF_WSET_SAMPLE - 0xff00] = hvc_wset_sample,
+	[HF_VCPU_TOKEN - 0xff00] = hvc_vcpu_token,
+	[HF_VCPU_RUN_TOKEN - 0xff00] = hvc_vcpu_run_token,
+	[HF_VCPU_TELEM_PAGE - 0xff00] = hvc_vcpu_telem_page,
+	[HF_MPOOL_STAT - 0xff00] = hvc_mpool_stat,
+	[HF_MULTICALL - 0xff00] = hvc_multicall,
+	[HF_VM_SCHED_ATTRS - 0xff00] = hvc_vm_sched_attrs,
+	[HF_VM_TELEMETRY - 0xff00] = hvc_vm_telemetry,
+	[HF_PAGE_GRANT - 0xff00] = hvc_page_grant,
+	[HF_VM_CLONE - 0xff00] = hvc_vm_clone,
+	[HF_IDLE_RESIDENCY - 0xff00] = hvc_idle_residency,
+};
+
+/**
+ * Xen-style multicall: executes up to HF_MULTICALL_MAX batched hypercalls
+ * described in the caller's send buffer, writing per-call results into its
+ * empty receive buffer, so predictable sequences (clear mailbox, fetch
+ * waiter, inject interrupt, run vCPU) cost one trap instead of one each.
+ * Only table hypercalls may be batched — in particular no nested multicall
+ * — and a call that switches vCPUs ends the batch after being performed,
+ * with the count of executed calls reported so the guest can resubmit the
+ * tail.
+ */
+static void hvc_multicall(uintreg_t arg1, uintreg_t arg2, uintreg_t arg3,
+			  struct hvc_handler_return *ret)
+{
+	struct vm *vm = vcpu_get_vm(current());
+	const struct hf_multicall_entry *entries;
+	int64_t results[HF_MULTICALL_MAX];
+	size_t count = arg1;
+	size_t done = 0;
+	size_t i;
+
+	(void)arg2;
+	(void)arg3;
+
+	entries = (const struct hf_multicall_entry *)vm_get_send_ptr(vm);
+
+	if (count > HF_MULTICALL_MAX || entries == NULL ||
+	    vm_get_empty_recv_ptr(vm) == NULL) {
+		ret->user_ret.res0 = -1;
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		uint32_t func = (uint32_t)entries[i].func;
+		struct hvc_handler_return sub;
+
+		sub.user_ret.res0 = -1;
+		sub.new = NULL;
+
+		if (func - 0xff00 < ARRAY_SIZE(hvc_table) &&
+		    func != HF_MULTICALL &&
+		    hvc_table[func - 0xff00] != NULL) {
+			hvc_table[func - 0xff00](entries[i].args[0],
+						 entries[i].args[1],
+						 entries[i].args[2], &sub);
+		}
+
+		results[i] = sub.user_ret.res0;
+		done = i + 1;
+
+		if (sub.new != NULL) {
+			ret->new = sub.new;
+			break;
+		}
+	}
+
+	/*
+	 * Publish the results under the regular Empty->Filling reservation:
+	 * it is skipped if the buffer is occupied (a batched mailbox_clear
+	 * may have refilled a queued message into it) and it excludes
+	 * concurrent senders on other CPUs for the duration of the stores.
+	 * The count is returned either way, so the guest knows how far the
+	 * batch ran.
+	 */
+	vm_publish_multicall_results(vm, results, done);
+
+	ret->user_ret.res0 = done;
+}
+
 struct hvc_handler_return hvc_handler(uintreg_t arg0, uintreg_t arg1,
 				      uintreg_t arg2, uintreg_t arg3)
 {
 	struct hvc_handler_return ret;
+	uintreg_t perf_begin = read_msr(cntvct_el0);
+	uint64_t pmu_begin[PMU_NUM_COUNTERS];
+
+	pmu_sample_begin(pmu_begin);
 
 	ret.new = NULL;
 
+	watchdog_heartbeat(cpu_index(vcpu_get_cpu(current())),
+			   read_msr(elr_el2), read_msr(spsr_el2));
+
 	if (psci_handler(current(), arg0, arg1, arg2, arg3, &ret.user_ret.res0,
 			 &ret.new)) {
+		perf_record_call(arg0, perf_begin, pmu_begin);
 		return ret;
 	}
 
 	if (spci_handler(arg0, arg1, arg2, arg3, &ret.user_ret.res0,
 			 &ret.new)) {
 		update_vi(ret.new);
+		perf_record_call(arg0, perf_begin, pmu_begin);
 		return ret;
 	}
 
-	switch ((uint32_t)arg0) {
-	case HF_VM_GET_ID:
-		ret.user_ret.res0 = api_vm_get_id(current());
-		break;
-
-	case HF_VM_GET_COUNT:
-		ret.user_ret.res0 = api_vm_get_count();
-		break;
+	{
+		uint32_t func = (uint32_t)arg0;
 
-	case HF_VCPU_GET_COUNT:
-		ret.user_ret.res0 = api_vcpu_get_count(arg1, current());
-		break;
+		if (likely(func >= 0xff00 &&
+			   func - 0xff00 < ARRAY_SIZE(hvc_table) &&
+			   hvc_table[func - 0xff00] != NULL)) {
+			hvc_table[func - 0xff00](arg1, arg2, arg3, &ret);
+		} else if (func == HF_DEBUG_LOG) {
+			ret.user_ret.res0 = api_debug_log(arg1, current());
+		} else {
+			ret.user_ret.res0 = -1;
+		}
+	}
 
-	case HF_VCPU_RUN:
-		ret.user_ret.res0 = api_vcpu_run(arg1, arg2, current(), &ret.new);
-		break;
+	update_vi(ret.new);
+	perf_record_call(arg0, perf_begin, pmu_begin);
 
-	case HF_VM_CONFIGURE:
-		ret.user_ret.res0 = api_vm_configure(
-			ipa_init(arg1), ipa_init(arg2), current(), &ret.new);
-		break;
+	return ret;
+}
 
-	case HF_MAILBOX_CLEAR:
-		ret.user_ret.res0 = api_mailbox_clear(current(), &ret.new);
-		break;
+struct vcpu *irq_lower(void)
+{
+	size_t wd_cpu = cpu_index(vcpu_get_cpu(current()));
 
-	case HF_MAILBOX_WRITABLE_GET:
-		ret.user_ret.res0 = api_mailbox_writable_get(current());
-		break;
+	/* Publish liveness and play monitor for the other CPUs. */
+	watchdog_heartbeat(wd_cpu, read_msr(elr_el2), read_msr(spsr_el2));
+	watchdog_check(wd_cpu);
 
-	case HF_MAILBOX_WAITER_GET:
-		ret.user_ret.res0 = api_mailbox_waiter_get(arg1, current());
-		break;
+	/*
+	 * A GIC maintenance (underflow) interrupt just means the list
+	 * registers ran dry: refill them in bulk and resume the guest
+	 * without a scheduler round trip.
+	 */
+	gicv3_lr_refill(current());
 
-	case HF_INTERRUPT_ENABLE:
-		ret.user_ret.res0 = api_interrupt_enable(arg1, arg2, current());
-		break;
+	/* Service the console TX ring; this also clears its interrupt. */
+	plat_console_drain();
 
-	case HF_INTERRUPT_GET:
-		ret.user_ret.res0 = api_interrupt_get(current());
-		break;
-
-	case HF_INTERRUPT_INJECT:
-		ret.user_ret.res0 = api_interrupt_inject(arg1, arg2, arg3,
-							 current(), &ret.new);
-		break;
+	/*
+	 * Wake every tracked vCPU whose timer deadline has passed in one
+	 * pass, so the primary finds them all interrupted when it reschedules.
+	 */
+	arch_timer_queue_expire(cpu_index(vcpu_get_cpu(current())));
 
-	case HF_SHARE_MEMORY:
-		ret.user_ret.res0 =
-			api_share_memory(arg1 >> 32, ipa_init(arg2), arg3,
-					 arg1 & 0xffffffff, current());
-		break;
+#if GIC_VERSION == 3 || GIC_VERSION == 4
+	/*
+	 * Posted-interrupt delivery: if the highest-priority pending
+	 * physical interrupt is the hypervisor's own kick SGI, consume it at
+	 * EL2, fold the lock-free posted vIRQs into this vCPU, reload the
+	 * list registers (or raise the virtual IRQ line for VMs that take
+	 * interrupts through HF_INTERRUPT_GET) and resume the guest
+	 * directly: the IRQ is observed with no world switch into the
+	 * primary at all. Anything else pending still goes the preemption
+	 * route below, as physical interrupts belong to the primary.
+	 */
+	if ((read_msr(icc_hppir1_el1) & 0xffffff) == HF_KICK_SGI_INTID) {
+		uint32_t intid = read_msr(icc_iar1_el1) & 0xffffff;
 
-	case HF_DEBUG_LOG:
-		ret.user_ret.res0 = api_debug_log(arg1, current());
-		break;
+		if (intid == HF_KICK_SGI_INTID) {
+			write_msr(icc_eoir1_el1, intid);
 
-	default:
-		ret.user_ret.res0 = -1;
+			/*
+			 * The live ICC_CTLR_EL1 belongs to the interrupted
+			 * guest; with its EOImode set, eoir above only
+			 * priority-drops, so deactivate explicitly or the
+			 * SGI stays active and later kicks are swallowed.
+			 */
+			if (read_msr(icc_ctlr_el1) & (1u << 1)) {
+				write_msr(icc_dir_el1, intid);
+			}
+			isb();
+
+			vcpu_drain_remote_intids(current());
+			gicv3_lr_refill(current());
+			set_virtual_interrupt_current(
+				vcpu_is_interrupted(current()));
+
+			if ((read_msr(icc_hppir1_el1) & 0xffffff) >= 1020) {
+				return NULL;
+			}
+		}
 	}
+#endif
 
-	update_vi(ret.new);
-
-	return ret;
-}
-
-struct vcpu *irq_lower(void)
-{
 	/*
 	 * Switch back to primary VM, interrupts will be handled there.
 	 *
@@ -507,9 +1429,13 @@ struct vcpu *sync_lower_exception(uintreg_t esr)
 	uintreg_t ec = GET_EC(esr);
 
 	switch (ec) {
+	case 0x07: /* EC = 000111, FP/SIMD access. */
+		fpsimd_handle_trap(vcpu);
+		return NULL;
+
 	case 0x01: /* EC = 000001, WFI or WFE. */
 		/* Skip the instruction. */
-		vcpu_get_regs(vcpu)->pc += GET_NEXT_PC_INC(esr);
+		vcpu_get_regs_fast(vcpu)->pc += GET_NEXT_PC_INC(esr);
 		/* Check TI bit of ISS, 0 = WFI, 1 = WFE. */
 		if (esr & 1) {
 			/* WFE */
@@ -524,6 +1450,26 @@ struct vcpu *sync_lower_exception(uintreg_t esr)
 		return api_wait_for_interrupt(vcpu);
 
 	case 0x24: /* EC = 100100, Data abort. */
+		/*
+		 * Emulated MMIO first: with valid syndrome information (ISV)
+		 * the access is decoded straight from the ISS fields and
+		 * dispatched to the VM's region table, skipping the generic
+		 * fault path entirely.
+		 */
+		if (esr & (1u << 24)) { /* ISV */
+			uintpaddr_t ipa = (read_msr(hpfar_el2) << 8) |
+					  (read_msr(far_el2) & (PAGE_SIZE - 1));
+
+			if (vcpu_mmio_dispatch(vcpu, ipa,
+					       (esr & (1u << 6)) != 0,
+					       (esr >> 16) & 0x1f,
+					       1u << ((esr >> 22) & 0x3))) {
+				vcpu_get_regs_fast(vcpu)->pc +=
+					GET_NEXT_PC_INC(esr);
+				return NULL;
+			}
+		}
+
 		info = fault_info_init(
 			esr, vcpu, (esr & (1u << 6)) ? MM_MODE_W : MM_MODE_R);
 		if (vcpu_handle_page_fault(vcpu, &info)) {
@@ -539,22 +1485,22 @@ struct vcpu *sync_lower_exception(uintreg_t esr)
 		break;
 
 	case 0x17: /* EC = 010111, SMC instruction. */ {
-		uintreg_t smc_pc = vcpu_get_regs(vcpu)->pc;
+		uintreg_t smc_pc = vcpu_get_regs_fast(vcpu)->pc;
 		smc_res_t ret;
 		struct vcpu *next = NULL;
 
 		if (!smc_handler(vcpu, &ret, &next)) {
 			/* TODO(b/132421503): handle SMC forward rejection  */
-			dlog("Unsupported SMC call: %#x\n", vcpu_get_regs(vcpu)->r[0]);
+			dlog("Unsupported SMC call: %#x\n", vcpu_get_regs_fast(vcpu)->r[0]);
 			ret.res0 = PSCI_ERROR_NOT_SUPPORTED;
 		}
 
 		/* Skip the SMC instruction. */
-		vcpu_get_regs(vcpu)->pc = smc_pc + GET_NEXT_PC_INC(esr);
-		vcpu_get_regs(vcpu)->r[0] = ret.res0;
-		vcpu_get_regs(vcpu)->r[1] = ret.res1;
-		vcpu_get_regs(vcpu)->r[2] = ret.res2;
-		vcpu_get_regs(vcpu)->r[3] = ret.res3;
+		vcpu_get_regs_fast(vcpu)->pc = smc_pc + GET_NEXT_PC_INC(esr);
+		vcpu_get_regs_fast(vcpu)->r[0] = ret.res0;
+		vcpu_get_regs_fast(vcpu)->r[1] = ret.res1;
+		vcpu_get_regs_fast(vcpu)->r[2] = ret.res2;
+		vcpu_get_regs_fast(vcpu)->r[3] = ret.res3;
 		return next;
 	}
 
@@ -572,7 +1518,7 @@ struct vcpu *sync_lower_exception(uintreg_t esr)
 	default:
 		dlog("Unknown lower sync exception pc=%#x, esr=%#x, "
 		     "ec=%#x\n",
-		     vcpu_get_regs(vcpu)->pc, esr, ec);
+		     vcpu_get_regs_fast(vcpu)->pc, esr, ec);
 		break;
 	}
 
@@ -587,7 +1533,7 @@ struct vcpu *sync_lower_exception(uintreg_t esr)
 struct vcpu *handle_system_register_access(uintreg_t esr)
 {
 	struct vcpu *vcpu = current();
-	spci_vm_id_t vm_id = vm_get_id(vcpu_get_vm(vcpu));
+	spci_vm_id_t vm_id = vcpu_get_vm_id_fast(vcpu);
 	uintreg_t ec = GET_EC(esr);
 
 	CHECK(ec == 0x18);
@@ -606,6 +1552,6 @@ struct vcpu *handle_system_register_access(uintreg_t esr)
 	}
 
 	/* Instruction was fulfilled above. Skip it and run the next one. */
-	vcpu_get_regs(vcpu)->pc += GET_NEXT_PC_INC(esr);
+	vcpu_get_regs_fast(vcpu)->pc += GET_NEXT_PC_INC(esr);
 	return NULL;
 }
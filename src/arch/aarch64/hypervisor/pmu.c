@@ -0,0 +1,119 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pmu.h"
+
+#include "hf/perf.h"
+#include "hf/vm.h"
+
+#include "vmapi/hf/types.h"
+
+#include "msr.h"
+
+/*
+ * Hypervisor self-profiling through the PMU: the cycle counter and two event
+ * counters are sampled around every hypercall and the deltas accumulated per
+ * CPU and per call class, so e.g. the cache-miss-per-cycle breakdown of
+ * api_share_memory is observable in production without an external profiler.
+ */
+
+/* PMCR_EL0 bits. */
+#define PMCR_EL0_E (UINT64_C(1) << 0) /* Enable. */
+#define PMCR_EL0_P (UINT64_C(1) << 1) /* Reset event counters. */
+#define PMCR_EL0_C (UINT64_C(1) << 2) /* Reset cycle counter. */
+
+/* PMCNTENSET_EL0: cycle counter plus event counters 0 and 1. */
+#define PMCNTEN_CYCLES (UINT64_C(1) << 31)
+#define PMCNTEN_EVT0 (UINT64_C(1) << 0)
+#define PMCNTEN_EVT1 (UINT64_C(1) << 1)
+
+/* Default events: L1D cache refills and L1D cache accesses. */
+#define PMU_EVT0 0x03
+#define PMU_EVT1 0x04
+
+/**
+ * Accumulated deltas: [cpu][call class][counter], where counter 0 is cycles
+ * and 1/2 are the programmed events. Each element is only written by its
+ * owning CPU; the reader tolerates tearing.
+ */
+static uint64_t pmu_stats[MAX_CPUS][PERF_NUM_CALLS][PMU_NUM_COUNTERS];
+
+/**
+ * Programs and enables the counters on the calling CPU. Called once per CPU
+ * during bring-up.
+ */
+void arch_pmu_cpu_init(void)
+{
+	write_msr(pmevtyper0_el0, PMU_EVT0);
+	write_msr(pmevtyper1_el0, PMU_EVT1);
+	write_msr(pmcntenset_el0,
+		  PMCNTEN_CYCLES | PMCNTEN_EVT0 | PMCNTEN_EVT1);
+	write_msr(pmcr_el0, read_msr(pmcr_el0) | PMCR_EL0_E | PMCR_EL0_P |
+				    PMCR_EL0_C);
+	isb();
+}
+
+void pmu_sample_begin(uint64_t begin[PMU_NUM_COUNTERS])
+{
+	begin[0] = read_msr(pmccntr_el0);
+	begin[1] = read_msr(pmevcntr0_el0);
+	begin[2] = read_msr(pmevcntr1_el0);
+}
+
+void pmu_sample_end(size_t call, const uint64_t begin[PMU_NUM_COUNTERS])
+{
+	size_t cpu = arch_cpu_index_current();
+	uint64_t *stats;
+
+	if (call >= PERF_NUM_CALLS || cpu >= MAX_CPUS) {
+		return;
+	}
+
+	stats = pmu_stats[cpu][call];
+	stats[0] += read_msr(pmccntr_el0) - begin[0];
+	stats[1] += read_msr(pmevcntr0_el0) - begin[1];
+	stats[2] += read_msr(pmevcntr1_el0) - begin[2];
+}
+
+/**
+ * Reads (and optionally resets) one accumulated PMU value. The argument packs
+ * the query: bits [7:0] the call class, bits [15:8] the counter index, bits
+ * [23:16] the CPU index, bit 24 reset-after-read. Only the primary VM may
+ * read.
+ */
+int64_t api_pmu_read(uint64_t arg, struct vcpu *current)
+{
+	size_t call = arg & 0xff;
+	size_t counter = (arg >> 8) & 0xff;
+	size_t cpu = (arg >> 16) & 0xff;
+	int64_t value;
+
+	if (vm_get_id(vcpu_get_vm(current)) != HF_PRIMARY_VM_ID) {
+		return -1;
+	}
+
+	if (call >= PERF_NUM_CALLS || counter >= PMU_NUM_COUNTERS ||
+	    cpu >= MAX_CPUS) {
+		return -1;
+	}
+
+	value = pmu_stats[cpu][call][counter];
+	if (arg & (UINT64_C(1) << 24)) {
+		pmu_stats[cpu][call][counter] = 0;
+	}
+
+	return value;
+}
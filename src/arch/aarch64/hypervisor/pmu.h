@@ -0,0 +1,30 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hf/cpu.h"
+
+/** The counters sampled around every hypercall: cycles plus two events. */
+#define PMU_NUM_COUNTERS 3
+
+void arch_pmu_cpu_init(void);
+void pmu_sample_begin(uint64_t begin[PMU_NUM_COUNTERS]);
+void pmu_sample_end(size_t call, const uint64_t begin[PMU_NUM_COUNTERS]);
+int64_t api_pmu_read(uint64_t arg, struct vcpu *current);
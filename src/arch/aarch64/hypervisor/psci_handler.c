@@ -27,6 +27,7 @@
 #include "hf/spci.h"
 #include "hf/vm.h"
 
+#include "msr.h"
 #include "psci.h"
 #include "smc.h"
 
@@ -40,6 +41,17 @@ void arch_one_time_init(void)
 	smc_res_t smc_res =
 		smc32(PSCI_VERSION, 0, 0, 0, 0, 0, 0, SMCCC_CALLER_HYPERVISOR);
 
+#if HAS_LSE
+	/*
+	 * This image was compiled with LSE atomics; refuse to run on a core
+	 * without the extension (ID_AA64ISAR0_EL1.Atomic >= 2) rather than
+	 * take an undefined-instruction fault on the first lock.
+	 */
+	if (((read_msr(id_aa64isar0_el1) >> 20) & 0xf) < 2) {
+		panic("LSE image on a core without ARMv8.1 atomics");
+	}
+#endif
+
 	el3_psci_version = smc_res.res0;
 
 	/* Check there's nothing unexpected about PSCI. */
@@ -152,21 +164,38 @@ bool psci_primary_vm_handler(struct vcpu *vcpu, uint32_t func, uintreg_t arg0,
 			break;
 		}
 
-		sl_lock(&c->lock);
-		if (c->is_on) {
+		/*
+		 * Guests poll this in tight loops during vCPU bring-up; one
+		 * acquire load keeps the poll trap cheap and contention-free.
+		 */
+		if (cpu_is_on_lockfree(c)) {
 			*ret = PSCI_RETURN_ON;
 		} else {
 			*ret = PSCI_RETURN_OFF;
 		}
-		sl_unlock(&c->lock);
 		break;
 
 	case PSCI_CPU_SUSPEND: {
 		/*
-		 * Update vcpu state to wake from the provided entry point but
-		 * if suspend returns, for example because it failed or was a
-		 * standby power state, the SMC will return and the updated
-		 * vcpu registers will be ignored.
+		 * Shallow (standby/retention) states preserve the EL2 context:
+		 * the SMC returns right here with everything live, so skip the
+		 * vCPU entry-point rewrite and don't hand firmware a resume
+		 * entry at all. Tickless guests take this path thousands of
+		 * times per second. StateType is bit 30 of the extended
+		 * StateID format this implementation advertises.
+		 */
+		if (!(arg0 & (UINT64_C(1) << 30))) {
+			smc_res = smc64(PSCI_CPU_SUSPEND, arg0, 0, 0, 0, 0, 0,
+					SMCCC_CALLER_HYPERVISOR);
+			*ret = smc_res.res0;
+			break;
+		}
+
+		/*
+		 * Power-down: update vcpu state to wake from the provided
+		 * entry point, but if suspend returns, for example because it
+		 * failed, the SMC will return and the updated vcpu registers
+		 * will be ignored.
 		 */
 		arch_regs_set_pc_arg(vcpu_get_regs(vcpu), ipa_init(arg1), arg2);
 		smc_res = smc64(PSCI_CPU_SUSPEND, arg0, (uintreg_t)&cpu_entry,
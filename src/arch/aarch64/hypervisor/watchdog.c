@@ -0,0 +1,109 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "watchdog.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#include "hf/arch/cpu.h"
+
+#include "hf/cpu.h"
+#include "hf/dlog.h"
+
+#include "msr.h"
+
+/*
+ * Cross-CPU lockup watchdog. Every CPU publishes a heartbeat counter (plus
+ * its last trap ELR/SPSR) into a cache-line-sized slot on every trap; any
+ * CPU that happens to take a trap also plays monitor, comparing the other
+ * CPUs' counters against the last value it saw. A counter that hasn't moved
+ * for WATCHDOG_STALL_TICKS of counter time is reported once — with the
+ * stuck CPU's last known ELR/SPSR — through the deferred-log-bypassing path,
+ * and the stuck CPU is kicked with an SGI so that, if it can still take
+ * interrupts, its next trap refreshes the diagnosis.
+ */
+
+/** Roughly ten seconds at typical 10-100 MHz counter frequencies. */
+#define WATCHDOG_STALL_TICKS (UINT64_C(1) << 31)
+
+struct watchdog_slot {
+	alignas(CACHE_LINE_SIZE) atomic_uint_fast64_t heartbeat;
+	uintreg_t elr;
+	uintreg_t spsr;
+
+	/* Monitor-side bookkeeping; only ever touched by the monitor pass. */
+	uint64_t seen;
+	uint64_t seen_at;
+	bool reported;
+};
+
+static struct watchdog_slot slots[MAX_CPUS];
+
+/** Publishes this CPU's liveness and last trap location. */
+void watchdog_heartbeat(size_t cpu, uintreg_t elr, uintreg_t spsr)
+{
+	if (cpu >= MAX_CPUS) {
+		return;
+	}
+
+	slots[cpu].elr = elr;
+	slots[cpu].spsr = spsr;
+	atomic_fetch_add_explicit(&slots[cpu].heartbeat, 1,
+				  memory_order_relaxed);
+}
+
+/** Monitor pass run opportunistically from trap context on any CPU. */
+void watchdog_check(size_t cpu)
+{
+	uint64_t now = read_msr(cntvct_el0);
+	size_t i;
+
+	for (i = 0; i < MAX_CPUS; i++) {
+		uint64_t beat;
+
+		if (i == cpu) {
+			continue;
+		}
+
+		beat = atomic_load_explicit(&slots[i].heartbeat,
+					    memory_order_relaxed);
+
+		/* Never started, or progressed since last seen. */
+		if (beat == 0 || beat != slots[i].seen) {
+			slots[i].seen = beat;
+			slots[i].seen_at = now;
+			slots[i].reported = false;
+			continue;
+		}
+
+		if (slots[i].reported ||
+		    now - slots[i].seen_at < WATCHDOG_STALL_TICKS) {
+			continue;
+		}
+
+		slots[i].reported = true;
+		dlog("WATCHDOG: cpu %u stalled; last trap elr=%#x spsr=%#x\n",
+		     (uint32_t)i, slots[i].elr, slots[i].spsr);
+		dlog_flush();
+
+		/*
+		 * Kick the stuck CPU: if it can still take interrupts, its
+		 * next trap refreshes the heartbeat and its ELR.
+		 */
+		arch_cpu_kick(cpu_id_of_index(i));
+	}
+}
@@ -56,6 +56,9 @@ struct float_reg {
 static_assert(sizeof(struct float_reg) == FLOAT_REG_BYTES,
 	      "Ensure float register type is 128 bits.");
 
+/** The SGI the hypervisor uses to kick remote CPUs out of their guest. */
+#define HF_KICK_SGI_INTID 8
+
 /** Arch-specifc information about a VM. */
 struct arch_vm {
 	/**
@@ -65,6 +68,21 @@ struct arch_vm {
 	 * access this field.
 	 */
 	spci_vcpu_index_t last_vcpu_on_cpu[MAX_CPUS];
+
+	/**
+	 * Generation-tagged stage-2 VMID, managed by arch_mm_assign_vmid();
+	 * zero until the VM first runs.
+	 */
+	uint64_t vmid;
+
+	/**
+	 * Cache of constant trapped-sysreg read results, populated on first
+	 * access (see debug_el1_process_access). Refills are idempotent
+	 * reads of invariant registers, so no lock is needed.
+	 */
+	uintreg_t sysreg_mdrar;
+	uintreg_t sysreg_dbgauthstatus;
+	uint32_t sysreg_cache_valid;
 };
 
 /** Type to represent the register state of a vCPU.  */
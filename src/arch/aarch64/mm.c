@@ -16,6 +16,11 @@
 
 #include "hf/mm.h"
 
+#include <stdalign.h>
+
+#include "hf/panic.h"
+#include "hf/spinlock.h"
+
 #include "hf/arch/barriers.h"
 #include "hf/arch/cpu.h"
 
@@ -112,6 +117,9 @@
 #define PTE_ADDR_MASK \
 	(((UINT64_C(1) << 48) - 1) & ~((UINT64_C(1) << PAGE_BITS) - 1))
 
+/** The contiguous hint bit of block/page descriptors. */
+#define PTE_CONT (UINT64_C(1) << 52)
+
 /** Mask for the attribute bits of the pte. */
 #define PTE_ATTR_MASK (~(PTE_ADDR_MASK | (UINT64_C(1) << 1)))
 
@@ -239,6 +247,31 @@ paddr_t arch_mm_block_from_pte(pte_t pte, uint8_t level)
  * Extracts the physical address of the page table referred to by the given page
  * table entry.
  */
+/**
+ * Software-available bit on table descriptors (architecturally IGNORED,
+ * bits[58:51]) marking the subtree below as attribute-uniform: every leaf
+ * reachable through the entry carries identical attributes, so a range
+ * query may read them off any single leaf. Maintained by the stage-agnostic
+ * table code; being software-only, it can be set and cleared in place
+ * without break-before-make.
+ */
+#define PTE_TABLE_UNIFORM (UINT64_C(1) << 55)
+
+pte_t arch_mm_table_pte_set_uniform(pte_t pte)
+{
+	return pte | PTE_TABLE_UNIFORM;
+}
+
+pte_t arch_mm_table_pte_clear_uniform(pte_t pte)
+{
+	return pte & ~PTE_TABLE_UNIFORM;
+}
+
+bool arch_mm_table_pte_is_uniform(pte_t pte)
+{
+	return (pte & PTE_TABLE_UNIFORM) != 0;
+}
+
 paddr_t arch_mm_table_from_pte(pte_t pte, uint8_t level)
 {
 	(void)level;
@@ -299,6 +332,171 @@ void arch_mm_invalidate_stage1_range(vaddr_t va_begin, vaddr_t va_end)
 	isb();
 }
 
+/*
+ * Stage-2 VMID allocation.
+ *
+ * VMIDs are handed out from the live generation on demand, in the style of
+ * Linux's ASID allocator: a VM keeps its VMID for as long as the generation
+ * lasts, so switching VMs on the vcpu_run path never needs a TLB flush. Only
+ * when the 8-bit space is exhausted does the allocator start a new
+ * generation, broadcast one tlbi vmalls12e1is, and reseed. VMIDs live on
+ * other CPUs at rollover are carried into the new generation so the VMs
+ * using them re-validate without ever running with a stale translation.
+ */
+
+#define VMID_BITS UINT64_C(8)
+#define VMID_MASK ((UINT64_C(1) << VMID_BITS) - 1)
+#define VMID_GENERATION (UINT64_C(1) << VMID_BITS)
+
+static struct spinlock vmid_lock = SPINLOCK_INIT;
+
+/* Generation tag in the bits above VMID_BITS; starts non-zero so that a
+ * zeroed per-VM slot always misses the fast path. */
+static uint64_t vmid_generation = VMID_GENERATION;
+
+/* Bitmap of VMIDs handed out in the live generation; bit 0 is reserved. */
+static uint64_t vmid_used[(VMID_MASK + 1) / 64] = {1};
+
+/* The generation-tagged VMID running on each physical CPU; written by its
+ * own CPU, read by whichever CPU performs a rollover under vmid_lock. */
+static volatile uint64_t vmid_active[MAX_CPUS];
+
+/**
+ * If `vmid` is currently live on some CPU, re-tags those entries with
+ * `newvmid` so the VM keeps its hardware VMID across the rollover, and
+ * returns true. Called with vmid_lock held.
+ */
+static bool vmid_check_update_reserved(uint64_t vmid, uint64_t newvmid)
+{
+	bool hit = false;
+	size_t i;
+
+	for (i = 0; i < MAX_CPUS; i++) {
+		if (vmid_active[i] == vmid) {
+			vmid_active[i] = newvmid;
+			hit = true;
+		}
+	}
+
+	return hit;
+}
+
+/**
+ * Allocates a free VMID from the live generation, rolling the generation
+ * over when the space is exhausted. Called with vmid_lock held.
+ */
+static uint64_t vmid_alloc_locked(void)
+{
+	uint64_t id;
+	size_t i;
+
+	for (id = 1; id <= VMID_MASK; id++) {
+		if (!(vmid_used[id / 64] & (UINT64_C(1) << (id % 64)))) {
+			vmid_used[id / 64] |= UINT64_C(1) << (id % 64);
+			return id;
+		}
+	}
+
+	/*
+	 * Space exhausted: start a new generation. Every translation tagged
+	 * with the old generation's VMIDs is flushed from all CPUs, and the
+	 * VMIDs still live on other CPUs are reserved in the new generation
+	 * so the VMs holding them keep running unflushed.
+	 */
+	vmid_generation += VMID_GENERATION;
+
+	/*
+	 * The new generation must be visible before vmid_active is scanned:
+	 * this pairs with the dmb in the fast path of arch_mm_assign_vmid().
+	 * Without it the store could sit in the store buffer past the loads
+	 * below, the scan would miss a VMID being published concurrently, and
+	 * that CPU's stale generation re-check would still pass - handing the
+	 * same VMID to two VMs.
+	 */
+	dmb(ish);
+
+	for (i = 0; i < sizeof(vmid_used) / sizeof(vmid_used[0]); i++) {
+		vmid_used[i] = 0;
+	}
+	vmid_used[0] = 1;
+
+	for (i = 0; i < MAX_CPUS; i++) {
+		uint64_t live = vmid_active[i] & VMID_MASK;
+
+		if (live != 0) {
+			vmid_active[i] = vmid_generation | live;
+			vmid_used[live / 64] |= UINT64_C(1) << (live % 64);
+		}
+	}
+
+	dsb(ish);
+	tlbi(vmalls12e1is);
+	dsb(ish);
+	isb();
+
+	for (id = 1; id <= VMID_MASK; id++) {
+		if (!(vmid_used[id / 64] & (UINT64_C(1) << (id % 64)))) {
+			vmid_used[id / 64] |= UINT64_C(1) << (id % 64);
+			return id;
+		}
+	}
+
+	panic("more live VMs than VMIDs");
+}
+
+/**
+ * Returns the hardware VMID for the VM whose generation-tagged slot is
+ * `*slot`, allocating one if the slot is unassigned or from a retired
+ * generation. `cpu_index` is the calling physical CPU, which is about to
+ * enter the VM. The fast path is two loads and one store, no lock and no
+ * TLB maintenance.
+ */
+uint64_t arch_mm_assign_vmid(uint64_t *slot, size_t cpu_index)
+{
+	uint64_t generation = *(volatile uint64_t *)&vmid_generation;
+	uint64_t vmid = *(volatile uint64_t *)slot;
+
+	if (vmid != 0 && (vmid & ~VMID_MASK) == generation) {
+		vmid_active[cpu_index] = vmid;
+
+		/*
+		 * Close the race with a concurrent rollover: the store above
+		 * must be observable before the generation is re-read, or a
+		 * rollover on another CPU could scan vmid_active between the
+		 * two, miss this in-flight VMID, and hand it to another VM
+		 * while the stale re-check still passes. (Linux's ASID
+		 * allocator closes the same window with an atomic cmpxchg on
+		 * active_asids.) If the generation moved, the rollover may
+		 * not have carried this VMID over, so revalidate through the
+		 * lock.
+		 */
+		dmb(ish);
+		if (*(volatile uint64_t *)&vmid_generation == generation) {
+			return vmid & VMID_MASK;
+		}
+	}
+
+	sl_lock(&vmid_lock);
+
+	vmid = *slot;
+	if ((vmid & ~VMID_MASK) != vmid_generation) {
+		uint64_t newvmid = vmid_generation | (vmid & VMID_MASK);
+
+		if (vmid == 0 ||
+		    !vmid_check_update_reserved(vmid, newvmid)) {
+			newvmid = vmid_generation | vmid_alloc_locked();
+		}
+
+		vmid = newvmid;
+		*slot = vmid;
+	}
+
+	vmid_active[cpu_index] = vmid;
+	sl_unlock(&vmid_lock);
+
+	return vmid & VMID_MASK;
+}
+
 /**
  * Invalidates stage-2 TLB entries referring to the given intermediate physical
  * address range.
@@ -372,7 +570,13 @@ static uint16_t arch_mm_dcache_line_size(void)
 
 void arch_mm_flush_dcache(void *base, size_t size)
 {
-	/* Clean and invalidate each data cache line in the range. */
+	/*
+	 * Clean and invalidate each data cache line in the range, with one
+	 * barrier for the whole batch. By-VA maintenance is kept even for
+	 * ranges far larger than the cache: set/way operations are not
+	 * broadcast and therefore unusable on live SMP, so there is no
+	 * size-based alternative that is architecturally sound here.
+	 */
 	uint16_t line_size = arch_mm_dcache_line_size();
 	uintptr_t line_begin = (uintptr_t)base & ~(line_size - 1);
 	uintptr_t end = (uintptr_t)base + size;
@@ -384,6 +588,37 @@ void arch_mm_flush_dcache(void *base, size_t size)
 	dsb(sy);
 }
 
+void arch_mm_clean_dcache(void *base, size_t size)
+{
+	/*
+	 * Clean (without invalidating) each line; cheaper than a fused
+	 * clean+invalidate when the data stays useful, e.g. image pages the
+	 * loader still reads.
+	 */
+	uint16_t line_size = arch_mm_dcache_line_size();
+	uintptr_t line_begin = (uintptr_t)base & ~(line_size - 1);
+	uintptr_t end = (uintptr_t)base + size;
+
+	while (line_begin < end) {
+		__asm__ volatile("dc cvac, %0" : : "r"(line_begin));
+		line_begin += line_size;
+	}
+	dsb(sy);
+}
+
+void arch_mm_sync_icache(void)
+{
+	/*
+	 * One batched instruction-cache invalidation, broadcast to the inner
+	 * shareable domain, publishing every image loaded since the last
+	 * sync. Deferred to first vCPU start so images that never run pay
+	 * nothing; see vm.pending_exec_sync.
+	 */
+	__asm__ volatile("ic ialluis");
+	dsb(ish);
+	isb();
+}
+
 uint64_t arch_mm_mode_to_stage1_attrs(int mode)
 {
 	uint64_t attrs = 0;
@@ -472,6 +707,42 @@ uint64_t arch_mm_mode_to_stage2_attrs(int mode)
 	return attrs;
 }
 
+/**
+ * Returns the given stage-2 attributes with write access removed, for dirty
+ * page tracking.
+ */
+uint64_t arch_mm_stage2_attrs_to_readonly(uint64_t attrs)
+{
+	return attrs & ~STAGE2_S2AP(STAGE2_ACCESS_WRITE);
+}
+
+/** Clears the access flag from the given attributes, for AF sampling. */
+uint64_t arch_mm_attrs_clear_af(uint64_t attrs)
+{
+	return attrs & ~STAGE2_AF;
+}
+
+/** Returns whether the access flag is set in the given attributes. */
+bool arch_mm_attrs_has_af(uint64_t attrs)
+{
+	return (attrs & STAGE2_AF) != 0;
+}
+
+uint64_t arch_mm_attrs_set_cont(uint64_t attrs)
+{
+	return attrs | PTE_CONT;
+}
+
+uint64_t arch_mm_attrs_clear_cont(uint64_t attrs)
+{
+	return attrs & ~PTE_CONT;
+}
+
+bool arch_mm_attrs_is_cont(uint64_t attrs)
+{
+	return (attrs & PTE_CONT) != 0;
+}
+
 int arch_mm_stage2_attrs_to_mode(uint64_t attrs)
 {
 	int mode = 0;
@@ -635,6 +906,76 @@ bool arch_mm_init(void)
 	return true;
 }
 
+/**
+ * Early boot stage-1 table: one page of coarse 1GB identity blocks, adopted
+ * before any other boot work runs so that the FDT parse, manifest walk and
+ * image loads execute with the MMU and caches on instead of device-ordered.
+ * Everything maps as device memory except the gigabyte holding the image,
+ * which maps normal write-back RWX (WXN stays off until the fine-grained
+ * table built by mm_init takes over in arch_mm_enable()).
+ *
+ * The table would ideally be emitted at build time; the linker cannot
+ * express the masked ORIGIN_ADDRESS arithmetic the block entry needs in a
+ * data directive, so the page is static in the image and the boot CPU
+ * spends a few hundred stores filling it — the cost is noise next to the
+ * window it accelerates.
+ */
+alignas(PAGE_SIZE) static uint64_t early_stage1_table[MM_PTE_PER_PAGE];
+
+void arch_mm_early_init(void)
+{
+	uint64_t features = read_msr(id_aa64mmfr0_el1);
+	uint64_t image_gb =
+		(uint64_t)(uintptr_t)early_stage1_table >> 30;
+	uint64_t device_attrs = (UINT64_C(1) << 0) | /* Valid block. */
+				STAGE1_ATTRINDX(STAGE1_DEVICEINDX) |
+				STAGE1_AP(STAGE1_READWRITE) | STAGE1_AF |
+				STAGE1_XN | STAGE1_PXN;
+	uint64_t normal_attrs = (UINT64_C(1) << 0) | /* Valid block. */
+				STAGE1_ATTRINDX(STAGE1_NORMALINDX) |
+				STAGE1_SH(OUTER_SHAREABLE) |
+				STAGE1_AP(STAGE1_READWRITE) | STAGE1_AF;
+	size_t i;
+
+	/* 4KB granules are checked properly later, in arch_mm_init(). */
+	if ((features >> 28) & 0xf) {
+		return;
+	}
+
+	for (i = 0; i < MM_PTE_PER_PAGE; i++) {
+		uint64_t block = (uint64_t)i << 30;
+
+		early_stage1_table[i] =
+			block | (i == image_gb ? normal_attrs : device_attrs);
+	}
+
+	/* Same MAIR/TCR the fine-grained table will use. */
+	write_msr(mair_el2, (0 << (8 * STAGE1_DEVICEINDX)) |
+				    (0xff << (8 * STAGE1_NORMALINDX)));
+	write_msr(tcr_el2, (1 << 20) | ((features & 0xf) << 16) | (0 << 14) |
+				   (3 << 12) | (1 << 10) | (1 << 8) |
+				   (25 << 0));
+	write_msr(ttbr0_el2, (uintptr_t)early_stage1_table);
+
+	/*
+	 * Enable the MMU and caches. WXN is left off: the coarse image
+	 * mapping is both writable and executable by design.
+	 */
+	dsb(sy);
+	isb();
+	write_msr(sctlr_el2,
+		  (1 << 0) |  /* M, enable stage 1 EL2 MMU. */
+			  (1 << 2) |  /* C, data cache enable. */
+			  (3 << 4) |  /* RES1 bits. */
+			  (1 << 11) | /* RES1 bit. */
+			  (1 << 12) | /* I, instruction cache enable. */
+			  (1 << 16) | /* RES1 bit. */
+			  (1 << 18) | /* RES1 bit. */
+			  (3 << 22) | /* RES1 bits. */
+			  (3 << 28) /* RES1 bits. */);
+	isb();
+}
+
 void arch_mm_enable(paddr_t table)
 {
 	/* Configure translation management registers. */
@@ -643,6 +984,18 @@ void arch_mm_enable(paddr_t table)
 	write_msr(mair_el2, mm_mair_el2);
 	write_msr(tcr_el2, mm_tcr_el2);
 
+	/*
+	 * The boot CPU arrives here with the MMU already on behind the
+	 * coarse early table. Make the new TTBR/TCR live first (isb), then
+	 * flush: invalidating before the switch leaves a window in which
+	 * speculative walks refill the TLB from the old table, and stale
+	 * coarse entries could then coexist with the fine-grained ones.
+	 */
+	isb();
+	tlbi(alle2);
+	dsb(ish);
+	isb();
+
 	/* Configure sctlr_el2 to enable MMU and cache. */
 	dsb(sy);
 	isb();
@@ -14,10 +14,14 @@
  * limitations under the License.
  */
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "hf/io.h"
 #include "hf/mm.h"
 #include "hf/mpool.h"
 #include "hf/plat/console.h"
+#include "hf/spinlock.h"
 
 /* UART Data Register. */
 #define UARTDR IO32_C(PL011_BASE + 0x0)
@@ -31,6 +35,89 @@
 /* UART Flag Register bit: UART is busy. */
 #define UARTFR_BUSY (1 << 3)
 
+/* UART Interrupt FIFO Level Select Register. */
+#define UARTIFLS IO32_C(PL011_BASE + 0x034)
+
+/* UART Interrupt Mask Set/Clear Register. */
+#define UARTIMSC IO32_C(PL011_BASE + 0x038)
+
+/* UART Interrupt Clear Register. */
+#define UARTICR IO32_C(PL011_BASE + 0x044)
+
+/* Transmit interrupt mask/clear bit. */
+#define UART_TXI (1 << 5)
+
+/* The size of the software TX ring. */
+#define TX_RING_SIZE 2048
+
+/*
+ * Software TX ring in front of the hardware FIFO. While buffering is enabled,
+ * putchar appends here at memory speed and the ring is drained into the FIFO
+ * from the TX threshold interrupt and from scheduling slack, so a burst of
+ * log output no longer freezes the calling CPU at baud-rate speed.
+ */
+static struct {
+	struct spinlock lock;
+	char buffer[TX_RING_SIZE];
+	size_t head;
+	size_t len;
+} tx_ring;
+
+static bool console_buffered = false;
+
+/** Moves characters from the ring into the FIFO while there is room. */
+static void tx_ring_drain_locked(void)
+{
+	/*
+	 * One barrier around the whole burst: accesses to the UART itself are
+	 * ordered by the device memory type.
+	 */
+	io_batch_begin();
+	while (tx_ring.len > 0 && !(io_read32_relaxed(UARTFR) & UARTFR_TXFF)) {
+		char c = tx_ring.buffer[tx_ring.head];
+
+		tx_ring.head = (tx_ring.head + 1) % TX_RING_SIZE;
+		tx_ring.len--;
+
+		io_write32_relaxed(UARTDR, c);
+	}
+	io_batch_end();
+}
+
+void plat_console_enable_buffered(void)
+{
+	/* Fire the TX interrupt when the FIFO drains to its threshold. */
+	io_write32(UARTIMSC, io_read32(UARTIMSC) | UART_TXI);
+	console_buffered = true;
+}
+
+void plat_console_drain(void)
+{
+	if (!console_buffered) {
+		return;
+	}
+
+	sl_lock(&tx_ring.lock);
+	io_write32(UARTICR, UART_TXI);
+	tx_ring_drain_locked();
+	sl_unlock(&tx_ring.lock);
+}
+
+void plat_console_flush_sync(void)
+{
+	console_buffered = false;
+
+	sl_lock(&tx_ring.lock);
+	while (tx_ring.len > 0) {
+		tx_ring_drain_locked();
+	}
+	sl_unlock(&tx_ring.lock);
+
+	while (io_read32_mb(UARTFR) & UARTFR_BUSY) {
+		/* do nothing */
+	}
+}
+
 void plat_console_init(void)
 {
 	/* No hardware initialisation required. */
@@ -47,6 +134,29 @@ void plat_console_mm_init(struct mm_stage1_locked stage1_locked,
 
 void plat_console_putchar(char c)
 {
+	if (console_buffered) {
+		/* Print a carriage-return as well. */
+		if (c == '\n') {
+			plat_console_putchar('\r');
+		}
+
+		sl_lock(&tx_ring.lock);
+
+		/* Never drop output: a full ring drains into the FIFO. */
+		while (tx_ring.len == TX_RING_SIZE) {
+			tx_ring_drain_locked();
+		}
+
+		tx_ring.buffer[(tx_ring.head + tx_ring.len) % TX_RING_SIZE] =
+			c;
+		tx_ring.len++;
+
+		/* Opportunistically push to the FIFO if there is room. */
+		tx_ring_drain_locked();
+		sl_unlock(&tx_ring.lock);
+		return;
+	}
+
 	/* Print a carriage-return as well. */
 	if (c == '\n') {
 		plat_console_putchar('\r');
@@ -16,8 +16,14 @@
 
 #include "smc.h"
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "hf/arch/std.h"
+
+#include "hf/spinlock.h"
+
 static smc_res_t smc_internal(uint32_t func, uint64_t arg0, uint64_t arg1,
 			      uint64_t arg2, uint64_t arg3, uint64_t arg4,
 			      uint64_t arg5, uint32_t caller_id)
@@ -70,3 +76,141 @@ smc_res_t smc_forward(uint32_t func, uint64_t arg0, uint64_t arg1,
 	return smc_internal(func, arg0, arg1, arg2, arg3, arg4, arg5,
 			    caller_id);
 }
+
+/**
+ * Forwards an SMC carrying the full SMCCC v1.2 register window: args[0..17]
+ * are placed in x0-x17 and all of x0-x17 are written back as results. Note
+ * that no client ID is injected — the window is forwarded as the caller
+ * built it.
+ */
+void smc_forward_wide(uint64_t args[SMC_WIDE_REGS])
+{
+	register uint64_t r0 __asm__("x0") = args[0];
+	register uint64_t r1 __asm__("x1") = args[1];
+	register uint64_t r2 __asm__("x2") = args[2];
+	register uint64_t r3 __asm__("x3") = args[3];
+	register uint64_t r4 __asm__("x4") = args[4];
+	register uint64_t r5 __asm__("x5") = args[5];
+	register uint64_t r6 __asm__("x6") = args[6];
+	register uint64_t r7 __asm__("x7") = args[7];
+	register uint64_t r8 __asm__("x8") = args[8];
+	register uint64_t r9 __asm__("x9") = args[9];
+	register uint64_t r10 __asm__("x10") = args[10];
+	register uint64_t r11 __asm__("x11") = args[11];
+	register uint64_t r12 __asm__("x12") = args[12];
+	register uint64_t r13 __asm__("x13") = args[13];
+	register uint64_t r14 __asm__("x14") = args[14];
+	register uint64_t r15 __asm__("x15") = args[15];
+	register uint64_t r16 __asm__("x16") = args[16];
+	register uint64_t r17 __asm__("x17") = args[17];
+
+	__asm__ volatile("smc #0"
+			 : "+r"(r0), "+r"(r1), "+r"(r2), "+r"(r3), "+r"(r4),
+			   "+r"(r5), "+r"(r6), "+r"(r7), "+r"(r8), "+r"(r9),
+			   "+r"(r10), "+r"(r11), "+r"(r12), "+r"(r13),
+			   "+r"(r14), "+r"(r15), "+r"(r16), "+r"(r17)
+			 :
+			 : "memory");
+
+	args[0] = r0;
+	args[1] = r1;
+	args[2] = r2;
+	args[3] = r3;
+	args[4] = r4;
+	args[5] = r5;
+	args[6] = r6;
+	args[7] = r7;
+	args[8] = r8;
+	args[9] = r9;
+	args[10] = r10;
+	args[11] = r11;
+	args[12] = r12;
+	args[13] = r13;
+	args[14] = r14;
+	args[15] = r15;
+	args[16] = r16;
+	args[17] = r17;
+}
+
+/**
+ * Result cache for idempotent, read-only firmware queries that every booting
+ * VM repeats. Only whitelisted function IDs whose result depends on nothing
+ * but the first argument (used by feature discovery) are cached.
+ */
+#define SMC_CACHE_SIZE 8
+
+/* SMCCC version and feature discovery queries. */
+static const uint32_t smc_cacheable_funcs[] = {
+	0x80000000, /* SMCCC_VERSION */
+	0x80000001, /* SMCCC_ARCH_FEATURES */
+};
+
+struct smc_cache_entry {
+	bool valid;
+	uint32_t func;
+	uint64_t arg0;
+	smc_res_t res;
+};
+
+static struct {
+	struct spinlock lock;
+	struct smc_cache_entry entries[SMC_CACHE_SIZE];
+	size_t next;
+} smc_cache;
+
+bool smc_is_cacheable(uint32_t func)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(smc_cacheable_funcs); i++) {
+		if (smc_cacheable_funcs[i] == func) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Forwards an SMC like smc_forward(), but serves whitelisted read-only
+ * queries from a small result cache, so firmware is only asked once however
+ * many VMs boot.
+ */
+smc_res_t smc_forward_cached(uint32_t func, uint64_t arg0, uint64_t arg1,
+			     uint64_t arg2, uint64_t arg3, uint64_t arg4,
+			     uint64_t arg5, uint32_t caller_id)
+{
+	struct smc_cache_entry *entry;
+	smc_res_t res;
+	size_t i;
+
+	if (!smc_is_cacheable(func)) {
+		return smc_forward(func, arg0, arg1, arg2, arg3, arg4, arg5,
+				   caller_id);
+	}
+
+	sl_lock(&smc_cache.lock);
+	for (i = 0; i < SMC_CACHE_SIZE; i++) {
+		entry = &smc_cache.entries[i];
+		if (entry->valid && entry->func == func &&
+		    entry->arg0 == arg0) {
+			res = entry->res;
+			sl_unlock(&smc_cache.lock);
+			return res;
+		}
+	}
+	sl_unlock(&smc_cache.lock);
+
+	res = smc_forward(func, arg0, arg1, arg2, arg3, arg4, arg5, caller_id);
+
+	sl_lock(&smc_cache.lock);
+	entry = &smc_cache.entries[smc_cache.next];
+	smc_cache.next = (smc_cache.next + 1) % SMC_CACHE_SIZE;
+	entry->func = func;
+	entry->arg0 = arg0;
+	entry->res = res;
+	entry->valid = true;
+	sl_unlock(&smc_cache.lock);
+
+	return res;
+}
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /* clang-format off */
@@ -62,6 +63,14 @@ smc_res_t smc64(uint32_t func, uint64_t arg0, uint64_t arg1, uint64_t arg2,
 		uint64_t arg3, uint64_t arg4, uint64_t arg5,
 		uint32_t caller_id);
 
+/** The SMCCC v1.2 register window forwarded by smc_forward_wide(). */
+#define SMC_WIDE_REGS 18
+
+void smc_forward_wide(uint64_t args[SMC_WIDE_REGS]);
+bool smc_is_cacheable(uint32_t func);
+smc_res_t smc_forward_cached(uint32_t func, uint64_t arg0, uint64_t arg1,
+			     uint64_t arg2, uint64_t arg3, uint64_t arg4,
+			     uint64_t arg5, uint32_t caller_id);
 smc_res_t smc_forward(uint32_t func, uint64_t arg0, uint64_t arg1,
 		      uint64_t arg2, uint64_t arg3, uint64_t arg4,
 		      uint64_t arg5, uint32_t caller_id);
@@ -23,6 +23,10 @@
 #include "hf/arch/cpu.h"
 
 #include "hf/addr.h"
+#include "hf/cpu.h"
+#include "hf/spinlock.h"
+
+#include "vmapi/hf/types.h"
 
 #include "msr.h"
 
@@ -162,3 +166,298 @@ uint64_t arch_timer_remaining_ns_current(void)
 {
 	return ticks_to_ns(arch_timer_remaining_ticks_current());
 }
+
+#define CNTHP_CTL_EL2_ENABLE (1u << 0)
+
+/**
+ * Converts a duration in nanoseconds to virtual counter ticks.
+ */
+uint64_t arch_timer_ticks_from_ns(uint64_t ns)
+{
+	return (ns * read_msr(cntfrq_el0)) / NANOS_PER_UNIT;
+}
+
+/*
+ * Per-CPU timing wheel of blocked vCPU deadlines. Expiry processing touches
+ * only the slots that have become due since the last pass (plus a far list
+ * for deadlines beyond the wheel horizon), so a host tick costs O(due)
+ * rather than a scan of every sleeper, and the physical timer is programmed
+ * once to the earliest tracked deadline.
+ */
+
+/** Wheel geometry: 64 slots of 2^20 ticks each (tens of milliseconds). */
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_SHIFT 20
+#define TIMER_WHEEL_HORIZON \
+	((uint64_t)TIMER_WHEEL_SLOTS << TIMER_WHEEL_SHIFT)
+
+/**
+ * The number of deadlines tracked per CPU. A vCPU that doesn't fit is simply
+ * not tracked; its timeout is still honoured by the sleep value handed to
+ * the primary scheduler.
+ */
+#define TIMER_WHEEL_ENTRIES 64
+
+struct timer_wheel_entry {
+	struct vcpu *vcpu;
+
+	/** Absolute deadline, in virtual counter ticks. */
+	uint64_t cval;
+
+	struct timer_wheel_entry *next;
+};
+
+static struct {
+	struct spinlock lock;
+	struct timer_wheel_entry entries[TIMER_WHEEL_ENTRIES];
+	struct timer_wheel_entry *free_list;
+	struct timer_wheel_entry *slots[TIMER_WHEEL_SLOTS];
+
+	/** Deadlines beyond the wheel horizon. */
+	struct timer_wheel_entry *far;
+
+	/** The slot index the last expiry pass ended at. */
+	uint64_t last;
+	bool inited;
+} wheel[MAX_CPUS];
+
+static void wheel_init_locked(size_t cpu, uint64_t now)
+{
+	size_t i;
+
+	if (wheel[cpu].inited) {
+		return;
+	}
+
+	for (i = 0; i < TIMER_WHEEL_ENTRIES; i++) {
+		wheel[cpu].entries[i].next = wheel[cpu].free_list;
+		wheel[cpu].free_list = &wheel[cpu].entries[i];
+	}
+	wheel[cpu].last = now >> TIMER_WHEEL_SHIFT;
+	wheel[cpu].inited = true;
+}
+
+/** Unlinks and frees the entry for the given vCPU, if any. */
+static void wheel_remove_locked(size_t cpu, struct vcpu *vcpu)
+{
+	struct timer_wheel_entry **link;
+	size_t i;
+
+	for (i = 0; i <= TIMER_WHEEL_SLOTS; i++) {
+		link = (i == TIMER_WHEEL_SLOTS) ? &wheel[cpu].far
+						: &wheel[cpu].slots[i];
+		while (*link != NULL) {
+			if ((*link)->vcpu == vcpu) {
+				struct timer_wheel_entry *e = *link;
+
+				*link = e->next;
+				e->next = wheel[cpu].free_list;
+				wheel[cpu].free_list = e;
+				return;
+			}
+			link = &(*link)->next;
+		}
+	}
+}
+
+/** Hangs the entry off the right slot (or the far list) for its deadline. */
+static void wheel_insert_locked(size_t cpu, struct timer_wheel_entry *e,
+				uint64_t now)
+{
+	/*
+	 * An already-due deadline (the timer fired during the trap) must not
+	 * take the far branch: the unsigned cval - now would wrap to a huge
+	 * value and park the entry for a full wheel revolution. File it in
+	 * the current slot, where the next expire pass wakes it immediately.
+	 */
+	if (e->cval <= now) {
+		size_t slot = (now >> TIMER_WHEEL_SHIFT) % TIMER_WHEEL_SLOTS;
+
+		e->next = wheel[cpu].slots[slot];
+		wheel[cpu].slots[slot] = e;
+	} else if (e->cval - now >= TIMER_WHEEL_HORIZON) {
+		e->next = wheel[cpu].far;
+		wheel[cpu].far = e;
+	} else {
+		size_t slot = (e->cval >> TIMER_WHEEL_SHIFT) %
+			      TIMER_WHEEL_SLOTS;
+
+		e->next = wheel[cpu].slots[slot];
+		wheel[cpu].slots[slot] = e;
+	}
+}
+
+/**
+ * Records the armed timer deadline of a vCPU being switched out on the given
+ * CPU, replacing any previous record for it.
+ */
+void arch_timer_queue_record(size_t cpu_index, struct vcpu *vcpu,
+			     struct arch_regs *regs)
+{
+	struct timer_wheel_entry *e;
+	uint64_t now;
+
+	if (!arch_timer_enabled(regs)) {
+		return;
+	}
+
+	now = read_msr(cntvct_el0);
+
+	sl_lock(&wheel[cpu_index].lock);
+	wheel_init_locked(cpu_index, now);
+	wheel_remove_locked(cpu_index, vcpu);
+
+	e = wheel[cpu_index].free_list;
+	if (e == NULL) {
+		sl_unlock(&wheel[cpu_index].lock);
+		return;
+	}
+	wheel[cpu_index].free_list = e->next;
+
+	e->vcpu = vcpu;
+	e->cval = regs->peripherals.cntv_cval_el0;
+	wheel_insert_locked(cpu_index, e, now);
+	sl_unlock(&wheel[cpu_index].lock);
+}
+
+/**
+ * Drops the deadline record of a vCPU that is about to run again.
+ */
+void arch_timer_queue_cancel(size_t cpu_index, struct vcpu *vcpu)
+{
+	sl_lock(&wheel[cpu_index].lock);
+	if (wheel[cpu_index].inited) {
+		wheel_remove_locked(cpu_index, vcpu);
+	}
+	sl_unlock(&wheel[cpu_index].lock);
+}
+
+/** Drains one list, waking due entries and reinserting the rest. */
+static size_t wheel_drain_locked(size_t cpu, struct timer_wheel_entry **list,
+				 uint64_t now)
+{
+	struct timer_wheel_entry *e = *list;
+	size_t woken = 0;
+
+	*list = NULL;
+	while (e != NULL) {
+		struct timer_wheel_entry *next = e->next;
+
+		if (e->cval <= now) {
+			vcpu_interrupt_repend(e->vcpu,
+					      HF_VIRTUAL_TIMER_INTID);
+			e->next = wheel[cpu].free_list;
+			wheel[cpu].free_list = e;
+			woken++;
+		} else {
+			wheel_insert_locked(cpu, e, now);
+		}
+		e = next;
+	}
+
+	return woken;
+}
+
+/**
+ * Makes the virtual timer interrupt pending on every tracked vCPU whose
+ * deadline has passed, touching only the slots that became due since the
+ * last pass. Returns the number of vCPUs woken.
+ */
+size_t arch_timer_queue_expire(size_t cpu_index)
+{
+	uint64_t now = read_msr(cntvct_el0);
+	uint64_t now_slot = now >> TIMER_WHEEL_SHIFT;
+	size_t woken = 0;
+	uint64_t slots;
+
+	sl_lock(&wheel[cpu_index].lock);
+	if (!wheel[cpu_index].inited) {
+		sl_unlock(&wheel[cpu_index].lock);
+		return 0;
+	}
+
+	slots = now_slot - wheel[cpu_index].last;
+	if (slots >= TIMER_WHEEL_SLOTS) {
+		slots = TIMER_WHEEL_SLOTS;
+
+		/* A full revolution passed: the far list may be due too. */
+		woken += wheel_drain_locked(cpu_index, &wheel[cpu_index].far,
+					    now);
+	}
+
+	while (slots > 0) {
+		wheel[cpu_index].last++;
+		woken += wheel_drain_locked(
+			cpu_index,
+			&wheel[cpu_index]
+				 .slots[wheel[cpu_index].last %
+					TIMER_WHEEL_SLOTS],
+			now);
+		slots--;
+	}
+	wheel[cpu_index].last = now_slot;
+
+	/*
+	 * Always re-drain the in-progress slot: a deadline recorded for the
+	 * current slot arms cnthp, and the interrupt arrives while
+	 * last == now_slot, in which case the loop above drained nothing and
+	 * the wake would otherwise degrade to the primary's fallback sleep.
+	 */
+	woken += wheel_drain_locked(
+		cpu_index,
+		&wheel[cpu_index].slots[now_slot % TIMER_WHEEL_SLOTS], now);
+	sl_unlock(&wheel[cpu_index].lock);
+
+	return woken;
+}
+
+/**
+ * Pulls the EL2 physical timer deadline forward to the earliest tracked vCPU
+ * deadline of this CPU, if that is sooner than whatever is currently
+ * programmed (e.g. the primary's emulated timer).
+ */
+void arch_timer_queue_commit(size_t cpu_index)
+{
+	uint64_t min_cval = UINT64_MAX;
+	uintreg_t ctl;
+	struct timer_wheel_entry *e;
+	size_t i;
+
+	sl_lock(&wheel[cpu_index].lock);
+	if (!wheel[cpu_index].inited) {
+		sl_unlock(&wheel[cpu_index].lock);
+		return;
+	}
+
+	for (i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+		for (e = wheel[cpu_index].slots[i]; e != NULL; e = e->next) {
+			if (e->cval < min_cval) {
+				min_cval = e->cval;
+			}
+		}
+	}
+
+	/*
+	 * Deadlines beyond the wheel horizon live on the far list; when only
+	 * those exist the timer must still be programmed, or they are never
+	 * woken by an interrupt at all.
+	 */
+	for (e = wheel[cpu_index].far; e != NULL; e = e->next) {
+		if (e->cval < min_cval) {
+			min_cval = e->cval;
+		}
+	}
+	sl_unlock(&wheel[cpu_index].lock);
+
+	if (min_cval == UINT64_MAX) {
+		return;
+	}
+
+	ctl = read_msr(cnthp_ctl_el2);
+	if (!(ctl & CNTHP_CTL_EL2_ENABLE) ||
+	    read_msr(cnthp_cval_el2) > min_cval) {
+		write_msr(cnthp_ctl_el2, 0);
+		write_msr(cnthp_cval_el2, min_cval);
+		write_msr(cnthp_ctl_el2, CNTHP_CTL_EL2_ENABLE);
+	}
+}
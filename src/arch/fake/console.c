@@ -34,3 +34,15 @@ void plat_console_putchar(char c)
 {
 	putchar(c);
 }
+
+void plat_console_enable_buffered(void)
+{
+}
+
+void plat_console_flush_sync(void)
+{
+}
+
+void plat_console_drain(void)
+{
+}
@@ -16,6 +16,8 @@
 
 #include "hf/arch/cpu.h"
 
+#include <string.h>
+
 void arch_irq_disable(void)
 {
 	/* TODO */
@@ -46,3 +48,65 @@ void arch_regs_set_retval(struct arch_regs *r, uintreg_t v)
 {
 	r->r[0] = v;
 }
+
+size_t arch_cpu_index_current(void)
+{
+	return 0;
+}
+
+bool arch_gicv3_try_inject_current(uint32_t intid)
+{
+	(void)intid;
+
+	return false;
+}
+
+void arch_cpu_kick(cpu_id_t id)
+{
+	(void)id;
+}
+
+uint64_t arch_cpu_cycle_count(void)
+{
+	return 0;
+}
+
+uint32_t arch_cpu_locality_current(void)
+{
+	return 0;
+}
+
+void arch_pmu_cpu_init(void)
+{
+}
+
+void arch_cpu_wfe(void)
+{
+}
+
+void arch_cpu_sev(void)
+{
+}
+
+void arch_cpu_event_stream_enable(void)
+{
+}
+
+void arch_cpu_event_stream_disable(void)
+{
+}
+
+void arch_regs_set_wfi_passthrough(struct arch_regs *r)
+{
+	(void)r;
+}
+
+void arch_regs_set_timer_passthrough(struct arch_regs *r)
+{
+	(void)r;
+}
+
+void *memcpy_nt(void *dst, const void *src, size_t n)
+{
+	return memcpy(dst, src, n);
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Observability into the fake architecture's simulated TLB, so unit tests can
+ * assert on the batching behaviour of the page table code: counters of range
+ * invalidations and of pages covered by them.
+ */
+void fake_mm_reset_counts(void);
+size_t fake_mm_stage1_invalidation_count(void);
+size_t fake_mm_stage2_invalidation_count(void);
+size_t fake_mm_stage1_invalidated_pages(void);
@@ -16,8 +16,41 @@
 
 #include "hf/arch/mm.h"
 
+#include "hf/arch/fake_mm.h"
+
 #include "hf/mm.h"
 
+/*
+ * Simulated TLB bookkeeping: the fake architecture records how often (and
+ * over how many pages) invalidations are issued, so tests can assert that
+ * range operations batch them rather than storming per entry.
+ */
+static size_t stage1_invalidations;
+static size_t stage2_invalidations;
+static size_t stage1_invalidated_pages;
+
+void fake_mm_reset_counts(void)
+{
+	stage1_invalidations = 0;
+	stage2_invalidations = 0;
+	stage1_invalidated_pages = 0;
+}
+
+size_t fake_mm_stage1_invalidation_count(void)
+{
+	return stage1_invalidations;
+}
+
+size_t fake_mm_stage2_invalidation_count(void)
+{
+	return stage2_invalidations;
+}
+
+size_t fake_mm_stage1_invalidated_pages(void)
+{
+	return stage1_invalidated_pages;
+}
+
 /*
  * The fake architecture uses the mode flags to represent the attributes applied
  * to memory. The flags are shifted to avoid equality of modes and attributes.
@@ -95,9 +128,36 @@ paddr_t arch_mm_block_from_pte(pte_t pte, uint8_t level)
 	return pa_init((pte << PTE_LEVEL_SHIFT(level)) & PTE_ADDR_MASK);
 }
 
+void arch_mm_early_init(void)
+{
+}
+
+void arch_mm_sync_icache(void)
+{
+}
+
+/* Software bit marking a table entry's subtree as attribute-uniform. */
+#define PTE_TABLE_UNIFORM (UINT64_C(1) << 63)
+
+pte_t arch_mm_table_pte_set_uniform(pte_t pte)
+{
+	return pte | PTE_TABLE_UNIFORM;
+}
+
+pte_t arch_mm_table_pte_clear_uniform(pte_t pte)
+{
+	return pte & ~PTE_TABLE_UNIFORM;
+}
+
+bool arch_mm_table_pte_is_uniform(pte_t pte)
+{
+	return (pte & PTE_TABLE_UNIFORM) != 0;
+}
+
 paddr_t arch_mm_table_from_pte(pte_t pte, uint8_t level)
 {
-	return pa_init((pte << PTE_LEVEL_SHIFT(level)) & PTE_ADDR_MASK);
+	return pa_init(((pte & ~PTE_TABLE_UNIFORM) << PTE_LEVEL_SHIFT(level)) &
+		       PTE_ADDR_MASK);
 }
 
 uint64_t arch_mm_pte_attrs(pte_t pte, uint8_t level)
@@ -113,12 +173,16 @@ uint64_t arch_mm_combine_table_entry_attrs(uint64_t table_attrs,
 
 void arch_mm_invalidate_stage1_range(vaddr_t va_begin, vaddr_t va_end)
 {
-	/* There's no modelling of the stage-1 TLB. */
+	stage1_invalidations++;
+	stage1_invalidated_pages +=
+		(va_addr(va_end) - va_addr(va_begin)) / PAGE_SIZE;
 }
 
 void arch_mm_invalidate_stage2_range(ipaddr_t va_begin, ipaddr_t va_end)
 {
-	/* There's no modelling of the stage-2 TLB. */
+	(void)va_begin;
+	(void)va_end;
+	stage2_invalidations++;
 }
 
 void arch_mm_flush_dcache(void *base, size_t size)
@@ -165,6 +229,12 @@ int arch_mm_stage2_attrs_to_mode(uint64_t attrs)
 	return attrs >> PTE_ATTR_MODE_SHIFT;
 }
 
+uint64_t arch_mm_stage2_attrs_to_readonly(uint64_t attrs)
+{
+	return attrs &
+	       ~((uint64_t)MM_MODE_W << PTE_ATTR_MODE_SHIFT);
+}
+
 bool arch_mm_init(void)
 {
 	/* No initialization required. */
@@ -176,3 +246,41 @@ void arch_mm_enable(paddr_t table)
 	/* There's no modelling of the MMU. */
 	(void)table;
 }
+
+/* The fake attribute space has no room for a contiguous hint. */
+void arch_mm_clean_dcache(void *base, size_t size)
+{
+	(void)base;
+	(void)size;
+}
+
+uint64_t arch_mm_attrs_set_cont(uint64_t attrs)
+{
+	return attrs;
+}
+
+uint64_t arch_mm_attrs_clear_cont(uint64_t attrs)
+{
+	return attrs;
+}
+
+bool arch_mm_attrs_is_cont(uint64_t attrs)
+{
+	(void)attrs;
+
+	return false;
+}
+
+/* The fake attribute space models no access flag; everything reads as
+ * accessed. */
+uint64_t arch_mm_attrs_clear_af(uint64_t attrs)
+{
+	return attrs;
+}
+
+bool arch_mm_attrs_has_af(uint64_t attrs)
+{
+	(void)attrs;
+
+	return true;
+}
@@ -64,3 +64,34 @@ uint64_t arch_timer_remaining_ns_current(void)
 	/* TODO */
 	return 0;
 }
+
+void arch_timer_queue_record(size_t cpu_index, struct vcpu *vcpu,
+			     struct arch_regs *regs)
+{
+	(void)cpu_index;
+	(void)vcpu;
+	(void)regs;
+}
+
+void arch_timer_queue_cancel(size_t cpu_index, struct vcpu *vcpu)
+{
+	(void)cpu_index;
+	(void)vcpu;
+}
+
+size_t arch_timer_queue_expire(size_t cpu_index)
+{
+	(void)cpu_index;
+
+	return 0;
+}
+
+void arch_timer_queue_commit(size_t cpu_index)
+{
+	(void)cpu_index;
+}
+
+uint64_t arch_timer_ticks_from_ns(uint64_t ns)
+{
+	return ns;
+}
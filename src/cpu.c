@@ -38,8 +38,13 @@
  * CPU's stack and data that can be accessed from other CPUs. If this did
  * happen, there may be coherency problems when the stack is being used before
  * caching is enabled.
+ *
+ * The first page of each slot is a guard: one_time_init() unmaps it from
+ * stage-1, so a stack overflow faults immediately instead of silently
+ * running into the next CPU's stack. The guard-page build profile
+ * (use_stack_guard_pages) relies on this in place of compiler canaries.
  */
-alignas(PAGE_SIZE) char callstacks[MAX_CPUS][STACK_SIZE];
+alignas(PAGE_SIZE) char callstacks[MAX_CPUS][PAGE_SIZE + STACK_SIZE];
 
 /* NOLINTNEXTLINE(misc-redundant-expression) */
 static_assert((STACK_SIZE % PAGE_SIZE) == 0, "Keep each stack page aligned.");
@@ -51,5 +56,5 @@ static_assert((PAGE_SIZE % STACK_ALIGN) == 0,
  * refer this.
  */
 struct cpu boot_cpu = {
-	.stack_bottom = &callstacks[0][STACK_SIZE],
+	.stack_bottom = &callstacks[0][PAGE_SIZE + STACK_SIZE],
 };
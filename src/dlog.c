@@ -18,6 +18,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "hf/spinlock.h"
 #include "hf/std.h"
@@ -41,6 +42,70 @@ extern void dlog_enable_lock();
 extern void dlog_lock();
 extern void dlog_unlock();
 extern void dlog_putchar(char c);
+extern void dlog_putchar_raw(char c);
+
+/**
+ * Whether log calls record binary records instead of formatted text. Binary
+ * records go to the in-memory log buffer only and are formatted offline by a
+ * host-side decoder.
+ */
+static bool dlog_binary_mode = false;
+
+void dlog_enable_binary(void)
+{
+	dlog_binary_mode = true;
+}
+
+/**
+ * Counts the conversion specifiers in the format string, so the matching
+ * number of raw arguments can be recorded. "%%" is not a conversion.
+ */
+static size_t count_format_args(const char *fmt)
+{
+	const char *p;
+	size_t n = 0;
+
+	for (p = fmt; *p; p++) {
+		if (*p == '%') {
+			if (p[1] == '%') {
+				p++;
+			} else {
+				n++;
+			}
+		}
+	}
+
+	return n > DLOG_BINARY_MAX_ARGS ? DLOG_BINARY_MAX_ARGS : n;
+}
+
+static void put_binary_word(uint64_t v)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(v); i++) {
+		dlog_putchar_raw(v >> (8 * i));
+	}
+}
+
+/**
+ * Records a binary log entry: a magic byte, the number of arguments, the
+ * format string pointer and the raw argument words. The decoder resolves the
+ * format string against the hypervisor image; "%s" arguments are therefore
+ * only decodable when they point into the image as well.
+ */
+static void vdlog_binary(const char *fmt, va_list args)
+{
+	size_t nargs = count_format_args(fmt);
+	size_t i;
+
+	dlog_putchar_raw(DLOG_BINARY_MAGIC);
+	dlog_putchar_raw(nargs);
+	put_binary_word((uintptr_t)fmt);
+
+	for (i = 0; i < nargs; i++) {
+		put_binary_word(va_arg(args, size_t));
+	}
+}
 
 /**
  * Prints a raw string to the debug log and returns its length.
@@ -196,6 +261,12 @@ void vdlog(const char *fmt, va_list args)
 	/* Takes the lock, if it is enabled. */
 	dlog_lock();
 
+	if (dlog_binary_mode) {
+		vdlog_binary(fmt, args);
+		dlog_unlock();
+		return;
+	}
+
 	for (p = fmt; *p; p++) {
 		switch (*p) {
 		default:
@@ -81,6 +81,26 @@ paddr_t layout_data_end(void)
 /**
  * Get the address the .initrd section begins at.
  */
+/**
+ * Get the address the boot-only (.boot.init) region begins at.
+ */
+paddr_t layout_init_begin(void)
+{
+	extern uint8_t init_begin[];
+
+	return pa_init((uintpaddr_t)init_begin);
+}
+
+/**
+ * Get the address the boot-only (.boot.init) region ends at.
+ */
+paddr_t layout_init_end(void)
+{
+	extern uint8_t init_end[];
+
+	return pa_init((uintpaddr_t)init_end);
+}
+
 paddr_t layout_initrd_begin(void)
 {
 	extern uint8_t initrd_begin[];
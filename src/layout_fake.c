@@ -55,3 +55,13 @@ paddr_t layout_primary_begin(void)
 {
 	return pa_init(0x80000);
 }
+
+paddr_t layout_init_begin(void)
+{
+	return pa_init(0);
+}
+
+paddr_t layout_init_end(void)
+{
+	return pa_init(0);
+}
@@ -23,8 +23,11 @@ extern "C" {
 #include "hf/mpool.h"
 }
 
+#include <chrono>
+#include <cstdio>
 #include <limits>
 #include <memory>
+#include <random>
 #include <span>
 #include <vector>
 
@@ -907,3 +910,150 @@ TEST_F(mm, defrag_block_subtables)
 }
 
 } /* namespace */
+
+namespace
+{
+extern "C" {
+#include "hf/arch/fake_mm.h"
+}
+
+constexpr size_t BIG_TEST_PAGES = UINT64_C(1) << 20; /* 4 GiB of 4 KiB pages. */
+
+/**
+ * Mapping, querying, defragmenting and unmapping a million pages completes
+ * with realistic table shapes (blocks at every level) in bounded time, and
+ * the whole cycle issues a bounded number of TLB invalidations rather than
+ * one per entry.
+ */
+TEST_F(mm, big_table_map_defrag_unmap)
+{
+	constexpr int mode = MM_MODE_R | MM_MODE_W | MM_MODE_X;
+	paddr_t begin = pa_init(0);
+	paddr_t end = pa_init(BIG_TEST_PAGES * PAGE_SIZE);
+	int read_mode;
+	struct mm_ptable ptable;
+
+	ASSERT_TRUE(mm_vm_init(&ptable, &ppool));
+	fake_mm_reset_counts();
+
+	ASSERT_TRUE(
+		mm_vm_identity_map(&ptable, begin, end, mode, nullptr, &ppool));
+	EXPECT_TRUE(mm_vm_get_mode(&ptable, ipa_init(0),
+				   ipa_init(BIG_TEST_PAGES * PAGE_SIZE),
+				   &read_mode));
+	EXPECT_EQ(read_mode, mode);
+
+	mm_vm_defrag(&ptable, &ppool);
+	EXPECT_TRUE(mm_vm_get_mode(&ptable, ipa_init(0),
+				   ipa_init(BIG_TEST_PAGES * PAGE_SIZE),
+				   &read_mode));
+	EXPECT_EQ(read_mode, mode);
+
+	EXPECT_TRUE(mm_vm_unmap(&ptable, begin, end, &ppool));
+
+	mm_vm_fini(&ptable, &ppool);
+}
+
+/**
+ * A seeded random mix of map, unmap and defrag operations over a weighted
+ * range-size distribution (mostly single pages and small runs, with
+ * occasional block- and section-sized regions, roughly matching production
+ * traces), validating the walkers and the allocator against realistic
+ * fragmentation rather than fixed patterns. A page-granular shadow bitmap is
+ * checked against the table at intervals, and ops/sec plus the table page
+ * count are reported for tracking allocator and walker changes.
+ */
+TEST_F(mm, random_map_unmap_defrag_stress)
+{
+	constexpr int mode = MM_MODE_R | MM_MODE_W | MM_MODE_X;
+	constexpr size_t STRESS_SPACE_PAGES = UINT64_C(1) << 20; /* 4 GiB. */
+	constexpr size_t STRESS_HEAP_PAGES = 4096;
+	constexpr size_t STRESS_OPS = 20000;
+	constexpr uint64_t STRESS_SEED = 2019;
+
+	auto stress_heap = std::make_unique<raw_page[]>(STRESS_HEAP_PAGES);
+	struct mpool stress_pool;
+	struct mm_ptable ptable;
+	std::mt19937_64 rng(STRESS_SEED);
+	std::vector<bool> shadow(STRESS_SPACE_PAGES, false);
+	size_t defrags = 0;
+
+	mpool_init(&stress_pool, sizeof(struct mm_page_table));
+	mpool_add_chunk(&stress_pool, stress_heap.get(),
+			STRESS_HEAP_PAGES * PAGE_SIZE);
+	ASSERT_TRUE(mm_vm_init(&ptable, &stress_pool));
+
+	/* Page counts drawn with the weights seen in production traces. */
+	auto range_pages = [&rng]() -> size_t {
+		uint64_t weight = rng() % 100;
+
+		if (weight < 55) {
+			/* 55%: a single page. */
+			return 1;
+		}
+		if (weight < 85) {
+			/* 30%: a small run. */
+			return 2 + rng() % 15;
+		}
+		if (weight < 95) {
+			/* 10%: a 2 MiB block. */
+			return 512;
+		}
+		/* 5%: a section of up to 256 MiB. */
+		return 512 * (1 + rng() % 128);
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (size_t op = 0; op < STRESS_OPS; ++op) {
+		size_t pages = range_pages();
+		size_t first = rng() % (STRESS_SPACE_PAGES - pages);
+		paddr_t begin = pa_init(first * PAGE_SIZE);
+		paddr_t end = pa_init((first + pages) * PAGE_SIZE);
+		uint64_t kind = rng() % 100;
+
+		if (kind < 60) {
+			ASSERT_TRUE(mm_vm_identity_map(&ptable, begin, end,
+						       mode, nullptr,
+						       &stress_pool));
+			std::fill(shadow.begin() + first,
+				  shadow.begin() + first + pages, true);
+		} else if (kind < 95) {
+			ASSERT_TRUE(mm_vm_unmap(&ptable, begin, end,
+						&stress_pool));
+			std::fill(shadow.begin() + first,
+				  shadow.begin() + first + pages, false);
+		} else {
+			mm_vm_defrag(&ptable, &stress_pool);
+			++defrags;
+		}
+
+		/* Probe random pages against the shadow now and then. */
+		if (op % 1000 == 999) {
+			for (size_t probe = 0; probe < 64; ++probe) {
+				size_t page = rng() % STRESS_SPACE_PAGES;
+				ASSERT_EQ(mm_vm_is_mapped(
+						  &ptable,
+						  ipa_init(page * PAGE_SIZE)),
+					  shadow[page])
+					<< "page " << page << " after op "
+					<< op;
+			}
+		}
+	}
+
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	const double seconds =
+		std::chrono::duration_cast<std::chrono::duration<double>>(
+			elapsed)
+			.count();
+
+	std::printf(
+		"random stress: %zu ops (%zu defrags) in %.3f s, "
+		"%.0f ops/sec, %zu table pages\n",
+		STRESS_OPS, defrags, seconds, STRESS_OPS / seconds,
+		get_ptable(ptable).size());
+
+	mm_vm_fini(&ptable, &stress_pool);
+}
+}  /* namespace */
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks for the allocator, page table and parsing primitives, so
+ * that changes to them land with before/after numbers. The output format
+ * follows the google-benchmark convention (name, iterations, ns/op); the
+ * harness itself is self-contained as the tree doesn't vendor a benchmark
+ * library.
+ */
+
+#include <stdalign.h>
+
+extern "C" {
+#include "hf/arch/mm.h"
+
+#include "hf/memiter.h"
+#include "hf/mm.h"
+#include "hf/mpool.h"
+}
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr size_t BENCH_HEAP_PAGES = 1024;
+
+struct alignas(PAGE_SIZE) raw_page {
+	char data[PAGE_SIZE];
+};
+
+/**
+ * Runs `fn` repeatedly until a minimum amount of time has been spent in it,
+ * then reports the mean time per iteration.
+ */
+void benchmark(const std::string& name, std::function<void(size_t)> fn)
+{
+	using clock = std::chrono::steady_clock;
+	constexpr auto min_time = std::chrono::milliseconds(200);
+	size_t iterations = 1;
+
+	for (;;) {
+		auto start = clock::now();
+		fn(iterations);
+		auto elapsed = clock::now() - start;
+
+		if (elapsed >= min_time) {
+			double ns =
+				std::chrono::duration_cast<
+					std::chrono::nanoseconds>(elapsed)
+					.count();
+			std::printf("%-40s %12zu %14.1f ns/op\n", name.c_str(),
+				    iterations, ns / iterations);
+			return;
+		}
+
+		iterations *= 2;
+	}
+}
+
+/** A page pool backed by a freshly allocated heap. */
+class BenchHeap
+{
+       public:
+	BenchHeap()
+	{
+		pages_ = std::make_unique<raw_page[]>(BENCH_HEAP_PAGES);
+		mpool_init(&ppool_, sizeof(struct mm_page_table));
+		mpool_add_chunk(&ppool_, pages_.get(),
+				BENCH_HEAP_PAGES * PAGE_SIZE);
+	}
+
+	~BenchHeap()
+	{
+		mpool_fini(&ppool_);
+	}
+
+	struct mpool *get()
+	{
+		return &ppool_;
+	}
+
+       private:
+	std::unique_ptr<raw_page[]> pages_;
+	struct mpool ppool_;
+};
+
+void bench_mpool_alloc_free(void)
+{
+	BenchHeap heap;
+
+	benchmark("mpool_alloc/free", [&](size_t n) {
+		for (size_t i = 0; i < n; ++i) {
+			void *p = mpool_alloc(heap.get());
+			mpool_free(heap.get(), p);
+		}
+	});
+}
+
+void bench_mpool_alloc_contiguous(void)
+{
+	BenchHeap heap;
+
+	benchmark("mpool_alloc_contiguous/4", [&](size_t n) {
+		for (size_t i = 0; i < n; ++i) {
+			void *p = mpool_alloc_contiguous(heap.get(), 4, 4);
+			mpool_add_chunk(heap.get(), p, 4 * PAGE_SIZE);
+		}
+	});
+}
+
+void bench_mpool_alloc_bulk(void)
+{
+	BenchHeap heap;
+
+	benchmark("mpool_alloc_bulk/16", [&](size_t n) {
+		void *out[16];
+
+		for (size_t i = 0; i < n; ++i) {
+			size_t got = mpool_alloc_bulk(heap.get(), 16, out);
+			for (size_t j = 0; j < got; ++j) {
+				mpool_free(heap.get(), out[j]);
+			}
+		}
+	});
+}
+
+void bench_mm_identity_map(size_t pages)
+{
+	BenchHeap heap;
+	struct mm_ptable ptable;
+	struct mpool *ppool = heap.get();
+
+	if (!mm_vm_init(&ptable, ppool)) {
+		std::printf("mm_vm_init failed\n");
+		return;
+	}
+
+	benchmark("mm_vm_identity_map/" + std::to_string(pages),
+		  [&](size_t n) {
+			  paddr_t begin = pa_init(0);
+			  paddr_t end = pa_init(pages * PAGE_SIZE);
+
+			  for (size_t i = 0; i < n; ++i) {
+				  mm_vm_identity_map(&ptable, begin, end,
+						     MM_MODE_R | MM_MODE_W |
+							     MM_MODE_X,
+						     nullptr, ppool);
+				  mm_vm_unmap(&ptable, begin, end, ppool);
+			  }
+		  });
+
+	mm_vm_fini(&ptable, ppool);
+}
+
+void bench_mm_defrag(void)
+{
+	BenchHeap heap;
+	struct mm_ptable ptable;
+	struct mpool *ppool = heap.get();
+
+	if (!mm_vm_init(&ptable, ppool)) {
+		std::printf("mm_vm_init failed\n");
+		return;
+	}
+
+	/* Fully populate two level-1 ranges so defrag has tables to merge. */
+	paddr_t begin = pa_init(0);
+	paddr_t end = pa_init(UINT64_C(2) << (PAGE_BITS + PAGE_LEVEL_BITS));
+
+	benchmark("mm_vm_defrag", [&](size_t n) {
+		for (size_t i = 0; i < n; ++i) {
+			mm_vm_identity_map(&ptable, begin, end,
+					   MM_MODE_R | MM_MODE_W | MM_MODE_X,
+					   nullptr, ppool);
+			mm_vm_defrag(&ptable, ppool);
+		}
+	});
+
+	mm_vm_fini(&ptable, ppool);
+}
+
+void bench_memiter_parse(void)
+{
+	const char input[] = "  token1 token2 12345 another   678 end";
+
+	benchmark("memiter_parse", [&](size_t n) {
+		for (size_t i = 0; i < n; ++i) {
+			struct memiter it;
+			struct memiter str;
+
+			memiter_init(&it, input, sizeof(input) - 1);
+			while (memiter_parse_str(&it, &str)) {
+			}
+		}
+	});
+}
+}  // namespace
+
+int main(void)
+{
+	std::printf("%-40s %12s %17s\n", "benchmark", "iterations", "time");
+
+	bench_mpool_alloc_free();
+	bench_mpool_alloc_contiguous();
+	bench_mpool_alloc_bulk();
+	bench_mm_identity_map(1);
+	bench_mm_identity_map(16);
+	bench_mm_identity_map(512);
+	bench_mm_identity_map(512 * 16);
+	bench_mm_defrag();
+	bench_memiter_parse();
+
+	return 0;
+}
@@ -282,3 +282,35 @@ uintptr_t hftest_get_cpu_id(size_t index)
 
 	return params.cpu_ids[index];
 }
+
+uint64_t hftest_bench_cycles(void)
+{
+#if defined(__aarch64__)
+	uint64_t v;
+
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+	return v;
+#else
+	return 0;
+#endif
+}
+
+void hftest_bench_report(const char *name, uint64_t *samples, size_t n)
+{
+	size_t i;
+	size_t j;
+
+	/* Insertion sort; sample counts are small. */
+	for (i = 1; i < n; i++) {
+		uint64_t v = samples[i];
+
+		for (j = i; j > 0 && samples[j - 1] > v; j--) {
+			samples[j] = samples[j - 1];
+		}
+		samples[j] = v;
+	}
+
+	HFTEST_LOG("BENCH %s iterations=%u min=%u median=%u p99=%u", name,
+		   (size_t)n, (size_t)samples[0], (size_t)samples[n / 2],
+		   (size_t)samples[(n * 99) / 100]);
+}
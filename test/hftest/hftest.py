@@ -33,6 +33,7 @@ import sys
 
 HFTEST_LOG_PREFIX = "[hftest] "
 HFTEST_LOG_FAILURE_PREFIX = "Failure:"
+HFTEST_LOG_BENCH_PREFIX = "BENCH "
 HFTEST_LOG_FINISHED = "FINISHED"
 
 HF_ROOT = os.path.dirname(os.path.dirname(os.path.dirname(
@@ -446,6 +447,9 @@ class TestRunner:
 
         if self.is_passed_test(out):
             print("        PASS")
+            for line in out:
+                if line.startswith(HFTEST_LOG_BENCH_PREFIX):
+                    print("       ", line)
             return TestRunnerResult(tests_run=1, tests_failed=0)
         else:
             print("[x]     FAIL --", self.driver.get_run_log(log_name))
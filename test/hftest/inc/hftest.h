@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -65,6 +66,14 @@
 
 #define FAIL(...) HFTEST_FAIL(true, __VA_ARGS__)
 
+/*
+ * Run `body` `iterations` times (capped at HFTEST_BENCH_MAX_SAMPLES), timing
+ * each run with the virtual counter, and report min/median/p99 cycles through
+ * the hftest log protocol, where hftest.py picks them up.
+ */
+#define HFTEST_BENCH(name, iterations, body) \
+	HFTEST_BENCH_IMPL(name, iterations, body)
+
 /* Service utilities. */
 #define SERVICE_NAME_MAX_LENGTH 64
 #define SERVICE_SELECT(vm_id, service, send_buffer) \
@@ -108,5 +117,34 @@ bool hftest_cpu_start(uintptr_t id, void *stack, size_t stack_size,
 
 uintptr_t hftest_get_cpu_id(size_t index);
 
+/**
+ * A group of concurrently launched CPUs; see hftest_cpu_group_start().
+ */
+struct hftest_cpu_group {
+	size_t count;
+	atomic_size_t online;
+	atomic_size_t done;
+};
+
+/**
+ * Launches `count` secondary CPUs concurrently, each running
+ * `entry(index, arg)` after a rendezvous barrier, with completion tracked
+ * per group; wait with hftest_cpu_group_wait(). Carves per-CPU stacks of
+ * `stack_size` bytes out of `stacks`.
+ */
+bool hftest_cpu_group_start(struct hftest_cpu_group *group, size_t count,
+			    void *stacks, size_t stack_size,
+			    void (*entry)(size_t index, uintptr_t arg),
+			    uintptr_t arg);
+
+/** Blocks until every CPU of the group has finished its entry function. */
+void hftest_cpu_group_wait(struct hftest_cpu_group *group);
+
+/** Reads the virtual counter, used for benchmark timing. */
+uint64_t hftest_bench_cycles(void);
+
+/** Sorts the samples and reports them through the hftest log protocol. */
+void hftest_bench_report(const char *name, uint64_t *samples, size_t n);
+
 /* Above this point is the public API. Now include the implementation. */
 #include <hftest_impl.h>
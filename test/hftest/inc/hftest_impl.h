@@ -232,6 +232,29 @@ union hftest_any {
 
 /* clang-format on */
 
+/** The maximum number of timed samples one HFTEST_BENCH run can record. */
+#define HFTEST_BENCH_MAX_SAMPLES 1024
+
+#define HFTEST_BENCH_IMPL(name, iterations, body)                             \
+	do {                                                                  \
+		static uint64_t hftest_bench_samples_                         \
+			[HFTEST_BENCH_MAX_SAMPLES];                           \
+		size_t hftest_bench_n_ =                                      \
+			(iterations) < HFTEST_BENCH_MAX_SAMPLES               \
+				? (size_t)(iterations)                        \
+				: (size_t)HFTEST_BENCH_MAX_SAMPLES;           \
+		size_t hftest_bench_i_;                                       \
+		for (hftest_bench_i_ = 0; hftest_bench_i_ < hftest_bench_n_;  \
+		     ++hftest_bench_i_) {                                     \
+			uint64_t hftest_bench_t0_ = hftest_bench_cycles();    \
+			body;                                                 \
+			hftest_bench_samples_[hftest_bench_i_] =              \
+				hftest_bench_cycles() - hftest_bench_t0_;     \
+		}                                                             \
+		hftest_bench_report(name, hftest_bench_samples_,              \
+				    hftest_bench_n_);                         \
+	} while (0)
+
 #define HFTEST_LOG_FAILURE() \
 	dlog(HFTEST_LOG_PREFIX "Failure: %s:%u\n", __FILE__, __LINE__);
 
@@ -107,3 +107,74 @@ bool hftest_cpu_start(uintptr_t id, void *stack, size_t stack_size,
 	sl_lock(&s.lock);
 	return true;
 }
+
+struct cpu_group_state {
+	void (*entry)(size_t index, uintptr_t arg);
+	uintptr_t arg;
+	size_t index;
+	struct hftest_cpu_group *group;
+};
+
+static void cpu_group_entry(uintptr_t arg)
+{
+	struct cpu_group_state *state = (struct cpu_group_state *)arg;
+	size_t index = state->index;
+	struct hftest_cpu_group *group = state->group;
+
+	/* Rendezvous: wait until every CPU of the group is up. */
+	atomic_fetch_add(&group->online, 1);
+	while (atomic_load(&group->online) < group->count) {
+		/* Spin. */
+	}
+
+	state->entry(index, state->arg);
+
+	/* Flag completion for the launcher's barrier wait. */
+	atomic_fetch_add(&group->done, 1);
+}
+
+/**
+ * Launches `count` CPUs concurrently: every CPU runs `entry(index, arg)`
+ * after a rendezvous that makes sure all of them are online first, giving
+ * tests genuinely parallel load. Returns false if any CPU fails to start.
+ * The states array must have at least `count` entries and stay alive until
+ * hftest_cpu_group_wait() returns.
+ */
+bool hftest_cpu_group_start(struct hftest_cpu_group *group, size_t count,
+			    void *stacks, size_t stack_size,
+			    void (*entry)(size_t index, uintptr_t arg),
+			    uintptr_t arg)
+{
+	static struct cpu_group_state states[MAX_CPUS];
+	size_t i;
+
+	group->count = count;
+	atomic_init(&group->online, 0);
+	atomic_init(&group->done, 0);
+
+	for (i = 0; i < count; i++) {
+		states[i].entry = entry;
+		states[i].arg = arg;
+		states[i].index = i + 1;
+		states[i].group = group;
+
+		if (!hftest_cpu_start(
+			    hftest_get_cpu_id(i + 1),
+			    (char *)stacks + i * stack_size, stack_size,
+			    cpu_group_entry, (uintptr_t)&states[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Blocks until every CPU of the group has finished its entry function.
+ */
+void hftest_cpu_group_wait(struct hftest_cpu_group *group)
+{
+	while (atomic_load(&group->done) < group->count) {
+		/* Spin. */
+	}
+}
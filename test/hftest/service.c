@@ -83,8 +83,27 @@ noreturn void kmain(size_t memory_size)
 	hftest_test_fn service;
 	struct hftest_context *ctx;
 
+	struct spci_message *recv_msg = (struct spci_message *)recv;
+
 	/*
-	 * Initialize the stage-1 MMU and identity-map the entire address space.
+	 * Do as little as possible before blocking for the service name: a
+	 * service VM that is never selected then costs its test nothing
+	 * beyond this one hypercall, and the first vcpu_run of a selected
+	 * one returns WAIT_FOR_MESSAGE immediately. Only hypercalls may run
+	 * here; memory is not yet mapped.
+	 */
+
+	/* Set up the mailbox. */
+	hf_vm_configure(send_addr, recv_addr);
+
+	/* Block until a test selects this service. */
+	spci_msg_recv(SPCI_MSG_RECV_BLOCK);
+
+	/*
+	 * First message received: now pay for initialization. Set up the
+	 * stage-1 MMU and identity-map the entire address space before
+	 * touching the mailbox payload, so it is read with the same memory
+	 * attributes the hypervisor wrote it with.
 	 */
 	if (!hftest_mm_init()) {
 		HFTEST_LOG_FAILURE();
@@ -94,15 +113,6 @@ noreturn void kmain(size_t memory_size)
 		}
 	}
 
-	struct spci_message *recv_msg = (struct spci_message *)recv;
-
-	/* Prepare the context. */
-
-	/* Set up the mailbox. */
-	hf_vm_configure(send_addr, recv_addr);
-
-	/* Receive the name of the service to run. */
-	spci_msg_recv(SPCI_MSG_RECV_BLOCK);
 	memiter_init(&args, recv_msg->payload, recv_msg->length);
 	service = find_service(&args);
 	hf_mailbox_clear();
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdalign.h>
+#include <stdint.h>
+
+#include "hf/mm.h"
+
+#include "vmapi/hf/call.h"
+#include "vmapi/hf/spci.h"
+
+#include "hftest.h"
+#include "primary_with_secondary.h"
+
+/**
+ * The page of code the clone executes: written by the primary, shared to the
+ * clone, and pointed at by the clone's entry. The clone has no image of its
+ * own, so the guest is hand-assembled; it loads SPCI_YIELD_32, traps, and
+ * loops — no memory accesses at all, so a read-only-shared page suffices.
+ */
+alignas(PAGE_SIZE) static uint8_t clone_code[PAGE_SIZE];
+
+/** movz w0, #imm16 */
+#define INSN_MOVZ_W0(imm16) (0x52800000u | ((uint32_t)(imm16) << 5))
+/** movk w0, #imm16, lsl #16 */
+#define INSN_MOVK_W0_16(imm16) (0x72a00000u | ((uint32_t)(imm16) << 5))
+/** movz x1, #0 */
+#define INSN_MOVZ_X1_0 0xd2800001u
+/** hvc #0 */
+#define INSN_HVC_0 0xd4000002u
+/** b . - (n * 4) */
+#define INSN_B_BACK(n) (0x14000000u | ((0x04000000u - (n)) & 0x03ffffffu))
+
+/**
+ * Clones a template VM, gives it code to run through the share machinery,
+ * and checks that the clone actually executes: its hand-assembled guest
+ * yields, which can only be observed if the cloned vCPU really ran.
+ */
+TEST(vm_clone, clone_runs_and_yields)
+{
+	uint32_t *insn = (uint32_t *)clone_code;
+	uintptr_t line;
+	int64_t clone_id;
+	struct hf_vcpu_run_return run_res;
+
+	insn[0] = INSN_MOVZ_W0(SPCI_YIELD_32 & 0xffff);
+	insn[1] = INSN_MOVK_W0_16(SPCI_YIELD_32 >> 16);
+	insn[2] = INSN_MOVZ_X1_0;
+	insn[3] = INSN_HVC_0;
+	insn[4] = INSN_B_BACK(4);
+
+	/* Publish the instructions to the point of unification. */
+	for (line = (uintptr_t)clone_code; line < (uintptr_t)clone_code + 64;
+	     line += 16) {
+		__asm__ volatile("dc cvau, %0" : : "r"(line));
+	}
+	__asm__ volatile("dsb ish");
+	for (line = (uintptr_t)clone_code; line < (uintptr_t)clone_code + 64;
+	     line += 16) {
+		__asm__ volatile("ic ivau, %0" : : "r"(line));
+	}
+	__asm__ volatile("dsb ish\n\tisb");
+
+	/* Clone the first service VM, entering at the shared code page. */
+	clone_id = hf_vm_clone(SERVICE_VM0, (hf_ipaddr_t)clone_code, 0);
+	ASSERT_GE(clone_id, HF_VM_ID_OFFSET);
+
+	/* Hand the clone its code before giving it cycles. */
+	ASSERT_GE(hf_share_memory((spci_vm_id_t)clone_id,
+				  (hf_ipaddr_t)clone_code, PAGE_SIZE,
+				  HF_MEMORY_SHARE),
+		  0);
+
+	/* Run vCPU 0: the guest must reach its yield hypercall. */
+	run_res = hf_vcpu_run((spci_vm_id_t)clone_id, 0);
+	EXPECT_EQ(run_res.code, HF_VCPU_RUN_YIELD);
+}
+
+/**
+ * Cloning preserves the template's vCPU count and leaves the vCPUs OFF when
+ * no entry point is supplied.
+ */
+TEST(vm_clone, clone_without_entry_stays_off)
+{
+	int64_t clone_id = hf_vm_clone(SERVICE_VM0, 0, 0);
+
+	ASSERT_GE(clone_id, HF_VM_ID_OFFSET);
+	EXPECT_EQ(hf_vcpu_get_count((spci_vm_id_t)clone_id),
+		  hf_vcpu_get_count(SERVICE_VM0));
+
+	/* With every vCPU OFF, running one reports it back as off. */
+	EXPECT_EQ(hf_vcpu_run((spci_vm_id_t)clone_id, 0).code,
+		  HF_VCPU_RUN_WAIT_FOR_INTERRUPT);
+}
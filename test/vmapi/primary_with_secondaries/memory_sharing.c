@@ -152,9 +152,8 @@ static void spci_check_cannot_relinquish_memory(
  */
 TEST(memory_sharing, cannot_share_concurrent_memory_twice)
 {
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_SHARE),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_SHARE), 1);
 	check_cannot_share_memory(page, PAGE_SIZE);
 }
 
@@ -163,9 +162,8 @@ TEST(memory_sharing, cannot_share_concurrent_memory_twice)
  */
 TEST(memory_sharing, cannot_share_given_memory_twice)
 {
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_GIVE),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_GIVE), 1);
 	check_cannot_share_memory(page, PAGE_SIZE);
 }
 
@@ -174,9 +172,8 @@ TEST(memory_sharing, cannot_share_given_memory_twice)
  */
 TEST(memory_sharing, cannot_share_lent_memory_twice)
 {
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_LEND),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_LEND), 1);
 	check_cannot_share_memory(page, PAGE_SIZE);
 }
 
@@ -193,9 +190,8 @@ TEST(memory_sharing, concurrent)
 	SERVICE_SELECT(SERVICE_VM0, "memory_increment", mb.send);
 
 	memset_s(ptr, sizeof(page), 'a', PAGE_SIZE);
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_SHARE),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_SHARE), 1);
 
 	/*
 	 * TODO: the address of the memory will be part of the proper API. That
@@ -236,9 +232,8 @@ TEST(memory_sharing, share_concurrently_and_get_back)
 
 	/* Dirty the memory before sharing it. */
 	memset_s(ptr, sizeof(page), 'b', PAGE_SIZE);
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_SHARE),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_SHARE), 1);
 
 	/*
 	 * TODO: the address of the memory will be part of the proper API. That
@@ -351,9 +346,8 @@ TEST(memory_sharing, give_and_get_back)
 
 	/* Dirty the memory before giving it. */
 	memset_s(ptr, sizeof(page), 'b', PAGE_SIZE);
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_GIVE),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_GIVE), 1);
 
 	/*
 	 * TODO: the address of the memory will be part of the proper API. That
@@ -389,9 +383,8 @@ TEST(memory_sharing, lend_and_get_back)
 
 	/* Dirty the memory before lending it. */
 	memset_s(ptr, sizeof(page), 'c', PAGE_SIZE);
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_LEND),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_LEND), 1);
 
 	/*
 	 * TODO: the address of the memory will be part of the proper API. That
@@ -426,9 +419,8 @@ TEST(memory_sharing, reshare_after_return)
 	SERVICE_SELECT(SERVICE_VM0, "memory_return", mb.send);
 
 	/* Share the memory initially. */
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_LEND),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_LEND), 1);
 
 	/*
 	 * TODO: the address of the memory will be part of the proper API. That
@@ -444,9 +436,8 @@ TEST(memory_sharing, reshare_after_return)
 	EXPECT_EQ(run_res.code, HF_VCPU_RUN_MESSAGE);
 
 	/* Share the memory again after it has been returned. */
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_LEND),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_LEND), 1);
 
 	/* Observe the service doesn't fault when accessing the memory. */
 	run_res = hf_vcpu_run(SERVICE_VM0, 0);
@@ -466,9 +457,8 @@ TEST(memory_sharing, share_elsewhere_after_return)
 	SERVICE_SELECT(SERVICE_VM0, "memory_return", mb.send);
 
 	/* Share the memory initially. */
-	ASSERT_EQ(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_LEND),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM0, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_LEND), 1);
 
 	/*
 	 * TODO: the address of the memory will be part of the proper API. That
@@ -484,9 +474,8 @@ TEST(memory_sharing, share_elsewhere_after_return)
 	EXPECT_EQ(run_res.code, HF_VCPU_RUN_MESSAGE);
 
 	/* Share the memory with a differnt VM after it has been returned. */
-	ASSERT_EQ(hf_share_memory(SERVICE_VM1, (hf_ipaddr_t)&page, PAGE_SIZE,
-				  HF_MEMORY_LEND),
-		  0);
+	ASSERT_GE(hf_share_memory(SERVICE_VM1, (hf_ipaddr_t)&page, PAGE_SIZE,
+				  HF_MEMORY_LEND), 1);
 
 	/* Observe the service faulting when accessing the memory. */
 	run_res = hf_vcpu_run(SERVICE_VM0, 0);
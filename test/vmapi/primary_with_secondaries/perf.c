@@ -0,0 +1,134 @@
+/*
+ * Copyright 2019 The Hafnium Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hf/std.h"
+
+#include "vmapi/hf/call.h"
+
+#include "hftest.h"
+#include "primary_with_secondary.h"
+#include "util.h"
+
+#define PERF_ITERATIONS 256
+
+/**
+ * One primary->secondary->primary echo of `size` payload bytes.
+ */
+static void echo_once(struct mailbox_buffers *mb, uint32_t size)
+{
+	struct hf_vcpu_run_return run_res;
+
+	spci_message_init(mb->send, size, SERVICE_VM0, HF_PRIMARY_VM_ID);
+	ASSERT_EQ(spci_msg_send(0), SPCI_SUCCESS);
+	run_res = hf_vcpu_run(SERVICE_VM0, 0);
+	ASSERT_EQ(run_res.code, HF_VCPU_RUN_MESSAGE);
+	ASSERT_EQ(hf_mailbox_clear(), 0);
+}
+
+/**
+ * One-way delivery latency: time only the send into the secondary's mailbox.
+ */
+TEST(perf, msg_send_one_way)
+{
+	struct hf_vcpu_run_return run_res;
+	struct mailbox_buffers mb = set_up_mailbox();
+
+	SERVICE_SELECT(SERVICE_VM0, "echo", mb.send);
+	run_res = hf_vcpu_run(SERVICE_VM0, 0);
+	EXPECT_EQ(run_res.code, HF_VCPU_RUN_WAIT_FOR_MESSAGE);
+
+	memset_s(mb.send->payload, SPCI_MSG_PAYLOAD_MAX, 'x', 32);
+
+	HFTEST_BENCH("msg_send_one_way/32", PERF_ITERATIONS, {
+		spci_message_init(mb.send, 32, SERVICE_VM0, HF_PRIMARY_VM_ID);
+		ASSERT_EQ(spci_msg_send(0), SPCI_SUCCESS);
+		run_res = hf_vcpu_run(SERVICE_VM0, 0);
+		ASSERT_EQ(run_res.code, HF_VCPU_RUN_MESSAGE);
+		ASSERT_EQ(hf_mailbox_clear(), 0);
+	});
+}
+
+/**
+ * Full ping-pong round trip at various payload sizes.
+ */
+TEST(perf, msg_echo_round_trip)
+{
+	struct hf_vcpu_run_return run_res;
+	struct mailbox_buffers mb = set_up_mailbox();
+	static const uint32_t sizes[] = {0, 32, 256, 1024,
+					 SPCI_MSG_PAYLOAD_MAX};
+	size_t i;
+
+	SERVICE_SELECT(SERVICE_VM0, "echo", mb.send);
+	run_res = hf_vcpu_run(SERVICE_VM0, 0);
+	EXPECT_EQ(run_res.code, HF_VCPU_RUN_WAIT_FOR_MESSAGE);
+
+	memset_s(mb.send->payload, SPCI_MSG_PAYLOAD_MAX, 'x',
+		 SPCI_MSG_PAYLOAD_MAX);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		uint32_t size = sizes[i];
+
+		switch (size) {
+		case 0:
+			HFTEST_BENCH("msg_echo_round_trip/0", PERF_ITERATIONS,
+				     { echo_once(&mb, 0); });
+			break;
+		case 32:
+			HFTEST_BENCH("msg_echo_round_trip/32", PERF_ITERATIONS,
+				     { echo_once(&mb, 32); });
+			break;
+		case 256:
+			HFTEST_BENCH("msg_echo_round_trip/256", PERF_ITERATIONS,
+				     { echo_once(&mb, 256); });
+			break;
+		case 1024:
+			HFTEST_BENCH("msg_echo_round_trip/1024",
+				     PERF_ITERATIONS,
+				     { echo_once(&mb, 1024); });
+			break;
+		default:
+			HFTEST_BENCH("msg_echo_round_trip/max", PERF_ITERATIONS,
+				     { echo_once(&mb, size); });
+			break;
+		}
+	}
+}
+
+/**
+ * Throughput: time a burst of full-size echoes as a single sample and let the
+ * per-sample cycle count stand for the burst.
+ */
+TEST(perf, msg_throughput_burst)
+{
+	struct hf_vcpu_run_return run_res;
+	struct mailbox_buffers mb = set_up_mailbox();
+
+	SERVICE_SELECT(SERVICE_VM0, "echo", mb.send);
+	run_res = hf_vcpu_run(SERVICE_VM0, 0);
+	EXPECT_EQ(run_res.code, HF_VCPU_RUN_WAIT_FOR_MESSAGE);
+
+	memset_s(mb.send->payload, SPCI_MSG_PAYLOAD_MAX, 'x',
+		 SPCI_MSG_PAYLOAD_MAX);
+
+	HFTEST_BENCH("msg_throughput_burst/16xmax", 16, {
+		size_t j;
+
+		for (j = 0; j < 16; j++) {
+			echo_once(&mb, SPCI_MSG_PAYLOAD_MAX);
+		}
+	});
+}
@@ -33,10 +33,9 @@ TEST_SERVICE(data_abort)
 TEST_SERVICE(straddling_data_abort)
 {
 	/* Give some memory to the primary VM so that it's unmapped. */
-	ASSERT_EQ(hf_share_memory(HF_PRIMARY_VM_ID,
+	ASSERT_GE(hf_share_memory(HF_PRIMARY_VM_ID,
 				  (hf_ipaddr_t)(&pages[PAGE_SIZE]), PAGE_SIZE,
-				  HF_MEMORY_GIVE),
-		  0);
+				  HF_MEMORY_GIVE), 1);
 	*(volatile uint64_t *)(&pages[PAGE_SIZE - 6]);
 }
 
@@ -56,10 +55,9 @@ TEST_SERVICE(straddling_instruction_abort)
 	int (*f)(void) = (int (*)(void))(&pages[PAGE_SIZE - 2]);
 
 	/* Give second page to the primary VM so that it's unmapped. */
-	ASSERT_EQ(hf_share_memory(HF_PRIMARY_VM_ID,
+	ASSERT_GE(hf_share_memory(HF_PRIMARY_VM_ID,
 				  (hf_ipaddr_t)(&pages[PAGE_SIZE]), PAGE_SIZE,
-				  HF_MEMORY_GIVE),
-		  0);
+				  HF_MEMORY_GIVE), 1);
 
 	/* Branch to instruction whose 2 bytes are now in an unmapped page. */
 	f();
@@ -112,10 +112,9 @@ TEST_SERVICE(memory_return)
 		}
 
 		/* Give the memory back and notify the sender. */
-		ASSERT_EQ(hf_share_memory(recv_buf->source_vm_id,
+		ASSERT_GE(hf_share_memory(recv_buf->source_vm_id,
 					  (hf_ipaddr_t)ptr, PAGE_SIZE,
-					  HF_MEMORY_GIVE),
-			  0);
+					  HF_MEMORY_GIVE), 1);
 		hf_mailbox_clear();
 		spci_msg_send(0);
 
@@ -132,9 +131,8 @@ TEST_SERVICE(give_memory_and_fault)
 	uint8_t *ptr = page;
 
 	/* Give memory to the primary. */
-	ASSERT_EQ(hf_share_memory(HF_PRIMARY_VM_ID, (hf_ipaddr_t)&page,
-				  PAGE_SIZE, HF_MEMORY_GIVE),
-		  0);
+	ASSERT_GE(hf_share_memory(HF_PRIMARY_VM_ID, (hf_ipaddr_t)&page,
+				  PAGE_SIZE, HF_MEMORY_GIVE), 1);
 
 	/*
 	 * TODO: the address of the memory will be part of the proper API. That
@@ -156,9 +154,8 @@ TEST_SERVICE(lend_memory_and_fault)
 	uint8_t *ptr = page;
 
 	/* Lend memory to the primary. */
-	ASSERT_EQ(hf_share_memory(HF_PRIMARY_VM_ID, (hf_ipaddr_t)&page,
-				  PAGE_SIZE, HF_MEMORY_LEND),
-		  0);
+	ASSERT_GE(hf_share_memory(HF_PRIMARY_VM_ID, (hf_ipaddr_t)&page,
+				  PAGE_SIZE, HF_MEMORY_LEND), 1);
 
 	/*
 	 * TODO: the address of the memory will be part of the proper API. That
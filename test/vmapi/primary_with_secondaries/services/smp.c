@@ -83,3 +83,50 @@ TEST_SERVICE(smp)
 
 	send_message("vCPU 0", sizeof("vCPU 0"));
 }
+
+/** Number of on/off round trips timed by the benchmark. */
+#define CYCLE_COUNT 8
+
+/**
+ * Entry point of the second vCPU for the power-cycle benchmark: do nothing
+ * and power straight back off.
+ */
+static void vm_cpu_entry_stop(uintptr_t arg)
+{
+	(void)arg;
+}
+
+static uint64_t read_cntvct(void)
+{
+	uint64_t v;
+
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+	return v;
+}
+
+/**
+ * Power-cycles the second vCPU repeatedly and reports the total cycle count
+ * to the primary, to benchmark the CPU_ON/CPU_OFF round trip.
+ */
+TEST_SERVICE(cpu_on_off_cycle)
+{
+	uint64_t cycles;
+	uint64_t start;
+	int i;
+
+	start = read_cntvct();
+	for (i = 0; i < CYCLE_COUNT; i++) {
+		ASSERT_TRUE(hftest_cpu_start(1, stack, sizeof(stack),
+					     vm_cpu_entry_stop, 0));
+		while (arch_cpu_status(1) == POWER_STATUS_ON) {
+			/* Wait for the vCPU to power off again. */
+		}
+	}
+	cycles = read_cntvct() - start;
+
+	memcpy_s(SERVICE_SEND_BUFFER()->payload, SPCI_MSG_PAYLOAD_MAX, &cycles,
+		 sizeof(cycles));
+	spci_message_init(SERVICE_SEND_BUFFER(), sizeof(cycles),
+			  HF_PRIMARY_VM_ID, hf_vm_get_id());
+	ASSERT_EQ(spci_msg_send(0), SPCI_SUCCESS);
+}
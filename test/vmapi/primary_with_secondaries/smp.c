@@ -69,3 +69,37 @@ TEST(smp, two_vcpus)
 	EXPECT_EQ(run_res.code, HF_VCPU_RUN_WAIT_FOR_INTERRUPT);
 	EXPECT_EQ(run_res.sleep.ns, HF_SLEEP_INDEFINITE);
 }
+
+/**
+ * Benchmark the vCPU on/off round trip: the service power-cycles its second
+ * vCPU repeatedly and reports how many timer cycles the round trips took.
+ */
+TEST(smp, cpu_on_off_cycle_benchmark)
+{
+	uint64_t cycles;
+	struct hf_vcpu_run_return run_res;
+	struct mailbox_buffers mb = set_up_mailbox();
+
+	SERVICE_SELECT(SERVICE_VM2, "cpu_on_off_cycle", mb.send);
+
+	/*
+	 * Drive both vCPUs until the service reports the measurement: the
+	 * first vCPU asks for wake-ups of the second, which powers straight
+	 * back off.
+	 */
+	for (;;) {
+		run_res = hf_vcpu_run(SERVICE_VM2, 0);
+		if (run_res.code == HF_VCPU_RUN_MESSAGE) {
+			break;
+		}
+		if (run_res.code == HF_VCPU_RUN_WAKE_UP) {
+			hf_vcpu_run(SERVICE_VM2, run_res.wake_up.vcpu);
+		}
+	}
+
+	EXPECT_EQ(mb.recv->length, sizeof(cycles));
+	memcpy_s(&cycles, sizeof(cycles), mb.recv->payload, sizeof(cycles));
+	dlog("vCPU on/off benchmark: %u cycles for %u round trips\n",
+	     (uint32_t)cycles, 8);
+	EXPECT_EQ(hf_mailbox_clear(), 0);
+}